@@ -0,0 +1,112 @@
+// compact-bench: many concurrent incremental hashers with libkeccak_compact_t
+//
+//   compact-bench [-n hashers] [-c chunks] [-l length]
+//
+// Opens `hashers` Keccak-256 states at once and feeds them `chunks` chunks of
+// up to `length` bytes each, round-robin, the way a server feeds one state per
+// open connection. A sample of the digests is checked against the one-shot
+// sponge over the same message.
+
+#include "lib/keccak256.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#define TIME_POINT std::chrono::steady_clock::time_point
+#define NOW        std::chrono::steady_clock::now()
+
+// Byte `offset` of the message of hasher `i`
+static inline char MessageByte(size_t i, size_t offset){
+  uint64_t x = (i + 1) * 0x9E3779B97F4A7C15ULL ^ offset * 0xC2B2AE3D27D4EB4FULL;
+  return (char)(x >> 56);
+}
+
+// Length of chunk `j` of hasher `i`, varied so partial blocks straddle updates
+static inline size_t ChunkLength(size_t i, size_t j, size_t length){
+  return 1 + ((i * 31 + j * 17) % length);
+}
+
+int main(int argc, char *argv[]){
+  size_t hashers = 1000000, chunks = 16, length = 100;
+  int c;
+
+  while((c = getopt(argc, argv, "n:c:l:")) != -1){
+    switch(c){
+      case 'n': hashers = (size_t)atol(optarg); break;
+      case 'c': chunks  = (size_t)atol(optarg); break;
+      case 'l': length  = (size_t)atol(optarg); break;
+      default:
+        std::cerr << "usage: " << argv[0] << " [-n hashers] [-c chunks] [-l length]\n";
+        return 1;
+    }
+  }
+
+  if(!hashers || !chunks || !length){
+    std::cerr << "compact-bench: invalid options\n";
+    return 1;
+  }
+
+  void* memory;
+  if(posix_memalign(&memory, 64, hashers * sizeof(libkeccak_compact_t))){
+    std::cerr << "compact-bench: out of memory\n";
+    return 1;
+  }
+  libkeccak_compact_t* states = (libkeccak_compact_t*)memory;
+  std::vector<size_t> offsets(hashers, 0);
+  std::vector<char> chunk(length);
+  std::vector<char> hashsums(hashers * 32);
+  size_t bytes = 0;
+
+  TIME_POINT t1 = NOW;
+  for(size_t i = 0; i < hashers; i++)
+    libkeccak_compact_keccak256_initialise(&states[i]);
+
+  for(size_t j = 0; j < chunks; j++){
+    for(size_t i = 0; i < hashers; i++){
+      size_t n = ChunkLength(i, j, length);
+      for(size_t k = 0; k < n; k++)
+        chunk[k] = MessageByte(i, offsets[i] + k);
+      libkeccak_compact_update(&states[i], chunk.data(), n);
+      offsets[i] += n;
+      bytes += n;
+    }
+  }
+
+  for(size_t i = 0; i < hashers; i++)
+    libkeccak_compact_digest(&states[i], NULL, 0, &hashsums[i * 32], 32);
+  TIME_POINT t2 = NOW;
+
+  // Check every 1000th hasher, and the last, against the one-shot sponge
+  int failures = 0;
+  for(size_t i = 0; i < hashers; i += (i + 1000 < hashers || i == hashers - 1) ? 1000 : hashers - 1 - i){
+    std::vector<char> message(offsets[i]);
+    char expected[32];
+    for(size_t k = 0; k < offsets[i]; k++)
+      message[k] = MessageByte(i, k);
+    libkeccak_keccak256(message.data(), message.size(), expected);
+    if(memcmp(expected, &hashsums[i * 32], 32)){
+      std::cerr << "compact-bench: wrong hashsum for hasher " << i << "\n";
+      failures++;
+    }
+  }
+
+  // What the same number of libkeccak_state_t would hold, including their message buffers
+  libkeccak_spec_t spec;
+  libkeccak_spec_sha3(&spec, 256);
+  size_t full = sizeof(libkeccak_state_t) + (size_t)(spec.bitrate * (spec.bitrate + spec.capacity)) / 4;
+
+  double seconds = std::chrono::duration<double>(t2 - t1).count();
+  std::cout << "hashers:     " << hashers << " x " << chunks << " chunks\n";
+  std::cout << "state size:  " << sizeof(libkeccak_compact_t) << " bytes, "
+                               << hashers * sizeof(libkeccak_compact_t) / (1024 * 1024) << " MiB in total\n";
+  std::cout << "full state:  " << full << " bytes, "
+                               << hashers * full / (1024 * 1024) << " MiB in total\n";
+  std::cout << "throughput:  " << (size_t)(hashers * chunks / seconds) << " updates/s, "
+                               << (size_t)(bytes / seconds / (1024 * 1024)) << " MiB/s\n";
+
+  free(memory);
+  return failures ? 1 : 0;
+}
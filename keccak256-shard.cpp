@@ -0,0 +1,618 @@
+// keccak256-shard: spreads bulk address derivation over worker processes
+//
+//   keccak256-shard -i input -o output [-l address] [-n workers] [-S shard] [-t threads] [-x]
+//   keccak256-shard -w address [-t threads]
+//
+// The coordinator splits the input file into shards of about `shard` KiB that
+// end at line boundaries, listens on `address`, a Unix socket path or
+// host:port, and hands the shards to the workers that connect, one at a time;
+// `-n` forks that many local workers, so a single host can run the whole job.
+// A worker hashes its shard with the threaded batch engine and writes the
+// records to the segment `output.<shard>`. A shard whose worker reports a
+// failure or disconnects goes back in the queue for the next idle worker.
+// Once every shard is done the coordinator concatenates the segments into
+// `output`, or with `-x` keeps them and writes `segment first-line lines`
+// for each of them to `output`.
+
+#include "keccak256-shard.h"
+extern "C" {
+  #include "lib/parallel.h"
+}
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define CHUNK_SIZE   (8 << 20) // Bytes of input a worker reads and hashes at a time
+#define GROUP        64        // Lines hashed by one call to PublicKeysToAddresses
+#define MAX_ATTEMPTS 3         // Attempts at a shard before the job is abandoned
+
+enum ShardState { PENDING, RUNNING, DONE };
+
+struct Shard{
+  uint64_t offset;
+  uint64_t length;
+  uint64_t lines = 0;
+  ShardState state = PENDING;
+  int attempts = 0;
+};
+
+struct Peer{
+  int fd;
+  long shard = -1; // The shard the worker is running, -1 while it is idle
+  char result[KECCAK256_SHARD_RESULT];
+  size_t got = 0;  // Bytes of the result frame read so far
+};
+
+struct Lines{
+  const char* text;
+  const size_t* starts; // Line i is text[starts[i]] up to text[starts[i + 1]]
+  char* records;
+};
+
+static long threads = 0;
+
+static bool WriteAll(int fd, const char* buf, size_t len){
+  while(len){
+    ssize_t r = write(fd, buf, len);
+    if(r < 0 && errno == EINTR)
+      continue;
+    if(r <= 0)
+      return false;
+    buf += r;
+    len -= (size_t)r;
+  }
+  return true;
+}
+
+static bool ReadAll(int fd, char* buf, size_t len){
+  while(len){
+    ssize_t r = read(fd, buf, len);
+    if(r < 0 && errno == EINTR)
+      continue;
+    if(r <= 0)
+      return false;
+    buf += r;
+    len -= (size_t)r;
+  }
+  return true;
+}
+
+// Listen on, or connect to, host:port over TCP, or else a Unix socket path
+static int OpenSocket(const char* address, bool server){
+  const char* colon = strrchr(address, ':');
+  int fd;
+
+  if(colon && !strchr(address, '/')){
+    std::string host(address, colon - address);
+    struct addrinfo hints, *found;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = server ? AI_PASSIVE : 0;
+    if(getaddrinfo(host.empty() ? NULL : host.c_str(), colon + 1, &hints, &found))
+      return -1;
+
+    fd = -1;
+    for(struct addrinfo* ai = found; ai && fd < 0; ai = ai->ai_next){
+      int one = 1;
+      fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+      if(fd < 0)
+        continue;
+      if(server)
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      if(server ? bind(fd, ai->ai_addr, ai->ai_addrlen) < 0 || listen(fd, 128) < 0
+                : connect(fd, ai->ai_addr, ai->ai_addrlen) < 0){
+        close(fd);
+        fd = -1;
+      }
+    }
+    freeaddrinfo(found);
+    return fd;
+  }
+
+  struct sockaddr_un unixAddress;
+  memset(&unixAddress, 0, sizeof(unixAddress));
+  unixAddress.sun_family = AF_UNIX;
+  if(strlen(address) >= sizeof(unixAddress.sun_path)){
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(unixAddress.sun_path, address);
+  if(server)
+    unlink(address);
+
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if(fd < 0)
+    return -1;
+  if(server ? bind(fd, (struct sockaddr*)&unixAddress, sizeof(unixAddress)) < 0 || listen(fd, 128) < 0
+            : connect(fd, (struct sockaddr*)&unixAddress, sizeof(unixAddress)) < 0){
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Decode the public key on a line, false if the line does not hold one
+static bool ParseKey(const char* line, size_t len, char* key){
+  char compressed[LIBKECCAK_SECP256K1_COMPRESSED];
+
+  while(len && isspace((unsigned char)line[len - 1]))
+    len--;
+  while(len && isspace((unsigned char)*line))
+    line++, len--;
+  if(len >= 2 && line[0] == '0' && (line[1] | 0x20) == 'x')
+    line += 2, len -= 2;
+  if(len == 2 * PUBLIC_KEY_SIZE + 2 && line[0] == '0' && line[1] == '4')
+    line += 2, len -= 2;
+
+  if(len == 2 * PUBLIC_KEY_SIZE)
+    return !libkeccak_secp256k1_unhex(line, key, PUBLIC_KEY_SIZE);
+  if(len == LIBKECCAK_SECP256K1_COMPRESSED_HEX)
+    return !libkeccak_secp256k1_unhex(line, compressed, LIBKECCAK_SECP256K1_COMPRESSED) &&
+           !libkeccak_secp256k1_decompress(compressed, key);
+  return false;
+}
+
+// libkeccak_parallel_for work function: one record for each line in [begin, end)
+static void HashLines(void* ctx, size_t begin, size_t end){
+  const Lines* in = (const Lines*)ctx;
+  char keys[GROUP * PUBLIC_KEY_SIZE];
+  char addresses[GROUP * ADDRESS_SIZE];
+  bool valid[GROUP];
+
+  for(size_t n; begin < end; begin += n){
+    n = end - begin < GROUP ? end - begin : GROUP;
+
+    for(size_t j = 0; j < n; j++){
+      const char* line = &in->text[in->starts[begin + j]];
+      char* key = &keys[j * PUBLIC_KEY_SIZE];
+      valid[j] = ParseKey(line, in->starts[begin + j + 1] - in->starts[begin + j], key);
+      if(!valid[j])
+        memset(key, 0, PUBLIC_KEY_SIZE);
+    }
+
+    PublicKeysToAddresses(keys, n, addresses);
+
+    for(size_t j = 0; j < n; j++){
+      char* record = &in->records[(begin + j) * KECCAK256_SHARD_RECORD];
+      if(valid[j]){
+        record[0] = '0';
+        record[1] = 'x';
+        libkeccak_behex_lower(&record[2], &addresses[j * ADDRESS_SIZE], ADDRESS_SIZE);
+      }else{
+        memset(record, '-', KECCAK256_SHARD_RECORD - 1);
+      }
+      record[KECCAK256_SHARD_RECORD - 1] = '\n';
+    }
+  }
+}
+
+// Hash the lines of a byte range of the input into a segment; the segment
+// only appears under its name once it is complete
+static bool RunShard(const std::string& input, uint64_t offset, uint64_t length,
+                     const std::string& output, uint64_t* lines){
+  std::string partial = output + ".part";
+  std::vector<char> buffer(CHUNK_SIZE);
+  std::vector<size_t> starts;
+  std::vector<char> records;
+  size_t have = 0;
+  uint64_t done = 0;
+  bool ok = true;
+
+  *lines = 0;
+  int in  = open(input.c_str(), O_RDONLY | O_CLOEXEC);
+  int out = open(partial.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if(in < 0 || out < 0){
+    if(in >= 0)
+      close(in);
+    if(out >= 0)
+      close(out);
+    return false;
+  }
+
+  while(ok){
+    size_t want = (size_t)std::min<uint64_t>(buffer.size() - have, length - done);
+    ssize_t r = want ? pread(in, &buffer[have], want, (off_t)(offset + done)) : 0;
+    if(r < 0 && errno == EINTR)
+      continue;
+    if(r < 0 || (want && !r)){
+      ok = false;
+      break;
+    }
+    have += (size_t)r;
+    done += (uint64_t)r;
+
+    // Whole lines only, until the end of the shard, which ends one
+    bool last = done == length;
+    size_t usable = have;
+    if(!last){
+      while(usable && buffer[usable - 1] != '\n')
+        usable--;
+      if(!usable){
+        buffer.resize(buffer.size() * 2);
+        continue;
+      }
+    }
+
+    starts.clear();
+    for(size_t p = 0; p < usable;){
+      const char* newline = (const char*)memchr(&buffer[p], '\n', usable - p);
+      starts.push_back(p);
+      p = newline ? (size_t)(newline - buffer.data()) + 1 : usable;
+    }
+    starts.push_back(usable);
+
+    size_t count = starts.size() - 1;
+    Lines job = { buffer.data(), starts.data(), NULL };
+    records.resize(count * KECCAK256_SHARD_RECORD);
+    job.records = records.data();
+    libkeccak_parallel_for(count, 16 * GROUP, HashLines, &job, threads);
+    ok = WriteAll(out, records.data(), records.size());
+    *lines += count;
+
+    memmove(buffer.data(), &buffer[usable], have - usable);
+    have -= usable;
+    if(last)
+      break;
+  }
+
+  close(in);
+  ok = !close(out) && ok;
+  if(ok && rename(partial.c_str(), output.c_str()) < 0)
+    ok = false;
+  if(!ok)
+    unlink(partial.c_str());
+  return ok;
+}
+
+static int Work(const char* address){
+  int fd = OpenSocket(address, false);
+  if(fd < 0){
+    std::cerr << "keccak256-shard: " << address << ": " << strerror(errno) << "\n";
+    return 1;
+  }
+
+  char header[KECCAK256_SHARD_JOB];
+  char frame[KECCAK256_SHARD_RESULT];
+  std::string input, output;
+
+  while(ReadAll(fd, header, KECCAK256_SHARD_JOB)){
+    uint32_t shard        = (uint32_t)GetShardInt(&header[0], 4);
+    uint32_t inputLength  = (uint32_t)GetShardInt(&header[4], 4);
+    uint64_t offset       = GetShardInt(&header[8], 8);
+    uint64_t length       = GetShardInt(&header[16], 8);
+    uint32_t outputLength = (uint32_t)GetShardInt(&header[24], 4);
+    uint64_t lines;
+
+    if(inputLength > KECCAK256_SHARD_PATH || outputLength > KECCAK256_SHARD_PATH)
+      break;
+    input.resize(inputLength);
+    output.resize(outputLength);
+    if(!ReadAll(fd, &input[0], inputLength) || !ReadAll(fd, &output[0], outputLength))
+      break;
+
+    bool ok = RunShard(input, offset, length, output, &lines);
+    if(!ok)
+      std::cerr << "keccak256-shard: shard " << shard << ": " << strerror(errno) << "\n";
+
+    PutShardResult(frame, shard, ok ? 0 : 1, lines);
+    if(!WriteAll(fd, frame, KECCAK256_SHARD_RESULT))
+      break;
+  }
+
+  close(fd);
+  return 0;
+}
+
+// Cut the input into shards of about `size` bytes, each ending just after a newline
+static std::vector<Shard> Split(int fd, uint64_t total, uint64_t size){
+  std::vector<Shard> shards;
+  char chunk[4096];
+
+  for(uint64_t begin = 0, end; begin < total; begin = end){
+    end = begin + size;
+    if(end >= total){
+      end = total;
+    }else{
+      for(;;){
+        ssize_t r = pread(fd, chunk, sizeof(chunk), (off_t)end);
+        if(r <= 0){
+          end = total;
+          break;
+        }
+        const char* newline = (const char*)memchr(chunk, '\n', (size_t)r);
+        if(newline){
+          end += (uint64_t)(newline - chunk) + 1;
+          break;
+        }
+        end += (uint64_t)r;
+      }
+    }
+
+    Shard shard;
+    shard.offset = begin;
+    shard.length = end - begin;
+    shards.push_back(shard);
+  }
+
+  return shards;
+}
+
+static std::string SegmentPath(const std::string& output, size_t shard){
+  return output + "." + std::to_string(shard);
+}
+
+// Put a shard back in the queue, false if it has used up its attempts
+static bool Requeue(Shard& shard, size_t index){
+  shard.state = PENDING;
+  std::cerr << "keccak256-shard: shard " << index << " failed, attempt " << shard.attempts << "\n";
+  return shard.attempts < MAX_ATTEMPTS;
+}
+
+static bool Assign(Peer* peer, std::vector<Shard>& shards, const std::string& input, const std::string& output){
+  for(size_t i = 0; i < shards.size(); i++){
+    if(shards[i].state != PENDING)
+      continue;
+
+    std::string segment = SegmentPath(output, i);
+    char header[KECCAK256_SHARD_JOB];
+    PutShardJob(header, (uint32_t)i, shards[i].offset, shards[i].length,
+                (uint32_t)input.size(), (uint32_t)segment.size());
+    if(!WriteAll(peer->fd, header, KECCAK256_SHARD_JOB) || !WriteAll(peer->fd, input.data(), input.size()) ||
+       !WriteAll(peer->fd, segment.data(), segment.size()))
+      return false;
+
+    shards[i].state = RUNNING;
+    shards[i].attempts++;
+    peer->shard = (long)i;
+    return true;
+  }
+  return true;
+}
+
+static bool Concatenate(const std::string& output, const std::vector<Shard>& shards){
+  std::vector<char> buffer(1 << 20);
+  int out = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  bool ok = out >= 0;
+
+  for(size_t i = 0; ok && i < shards.size(); i++){
+    std::string segment = SegmentPath(output, i);
+    int in = open(segment.c_str(), O_RDONLY | O_CLOEXEC);
+    ssize_t r;
+
+    if(in < 0){
+      ok = false;
+      break;
+    }
+    while((r = read(in, buffer.data(), buffer.size())) > 0 || (r < 0 && errno == EINTR))
+      if(r > 0 && !WriteAll(out, buffer.data(), (size_t)r))
+        break;
+    ok = !r;
+    close(in);
+    unlink(segment.c_str());
+  }
+
+  return out >= 0 && !close(out) && ok;
+}
+
+static bool Index(const std::string& output, const std::vector<Shard>& shards){
+  std::string index;
+  uint64_t first = 0;
+
+  for(size_t i = 0; i < shards.size(); i++){
+    index += SegmentPath(output, i) + " " + std::to_string(first) + " " + std::to_string(shards[i].lines) + "\n";
+    first += shards[i].lines;
+  }
+
+  int out = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  bool ok = out >= 0 && WriteAll(out, index.data(), index.size());
+  return out >= 0 && !close(out) && ok;
+}
+
+static int Coordinate(const std::string& input, const std::string& output, const char* address,
+                      long local, uint64_t shardSize, bool index){
+  struct stat attr;
+  int fd = open(input.c_str(), O_RDONLY | O_CLOEXEC);
+  if(fd < 0 || fstat(fd, &attr) < 0){
+    std::cerr << "keccak256-shard: " << input << ": " << strerror(errno) << "\n";
+    return 1;
+  }
+  std::vector<Shard> shards = Split(fd, (uint64_t)attr.st_size, shardSize);
+  close(fd);
+
+  int listenFd = OpenSocket(address, true);
+  if(listenFd < 0){
+    std::cerr << "keccak256-shard: " << address << ": " << strerror(errno) << "\n";
+    return 1;
+  }
+
+  // Local workers share the processors between them
+  std::vector<pid_t> children;
+  if(local > 0 && threads <= 0)
+    threads = std::max(1L, libkeccak_parallel_threads(0) / local);
+  for(long i = 0; i < local; i++){
+    pid_t pid = fork();
+    if(!pid){
+      close(listenFd);
+      _exit(Work(address));
+    }
+    if(pid > 0)
+      children.push_back(pid);
+  }
+
+  std::cout << "keccak256-shard: " << shards.size() << " shards on " << address << "\n";
+
+  std::vector<Peer*> peers;
+  size_t remaining = shards.size();
+  int status = 0;
+
+  while(remaining && !status){
+    std::vector<struct pollfd> fds(1 + peers.size());
+    fds[0].fd     = listenFd;
+    fds[0].events = POLLIN;
+    for(size_t i = 0; i < peers.size(); i++){
+      fds[1 + i].fd     = peers[i]->fd;
+      fds[1 + i].events = POLLIN;
+    }
+
+    if(poll(fds.data(), fds.size(), 1000) < 0 && errno != EINTR){
+      std::cerr << "keccak256-shard: poll: " << strerror(errno) << "\n";
+      status = 1;
+      break;
+    }
+
+    for(size_t i = 0; i < peers.size(); i++){
+      Peer* peer = peers[i];
+      bool drop = false;
+
+      if(fds[1 + i].revents & (POLLIN | POLLHUP | POLLERR)){
+        ssize_t r = read(peer->fd, &peer->result[peer->got], KECCAK256_SHARD_RESULT - peer->got);
+        if(r > 0)
+          peer->got += (size_t)r;
+        else if(!r || errno != EINTR)
+          drop = true;
+      }
+
+      if(!drop && peer->got == KECCAK256_SHARD_RESULT){
+        long shard = (long)GetShardInt(&peer->result[0], 4);
+        if(shard != peer->shard){
+          drop = true;
+        }else if(GetShardInt(&peer->result[4], 4)){
+          if(!Requeue(shards[shard], (size_t)shard))
+            status = 1;
+        }else{
+          shards[shard].state = DONE;
+          shards[shard].lines = GetShardInt(&peer->result[8], 8);
+          remaining--;
+        }
+        peer->shard = drop ? peer->shard : -1;
+        peer->got   = 0;
+      }
+
+      // An idle worker gets the next shard
+      if(!drop && peer->shard < 0 && !Assign(peer, shards, input, output))
+        drop = true;
+
+      if(drop){
+        if(peer->shard >= 0 && shards[peer->shard].state == RUNNING && !Requeue(shards[peer->shard], (size_t)peer->shard))
+          status = 1;
+        close(peer->fd);
+        delete peer;
+        peers[i] = NULL;
+      }
+    }
+
+    size_t kept = 0;
+    for(Peer* peer : peers)
+      if(peer)
+        peers[kept++] = peer;
+    peers.resize(kept);
+
+    if(fds[0].revents & POLLIN){
+      int accepted = accept4(listenFd, NULL, NULL, SOCK_CLOEXEC);
+      if(accepted >= 0){
+        // Workers on other hosts can vanish without a word; let the kernel notice
+        int one = 1;
+        setsockopt(accepted, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+
+        Peer* peer = new Peer();
+        peer->fd = accepted;
+        if(Assign(peer, shards, input, output)){
+          peers.push_back(peer);
+        }else{
+          close(accepted);
+          delete peer;
+        }
+      }
+    }
+
+    // Forked workers that are gone will not come back
+    for(size_t i = 0; i < children.size();)
+      if(waitpid(children[i], NULL, WNOHANG) > 0)
+        children.erase(children.begin() + i);
+      else
+        i++;
+    if(local > 0 && children.empty() && peers.empty() && remaining){
+      std::cerr << "keccak256-shard: every local worker exited\n";
+      status = 1;
+    }
+  }
+
+  for(Peer* peer : peers){
+    close(peer->fd);
+    delete peer;
+  }
+  close(listenFd);
+  if(!strchr(address, ':') || strchr(address, '/'))
+    unlink(address);
+  for(pid_t pid : children)
+    waitpid(pid, NULL, 0);
+
+  if(status){
+    std::cerr << "keccak256-shard: abandoned with " << remaining << " shards left\n";
+    return status;
+  }
+
+  if(!(index ? Index(output, shards) : Concatenate(output, shards))){
+    std::cerr << "keccak256-shard: " << output << ": " << strerror(errno) << "\n";
+    return 1;
+  }
+
+  uint64_t lines = 0;
+  for(const Shard& shard : shards)
+    lines += shard.lines;
+  std::cout << "keccak256-shard: " << lines << " lines in " << shards.size() << " shards\n";
+  return 0;
+}
+
+int main(int argc, char *argv[]){
+  const char* address = KECCAK256_SHARD_SOCKET;
+  const char* input   = NULL;
+  const char* output  = NULL;
+  uint64_t shardSize  = 64 << 10;
+  long local          = 0;
+  bool worker         = false;
+  bool index          = false;
+  int c;
+
+  while((c = getopt(argc, argv, "i:o:l:n:S:t:w:x")) != -1){
+    switch(c){
+      case 'i': input     = optarg;                         break;
+      case 'o': output    = optarg;                         break;
+      case 'l': address   = optarg;                         break;
+      case 'n': local     = atol(optarg);                   break;
+      case 'S': shardSize = (uint64_t)atoll(optarg);        break;
+      case 't': threads   = atol(optarg);                   break;
+      case 'w': address   = optarg; worker = true;          break;
+      case 'x': index     = true;                           break;
+      default:
+        std::cerr << "usage: " << argv[0] << " -i input -o output [-l address] [-n workers] [-S shard] [-t threads] [-x]\n"
+                  << "       " << argv[0] << " -w address [-t threads]\n";
+        return 1;
+    }
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+
+  if(worker)
+    return Work(address);
+
+  if(!input || !output){
+    std::cerr << "keccak256-shard: -i and -o are required\n";
+    return 1;
+  }
+
+  return Coordinate(input, output, address, local, (shardSize ? shardSize : 1) << 10, index);
+}
@@ -0,0 +1,61 @@
+#ifndef KECCAK256_SHARD_H
+#define KECCAK256_SHARD_H
+
+#include "lib/keccak256.h"
+#include <stdint.h>
+#include <string.h>
+
+// keccak256-shard protocol, over a Unix or TCP stream socket
+//
+// The coordinator sends a worker one job at a time: a KECCAK256_SHARD_JOB byte
+// header holding the shard number, the byte range of the input file and the
+// lengths of two paths, followed by the path of the input file and the path
+// the worker writes the output segment to. The worker answers with a
+// KECCAK256_SHARD_RESULT byte frame holding the shard number, a status, zero
+// on success, and the number of lines in the shard. All integers are
+// little-endian; the paths must name the same files on the worker's host.
+//
+// Input files hold one public key per line in hexadecimal, with or without a
+// 0x prefix: 128 digits for X and Y, 130 with the 04 prefix, or 66 for a SEC1
+// compressed key. Every line becomes a KECCAK256_SHARD_RECORD byte record of
+// output, the 0x-prefixed address and a newline, or dashes if the line does
+// not hold a valid key, so line i of a segment is at byte i * RECORD.
+
+#define KECCAK256_SHARD_SOCKET "/tmp/keccak256-shard.sock" // Default coordinator address
+#define KECCAK256_SHARD_JOB    32                          // Size of a job header
+#define KECCAK256_SHARD_RESULT 16                          // Size of a result frame
+#define KECCAK256_SHARD_RECORD 43                          // Size of an output record
+#define KECCAK256_SHARD_PATH   4096                        // Longest path in a job
+
+static inline void PutShardInt(char* p, uint64_t v, int size){
+  for(int i = 0; i < size; i++)
+    p[i] = (char)(v >> (8 * i));
+}
+
+static inline uint64_t GetShardInt(const char* p, int size){
+  uint64_t v = 0;
+
+  for(int i = 0; i < size; i++)
+    v |= (uint64_t)(unsigned char)p[i] << (8 * i);
+  return v;
+}
+
+// Job header: shard @0, input path length @4, offset @8, length @16, output path length @24
+static inline void PutShardJob(char* header, uint32_t shard, uint64_t offset, uint64_t length,
+                               uint32_t inputLength, uint32_t outputLength){
+  memset(header, 0, KECCAK256_SHARD_JOB);
+  PutShardInt(&header[0], shard, 4);
+  PutShardInt(&header[4], inputLength, 4);
+  PutShardInt(&header[8], offset, 8);
+  PutShardInt(&header[16], length, 8);
+  PutShardInt(&header[24], outputLength, 4);
+}
+
+// Result frame: shard @0, status @4, lines @8
+static inline void PutShardResult(char* frame, uint32_t shard, uint32_t status, uint64_t lines){
+  PutShardInt(&frame[0], shard, 4);
+  PutShardInt(&frame[4], status, 4);
+  PutShardInt(&frame[8], lines, 8);
+}
+
+#endif
@@ -0,0 +1,161 @@
+// keccak256d-load: load generator for keccak256d
+//
+//   keccak256d-load [-s socket] [-c connections] [-n requests] [-k keys] [-d depth]
+//
+// Every connection runs on its own thread and keeps up to `depth` requests of
+// `keys` keys in flight until it has sent `requests` requests. The first
+// response of each connection is checked against PublicKeysToAddresses.
+
+#include "keccak256d.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#define TIME_POINT std::chrono::steady_clock::time_point
+#define NOW        std::chrono::steady_clock::now()
+
+static const char* path = KECCAK256D_SOCKET;
+static size_t requests = 10000, keys = 16, depth = 8;
+static std::atomic<int> failures(0);
+
+static bool WriteAll(int fd, const char* buf, size_t len){
+  while(len){
+    ssize_t r = write(fd, buf, len);
+    if(r < 0 && errno == EINTR)
+      continue;
+    if(r <= 0)
+      return false;
+    buf += r;
+    len -= (size_t)r;
+  }
+  return true;
+}
+
+static bool ReadAll(int fd, char* buf, size_t len){
+  while(len){
+    ssize_t r = read(fd, buf, len);
+    if(r < 0 && errno == EINTR)
+      continue;
+    if(r <= 0)
+      return false;
+    buf += r;
+    len -= (size_t)r;
+  }
+  return true;
+}
+
+static void Client(unsigned seed, std::vector<double>* latencies){
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if(fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0){
+    std::cerr << "keccak256d-load: " << path << ": " << strerror(errno) << "\n";
+    failures++;
+    return;
+  }
+
+  std::vector<char> request(KECCAK256D_HEADER + keys * PUBLIC_KEY_SIZE);
+  std::vector<char> response(KECCAK256D_HEADER + keys * ADDRESS_SIZE);
+  std::vector<char> expected(keys * ADDRESS_SIZE);
+  std::vector<TIME_POINT> sent(requests);
+  char* publicKeys = &request[KECCAK256D_HEADER];
+
+  for(size_t i = 0; i < keys * PUBLIC_KEY_SIZE; i++)
+    publicKeys[i] = (char)rand_r(&seed);
+  PublicKeysToAddresses(publicKeys, keys, expected.data());
+
+  size_t issued = 0, received = 0;
+  while(received < requests){
+    while(issued < requests && issued - received < depth){
+      PutFrameHeader(request.data(), (uint32_t)keys, (uint32_t)issued);
+      sent[issued] = NOW;
+      if(!WriteAll(fd, request.data(), request.size()))
+        goto broken;
+      issued++;
+    }
+
+    uint32_t count, tag;
+    if(!ReadAll(fd, response.data(), response.size()))
+      goto broken;
+    GetFrameHeader(response.data(), &count, &tag);
+    if(count != keys || tag >= issued)
+      goto broken;
+
+    latencies->push_back(std::chrono::duration<double, std::micro>(NOW - sent[tag]).count());
+    if(!received && memcmp(&response[KECCAK256D_HEADER], expected.data(), expected.size())){
+      std::cerr << "keccak256d-load: wrong addresses\n";
+      failures++;
+    }
+    received++;
+  }
+
+  close(fd);
+  return;
+
+broken:
+  std::cerr << "keccak256d-load: connection broken after " << received << " responses\n";
+  failures++;
+  close(fd);
+}
+
+int main(int argc, char *argv[]){
+  size_t connections = 4;
+  int c;
+
+  while((c = getopt(argc, argv, "s:c:n:k:d:")) != -1){
+    switch(c){
+      case 's': path        = optarg;                 break;
+      case 'c': connections = (size_t)atol(optarg);   break;
+      case 'n': requests    = (size_t)atol(optarg);   break;
+      case 'k': keys        = (size_t)atol(optarg);   break;
+      case 'd': depth       = (size_t)atol(optarg);   break;
+      default:
+        std::cerr << "usage: " << argv[0] << " [-s socket] [-c connections] [-n requests] [-k keys] [-d depth]\n";
+        return 1;
+    }
+  }
+
+  if(!connections || !requests || !keys || keys > KECCAK256D_MAX_KEYS || !depth){
+    std::cerr << "keccak256d-load: invalid options\n";
+    return 1;
+  }
+
+  std::vector<std::vector<double> > latencies(connections);
+  std::vector<std::thread> threads;
+
+  TIME_POINT t1 = NOW;
+  for(size_t i = 0; i < connections; i++)
+    threads.emplace_back(Client, (unsigned)i + 1, &latencies[i]);
+  for(std::thread& thread : threads)
+    thread.join();
+  TIME_POINT t2 = NOW;
+
+  std::vector<double> all;
+  for(const std::vector<double>& l : latencies)
+    all.insert(all.end(), l.begin(), l.end());
+  if(all.empty())
+    return 1;
+  std::sort(all.begin(), all.end());
+
+  double seconds = std::chrono::duration<double>(t2 - t1).count();
+  std::cout << "requests:    " << all.size() << " x " << keys << " keys\n";
+  std::cout << "throughput:  " << (size_t)(all.size() / seconds) << " requests/s, "
+                               << (size_t)(all.size() * keys / seconds) << " addresses/s\n";
+  std::cout << "latency p50: " << all[all.size() / 2] << " us\n";
+  std::cout << "latency p99: " << all[all.size() * 99 / 100] << " us\n";
+  std::cout << "latency max: " << all.back() << " us\n";
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,403 @@
+// keccak256d: serves address derivation to local processes over a Unix socket
+//
+//   keccak256d [-s socket] [-b batch] [-w workers]
+//
+// One epoll loop reads requests from every connection and gathers their keys
+// into shared batches. A batch is handed to the worker pool once it holds
+// `batch` keys, or at the end of an event loop round, so an idle daemon does
+// not hold requests back. Workers post finished batches back to the loop
+// through an eventfd, and the loop answers each request with one writev.
+//
+// Each connection buffers at most KECCAK256D_MAX_BUFFER bytes of input per
+// round before parsing it, and stops being polled for input while as many
+// bytes of responses wait for a peer that does not read them.
+
+#include "keccak256d.h"
+extern "C" {
+  #include "lib/parallel.h"
+}
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define KECCAK256D_MAX_BUFFER (4 << 20) // Most bytes a connection buffers in either direction
+
+struct Connection{
+  int fd;
+  std::vector<char> in;  // Bytes read but not parsed into requests yet, at most KECCAK256D_MAX_BUFFER
+  std::vector<char> out; // Response bytes the socket did not accept yet, no input is read while it is full
+  size_t inflight = 0;   // Requests handed to workers
+  bool eof = false;      // The peer sent everything, close once it is answered
+  bool closed = false;   // The socket is gone, free once nothing is in flight
+};
+
+struct Request{
+  Connection* connection;
+  uint32_t tag;
+  uint32_t count;
+  size_t first; // Index of the request's first key in the batch
+};
+
+struct Batch{
+  std::vector<char> publicKeys;
+  std::vector<char> addresses;
+  std::vector<Request> requests;
+  size_t count = 0;
+};
+
+static size_t batchSize = 256;
+static int epollFd, listenFd, wakeFd;
+
+static std::mutex queueLock;
+static std::condition_variable queueReady;
+static std::deque<Batch*> todo;
+static std::deque<Batch*> done;
+static std::vector<Batch*> spare;
+static Batch* current = NULL;
+static std::vector<Connection*> closing; // Freed at the end of the event loop round
+
+static void Worker(){
+  for(;;){
+    Batch* batch;
+    {
+      std::unique_lock<std::mutex> guard(queueLock);
+      queueReady.wait(guard, []{ return !todo.empty(); });
+      batch = todo.front();
+      todo.pop_front();
+    }
+
+    batch->addresses.resize(batch->count * ADDRESS_SIZE);
+    PublicKeysToAddresses(batch->publicKeys.data(), batch->count, batch->addresses.data());
+
+    {
+      std::lock_guard<std::mutex> guard(queueLock);
+      done.push_back(batch);
+    }
+
+    uint64_t one = 1;
+    if(write(wakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+      std::cerr << "keccak256d: eventfd: " << strerror(errno) << "\n";
+  }
+}
+
+static void Dispatch(){
+  if(!current || !current->count)
+    return;
+
+  {
+    std::lock_guard<std::mutex> guard(queueLock);
+    todo.push_back(current);
+  }
+
+  queueReady.notify_one();
+  current = NULL;
+}
+
+static void Release(Connection* connection){
+  if(connection->closed && !connection->inflight)
+    closing.push_back(connection);
+}
+
+static void Close(Connection* connection){
+  if(connection->closed)
+    return;
+
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, connection->fd, NULL);
+  close(connection->fd);
+  connection->closed = true;
+  Release(connection);
+}
+
+static void Watch(Connection* connection, bool writable){
+  if(connection->closed)
+    return;
+
+  // Past the limit, let the peer read its responses before taking more requests
+  bool readable = !connection->eof && connection->out.size() < KECCAK256D_MAX_BUFFER;
+  struct epoll_event event;
+  event.events   = (readable ? (uint32_t)EPOLLIN : 0u) | (writable ? (uint32_t)EPOLLOUT : 0u);
+  event.data.ptr = connection;
+  epoll_ctl(epollFd, EPOLL_CTL_MOD, connection->fd, &event);
+}
+
+// Close a connection whose peer stopped sending once every request it sent is answered
+static void Finish(Connection* connection){
+  if(connection->eof && !connection->inflight && connection->out.empty())
+    Close(connection);
+}
+
+// Write as much of the pending output as the socket takes
+static void Flush(Connection* connection){
+  size_t w = 0;
+
+  if(connection->closed)
+    return;
+
+  while(w < connection->out.size()){
+    ssize_t r = write(connection->fd, &connection->out[w], connection->out.size() - w);
+    if(r < 0){
+      if(errno == EINTR)
+        continue;
+      if(errno != EAGAIN)
+        return Close(connection);
+      break;
+    }
+    w += (size_t)r;
+  }
+
+  connection->out.erase(connection->out.begin(), connection->out.begin() + w);
+  Watch(connection, !connection->out.empty());
+  Finish(connection);
+}
+
+static void Respond(Batch* batch){
+  for(const Request& request : batch->requests){
+    Connection* connection = request.connection;
+    char header[KECCAK256D_HEADER];
+    struct iovec iov[2];
+    size_t len, w = 0;
+
+    connection->inflight--;
+    if(connection->closed){
+      Release(connection);
+      continue;
+    }
+
+    PutFrameHeader(header, request.count, request.tag);
+    iov[0].iov_base = header;
+    iov[0].iov_len  = KECCAK256D_HEADER;
+    iov[1].iov_base = &batch->addresses[request.first * ADDRESS_SIZE];
+    iov[1].iov_len  = request.count * ADDRESS_SIZE;
+    len = iov[0].iov_len + iov[1].iov_len;
+
+    // Earlier responses still queued: keep the byte stream in order
+    if(connection->out.empty()){
+      ssize_t r;
+      do
+        r = writev(connection->fd, iov, 2);
+      while(r < 0 && errno == EINTR);
+
+      if(r < 0 && errno != EAGAIN){
+        Close(connection);
+        continue;
+      }
+      w = r < 0 ? 0 : (size_t)r;
+    }
+
+    if(w < len){
+      for(int i = 0; i < 2; i++){
+        if(w >= iov[i].iov_len){
+          w -= iov[i].iov_len;
+          continue;
+        }
+        char* base = (char*)iov[i].iov_base;
+        connection->out.insert(connection->out.end(), base + w, base + iov[i].iov_len);
+        w = 0;
+      }
+      Watch(connection, true);
+    }
+    Finish(connection);
+  }
+
+  batch->requests.clear();
+  batch->count = 0;
+  spare.push_back(batch);
+}
+
+// Move every complete request of a connection into the current batch
+static void Parse(Connection* connection){
+  size_t r = 0;
+
+  while(connection->in.size() - r >= KECCAK256D_HEADER){
+    uint32_t count, tag;
+    GetFrameHeader(&connection->in[r], &count, &tag);
+
+    if(!count || count > KECCAK256D_MAX_KEYS)
+      return Close(connection);
+    if(connection->in.size() - r - KECCAK256D_HEADER < (size_t)count * PUBLIC_KEY_SIZE)
+      break;
+
+    if(!current){
+      if(spare.empty())
+        spare.push_back(new Batch());
+      current = spare.back();
+      spare.pop_back();
+    }
+
+    Request request = { connection, tag, count, current->count };
+    const char* keys = &connection->in[r + KECCAK256D_HEADER];
+    current->publicKeys.resize((current->count + count) * PUBLIC_KEY_SIZE);
+    memcpy(&current->publicKeys[current->count * PUBLIC_KEY_SIZE], keys, (size_t)count * PUBLIC_KEY_SIZE);
+    current->requests.push_back(request);
+    current->count += count;
+    connection->inflight++;
+    r += KECCAK256D_HEADER + (size_t)count * PUBLIC_KEY_SIZE;
+
+    if(current->count >= batchSize)
+      Dispatch();
+  }
+
+  connection->in.erase(connection->in.begin(), connection->in.begin() + r);
+}
+
+static void Read(Connection* connection){
+  char chunk[64 << 10];
+
+  // Hang-up or error after the peer finished sending: nobody is left to answer
+  if(connection->eof)
+    return Close(connection);
+
+  // Parse drains all but a partial request, far below the limit; anything
+  // left unread is reported again by the level-triggered poll
+  while(connection->in.size() < KECCAK256D_MAX_BUFFER){
+    size_t n = KECCAK256D_MAX_BUFFER - connection->in.size();
+    ssize_t r = read(connection->fd, chunk, n < sizeof(chunk) ? n : sizeof(chunk));
+    if(r < 0 && errno == EINTR)
+      continue;
+    if(r < 0 && errno == EAGAIN)
+      break;
+    if(r < 0)
+      return Close(connection);
+    if(!r){
+      connection->eof = true;
+      break;
+    }
+    connection->in.insert(connection->in.end(), chunk, chunk + r);
+  }
+
+  Parse(connection);
+
+  // Half-closed: answer what was sent, then close; stop polling for input meanwhile
+  if(connection->eof && !connection->closed){
+    Watch(connection, !connection->out.empty());
+    Finish(connection);
+  }
+}
+
+static void Accept(){
+  for(;;){
+    int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if(fd < 0)
+      return;
+
+    Connection* connection = new Connection();
+    connection->fd = fd;
+
+    struct epoll_event event;
+    event.events   = EPOLLIN;
+    event.data.ptr = connection;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+  }
+}
+
+int main(int argc, char *argv[]){
+  const char* path = KECCAK256D_SOCKET;
+  long workers = 0;
+  int c;
+
+  while((c = getopt(argc, argv, "s:b:w:")) != -1){
+    switch(c){
+      case 's': path      = optarg;                     break;
+      case 'b': batchSize = (size_t)atol(optarg);       break;
+      case 'w': workers   = atol(optarg);               break;
+      default:
+        std::cerr << "usage: " << argv[0] << " [-s socket] [-b batch] [-w workers]\n";
+        return 1;
+    }
+  }
+
+  if(!batchSize)
+    batchSize = 1;
+  workers = libkeccak_parallel_threads(workers);
+  signal(SIGPIPE, SIG_IGN);
+
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if(strlen(path) >= sizeof(address.sun_path)){
+    std::cerr << "keccak256d: socket path too long\n";
+    return 1;
+  }
+  strcpy(address.sun_path, path);
+  unlink(path);
+
+  listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if(listenFd < 0 || bind(listenFd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listenFd, 128) < 0){
+    std::cerr << "keccak256d: " << path << ": " << strerror(errno) << "\n";
+    return 1;
+  }
+
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  wakeFd  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if(epollFd < 0 || wakeFd < 0){
+    std::cerr << "keccak256d: " << strerror(errno) << "\n";
+    return 1;
+  }
+
+  struct epoll_event event;
+  event.events   = EPOLLIN;
+  event.data.ptr = &listenFd;
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+  event.data.ptr = &wakeFd;
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+
+  for(long i = 0; i < workers; i++)
+    std::thread(Worker).detach();
+
+  std::cout << "keccak256d: listening on " << path << " with " << workers << " workers\n";
+
+  struct epoll_event events[64];
+  for(;;){
+    int n = epoll_wait(epollFd, events, 64, -1);
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n < 0){
+      std::cerr << "keccak256d: epoll_wait: " << strerror(errno) << "\n";
+      return 1;
+    }
+
+    for(int i = 0; i < n; i++){
+      if(events[i].data.ptr == &listenFd){
+        Accept();
+      }else if(events[i].data.ptr == &wakeFd){
+        uint64_t count;
+        std::deque<Batch*> finished;
+
+        if(read(wakeFd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+          std::cerr << "keccak256d: eventfd: " << strerror(errno) << "\n";
+        {
+          std::lock_guard<std::mutex> guard(queueLock);
+          finished.swap(done);
+        }
+        for(Batch* batch : finished)
+          Respond(batch);
+      }else{
+        Connection* connection = (Connection*)events[i].data.ptr;
+        if(!connection->closed && events[i].events & EPOLLOUT)
+          Flush(connection);
+        if(!connection->closed && events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+          Read(connection);
+      }
+    }
+
+    // Nothing else is ready: send off a partial batch rather than wait for more
+    Dispatch();
+
+    for(Connection* connection : closing)
+      delete connection;
+    closing.clear();
+  }
+}
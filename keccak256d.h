@@ -0,0 +1,36 @@
+#ifndef KECCAK256D_H
+#define KECCAK256D_H
+
+#include "lib/keccak256.h"
+#include <stdint.h>
+
+// keccak256d protocol, over a Unix stream socket
+//
+// Every frame is an 8 byte header followed by a payload. The header holds the
+// number of keys and a tag chosen by the client, both 32-bit little-endian.
+// A request carries count * PUBLIC_KEY_SIZE bytes of binary public keys; its
+// response repeats the header and carries count * ADDRESS_SIZE bytes of
+// addresses. Responses may arrive out of order, the tag pairs them up.
+
+#define KECCAK256D_SOCKET   "/tmp/keccak256d.sock" // Default socket path
+#define KECCAK256D_HEADER   8                      // Size of a frame header
+#define KECCAK256D_MAX_KEYS 4096                   // Most keys in one request
+
+static inline void PutFrameHeader(char* header, uint32_t count, uint32_t tag){
+  for(int i = 0; i < 4; i++){
+    header[i]     = (char)(count >> (8 * i));
+    header[4 + i] = (char)(tag >> (8 * i));
+  }
+}
+
+static inline void GetFrameHeader(const char* header, uint32_t* count, uint32_t* tag){
+  *count = 0;
+  *tag   = 0;
+
+  for(int i = 0; i < 4; i++){
+    *count |= (uint32_t)(unsigned char)header[i] << (8 * i);
+    *tag   |= (uint32_t)(unsigned char)header[4 + i] << (8 * i);
+  }
+}
+
+#endif
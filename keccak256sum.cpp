@@ -0,0 +1,650 @@
+// keccak256sum: hashes files and directory trees with Keccak-256 or SHA3-256
+//
+//   keccak256sum [-a keccak|sha3] [-j threads] [-q depth] path...
+//
+// Directories are walked recursively, entries in name order and without
+// following symbolic links, and a `hashsum  path` line is printed for every
+// regular file in walk order, whatever order the files finish in. The main
+// thread keeps up to `depth` reads in flight through io_uring, into buffers
+// registered with the kernel, and falls back to pread(2) where io_uring is
+// unavailable. Files of at most SMALL_FILE bytes are read whole into batches
+// that a worker hashes with the multi-buffer kernel; larger files are read
+// READ_SIZE bytes at a time, a few blocks ahead, and each block is absorbed
+// in order by whichever worker is free.
+
+#include "lib/keccak256.h"
+extern "C" {
+  #include "lib/batch.h"
+  #include "lib/parallel.h"
+}
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define READ_SIZE   (512 << 10)    // Bytes read at a time from a large file, the size of a registered buffer
+#define READ_AHEAD  4              // Blocks of a large file read ahead of the worker absorbing it
+#define SMALL_FILE  (64 << 10)     // Largest file that is hashed in a batch
+#define BATCH_SIZE  (2 << 20)      // Bytes of small files in one batch
+#define BATCH_FILES 512            // Files in one batch
+#define TRUNCATED   (-1)           // File error for a file that ended before the size it had when opened
+#define WAKE        (~(uint64_t)0) // Tag of the eventfd read through which workers wake the main thread
+
+struct Block{
+  int buffer;
+  size_t length;
+};
+
+struct File{
+  std::string path;
+  uint64_t size;
+  int fd = -1;
+  int error = 0;         // errno of the first failure, or TRUNCATED
+  bool done = false;
+  char hashsum[32];
+
+  // Large files only; `ready` and `absorbed` are shared with the workers
+  libkeccak_state_t state;
+  uint64_t submitted = 0;             // Bytes that reads have been submitted for
+  uint64_t absorbed  = 0;             // Bytes absorbed into `state`
+  unsigned blocks    = 0;             // Buffers the file holds, being read, ready or being absorbed
+  std::map<uint64_t, Block> ready;    // Blocks that have been read, by offset
+  bool queued = false;                // Whether the file is queued for, or held by, a worker
+};
+
+struct Batch{
+  char* data;
+  std::vector<size_t> offsets; // Start of every file in `data`, and the end of the last one
+  std::vector<File*> files;
+  std::vector<char> hashsums;
+  size_t pending = 0;          // Reads that have not completed
+  bool closed = false;         // Whether the batch takes no more files
+};
+
+struct Request{
+  File* file;
+  Batch* batch; // NULL for a block of a large file
+  int buffer;
+  char* data;
+  uint64_t offset;
+  size_t length;
+  size_t got;
+};
+
+struct Task{
+  File* file;
+  Batch* batch;
+};
+
+struct Completion{
+  uint64_t tag;
+  int result;
+};
+
+// Reads through io_uring, or with pread(2) where io_uring cannot be set up
+class Ring{
+public:
+  bool uring = false;
+
+  void Setup(unsigned entries, char* buffers, unsigned count){
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    long fd = syscall(__NR_io_uring_setup, entries, &params);
+    if(fd < 0)
+      return;
+    ringFd = (int)fd;
+
+    // IORING_OP_READ arrived in 5.6; IORING_FEAT_FAST_POLL, from 5.7, is the nearest feature bit
+    if(!(params.features & IORING_FEAT_FAST_POLL)){
+      close(ringFd);
+      return;
+    }
+
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if(params.features & IORING_FEAT_SINGLE_MMAP)
+      sqSize = cqSize = std::max(sqSize, cqSize);
+
+    char* sq = (char*)mmap(NULL, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    char* cq = sq;
+    if(sq != MAP_FAILED && !(params.features & IORING_FEAT_SINGLE_MMAP))
+      cq = (char*)mmap(NULL, cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    sqes = (struct io_uring_sqe*)mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                                      MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if(sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED){
+      close(ringFd);
+      return;
+    }
+
+    sqTail  = (unsigned*)(sq + params.sq_off.tail);
+    sqMask  = (unsigned*)(sq + params.sq_off.ring_mask);
+    sqArray = (unsigned*)(sq + params.sq_off.array);
+    cqHead  = (unsigned*)(cq + params.cq_off.head);
+    cqTail  = (unsigned*)(cq + params.cq_off.tail);
+    cqMask  = (unsigned*)(cq + params.cq_off.ring_mask);
+    cqes    = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    uring   = true;
+
+    // Registered buffers spare the kernel mapping them for every read; without them, plain reads do
+    std::vector<struct iovec> iovecs(count);
+    for(unsigned i = 0; i < count; i++){
+      iovecs[i].iov_base = buffers + (size_t)i * READ_SIZE;
+      iovecs[i].iov_len  = READ_SIZE;
+    }
+    fixed = !syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, iovecs.data(), count);
+  }
+
+  // Queue a read; `buffer` is the registered buffer `data` lies in, or -1
+  void Read(int fd, char* data, size_t length, uint64_t offset, int buffer, uint64_t tag){
+    if(!uring){
+      if(tag == WAKE){
+        wakeFd = fd;
+        wakeData = data;
+        return;
+      }
+      ssize_t r;
+      do
+        r = pread(fd, data, length, (off_t)offset);
+      while(r < 0 && errno == EINTR);
+      done.push_back({tag, r < 0 ? -errno : (int)r});
+      return;
+    }
+
+    unsigned tail  = *sqTail;
+    unsigned index = tail & *sqMask;
+    struct io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode    = buffer >= 0 && fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd        = fd;
+    sqe->addr      = (uint64_t)(uintptr_t)data;
+    sqe->len       = (uint32_t)length;
+    sqe->off       = offset;
+    sqe->buf_index = (uint16_t)(buffer >= 0 ? buffer : 0);
+    sqe->user_data = tag;
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    queued++;
+  }
+
+  // Submit the queued reads and collect completions, waiting for one if `block`
+  void Wait(std::vector<Completion>& completions, bool block){
+    if(!uring){
+      if(done.empty() && block && wakeFd >= 0){
+        ssize_t r = read(wakeFd, wakeData, 8);
+        done.push_back({WAKE, r < 0 ? -errno : (int)r});
+        wakeFd = -1;
+      }
+      completions.insert(completions.end(), done.begin(), done.end());
+      done.clear();
+      return;
+    }
+
+    unsigned head = *cqHead;
+    if(queued || (block && head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))){
+      long r = syscall(__NR_io_uring_enter, ringFd, queued, block ? 1 : 0, block ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+      if(r > 0)
+        queued -= (unsigned)r;
+    }
+
+    unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    for(; head != tail; head++){
+      struct io_uring_cqe* cqe = &cqes[head & *cqMask];
+      completions.push_back({cqe->user_data, cqe->res});
+    }
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+  }
+
+private:
+  int ringFd = -1;
+  bool fixed = false;
+  unsigned queued = 0; // Reads queued but not submitted
+  unsigned *sqTail, *sqMask, *sqArray, *cqHead, *cqTail, *cqMask;
+  struct io_uring_sqe* sqes;
+  struct io_uring_cqe* cqes;
+
+  std::vector<Completion> done; // Completed reads without io_uring
+  int wakeFd = -1;
+  char* wakeData;
+};
+
+static const char* suffix = "";
+static unsigned char pad  = LIBKECCAK_KECCAK_PAD;
+static libkeccak_spec_t spec;
+static char* buffers;
+static int wakeFd;
+
+static std::mutex lock;
+static std::condition_variable wakeWorkers;
+static std::deque<Task> tasks;
+static bool stopping = false;
+static std::vector<std::pair<File*, int>> returned; // Buffers the workers are done with
+static std::vector<Batch*> hashed;
+
+static void WakeMain(){
+  uint64_t one = 1;
+  while(write(wakeFd, &one, sizeof(one)) < 0 && errno == EINTR);
+}
+
+static void Work(){
+  std::unique_lock<std::mutex> guard(lock);
+
+  for(;;){
+    wakeWorkers.wait(guard, []{ return stopping || !tasks.empty(); });
+    if(tasks.empty())
+      return;
+    Task task = tasks.front();
+    tasks.pop_front();
+
+    if(task.batch){
+      Batch* batch = task.batch;
+      guard.unlock();
+      batch->hashsums.resize(batch->files.size() * 32);
+      if(libkeccak_batch(batch->data, batch->offsets.data(), NULL, batch->files.size(), LIBKECCAK_KECCAK256_RATE,
+                         24, pad, batch->hashsums.data(), 32, 1) < 0)
+        for(File* file : batch->files)
+          file->error = errno;
+      guard.lock();
+      hashed.push_back(batch);
+      WakeMain();
+      continue;
+    }
+
+    // Absorb the blocks of the file that are ready, in order
+    File* file = task.file;
+    for(;;){
+      auto it = file->ready.find(file->absorbed);
+      if(it == file->ready.end() || file->error){
+        file->queued = false;
+        break;
+      }
+      Block block = it->second;
+      file->ready.erase(it);
+      guard.unlock();
+
+      int error = 0;
+      if(libkeccak_fast_update(&file->state, buffers + (size_t)block.buffer * READ_SIZE, block.length) < 0 ||
+         (file->absorbed + block.length == file->size &&
+          libkeccak_fast_digest(&file->state, NULL, 0, 0, suffix, file->hashsum) < 0))
+        error = errno;
+
+      guard.lock();
+      file->absorbed += block.length;
+      if(error && !file->error)
+        file->error = error;
+      returned.push_back({file, block.buffer});
+      WakeMain();
+    }
+  }
+}
+
+// Queue a large file for the workers if its next block is ready; the lock must be held
+static void Schedule(File* file){
+  if(!file->queued && !file->error && file->ready.count(file->absorbed)){
+    file->queued = true;
+    tasks.push_back({file, NULL});
+    wakeWorkers.notify_one();
+  }
+}
+
+// Fail a large file and give back the blocks no worker will absorb now; the lock must be held
+static void Fail(File* file, int error, std::vector<int>& freeBuffers){
+  if(!file->error)
+    file->error = error;
+  for(auto& ready : file->ready){
+    freeBuffers.push_back(ready.second.buffer);
+    file->blocks--;
+  }
+  file->ready.clear();
+}
+
+static void Enqueue(Batch* batch){
+  std::lock_guard<std::mutex> guard(lock);
+  tasks.push_back({NULL, batch});
+  wakeWorkers.notify_one();
+}
+
+static void Walk(const std::string& path, bool operand, std::vector<File>& files, int& status){
+  struct stat st;
+
+  if((operand ? stat : lstat)(path.c_str(), &st) < 0){
+    std::cerr << "keccak256sum: " << path << ": " << strerror(errno) << "\n";
+    status = 1;
+    return;
+  }
+
+  if(S_ISREG(st.st_mode)){
+    File file;
+    file.path = path;
+    file.size = (uint64_t)st.st_size;
+    files.push_back(file);
+    return;
+  }
+
+  if(!S_ISDIR(st.st_mode)){
+    if(operand){
+      std::cerr << "keccak256sum: " << path << ": not a regular file or directory\n";
+      status = 1;
+    }
+    return;
+  }
+
+  DIR* dir = opendir(path.c_str());
+  if(!dir){
+    std::cerr << "keccak256sum: " << path << ": " << strerror(errno) << "\n";
+    status = 1;
+    return;
+  }
+  std::vector<std::string> names;
+  while(struct dirent* entry = readdir(dir))
+    if(strcmp(entry->d_name, ".") && strcmp(entry->d_name, ".."))
+      names.push_back(entry->d_name);
+  closedir(dir);
+
+  std::sort(names.begin(), names.end());
+  for(const std::string& name : names)
+    Walk(path.back() == '/' ? path + name : path + "/" + name, false, files, status);
+}
+
+static bool Print(File& file){
+  if(file.error){
+    std::cerr << "keccak256sum: " << file.path << ": "
+              << (file.error == TRUNCATED ? "file shrank while being read" : strerror(file.error)) << "\n";
+    return false;
+  }
+
+  char hex[65];
+  libkeccak_behex_lower(hex, file.hashsum, 32);
+  std::cout << hex << "  " << file.path << "\n";
+  return true;
+}
+
+static int Sum(std::vector<File>& files, long threads, unsigned depth){
+  size_t active  = (size_t)threads + 1;  // Large files being read at once
+  size_t batches = 0;                    // Batches being read or hashed
+  unsigned count = (unsigned)(active * READ_AHEAD);
+  int status = 0;
+
+  if(posix_memalign((void**)&buffers, 4096, (size_t)count * READ_SIZE)){
+    std::cerr << "keccak256sum: " << strerror(ENOMEM) << "\n";
+    return 1;
+  }
+  wakeFd = eventfd(0, EFD_CLOEXEC);
+  if(wakeFd < 0){
+    std::cerr << "keccak256sum: eventfd: " << strerror(errno) << "\n";
+    return 1;
+  }
+
+  Ring ring;
+  ring.Setup(depth + 1, buffers, count);
+
+  std::vector<std::thread> workers;
+  for(long i = 0; i < threads; i++)
+    workers.push_back(std::thread(Work));
+
+  std::vector<int> freeBuffers;
+  for(unsigned i = count; i--;)
+    freeBuffers.push_back((int)i);
+  std::vector<Request> requests(depth);
+  std::vector<unsigned> freeRequests;
+  for(unsigned i = depth; i--;)
+    freeRequests.push_back(i);
+
+  std::vector<File*> reading;   // Large files that are open
+  std::vector<Completion> completions;
+  std::vector<std::pair<File*, int>> blocksBack;
+  std::vector<Batch*> batchesBack;
+  Batch* batch = NULL;          // The batch small files are added to
+  size_t next = 0, printed = 0; // The next file to open, and to print
+  uint64_t wakeData;
+
+  ring.Read(wakeFd, (char*)&wakeData, sizeof(wakeData), (uint64_t)-1, -1, WAKE);
+
+  auto Submit = [&](File* file, Batch* in, int buffer, char* data, uint64_t offset, size_t length){
+    unsigned slot = freeRequests.back();
+    freeRequests.pop_back();
+    requests[slot] = {file, in, buffer, data, offset, length, 0};
+    ring.Read(file->fd, data, length, offset, buffer, slot);
+  };
+
+  auto Close = [&](Batch* closing){
+    closing->closed = true;
+    if(closing->files.empty()){
+      free(closing->data);
+      delete closing;
+      batches--;
+    }else if(!closing->pending){
+      Enqueue(closing);
+    }
+  };
+
+  while(printed < files.size()){
+    // Open files, in order, while there is room for them
+    while(next < files.size() && !freeRequests.empty()){
+      File& file = files[next];
+      bool small = file.size <= SMALL_FILE;
+
+      if(small && batch && (batch->files.size() == BATCH_FILES || batch->offsets.back() + file.size > BATCH_SIZE)){
+        Close(batch);
+        batch = NULL;
+      }
+      if(small ? !batch && batches > (size_t)threads : reading.size() >= active)
+        break;
+
+      next++;
+      file.fd = open(file.path.c_str(), O_RDONLY | O_CLOEXEC);
+      if(file.fd < 0){
+        file.error = errno;
+        file.done  = true;
+        continue;
+      }
+
+      if(small){
+        if(!batch){
+          char* data = (char*)malloc(BATCH_SIZE);
+          if(!data){
+            file.error = ENOMEM;
+            file.done  = true;
+            close(file.fd);
+            continue;
+          }
+          batch = new Batch();
+          batch->data = data;
+          batch->offsets.push_back(0);
+          batches++;
+        }
+        size_t at = batch->offsets.back();
+        batch->offsets.push_back(at + file.size);
+        batch->files.push_back(&file);
+        if(file.size){
+          batch->pending++;
+          Submit(&file, batch, -1, batch->data + at, 0, file.size);
+        }else{
+          close(file.fd);
+        }
+      }else{
+        if(libkeccak_state_initialise(&file.state, &spec) < 0){
+          file.error = errno;
+          file.done  = true;
+          close(file.fd);
+          continue;
+        }
+        posix_fadvise(file.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        reading.push_back(&file);
+      }
+    }
+    if(batch && (next == files.size() || !batch->pending)){
+      Close(batch);
+      batch = NULL;
+    }
+
+    // Keep every large file a few blocks ahead of its worker
+    for(bool more = true; more;){
+      more = false;
+      for(File* file : reading){
+        if(file->error || file->submitted == file->size || file->blocks >= READ_AHEAD ||
+           freeBuffers.empty() || freeRequests.empty())
+          continue;
+        int buffer = freeBuffers.back();
+        freeBuffers.pop_back();
+        size_t length = (size_t)std::min<uint64_t>(READ_SIZE, file->size - file->submitted);
+        Submit(file, NULL, buffer, buffers + (size_t)buffer * READ_SIZE, file->submitted, length);
+        file->submitted += length;
+        file->blocks++;
+        more = true;
+      }
+    }
+
+    // Print what is done, in order
+    while(printed < files.size() && files[printed].done)
+      if(!Print(files[printed++]))
+        status = 1;
+    if(printed == files.size())
+      break;
+
+    completions.clear();
+    ring.Wait(completions, true);
+
+    for(const Completion& completion : completions){
+      if(completion.tag == WAKE){
+        ring.Read(wakeFd, (char*)&wakeData, sizeof(wakeData), (uint64_t)-1, -1, WAKE);
+        continue;
+      }
+
+      Request& request = requests[completion.tag];
+      File* file = request.file;
+      if(completion.result > 0 && request.got + (size_t)completion.result < request.length){
+        request.got += (size_t)completion.result;
+        ring.Read(file->fd, request.data + request.got, request.length - request.got,
+                  request.offset + request.got, request.buffer, completion.tag);
+        continue;
+      }
+      int error = completion.result < 0 ? -completion.result : completion.result ? 0 : TRUNCATED;
+      freeRequests.push_back((unsigned)completion.tag);
+
+      if(request.batch){
+        if(error)
+          file->error = error;
+        close(file->fd);
+        if(!--request.batch->pending && request.batch->closed)
+          Enqueue(request.batch);
+        continue;
+      }
+
+      std::lock_guard<std::mutex> guard(lock);
+      if(error || file->error){
+        freeBuffers.push_back(request.buffer);
+        file->blocks--;
+        Fail(file, error ? error : file->error, freeBuffers);
+      }else{
+        file->ready[request.offset] = {request.buffer, request.length};
+        Schedule(file);
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      blocksBack.swap(returned);
+      batchesBack.swap(hashed);
+      for(auto& back : blocksBack){
+        freeBuffers.push_back(back.second);
+        back.first->blocks--;
+        if(back.first->error)
+          Fail(back.first, back.first->error, freeBuffers);
+      }
+    }
+    blocksBack.clear();
+
+    for(Batch* done : batchesBack){
+      for(size_t i = 0; i < done->files.size(); i++){
+        if(!done->files[i]->error)
+          memcpy(done->files[i]->hashsum, &done->hashsums[i * 32], 32);
+        done->files[i]->done = true;
+      }
+      free(done->data);
+      delete done;
+      batches--;
+    }
+    batchesBack.clear();
+
+    // A large file is done once every block is back, absorbed or dropped
+    for(size_t i = 0; i < reading.size();){
+      File* file = reading[i];
+      if(!file->blocks && (file->error || file->submitted == file->size)){
+        libkeccak_state_fast_destroy(&file->state);
+        close(file->fd);
+        file->done = true;
+        reading.erase(reading.begin() + i);
+      }else{
+        i++;
+      }
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wakeWorkers.notify_all();
+  for(std::thread& worker : workers)
+    worker.join();
+
+  std::cout.flush();
+  return status;
+}
+
+int main(int argc, char *argv[]){
+  long threads   = 0;
+  unsigned depth = 64;
+  int c;
+
+  while((c = getopt(argc, argv, "a:j:q:")) != -1){
+    switch(c){
+      case 'a':
+        if(!strcmp(optarg, "sha3")){
+          suffix = LIBKECCAK_SHA3_SUFFIX;
+          pad    = LIBKECCAK_SHA3_PAD;
+        }else if(strcmp(optarg, "keccak")){
+          std::cerr << "keccak256sum: unknown algorithm " << optarg << "\n";
+          return 1;
+        }
+        break;
+      case 'j': threads = atol(optarg);                       break;
+      case 'q': depth   = (unsigned)std::max(1L, atol(optarg)); break;
+      default:
+        std::cerr << "usage: " << argv[0] << " [-a keccak|sha3] [-j threads] [-q depth] path...\n";
+        return 1;
+    }
+  }
+  if(optind == argc){
+    std::cerr << "usage: " << argv[0] << " [-a keccak|sha3] [-j threads] [-q depth] path...\n";
+    return 1;
+  }
+
+  std::ios::sync_with_stdio(false);
+  libkeccak_spec_sha3(&spec, 256);
+
+  std::vector<File> files;
+  int status = 0;
+  for(int i = optind; i < argc; i++)
+    Walk(argv[i], true, files, status);
+  if(files.empty())
+    return status;
+
+  return Sum(files, libkeccak_parallel_threads(threads), depth) | status;
+}
@@ -0,0 +1,221 @@
+#include "alloc.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// Arena allocations are aligned to this many bytes
+#define LIBKECCAK_ARENA_ALIGN 16
+
+// Space at the start of a region for its header, a cache line so the first allocation is line aligned
+#define LIBKECCAK_ARENA_HEADER 64
+
+// Allocations at least this large get a region of their own
+#define LIBKECCAK_ARENA_LARGE (LIBKECCAK_ARENA_CHUNK / 2)
+
+// The header of an arena region
+struct libkeccak_arena_region {
+	struct libkeccak_arena_region *next; // The region mapped before this one
+	size_t size;                         // The size of the mapping
+};
+
+// A thread's arena
+struct libkeccak_arena {
+	struct libkeccak_arena_region *regions; // Every mapped region, newest first
+	char *top;                              // The next free byte of the current region
+	char *end;                              // The end of the current region
+	char *last;                             // The latest allocation, `NULL` if released
+	int registered;                         // Whether the destructor is registered for this thread
+};
+
+static void *libkeccak_malloc_allocate(void *ctx, size_t size);
+static void *libkeccak_malloc_reallocate(void *ctx, void *ptr, size_t oldsize, size_t size);
+static void libkeccak_malloc_release(void *ctx, void *ptr);
+static void *libkeccak_arena_allocate(void *ctx, size_t size);
+static void *libkeccak_arena_reallocate(void *ctx, void *ptr, size_t oldsize, size_t size);
+static void libkeccak_arena_release(void *ctx, void *ptr);
+
+const libkeccak_allocator_t libkeccak_malloc_allocator = {
+	libkeccak_malloc_allocate, libkeccak_malloc_reallocate, libkeccak_malloc_release, NULL
+};
+
+const libkeccak_allocator_t libkeccak_arena_allocator = {
+	libkeccak_arena_allocate, libkeccak_arena_reallocate, libkeccak_arena_release, NULL
+};
+
+const libkeccak_allocator_t *libkeccak_allocator = &libkeccak_malloc_allocator;
+
+static __thread struct libkeccak_arena libkeccak_arena;
+static pthread_key_t libkeccak_arena_key;
+static pthread_once_t libkeccak_arena_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Select the allocator for all subsequent library allocations
+ *
+ * @param  allocator  The allocator, `NULL` for `libkeccak_malloc_allocator`
+ */
+void libkeccak_set_allocator(const libkeccak_allocator_t *allocator)
+{
+	libkeccak_allocator = allocator ? allocator : &libkeccak_malloc_allocator;
+}
+
+static void *libkeccak_malloc_allocate(void *ctx, size_t size)
+{
+	(void) ctx;
+	return malloc(size);
+}
+
+static void *libkeccak_malloc_reallocate(void *ctx, void *ptr, size_t oldsize, size_t size)
+{
+	(void) ctx, (void) oldsize;
+	return realloc(ptr, size);
+}
+
+static void libkeccak_malloc_release(void *ctx, void *ptr)
+{
+	(void) ctx;
+	free(ptr);
+}
+
+/**
+ * Unmap every region of the calling thread's arena, except `keep`
+ *
+ * @param  arena  The arena
+ * @param  keep   The region to keep, may be `NULL`
+ */
+static void libkeccak_arena_unmap(struct libkeccak_arena *arena, struct libkeccak_arena_region *keep)
+{
+	struct libkeccak_arena_region *region, *next;
+	for (region = arena->regions; region; region = next) {
+		next = region->next;
+		if (region != keep)
+			munmap(region, region->size);
+	}
+	arena->regions = keep;
+	if (keep)
+		keep->next = NULL;
+}
+
+/**
+ * Release a thread's arena when the thread exits
+ *
+ * @param  arena  The arena
+ */
+static void libkeccak_arena_destructor(void *arena)
+{
+	libkeccak_arena_unmap(arena, NULL);
+}
+
+static void libkeccak_arena_key_create(void)
+{
+	pthread_key_create(&libkeccak_arena_key, libkeccak_arena_destructor);
+}
+
+/**
+ * Map a region aligned to `LIBKECCAK_ARENA_CHUNK` and ask for huge pages
+ *
+ * @param   arena  The arena to add the region to
+ * @param   size   The minimum usable size
+ * @return         The region, `NULL` on error
+ */
+static struct libkeccak_arena_region *libkeccak_arena_map(struct libkeccak_arena *arena, size_t size)
+{
+	struct libkeccak_arena_region *region;
+	uintptr_t p, aligned;
+
+	size = (size + LIBKECCAK_ARENA_HEADER + LIBKECCAK_ARENA_CHUNK - 1) & ~(LIBKECCAK_ARENA_CHUNK - 1);
+	p = (uintptr_t)mmap(NULL, size + LIBKECCAK_ARENA_CHUNK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if ((void *)p == MAP_FAILED)
+		return NULL;
+
+	/* Trim the mapping to a huge page boundary so the whole region can be backed by huge pages. */
+	aligned = (p + LIBKECCAK_ARENA_CHUNK - 1) & ~(uintptr_t)(LIBKECCAK_ARENA_CHUNK - 1);
+	if (aligned > p)
+		munmap((void *)p, aligned - p);
+	munmap((void *)(aligned + size), p + LIBKECCAK_ARENA_CHUNK - aligned);
+#ifdef MADV_HUGEPAGE
+	madvise((void *)aligned, size, MADV_HUGEPAGE);
+#endif
+
+	if (!arena->registered) {
+		pthread_once(&libkeccak_arena_once, libkeccak_arena_key_create);
+		pthread_setspecific(libkeccak_arena_key, arena);
+		arena->registered = 1;
+	}
+
+	region = (struct libkeccak_arena_region *)aligned;
+	region->next = arena->regions;
+	region->size = size;
+	arena->regions = region;
+	return region;
+}
+
+static void *libkeccak_arena_allocate(void *ctx, size_t size)
+{
+	struct libkeccak_arena *arena = &libkeccak_arena;
+	struct libkeccak_arena_region *region;
+	(void) ctx;
+
+	size = (size + LIBKECCAK_ARENA_ALIGN - 1) & ~(size_t)(LIBKECCAK_ARENA_ALIGN - 1);
+	if (size > (size_t)(arena->end - arena->top)) {
+		if (size >= LIBKECCAK_ARENA_LARGE) {
+			/* Keep filling the current region, large allocations cannot be extended in place anyway. */
+			region = libkeccak_arena_map(arena, size);
+			return region ? (char *)region + LIBKECCAK_ARENA_HEADER : NULL;
+		}
+		region = libkeccak_arena_map(arena, LIBKECCAK_ARENA_CHUNK - LIBKECCAK_ARENA_HEADER);
+		if (!region)
+			return NULL;
+		arena->top = (char *)region + LIBKECCAK_ARENA_HEADER;
+		arena->end = (char *)region + region->size;
+	}
+	arena->last = arena->top;
+	arena->top += size;
+	return arena->last;
+}
+
+static void *libkeccak_arena_reallocate(void *ctx, void *ptr, size_t oldsize, size_t size)
+{
+	struct libkeccak_arena *arena = &libkeccak_arena;
+	size_t rounded = (size + LIBKECCAK_ARENA_ALIGN - 1) & ~(size_t)(LIBKECCAK_ARENA_ALIGN - 1);
+	void *p;
+
+	if (ptr && ptr == arena->last && rounded <= (size_t)(arena->end - arena->last)) {
+		arena->top = arena->last + rounded;
+		return ptr;
+	}
+	p = libkeccak_arena_allocate(ctx, size);
+	if (p && ptr)
+		memcpy(p, ptr, oldsize < size ? oldsize : size);
+	return p;
+}
+
+static void libkeccak_arena_release(void *ctx, void *ptr)
+{
+	struct libkeccak_arena *arena = &libkeccak_arena;
+	(void) ctx;
+	if (ptr == arena->last) {
+		arena->top = arena->last;
+		arena->last = NULL;
+	}
+}
+
+/**
+ * Reclaim everything the calling thread has allocated from `libkeccak_arena_allocator`,
+ * keeping one region mapped for reuse
+ */
+void libkeccak_arena_reset(void)
+{
+	struct libkeccak_arena *arena = &libkeccak_arena;
+	struct libkeccak_arena_region *region, *keep = NULL;
+
+	for (region = arena->regions; region && !keep; region = region->next)
+		if (region->size == LIBKECCAK_ARENA_CHUNK)
+			keep = region;
+	libkeccak_arena_unmap(arena, keep);
+	arena->top = keep ? (char *)keep + LIBKECCAK_ARENA_HEADER : NULL;
+	arena->end = keep ? (char *)keep + keep->size : NULL;
+	arena->last = NULL;
+}
@@ -0,0 +1,91 @@
+#ifndef LIBKECCAK_ALLOC_H
+#define LIBKECCAK_ALLOC_H
+
+#include "metrics.h"
+
+#include <stddef.h>
+
+// Size and alignment of the regions backing `libkeccak_arena_allocator`, one transparent huge page
+#define LIBKECCAK_ARENA_CHUNK ((size_t)2 << 20)
+
+/**
+ * Allocator used for every allocation the library makes
+ *
+ * An allocation must be released through the allocator that made it,
+ * so switch allocators only while no library object is alive
+ */
+typedef struct libkeccak_allocator {
+	void* (*allocate)(void* ctx, size_t size);                            // Like `malloc`
+	void* (*reallocate)(void* ctx, void* ptr, size_t oldsize, size_t size); // Like `realloc`, `oldsize` is the size `ptr` was allocated with
+	void (*release)(void* ctx, void* ptr);                                 // Like `free`, never called with `NULL`
+	void* ctx;                                                            // Passed to each function
+} libkeccak_allocator_t;
+
+// The allocator that is used, `libkeccak_malloc_allocator` unless changed with `libkeccak_set_allocator`
+extern const libkeccak_allocator_t* libkeccak_allocator;
+
+// The allocator backed by `malloc`, `realloc` and `free`
+extern const libkeccak_allocator_t libkeccak_malloc_allocator;
+
+/**
+ * Per-thread bump allocator on 2 MB transparent huge pages
+ *
+ * Each thread allocates from its own chain of `LIBKECCAK_ARENA_CHUNK` aligned
+ * regions, which the kernel places on that thread's NUMA node when the thread
+ * first touches them. Releasing memory only reclaims the thread's latest
+ * allocation; everything else is reclaimed by `libkeccak_arena_reset` or when
+ * the thread exits, so memory must not outlive the thread that allocated it
+ */
+extern const libkeccak_allocator_t libkeccak_arena_allocator;
+
+/**
+ * Select the allocator for all subsequent library allocations
+ *
+ * @param  allocator  The allocator, `NULL` for `libkeccak_malloc_allocator`
+ */
+void libkeccak_set_allocator(const libkeccak_allocator_t* allocator);
+
+/**
+ * Reclaim everything the calling thread has allocated from `libkeccak_arena_allocator`,
+ * keeping one region mapped for reuse
+ */
+void libkeccak_arena_reset(void);
+
+/**
+ * Allocate memory with the selected allocator
+ *
+ * @param   size  The number of bytes
+ * @return        The allocation, `NULL` on error
+ */
+static inline void* libkeccak_malloc(size_t size)
+{
+	LIBKECCAK_COUNT(LIBKECCAK_ALLOCATIONS, 1);
+	return libkeccak_allocator->allocate(libkeccak_allocator->ctx, size);
+}
+
+/**
+ * Resize memory allocated with the selected allocator
+ *
+ * @param   ptr      The allocation, may be `NULL`
+ * @param   oldsize  The current size of the allocation
+ * @param   size     The new size
+ * @return           The resized allocation, `NULL` on error, in which case `ptr` is untouched
+ */
+static inline void* libkeccak_realloc(void* ptr, size_t oldsize, size_t size)
+{
+	LIBKECCAK_COUNT(LIBKECCAK_ALLOCATIONS, 1);
+	return libkeccak_allocator->reallocate(libkeccak_allocator->ctx, ptr, oldsize, size);
+}
+
+/**
+ * Release memory allocated with the selected allocator
+ *
+ * @param  ptr  The allocation, may be `NULL`
+ */
+static inline void libkeccak_free(void* ptr)
+{
+	if (ptr)
+		libkeccak_allocator->release(libkeccak_allocator->ctx, ptr);
+}
+
+#endif
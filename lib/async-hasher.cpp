@@ -0,0 +1,117 @@
+#include "async-hasher.h"
+
+AsyncHasher::Awaitable::Awaitable(AsyncHasher* hasher, const char* publicKey) : hasher(hasher), next(nullptr){
+  memcpy(this->publicKey, publicKey, PUBLIC_KEY_SIZE);
+}
+
+void AsyncHasher::Awaitable::await_suspend(std::coroutine_handle<> handle){
+  this->handle = handle;
+  // The coroutine may be resumed on a worker before Submit returns; nothing may touch *this afterwards
+  hasher->Submit(this);
+}
+
+AsyncHasher::AsyncHasher() : AsyncHasher(Options()){}
+
+AsyncHasher::AsyncHasher(const Options& options) : options(options){
+  if(!this->options.batch)
+    this->options.batch = 1;
+  if(!this->options.workers)
+    this->options.workers = 1;
+
+  for(unsigned i = 0; i < this->options.workers; i++)
+    workers.emplace_back(&AsyncHasher::Run, this);
+}
+
+AsyncHasher::~AsyncHasher(){
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+
+  wake.notify_all();
+
+  for(std::thread& worker : workers)
+    worker.join();
+}
+
+AsyncHasher::Awaitable AsyncHasher::address(const char* publicKey){
+  return Awaitable(this, publicKey);
+}
+
+void AsyncHasher::Flush(){
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if(!pending)
+      return;
+    flushing = true;
+  }
+
+  wake.notify_all();
+}
+
+void AsyncHasher::Submit(Awaitable* request){
+  bool notify;
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    request->arrival = Clock::now();
+    *tail = request;
+    tail = &request->next;
+    pending++;
+    // The first request arms a worker's deadline, a full batch releases it early
+    notify = pending == 1 || pending % options.batch == 0;
+  }
+
+  if(notify)
+    wake.notify_one();
+}
+
+void AsyncHasher::Run(){
+  std::vector<char> publicKeys(options.batch * PUBLIC_KEY_SIZE);
+  std::vector<char> addresses(options.batch * ADDRESS_SIZE);
+  std::vector<Awaitable*> batch(options.batch);
+  std::unique_lock<std::mutex> guard(lock);
+
+  for(;;){
+    if(!pending){
+      flushing = false;
+      if(stopping)
+        return;
+      wake.wait(guard);
+      continue;
+    }
+
+    Clock::time_point deadline = head->arrival + options.deadline;
+    if(pending < options.batch && !flushing && !stopping && Clock::now() < deadline){
+      wake.wait_until(guard, deadline);
+      continue;
+    }
+
+    size_t n = 0;
+    while(head && n < options.batch){
+      batch[n++] = head;
+      head = head->next;
+    }
+    if(!head)
+      tail = &head;
+    pending -= n;
+
+    // Let another worker start on the remainder while this batch is hashed
+    if(pending)
+      wake.notify_one();
+
+    guard.unlock();
+
+    for(size_t i = 0; i < n; i++)
+      memcpy(&publicKeys[i * PUBLIC_KEY_SIZE], batch[i]->publicKey, PUBLIC_KEY_SIZE);
+
+    PublicKeysToAddresses(publicKeys.data(), n, addresses.data());
+
+    for(size_t i = 0; i < n; i++){
+      memcpy(batch[i]->address.data(), &addresses[i * ADDRESS_SIZE], ADDRESS_SIZE);
+      batch[i]->handle.resume();
+    }
+
+    guard.lock();
+  }
+}
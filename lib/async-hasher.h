@@ -0,0 +1,77 @@
+#ifndef ASYNC_HASHER_H
+#define ASYNC_HASHER_H
+
+#include "keccak256.h"
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Coalesces address requests from many coroutines into multi-buffer batches:
+//
+//   AsyncHasher hasher;
+//   std::array<char, ADDRESS_SIZE> address = co_await hasher.address(publicKey);
+//
+// A batch is flushed as soon as it is full, or once its oldest request has
+// waited for the deadline. Waiters are resumed on the worker thread that
+// hashed their batch, so they should hand off long-running work themselves.
+class AsyncHasher{
+  using Clock = std::chrono::steady_clock;
+
+public:
+  struct Options{
+    size_t batch = 64;                      // Requests per flush; larger batches favour throughput, keep it a multiple of 4
+    std::chrono::microseconds deadline{50}; // Longest a request waits for its batch to fill; smaller favours latency
+    unsigned workers = 1;                   // Threads that hash flushed batches and resume their waiters
+  };
+
+  class Awaitable{
+  public:
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle);
+    std::array<char, ADDRESS_SIZE> await_resume() const noexcept { return address; }
+
+  private:
+    friend class AsyncHasher;
+    Awaitable(AsyncHasher* hasher, const char* publicKey);
+
+    AsyncHasher* hasher;
+    Awaitable* next;
+    Clock::time_point arrival;
+    std::coroutine_handle<> handle;
+    char publicKey[PUBLIC_KEY_SIZE];
+    std::array<char, ADDRESS_SIZE> address;
+  };
+
+  AsyncHasher();
+  explicit AsyncHasher(const Options& options);
+  ~AsyncHasher(); // Flushes every pending request before returning
+  AsyncHasher(const AsyncHasher&) = delete;
+  AsyncHasher& operator=(const AsyncHasher&) = delete;
+
+  // Request the address of a binary public key of PUBLIC_KEY_SIZE bytes, the key is copied
+  Awaitable address(const char* publicKey);
+
+  // Flush every pending request now instead of waiting for the deadline
+  void Flush();
+
+private:
+  void Submit(Awaitable* request);
+  void Run();
+
+  Options options;
+  std::mutex lock;
+  std::condition_variable wake;
+  Awaitable* head = nullptr;
+  Awaitable** tail = &head;
+  size_t pending = 0;
+  bool flushing = false;
+  bool stopping = false;
+  std::vector<std::thread> workers;
+};
+
+#endif
@@ -0,0 +1,256 @@
+#include "batch.h"
+#include "alloc.h"
+#include "metrics.h"
+#include "parallel.h"
+
+#include <string.h>
+
+// Records handed to a thread at a time, a multiple of `LIBKECCAK_X4`
+#define LIBKECCAK_BATCH_GRAIN 1024
+
+// A batch of packed records, with its records sorted by block count
+struct libkeccak_batch_input {
+	const char *buf;       // The buffer holding the records
+	const size_t *offsets; // The offset of each record
+	const size_t *lengths; // The length of each record, `NULL` if derived from `offsets`
+	const size_t *order;   // The indices of the records, by ascending block count
+	long rate;             // The bitrate in bytes
+	long nr;               // The number of rounds
+	unsigned char pad;     // The padding byte
+	char *hashsums;        // The output column, `NULL` when verifying
+	size_t outlen;         // The size of each hashsum
+	const char *expected;  // The expected hashsums when verifying, `NULL` when hashing
+	uint64_t *valid;       // The bitmap of matching records when verifying
+	size_t matches;        // The number of matching records when verifying, updated atomically
+};
+
+/**
+ * Get the length of a record
+ *
+ * @param   in  The batch
+ * @param   i   The index of the record
+ * @return      The length of the record
+ */
+static inline size_t libkeccak_batch_length(const struct libkeccak_batch_input *in, size_t i)
+{
+	return in->lengths ? in->lengths[i] : in->offsets[i + 1] - in->offsets[i];
+}
+
+/**
+ * Record that a record matches its expected hashsum
+ *
+ * @param  in  The batch
+ * @param  i   The index of the record
+ */
+static inline void libkeccak_batch_match(struct libkeccak_batch_input *in, size_t i)
+{
+	__atomic_or_fetch(&in->valid[i >> 6], (uint64_t)1 << (i & 63), __ATOMIC_RELAXED);
+}
+
+/**
+ * Hash, or verify, the records at `[begin, end)` of the sorted order, as
+ * many at a time as the kernel selected with `libkeccak_set_kernel` takes
+ * wherever that many consecutive records span the same number of blocks
+ *
+ * @param  ctx    The `struct libkeccak_batch_input`
+ * @param  begin  The first position in the sorted order
+ * @param  end    One past the last position in the sorted order
+ */
+static void libkeccak_batch_range(void *ctx, size_t begin, size_t end)
+{
+	struct libkeccak_batch_input *in = ctx;
+	const libkeccak_kernel_t *kernel = libkeccak_get_kernel();
+	const char *msgs[LIBKECCAK_X4];
+	const char *want[LIBKECCAK_X4];
+	size_t lens[LIBKECCAK_X4];
+	char *outs[LIBKECCAK_X4];
+	size_t i, k, r, blocks, matches = 0;
+	unsigned valid;
+
+	while (begin < end) {
+		r = in->order[begin];
+		lens[0] = libkeccak_batch_length(in, r);
+		blocks = lens[0] / (size_t)in->rate;
+		if (kernel->width > 1 && end - begin >= kernel->width && blocks < LIBKECCAK_BATCH_BUCKETS) {
+			for (k = 1; k < kernel->width; k++) {
+				lens[k] = libkeccak_batch_length(in, in->order[begin + k]);
+				if (lens[k] / (size_t)in->rate != blocks)
+					break;
+			}
+			if (k == kernel->width) {
+				for (k = 0; k < kernel->width; k++) {
+					i = in->order[begin + k];
+					msgs[k] = in->buf + in->offsets[i];
+					if (in->expected)
+						want[k] = in->expected + i * in->outlen;
+					else
+						outs[k] = in->hashsums + i * in->outlen;
+				}
+				if (in->expected) {
+					valid = kernel->verify(msgs, lens, in->rate, in->nr, in->pad, want, 0, in->outlen);
+					for (k = 0; k < kernel->width; k++)
+						if (valid >> k & 1)
+							libkeccak_batch_match(in, in->order[begin + k]), matches++;
+				} else {
+					kernel->sponge(msgs, lens, in->rate, in->nr, in->pad, outs, in->outlen);
+				}
+				begin += kernel->width;
+				continue;
+			}
+		}
+		if (!in->expected)
+			libkeccak_sponge(in->buf + in->offsets[r], lens[0], in->rate, in->nr, in->pad,
+			                 in->hashsums + r * in->outlen, in->outlen);
+		else if (libkeccak_sponge_verify(in->buf + in->offsets[r], lens[0], in->rate, in->nr, in->pad,
+		                                 in->expected + r * in->outlen, 0, in->outlen))
+			libkeccak_batch_match(in, r), matches++;
+		begin++;
+	}
+	if (matches)
+		__atomic_add_fetch(&in->matches, matches, __ATOMIC_RELAXED);
+}
+
+/**
+ * Sort the records of a batch by block count and hash, or verify, them
+ *
+ * @param   in       The batch, with everything but `order` set
+ * @param   count    The number of records, nonzero
+ * @param   threads  The number of threads, zero or negative for one per online processor
+ * @return           Zero on success, -1 on error
+ */
+static int libkeccak_batch_run(struct libkeccak_batch_input *in, size_t count, long threads)
+{
+	size_t starts[LIBKECCAK_BATCH_BUCKETS + 1] = { 0 };
+	size_t *order, i, b, nshort, sum;
+
+	order = libkeccak_malloc(count * sizeof(*order));
+	if (!order)
+		return LIBKECCAK_COUNT(LIBKECCAK_ERRORS, 1), -1;
+	in->order = order;
+
+	/* Counting sort by block count, everything from `LIBKECCAK_BATCH_BUCKETS` blocks up shares the last bucket. */
+	for (i = 0; i < count; i++) {
+		b = libkeccak_batch_length(in, i) / (size_t)in->rate;
+		starts[b < LIBKECCAK_BATCH_BUCKETS ? b : LIBKECCAK_BATCH_BUCKETS]++;
+	}
+	for (sum = 0, b = 0; b <= LIBKECCAK_BATCH_BUCKETS; b++) {
+		i = starts[b];
+		starts[b] = sum;
+		sum += i;
+	}
+	nshort = starts[LIBKECCAK_BATCH_BUCKETS];
+	for (i = 0; i < count; i++) {
+		b = libkeccak_batch_length(in, i) / (size_t)in->rate;
+		order[starts[b < LIBKECCAK_BATCH_BUCKETS ? b : LIBKECCAK_BATCH_BUCKETS]++] = i;
+	}
+
+	libkeccak_parallel_for(nshort, LIBKECCAK_BATCH_GRAIN, libkeccak_batch_range, in, threads);
+	in->order = order + nshort;
+	libkeccak_parallel_for(count - nshort, 1, libkeccak_batch_range, in, threads);
+
+	libkeccak_free(order);
+	return 0;
+}
+
+/**
+ * Hash variable-length records packed into one buffer
+ *
+ * Records are grouped by the number of blocks they span so that the
+ * kernel selected with `libkeccak_set_kernel` always gets records of
+ * equal block count, long records take the scalar path, and the work
+ * is spread across `threads` threads; the only allocation is one index
+ * per record for the whole batch
+ *
+ * @param   buf       The buffer holding the records
+ * @param   offsets   The offset of each record in `buf`
+ * @param   lengths   The length of each record, or `NULL` if `offsets` has `count + 1`
+ *                    entries and record `i` ends where record `i + 1` starts
+ * @param   count     The number of records
+ * @param   rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param   nr        The number of rounds
+ * @param   pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param   hashsums  Output parameter for the hashsums, hashsum `i` is stored at `hashsums + i * outlen`
+ * @param   outlen    The number of bytes to squeeze for each record
+ * @param   threads   The number of threads, zero or negative for one per online processor
+ * @return            Zero on success, -1 on error
+ */
+int libkeccak_batch(const char *buf, const size_t *offsets, const size_t *lengths, size_t count, long rate,
+                    long nr, unsigned char pad, char *hashsums, size_t outlen, long threads)
+{
+	struct libkeccak_batch_input in;
+	LIBKECCAK_TIMER(start);
+
+	LIBKECCAK_COUNT(LIBKECCAK_CALLS, 1);
+	if (!count)
+		return 0;
+
+	in.buf = buf;
+	in.offsets = offsets;
+	in.lengths = lengths;
+	in.rate = rate;
+	in.nr = nr;
+	in.pad = pad;
+	in.hashsums = hashsums;
+	in.outlen = outlen;
+	in.expected = NULL;
+	in.valid = NULL;
+	in.matches = 0;
+	if (libkeccak_batch_run(&in, count, threads))
+		return -1;
+
+	LIBKECCAK_RECORD(LIBKECCAK_LATENCY_BATCH, start);
+	return 0;
+}
+
+/**
+ * Check the hashsums of variable-length records packed into one buffer
+ * against expected hashsums, without writing any hashsum out
+ *
+ * The records are scheduled as by `libkeccak_batch`; each record compares
+ * only the lanes of its first output block that hold the hashsum and
+ * stops at the first difference
+ *
+ * @param   buf       The buffer holding the records
+ * @param   offsets   The offset of each record in `buf`
+ * @param   lengths   The length of each record, or `NULL` if `offsets` has `count + 1`
+ *                    entries and record `i` ends where record `i + 1` starts
+ * @param   count     The number of records
+ * @param   rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param   nr        The number of rounds
+ * @param   pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param   expected  The expected hashsums, hashsum `i` is stored at `expected + i * outlen`
+ * @param   outlen    The size of each hashsum, no greater than `rate`
+ * @param   valid     Output parameter for the bitmap of matching records, `(count + 63) / 64`
+ *                    words with bit `i % 64` of word `i / 64` set if record `i` matches
+ * @param   threads   The number of threads, zero or negative for one per online processor
+ * @return            The number of matching records, `(size_t)-1` on error
+ */
+size_t libkeccak_batch_verify(const char *buf, const size_t *offsets, const size_t *lengths, size_t count,
+                              long rate, long nr, unsigned char pad, const char *expected, size_t outlen,
+                              uint64_t *valid, long threads)
+{
+	struct libkeccak_batch_input in;
+	LIBKECCAK_TIMER(start);
+
+	LIBKECCAK_COUNT(LIBKECCAK_CALLS, 1);
+	memset(valid, 0, (count + 63) / 64 * sizeof(*valid));
+	if (!count)
+		return 0;
+
+	in.buf = buf;
+	in.offsets = offsets;
+	in.lengths = lengths;
+	in.rate = rate;
+	in.nr = nr;
+	in.pad = pad;
+	in.hashsums = NULL;
+	in.outlen = outlen;
+	in.expected = expected;
+	in.valid = valid;
+	in.matches = 0;
+	if (libkeccak_batch_run(&in, count, threads))
+		return (size_t)-1;
+
+	LIBKECCAK_RECORD(LIBKECCAK_LATENCY_BATCH, start);
+	return in.matches;
+}
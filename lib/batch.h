@@ -0,0 +1,103 @@
+#ifndef LIBKECCAK_BATCH_H
+#define LIBKECCAK_BATCH_H
+
+#include "keccak-p.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Records spanning at least this many blocks skip the multi-message kernel and are hashed one by one
+#define LIBKECCAK_BATCH_BUCKETS 64
+
+/**
+ * Hash variable-length records packed into one buffer
+ *
+ * Records are grouped by the number of blocks they span so that the
+ * kernel selected with `libkeccak_set_kernel` always gets records of
+ * equal block count, long records take the scalar path, and the work
+ * is spread across `threads` threads; the only allocation is one index
+ * per record for the whole batch
+ *
+ * @param   buf       The buffer holding the records
+ * @param   offsets   The offset of each record in `buf`
+ * @param   lengths   The length of each record, or `NULL` if `offsets` has `count + 1`
+ *                    entries and record `i` ends where record `i + 1` starts
+ * @param   count     The number of records
+ * @param   rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param   nr        The number of rounds
+ * @param   pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param   hashsums  Output parameter for the hashsums, hashsum `i` is stored at `hashsums + i * outlen`
+ * @param   outlen    The number of bytes to squeeze for each record
+ * @param   threads   The number of threads, zero or negative for one per online processor
+ * @return            Zero on success, -1 on error
+ */
+int libkeccak_batch(const char* buf, const size_t* offsets, const size_t* lengths, size_t count, long rate,
+                    long nr, unsigned char pad, char* hashsums, size_t outlen, long threads);
+
+/**
+ * Check the hashsums of variable-length records packed into one buffer
+ * against expected hashsums, without writing any hashsum out
+ *
+ * The records are scheduled as by `libkeccak_batch`; each record compares
+ * only the lanes of its first output block that hold the hashsum and
+ * stops at the first difference
+ *
+ * @param   buf       The buffer holding the records
+ * @param   offsets   The offset of each record in `buf`
+ * @param   lengths   The length of each record, or `NULL` if `offsets` has `count + 1`
+ *                    entries and record `i` ends where record `i + 1` starts
+ * @param   count     The number of records
+ * @param   rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param   nr        The number of rounds
+ * @param   pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param   expected  The expected hashsums, hashsum `i` is stored at `expected + i * outlen`
+ * @param   outlen    The size of each hashsum, no greater than `rate`
+ * @param   valid     Output parameter for the bitmap of matching records, `(count + 63) / 64`
+ *                    words with bit `i % 64` of word `i / 64` set if record `i` matches
+ * @param   threads   The number of threads, zero or negative for one per online processor
+ * @return            The number of matching records, `(size_t)-1` on error
+ */
+size_t libkeccak_batch_verify(const char* buf, const size_t* offsets, const size_t* lengths, size_t count,
+                              long rate, long nr, unsigned char pad, const char* expected, size_t outlen,
+                              uint64_t* valid, long threads);
+
+/**
+ * Calculate the Keccak-256 hashsums, as used by Ethereum, of variable-length
+ * records packed into one buffer
+ *
+ * @param   buf       The buffer holding the records
+ * @param   offsets   The offset of each record in `buf`
+ * @param   lengths   The length of each record, or `NULL` if `offsets` has `count + 1` entries
+ * @param   count     The number of records
+ * @param   hashsums  Output parameter for the hashsums, `32 * count` bytes
+ * @param   threads   The number of threads, zero or negative for one per online processor
+ * @return            Zero on success, -1 on error
+ */
+static inline int libkeccak_keccak256_batch(const char* buf, const size_t* offsets, const size_t* lengths,
+                                            size_t count, char* hashsums, long threads)
+{
+	return libkeccak_batch(buf, offsets, lengths, count, LIBKECCAK_KECCAK256_RATE, 24,
+	                       LIBKECCAK_KECCAK_PAD, hashsums, 32, threads);
+}
+
+/**
+ * Check the Keccak-256 hashsums, as used by Ethereum, of variable-length
+ * records packed into one buffer against expected hashsums
+ *
+ * @param   buf      The buffer holding the records
+ * @param   offsets  The offset of each record in `buf`
+ * @param   lengths  The length of each record, or `NULL` if `offsets` has `count + 1` entries
+ * @param   count    The number of records
+ * @param   digests  The expected hashsums, `32 * count` bytes
+ * @param   valid    Output parameter for the bitmap of matching records, `(count + 63) / 64` words
+ * @param   threads  The number of threads, zero or negative for one per online processor
+ * @return           The number of matching records, `(size_t)-1` on error
+ */
+static inline size_t libkeccak_keccak256_batch_verify(const char* buf, const size_t* offsets, const size_t* lengths,
+                                                      size_t count, const char* digests, uint64_t* valid, long threads)
+{
+	return libkeccak_batch_verify(buf, offsets, lengths, count, LIBKECCAK_KECCAK256_RATE, 24,
+	                              LIBKECCAK_KECCAK_PAD, digests, 32, valid, threads);
+}
+
+#endif
@@ -0,0 +1,246 @@
+#include "cache.h"
+#include "alloc.h"
+#include "keccak-p.h"
+
+#include <string.h>
+
+/**
+ * Load a little-endian 64-bit word from a key
+ *
+ * @param   p  The first byte
+ * @return     The word
+ */
+static inline uint64_t libkeccak_cache_word(const char *p)
+{
+	uint64_t x;
+	memcpy(&x, p, sizeof(x));
+	return x;
+}
+
+/**
+ * Hash a public key; keys are curve points, which are uniform enough
+ * that folding a few of their words is all the mixing they need
+ *
+ * @param   key  The public key
+ * @return       The hash
+ */
+static inline uint64_t libkeccak_cache_hash(const char *key)
+{
+	uint64_t h = libkeccak_cache_word(key) ^ libkeccak_cache_word(key + 24) ^ libkeccak_cache_word(key + 56);
+	h *= 0x9E3779B97F4A7C15ULL;
+	return h ^ (h >> 31);
+}
+
+/**
+ * Get the counter stripe of the calling thread; threads take stripes in
+ * turn the first time they look a key up
+ *
+ * @return  The stripe, less than `LIBKECCAK_CACHE_STRIPES`
+ */
+static inline size_t libkeccak_cache_stripe(void)
+{
+	static unsigned next = 0;
+	static __thread unsigned stripe = 0; /* One more than the stripe, 0 until assigned */
+	if (!stripe)
+		stripe = __atomic_add_fetch(&next, 1, __ATOMIC_RELAXED);
+	return (stripe - 1) & (LIBKECCAK_CACHE_STRIPES - 1);
+}
+
+/**
+ * Find the shard and set of a key
+ *
+ * @param   cache  The cache
+ * @param   key    The public key
+ * @param   shard  Output parameter for the shard
+ * @return         The set
+ */
+static inline libkeccak_cache_set_t *libkeccak_cache_set(libkeccak_cache_t *restrict cache, const char *restrict key,
+                                                         libkeccak_cache_shard_t **restrict shard)
+{
+	uint64_t h = libkeccak_cache_hash(key);
+	*shard = &cache->shards[h & cache->shardmask];
+	return &(*shard)->sets[(h >> 32) & cache->setmask];
+}
+
+/**
+ * Initialise a cache
+ *
+ * @param   cache     The cache that should be initialised
+ * @param   capacity  The number of entries, rounded up to fill every shard with a power of 2 number of sets
+ * @param   shards    The number of shards, rounded up to a power of 2
+ * @return            Zero on success, -1 on error
+ */
+int libkeccak_cache_initialise(libkeccak_cache_t *restrict cache, size_t capacity, size_t shards)
+{
+	size_t nshards = 1, nsets = 1, i;
+	libkeccak_cache_set_t *sets;
+
+	while (nshards < shards)
+		nshards <<= 1;
+	while (nshards * nsets * LIBKECCAK_CACHE_WAYS < capacity)
+		nsets <<= 1;
+
+	cache->storage = libkeccak_malloc(63 + nshards * sizeof(*cache->shards) +
+	                                  LIBKECCAK_CACHE_STRIPES * sizeof(*cache->counters) +
+	                                  nshards * nsets * sizeof(*sets));
+	if (!cache->storage)
+		return -1;
+	cache->shards = (libkeccak_cache_shard_t *)(((uintptr_t)cache->storage + 63) & ~(uintptr_t)63);
+	cache->counters = (libkeccak_cache_counters_t *)(cache->shards + nshards);
+	cache->shardmask = nshards - 1;
+	cache->setmask = nsets - 1;
+	memset(cache->counters, 0, LIBKECCAK_CACHE_STRIPES * sizeof(*cache->counters));
+	sets = (libkeccak_cache_set_t *)(cache->counters + LIBKECCAK_CACHE_STRIPES);
+	memset(sets, 0, nshards * nsets * sizeof(*sets));
+
+	for (i = 0; i < nshards; i++) {
+		if (pthread_mutex_init(&cache->shards[i].lock, NULL)) {
+			while (i--)
+				pthread_mutex_destroy(&cache->shards[i].lock);
+			libkeccak_free(cache->storage);
+			return -1;
+		}
+		cache->shards[i].sets = sets + i * nsets;
+	}
+	return 0;
+}
+
+/**
+ * Release the resources of a cache
+ *
+ * @param  cache  The cache that should be destroyed
+ */
+void libkeccak_cache_destroy(libkeccak_cache_t *restrict cache)
+{
+	size_t i;
+	if (!cache || !cache->storage)
+		return;
+	for (i = 0; i <= cache->shardmask; i++)
+		pthread_mutex_destroy(&cache->shards[i].lock);
+	libkeccak_free(cache->storage);
+	cache->storage = NULL;
+	cache->shards = NULL;
+}
+
+/**
+ * Look a public key up
+ *
+ * @param   cache  The cache
+ * @param   key    The public key, `LIBKECCAK_CACHE_KEY` bytes
+ * @param   value  Output parameter for the address, `LIBKECCAK_CACHE_VALUE` bytes
+ * @return         1 on a hit, 0 on a miss
+ */
+int libkeccak_cache_lookup(libkeccak_cache_t *restrict cache, const char *restrict key, char *restrict value)
+{
+	libkeccak_cache_shard_t *shard;
+	libkeccak_cache_set_t *set = libkeccak_cache_set(cache, key, &shard);
+	libkeccak_cache_entry_t *entry;
+	libkeccak_cache_counters_t *counters;
+	uint64_t first = libkeccak_cache_word(key);
+	uint32_t seq;
+	int i, found;
+
+	do {
+		while ((seq = __atomic_load_n(&set->seq, __ATOMIC_ACQUIRE)) & 1)
+			;
+		found = -1;
+		for (i = 0; i < LIBKECCAK_CACHE_WAYS; i++) {
+			entry = &set->entries[i];
+			if (entry->valid && libkeccak_cache_word(entry->key) == first &&
+			    !memcmp(entry->key, key, LIBKECCAK_CACHE_KEY)) {
+				memcpy(value, entry->value, LIBKECCAK_CACHE_VALUE);
+				found = i;
+				break;
+			}
+		}
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while (__atomic_load_n(&set->seq, __ATOMIC_RELAXED) != seq);
+
+	counters = &cache->counters[libkeccak_cache_stripe()];
+	if (found < 0) {
+		__atomic_fetch_add(&counters->misses, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	/* Only write the reference bit when it changes; with the counters in
+	 * the thread's stripe, hits on hot keys leave the set's lines clean. */
+	if (!__atomic_load_n(&set->entries[found].referenced, __ATOMIC_RELAXED))
+		__atomic_store_n(&set->entries[found].referenced, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&counters->hits, 1, __ATOMIC_RELAXED);
+	return 1;
+}
+
+/**
+ * Store the address of a public key, evicting an entry if its set is full
+ *
+ * @param  cache  The cache
+ * @param  key    The public key, `LIBKECCAK_CACHE_KEY` bytes
+ * @param  value  The address, `LIBKECCAK_CACHE_VALUE` bytes
+ */
+void libkeccak_cache_insert(libkeccak_cache_t *restrict cache, const char *restrict key, const char *restrict value)
+{
+	libkeccak_cache_shard_t *shard;
+	libkeccak_cache_set_t *set = libkeccak_cache_set(cache, key, &shard);
+	libkeccak_cache_entry_t *entry = NULL;
+	int i;
+
+	pthread_mutex_lock(&shard->lock);
+
+	/* Another thread may have missed on the same key and inserted it first. */
+	for (i = 0; i < LIBKECCAK_CACHE_WAYS && !entry; i++)
+		if (set->entries[i].valid && !memcmp(set->entries[i].key, key, LIBKECCAK_CACHE_KEY))
+			entry = &set->entries[i];
+	for (i = 0; i < LIBKECCAK_CACHE_WAYS && !entry; i++)
+		if (!set->entries[i].valid)
+			entry = &set->entries[i];
+	while (!entry) {
+		entry = &set->entries[set->hand];
+		set->hand = (set->hand + 1) % LIBKECCAK_CACHE_WAYS;
+		if (__atomic_load_n(&entry->referenced, __ATOMIC_RELAXED)) {
+			__atomic_store_n(&entry->referenced, 0, __ATOMIC_RELAXED);
+			entry = NULL;
+		}
+	}
+
+	__atomic_store_n(&set->seq, set->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(entry->key, key, LIBKECCAK_CACHE_KEY);
+	memcpy(entry->value, value, LIBKECCAK_CACHE_VALUE);
+	entry->valid = 1;
+	__atomic_store_n(&entry->referenced, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&set->seq, set->seq + 1, __ATOMIC_RELEASE);
+
+	pthread_mutex_unlock(&shard->lock);
+}
+
+/**
+ * Get the address of a public key from the cache, on a miss
+ * hash it with the allocation-free sponge and store it
+ *
+ * @param  cache    The cache
+ * @param  key      The public key, `LIBKECCAK_CACHE_KEY` bytes
+ * @param  address  Output parameter for the address, `LIBKECCAK_CACHE_VALUE` bytes
+ */
+void libkeccak_cache_address(libkeccak_cache_t *restrict cache, const char *restrict key, char *restrict address)
+{
+	if (libkeccak_cache_lookup(cache, key, address))
+		return;
+	libkeccak_keccak256_range(key, LIBKECCAK_CACHE_KEY, address, 32 - LIBKECCAK_CACHE_VALUE, LIBKECCAK_CACHE_VALUE);
+	libkeccak_cache_insert(cache, key, address);
+}
+
+/**
+ * Sum the hit and miss counters of every stripe
+ *
+ * @param  cache   The cache
+ * @param  hits    Output parameter for the number of hits
+ * @param  misses  Output parameter for the number of misses
+ */
+void libkeccak_cache_stats(const libkeccak_cache_t *restrict cache, uint64_t *restrict hits, uint64_t *restrict misses)
+{
+	size_t i;
+	*hits = *misses = 0;
+	for (i = 0; i < LIBKECCAK_CACHE_STRIPES; i++) {
+		*hits += __atomic_load_n(&cache->counters[i].hits, __ATOMIC_RELAXED);
+		*misses += __atomic_load_n(&cache->counters[i].misses, __ATOMIC_RELAXED);
+	}
+}
@@ -0,0 +1,118 @@
+#ifndef LIBKECCAK_CACHE_H
+#define LIBKECCAK_CACHE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Size of a cache key, a binary uncompressed public key without the 0x04 prefix
+#define LIBKECCAK_CACHE_KEY 64
+
+// Size of a cached value, a binary address
+#define LIBKECCAK_CACHE_VALUE 20
+
+// Number of entries in a set; a key can only be stored in the set its hash selects
+#define LIBKECCAK_CACHE_WAYS 8
+
+// Number of hit and miss counter stripes, a power of 2; each thread counts in one stripe
+#define LIBKECCAK_CACHE_STRIPES 16
+
+// A cached address
+typedef struct libkeccak_cache_entry {
+	char key[LIBKECCAK_CACHE_KEY];     // The public key
+	char value[LIBKECCAK_CACHE_VALUE]; // The address
+	unsigned char referenced;          // The CLOCK reference bit, set by hits
+	unsigned char valid;               // Whether the entry is in use
+} libkeccak_cache_entry_t;
+
+// A group of entries guarded by a sequence lock
+typedef struct libkeccak_cache_set {
+	uint32_t seq;                                          // Odd while a writer modifies the set
+	uint32_t hand;                                         // The CLOCK hand
+	libkeccak_cache_entry_t entries[LIBKECCAK_CACHE_WAYS]; // The entries
+} libkeccak_cache_set_t;
+
+// A shard, its writers serialise on `lock` while readers never block
+typedef struct libkeccak_cache_shard {
+	pthread_mutex_t lock;        // Taken by writers
+	libkeccak_cache_set_t* sets; // The sets of the shard
+} __attribute__((aligned(64))) libkeccak_cache_shard_t;
+
+// A stripe of the hit and miss counters, on a cache line of its own so that lookups never write a shared line
+typedef struct libkeccak_cache_counters {
+	uint64_t hits;   // Number of lookups that found their key
+	uint64_t misses; // Number of lookups that did not
+} __attribute__((aligned(64))) libkeccak_cache_counters_t;
+
+/**
+ * Bounded, sharded public key to address cache
+ *
+ * Lookups are lock-free; each set is a sequence lock, so a reader
+ * only retries if a writer modified the same set meanwhile. When a
+ * set is full the CLOCK algorithm evicts an entry that has not been
+ * hit since the hand last passed it
+ */
+typedef struct libkeccak_cache {
+	libkeccak_cache_shard_t* shards;      // The shards
+	libkeccak_cache_counters_t* counters; // The `LIBKECCAK_CACHE_STRIPES` counter stripes
+	size_t shardmask;                     // The number of shards minus 1
+	size_t setmask;                       // The number of sets per shard minus 1
+	void* storage;                        // The allocation holding the shards, counters and sets
+} libkeccak_cache_t;
+
+/**
+ * Initialise a cache
+ *
+ * @param   cache     The cache that should be initialised
+ * @param   capacity  The number of entries, rounded up to fill every shard with a power of 2 number of sets
+ * @param   shards    The number of shards, rounded up to a power of 2
+ * @return            Zero on success, -1 on error
+ */
+int libkeccak_cache_initialise(libkeccak_cache_t* cache, size_t capacity, size_t shards);
+
+/**
+ * Release the resources of a cache
+ *
+ * @param  cache  The cache that should be destroyed
+ */
+void libkeccak_cache_destroy(libkeccak_cache_t* cache);
+
+/**
+ * Look a public key up
+ *
+ * @param   cache  The cache
+ * @param   key    The public key, `LIBKECCAK_CACHE_KEY` bytes
+ * @param   value  Output parameter for the address, `LIBKECCAK_CACHE_VALUE` bytes
+ * @return         1 on a hit, 0 on a miss
+ */
+int libkeccak_cache_lookup(libkeccak_cache_t* cache, const char* key, char* value);
+
+/**
+ * Store the address of a public key, evicting an entry if its set is full
+ *
+ * @param  cache  The cache
+ * @param  key    The public key, `LIBKECCAK_CACHE_KEY` bytes
+ * @param  value  The address, `LIBKECCAK_CACHE_VALUE` bytes
+ */
+void libkeccak_cache_insert(libkeccak_cache_t* cache, const char* key, const char* value);
+
+/**
+ * Get the address of a public key from the cache, on a miss
+ * hash it with the allocation-free sponge and store it
+ *
+ * @param  cache    The cache
+ * @param  key      The public key, `LIBKECCAK_CACHE_KEY` bytes
+ * @param  address  Output parameter for the address, `LIBKECCAK_CACHE_VALUE` bytes
+ */
+void libkeccak_cache_address(libkeccak_cache_t* cache, const char* key, char* address);
+
+/**
+ * Sum the hit and miss counters of every stripe
+ *
+ * @param  cache   The cache
+ * @param  hits    Output parameter for the number of hits
+ * @param  misses  Output parameter for the number of misses
+ */
+void libkeccak_cache_stats(const libkeccak_cache_t* cache, uint64_t* hits, uint64_t* misses);
+
+#endif
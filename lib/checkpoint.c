@@ -0,0 +1,340 @@
+#include "checkpoint.h"
+#include "keccak-p.h"
+#include "keccak-f.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// Identifies a checkpoint file, and its layout version
+#define LIBKECCAK_CHECKPOINT_MAGIC "KECCAKCP"
+#define LIBKECCAK_CHECKPOINT_VERSION 1
+
+// Size of the fixed fields in front of the lanes
+#define LIBKECCAK_CHECKPOINT_HEADER 48
+
+// Size of the check value closing a checkpoint
+#define LIBKECCAK_CHECKPOINT_CHECK 8
+
+// Bytes of message read at a time
+#define LIBKECCAK_CHECKPOINT_CHUNK ((size_t)1 << 20)
+
+/**
+ * Store an unsigned integer in little-endian order
+ *
+ * @param  p     The buffer
+ * @param  v     The value
+ * @param  size  The number of bytes to store
+ */
+static inline void libkeccak_checkpoint_put(unsigned char *p, uint64_t v, int size)
+{
+	for (; size--; v >>= 8)
+		*p++ = (unsigned char)v;
+}
+
+/**
+ * Load an unsigned little-endian integer
+ *
+ * @param   p     The buffer
+ * @param   size  The number of bytes to load
+ * @return        The value
+ */
+static inline uint64_t libkeccak_checkpoint_get(const unsigned char *p, int size)
+{
+	uint64_t v = 0;
+	while (size--)
+		v = v << 8 | p[size];
+	return v;
+}
+
+/**
+ * Write a whole buffer to a file
+ *
+ * @param   fd   The file descriptor
+ * @param   buf  The buffer
+ * @param   len  The length of the buffer
+ * @return       Zero on success, -1 on error
+ */
+static int libkeccak_checkpoint_write(int fd, const unsigned char *buf, size_t len)
+{
+	ssize_t r;
+	for (; len; buf += r, len -= (size_t)r) {
+		r = write(fd, buf, len);
+		if (r < 0 && errno == EINTR)
+			r = 0;
+		else if (r <= 0)
+			return -1;
+	}
+	return 0;
+}
+
+/**
+ * Read up to `len` bytes, stopping early only at the end of the file
+ *
+ * @param   fd   The file descriptor
+ * @param   buf  The buffer
+ * @param   len  The size of the buffer
+ * @return       The number of bytes read, -1 on error
+ */
+static ssize_t libkeccak_checkpoint_read(int fd, char *buf, size_t len)
+{
+	size_t got = 0;
+	ssize_t r;
+	while (got < len) {
+		r = read(fd, buf + got, len - got);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r < 0)
+			return -1;
+		if (!r)
+			break;
+		got += (size_t)r;
+	}
+	return (ssize_t)got;
+}
+
+/**
+ * Write a checkpoint of a hashing process: the number of message bytes
+ * absorbed so far and the sponge, in a host-independent little-endian
+ * layout closed by a Keccak-256 check value
+ *
+ * The checkpoint is written to a temporary file that is synchronised
+ * and then renamed over `path`, so `path` always holds a complete checkpoint
+ *
+ * @param   path    The checkpoint file
+ * @param   state   The hashing state, between updates
+ * @param   offset  The number of message bytes absorbed into `state`
+ * @return          Zero on success, -1 on error
+ */
+int libkeccak_checkpoint_save(const char *restrict path, const libkeccak_state_t *restrict state, uint64_t offset)
+{
+	size_t len = LIBKECCAK_CHECKPOINT_HEADER + 25 * 8 + state->mptr, pathlen = strlen(path);
+	unsigned char *buf, check[32];
+	char *tmp, *slash;
+	int fd, dir, saved;
+	long i;
+
+	buf = libkeccak_malloc(len + LIBKECCAK_CHECKPOINT_CHECK + pathlen + sizeof(".tmp"));
+	if (!buf)
+		return -1;
+	tmp = (char *)buf + len + LIBKECCAK_CHECKPOINT_CHECK;
+	memcpy(tmp, path, pathlen);
+	memcpy(tmp + pathlen, ".tmp", sizeof(".tmp"));
+
+	memset(buf, 0, LIBKECCAK_CHECKPOINT_HEADER);
+	memcpy(buf, LIBKECCAK_CHECKPOINT_MAGIC, 8);
+	libkeccak_checkpoint_put(buf + 8, LIBKECCAK_CHECKPOINT_VERSION, 4);
+	libkeccak_checkpoint_put(buf + 12, state->mptr, 4);
+	libkeccak_checkpoint_put(buf + 16, (uint64_t)state->r, 4);
+	libkeccak_checkpoint_put(buf + 20, (uint64_t)state->c, 4);
+	libkeccak_checkpoint_put(buf + 24, (uint64_t)state->n, 8);
+	libkeccak_checkpoint_put(buf + 32, offset, 8);
+	for (i = 0; i < 25; i++)
+		libkeccak_store64(buf + LIBKECCAK_CHECKPOINT_HEADER + i * 8, (uint64_t)state->S[i]);
+	memcpy(buf + LIBKECCAK_CHECKPOINT_HEADER + 25 * 8, state->M, state->mptr);
+	libkeccak_keccak256((const char *)buf, len, (char *)check);
+	memcpy(buf + len, check, LIBKECCAK_CHECKPOINT_CHECK);
+	len += LIBKECCAK_CHECKPOINT_CHECK;
+
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0)
+		goto fail;
+	if (libkeccak_checkpoint_write(fd, buf, len) || fsync(fd)) {
+		saved = errno;
+		close(fd);
+		errno = saved;
+		goto fail_unlink;
+	}
+	if (close(fd) || rename(tmp, path))
+		goto fail_unlink;
+
+	/* The rename is only durable once the directory is. */
+	slash = strrchr(tmp, '/');
+	if (slash)
+		slash[slash == tmp] = '\0';
+	dir = open(slash ? tmp : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dir >= 0) {
+		fsync(dir);
+		close(dir);
+	}
+	libkeccak_free(buf);
+	return 0;
+
+fail_unlink:
+	saved = errno;
+	unlink(tmp);
+	errno = saved;
+fail:
+	saved = errno;
+	libkeccak_free(buf);
+	errno = saved;
+	return -1;
+}
+
+/**
+ * Resume a hashing process from a checkpoint
+ *
+ * @param   path    The checkpoint file
+ * @param   state   The state, initialised for the same specifications as the checkpointed one
+ * @param   offset  Output parameter for the number of message bytes absorbed into the checkpoint
+ * @return          Zero on success, -1 on error; `errno` is `EINVAL` if the file is not an
+ *                  intact checkpoint for the specifications of `state`, and `state` is untouched
+ */
+int libkeccak_checkpoint_load(const char *restrict path, libkeccak_state_t *restrict state, uint64_t *restrict offset)
+{
+	unsigned char head[LIBKECCAK_CHECKPOINT_HEADER], check[32];
+	unsigned char *buf = NULL;
+	char *new;
+	ssize_t got;
+	size_t mptr, len;
+	long i;
+	int fd, saved;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	got = libkeccak_checkpoint_read(fd, (char *)head, sizeof(head));
+	if (got < 0)
+		goto fail;
+	mptr = (size_t)libkeccak_checkpoint_get(head + 12, 4);
+	if ((size_t)got < sizeof(head) || memcmp(head, LIBKECCAK_CHECKPOINT_MAGIC, 8) ||
+	    libkeccak_checkpoint_get(head + 8, 4) != LIBKECCAK_CHECKPOINT_VERSION ||
+	    libkeccak_checkpoint_get(head + 16, 4) != (uint64_t)state->r ||
+	    libkeccak_checkpoint_get(head + 20, 4) != (uint64_t)state->c ||
+	    libkeccak_checkpoint_get(head + 24, 8) != (uint64_t)state->n ||
+	    mptr >= (size_t)((state->r * state->b) >> 3))
+		goto invalid;
+
+	/* One byte more than a checkpoint can hold, to tell a trailing mess from the end of the file. */
+	len = LIBKECCAK_CHECKPOINT_HEADER + 25 * 8 + mptr;
+	buf = libkeccak_malloc(len + LIBKECCAK_CHECKPOINT_CHECK + 1);
+	if (!buf)
+		goto fail;
+	memcpy(buf, head, sizeof(head));
+	got = libkeccak_checkpoint_read(fd, (char *)buf + sizeof(head), len + LIBKECCAK_CHECKPOINT_CHECK + 1 - sizeof(head));
+	if (got < 0)
+		goto fail;
+	if ((size_t)got != len + LIBKECCAK_CHECKPOINT_CHECK - sizeof(head))
+		goto invalid;
+	libkeccak_keccak256((const char *)buf, len, (char *)check);
+	if (memcmp(buf + len, check, LIBKECCAK_CHECKPOINT_CHECK))
+		goto invalid;
+
+	if (mptr > state->mlen) {
+		new = libkeccak_realloc(state->M, state->mlen, mptr);
+		if (!new)
+			goto fail;
+		state->M = new;
+		state->mlen = mptr;
+	}
+	for (i = 0; i < 25; i++)
+		state->S[i] = (int64_t)libkeccak_load64(buf + LIBKECCAK_CHECKPOINT_HEADER + i * 8);
+	memcpy(state->M, buf + LIBKECCAK_CHECKPOINT_HEADER + 25 * 8, mptr);
+	state->mptr = mptr;
+	*offset = libkeccak_checkpoint_get(head + 32, 8);
+	libkeccak_free(buf);
+	close(fd);
+	return 0;
+
+invalid:
+	errno = EINVAL;
+fail:
+	saved = errno;
+	libkeccak_free(buf);
+	close(fd);
+	errno = saved;
+	return -1;
+}
+
+/**
+ * Hash everything that is left of a file or stream, writing a checkpoint
+ * every `interval` bytes and resuming from the checkpoint if it exists
+ *
+ * On resume a seekable file is read from the checkpointed offset, anything
+ * else has the bytes before it read and discarded. The checkpoint is
+ * removed once the hashsum is complete
+ *
+ * @param   fd          The file descriptor, positioned at the start of the message
+ * @param   spec        The specifications for the hashing
+ * @param   suffix      The suffix concatenate to the message, only '1':s and '0':s, and NUL-termination
+ * @param   checkpoint  The checkpoint file, `NULL` to hash without checkpoints
+ * @param   interval    The number of message bytes between two checkpoints, 0 for `LIBKECCAK_CHECKPOINT_INTERVAL`
+ * @param   hashsum     Output parameter for the hashsum, `(spec->output + 7) / 8` bytes
+ * @return              Zero on success, -1 on error
+ */
+int libkeccak_checkpoint_hash_fd(int fd, const libkeccak_spec_t *restrict spec, const char *restrict suffix,
+                                 const char *restrict checkpoint, size_t interval, char *restrict hashsum)
+{
+	libkeccak_state_t state;
+	uint64_t offset = 0, skip, next;
+	char *chunk = NULL;
+	ssize_t got;
+	size_t n, unit;
+	int saved;
+
+	if (libkeccak_state_initialise(&state, spec) < 0)
+		return -1;
+
+	/* `libkeccak_fast_update` absorbs whole multiples of `r * b / 8` bytes, so
+	 * with the interval rounded to one the checkpoints buffer no message. */
+	unit = (size_t)((state.r * state.b) >> 3);
+	interval = interval ? interval : LIBKECCAK_CHECKPOINT_INTERVAL;
+	interval = (interval + unit - 1) / unit * unit;
+	chunk = libkeccak_malloc(LIBKECCAK_CHECKPOINT_CHUNK);
+	if (!chunk)
+		goto fail;
+
+	/* A missing or damaged checkpoint means starting from the beginning. */
+	if (checkpoint && libkeccak_checkpoint_load(checkpoint, &state, &offset))
+		offset = 0;
+	if (offset && lseek(fd, (off_t)offset, SEEK_CUR) < 0) {
+		if (errno != ESPIPE)
+			goto fail;
+		for (skip = offset; skip; skip -= (uint64_t)got) {
+			n = skip < LIBKECCAK_CHECKPOINT_CHUNK ? (size_t)skip : LIBKECCAK_CHECKPOINT_CHUNK;
+			got = libkeccak_checkpoint_read(fd, chunk, n);
+			if (got < 0)
+				goto fail;
+			if (!got) {
+				errno = EINVAL;
+				goto fail;
+			}
+		}
+	}
+
+	/* Checkpoints fall on multiples of the interval, so a resumed run keeps the same rhythm. */
+	next = (offset / interval + 1) * interval;
+	for (;;) {
+		n = next - offset < LIBKECCAK_CHECKPOINT_CHUNK ? (size_t)(next - offset) : LIBKECCAK_CHECKPOINT_CHUNK;
+		got = libkeccak_checkpoint_read(fd, chunk, n);
+		if (got < 0)
+			goto fail;
+		if (!got)
+			break;
+		if (libkeccak_fast_update(&state, chunk, (size_t)got) < 0)
+			goto fail;
+		offset += (uint64_t)got;
+		if (offset == next) {
+			if (checkpoint && libkeccak_checkpoint_save(checkpoint, &state, offset))
+				goto fail;
+			next += interval;
+		}
+	}
+
+	if (libkeccak_fast_digest(&state, NULL, 0, 0, suffix, hashsum) < 0)
+		goto fail;
+	if (checkpoint)
+		unlink(checkpoint);
+	libkeccak_free(chunk);
+	libkeccak_state_fast_destroy(&state);
+	return 0;
+
+fail:
+	saved = errno;
+	libkeccak_free(chunk);
+	libkeccak_state_fast_destroy(&state);
+	errno = saved;
+	return -1;
+}
@@ -0,0 +1,58 @@
+#ifndef LIBKECCAK_CHECKPOINT_H
+#define LIBKECCAK_CHECKPOINT_H
+
+#include "digest.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Default distance between two checkpoints, in bytes of message
+#define LIBKECCAK_CHECKPOINT_INTERVAL ((size_t)256 << 20)
+
+/**
+ * Write a checkpoint of a hashing process: the number of message bytes
+ * absorbed so far and the sponge, in a host-independent little-endian
+ * layout closed by a Keccak-256 check value
+ *
+ * The checkpoint is written to a temporary file that is synchronised
+ * and then renamed over `path`, so `path` always holds a complete checkpoint
+ *
+ * @param   path    The checkpoint file
+ * @param   state   The hashing state, between updates
+ * @param   offset  The number of message bytes absorbed into `state`
+ * @return          Zero on success, -1 on error
+ */
+int libkeccak_checkpoint_save(const char* path, const libkeccak_state_t* state, uint64_t offset);
+
+/**
+ * Resume a hashing process from a checkpoint
+ *
+ * @param   path    The checkpoint file
+ * @param   state   The state, initialised for the same specifications as the checkpointed one
+ * @param   offset  Output parameter for the number of message bytes absorbed into the checkpoint
+ * @return          Zero on success, -1 on error; `errno` is `EINVAL` if the file is not an
+ *                  intact checkpoint for the specifications of `state`, and `state` is untouched
+ */
+int libkeccak_checkpoint_load(const char* path, libkeccak_state_t* state, uint64_t* offset);
+
+/**
+ * Hash everything that is left of a file or stream, writing a checkpoint
+ * every `interval` bytes and resuming from the checkpoint if it exists
+ *
+ * On resume a seekable file is read from the checkpointed offset, anything
+ * else has the bytes before it read and discarded. The checkpoint is
+ * removed once the hashsum is complete
+ *
+ * @param   fd          The file descriptor, positioned at the start of the message
+ * @param   spec        The specifications for the hashing
+ * @param   suffix      The suffix concatenate to the message, only '1':s and '0':s, and NUL-termination
+ * @param   checkpoint  The checkpoint file, `NULL` to hash without checkpoints
+ * @param   interval    The number of message bytes between two checkpoints, 0 for `LIBKECCAK_CHECKPOINT_INTERVAL`,
+ *                      rounded up to a multiple of `spec->bitrate * (spec->bitrate + spec->capacity) / 8`
+ * @param   hashsum     Output parameter for the hashsum, `(spec->output + 7) / 8` bytes
+ * @return              Zero on success, -1 on error
+ */
+int libkeccak_checkpoint_hash_fd(int fd, const libkeccak_spec_t* spec, const char* suffix,
+                                 const char* checkpoint, size_t interval, char* hashsum);
+
+#endif
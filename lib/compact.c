@@ -0,0 +1,91 @@
+#include "compact.h"
+#include "keccak-f.h"
+
+/**
+ * Initialise a compact state
+ *
+ * @param   state  The state that should be initialised
+ * @param   rate   The bitrate in bytes, a multiple of 8 no greater than `LIBKECCAK_COMPACT_MAX_RATE`
+ * @param   pad    The domain suffix bits followed by the first bit of pad10*1, e.g. `LIBKECCAK_KECCAK_PAD`
+ * @return         Zero on success, -1 on error
+ */
+int libkeccak_compact_initialise(libkeccak_compact_t *restrict state, long rate, unsigned char pad)
+{
+	if (rate <= 0 || rate > LIBKECCAK_COMPACT_MAX_RATE || rate % 8 || !pad)
+		return -1;
+	memset(state->S, 0, sizeof(state->S));
+	state->mptr = 0;
+	state->rate = (uint8_t)rate;
+	state->pad = pad;
+	state->squeezing = 0;
+	return 0;
+}
+
+/**
+ * Absorb more of the message to the sponge
+ *
+ * @param  state   The hashing state, must not be squeezing
+ * @param  msg     The partial message
+ * @param  msglen  The length of the partial message
+ */
+void libkeccak_compact_update(libkeccak_compact_t *restrict state, const char *restrict msg, size_t msglen)
+{
+	size_t rate = state->rate;
+	size_t n;
+
+	if (state->mptr) {
+		n = rate - state->mptr < msglen ? rate - state->mptr : msglen;
+		memcpy(state->M + state->mptr, msg, n);
+		state->mptr = (uint8_t)(state->mptr + n), msg += n, msglen -= n;
+		if (state->mptr < rate)
+			return;
+		libkeccak_sponge_absorb_block(state->S, state->M, (long)rate);
+		libkeccak_p1600(state->S, 24);
+		state->mptr = 0;
+	}
+
+	/* Whole blocks are absorbed straight from the message, only the tail is copied. */
+	for (; msglen >= rate; msg += rate, msglen -= rate) {
+		libkeccak_sponge_absorb_block(state->S, (const unsigned char *)msg, (long)rate);
+		libkeccak_p1600(state->S, 24);
+	}
+
+	memcpy(state->M, msg, msglen);
+	state->mptr = (uint8_t)msglen;
+}
+
+/**
+ * Squeeze output from the sponge, padding the message on the first call;
+ * consecutive calls continue the output stream
+ *
+ * @param  state    The hashing state
+ * @param  hashsum  Output parameter for the output
+ * @param  outlen   The number of bytes to squeeze
+ */
+void libkeccak_compact_squeeze(libkeccak_compact_t *restrict state, char *restrict hashsum, size_t outlen)
+{
+	size_t rate = state->rate;
+	size_t n;
+	long i;
+
+	if (!state->squeezing) {
+		memset(state->M + state->mptr, 0, rate - state->mptr);
+		state->M[state->mptr] ^= state->pad;
+		state->M[rate - 1] ^= 0x80;
+		libkeccak_sponge_absorb_block(state->S, state->M, (long)rate);
+		state->squeezing = 1;
+		state->mptr = (uint8_t)rate;
+	}
+
+	while (outlen) {
+		if (state->mptr == rate) {
+			libkeccak_p1600(state->S, 24);
+			for (i = 0; i < (long)(rate >> 3); i++)
+				libkeccak_store64(state->M + (i << 3), (uint64_t)state->S[LANE_TRANSPOSE_MAP[i]]);
+			state->mptr = 0;
+		}
+		n = rate - state->mptr < outlen ? rate - state->mptr : outlen;
+		memcpy(hashsum, state->M + state->mptr, n);
+		state->mptr = (uint8_t)(state->mptr + n), hashsum += n, outlen -= n;
+	}
+}
@@ -0,0 +1,83 @@
+#ifndef LIBKECCAK_COMPACT_H
+#define LIBKECCAK_COMPACT_H
+
+#include "keccak-p.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest bitrate, in bytes, a compact state supports, that of SHAKE128
+#define LIBKECCAK_COMPACT_MAX_RATE 168
+
+/**
+ * Fixed-specification Keccak-f[1600] state for incremental hashing,
+ * 384 bytes and one cache-line aligned allocation, it owns no heap memory
+ *
+ * Unlike `libkeccak_state_t` it only buffers the partial block, so
+ * millions of them can be kept open at once, one per connection or document
+ */
+typedef struct libkeccak_compact {
+	int64_t S[25];                                // The lanes (state/sponge)
+	unsigned char M[LIBKECCAK_COMPACT_MAX_RATE];  // The partial block not yet absorbed, or the block being squeezed
+	uint8_t mptr;                                 // Number of bytes used in `M`
+	uint8_t rate;                                 // The bitrate in bytes
+	uint8_t pad;                                  // The domain suffix bits followed by the first bit of pad10*1
+	uint8_t squeezing;                            // Whether the message has been padded and the sponge is being squeezed
+} __attribute__((aligned(64))) libkeccak_compact_t;
+
+/**
+ * Initialise a compact state
+ *
+ * @param   state  The state that should be initialised
+ * @param   rate   The bitrate in bytes, a multiple of 8 no greater than `LIBKECCAK_COMPACT_MAX_RATE`
+ * @param   pad    The domain suffix bits followed by the first bit of pad10*1, e.g. `LIBKECCAK_KECCAK_PAD`
+ * @return         Zero on success, -1 on error
+ */
+int libkeccak_compact_initialise(libkeccak_compact_t* state, long rate, unsigned char pad);
+
+/**
+ * Absorb more of the message to the sponge
+ *
+ * @param  state   The hashing state, must not be squeezing
+ * @param  msg     The partial message
+ * @param  msglen  The length of the partial message
+ */
+void libkeccak_compact_update(libkeccak_compact_t* state, const char* msg, size_t msglen);
+
+/**
+ * Squeeze output from the sponge, padding the message on the first call;
+ * consecutive calls continue the output stream
+ *
+ * @param  state    The hashing state
+ * @param  hashsum  Output parameter for the output
+ * @param  outlen   The number of bytes to squeeze
+ */
+void libkeccak_compact_squeeze(libkeccak_compact_t* state, char* hashsum, size_t outlen);
+
+/**
+ * Initialise a compact state for Keccak-256, as used by Ethereum
+ *
+ * @param  state  The state that should be initialised
+ */
+static inline void libkeccak_compact_keccak256_initialise(libkeccak_compact_t* state)
+{
+	libkeccak_compact_initialise(state, LIBKECCAK_KECCAK256_RATE, LIBKECCAK_KECCAK_PAD);
+}
+
+/**
+ * Absorb the last part of the message and squeeze the hashsum
+ *
+ * @param  state    The hashing state, must not be squeezing
+ * @param  msg      The rest of the message, may be `NULL`
+ * @param  msglen   The length of the rest of the message
+ * @param  hashsum  Output parameter for the hashsum
+ * @param  outlen   The number of bytes to squeeze
+ */
+static inline void libkeccak_compact_digest(libkeccak_compact_t* state, const char* msg, size_t msglen,
+                                            char* hashsum, size_t outlen)
+{
+	if (msglen)
+		libkeccak_compact_update(state, msg, msglen);
+	libkeccak_compact_squeeze(state, hashsum, outlen);
+}
+
+#endif
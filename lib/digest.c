@@ -1,4 +1,7 @@
 #include "digest.h"
+#include "keccak-f.h"
+#include "keccak-p.h"
+#include "metrics.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -30,8 +33,10 @@ int libkeccak_state_initialise(libkeccak_state_t *restrict state, const libkecca
 		state->S[x] = 0;
 	state->mptr = 0;
 	state->mlen = (size_t)(state->r * state->b) >> 2;
-	state->M = malloc(state->mlen * sizeof(char));
-	return state->M == NULL ? -1 : 0;
+	state->M = libkeccak_malloc(state->mlen * sizeof(char));
+	if (state->M == NULL)
+		return LIBKECCAK_COUNT(LIBKECCAK_ERRORS, 1), -1;
+	return 0;
 }
 
 /**
@@ -77,7 +82,7 @@ void libkeccak_state_wipe(volatile libkeccak_state_t *restrict state){
  */
 int libkeccak_state_copy(libkeccak_state_t *restrict dest, const libkeccak_state_t *restrict src){
 	memcpy(dest, src, sizeof(libkeccak_state_t));
-	dest->M = malloc(src->mlen * sizeof(char));
+	dest->M = libkeccak_malloc(src->mlen * sizeof(char));
 	if (!dest->M)
 		return -1;
 	memcpy(dest->M, src->M, src->mptr * sizeof(char));
@@ -132,7 +137,7 @@ size_t libkeccak_state_unmarshal(libkeccak_state_t *restrict state, const char *
 	data += sizeof(state->S) / sizeof(char);
 	get(size_t, mptr);
 	get(size_t, mlen);
-	state->M = malloc(state->mptr * sizeof(char));
+	state->M = libkeccak_malloc(state->mlen * sizeof(char));
 	if (!state->M)
 		return 0;
 	memcpy(state->M, data, state->mptr * sizeof(char));
@@ -159,47 +164,6 @@ size_t libkeccak_state_unmarshal_skip(const char *restrict data){
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-/**
- * X-macro-enabled listing of all intergers in [0, 4]
- */
-#define LIST_5 X(0) X(1) X(2) X(3) X(4)
-
-/**
- * X-macro-enabled listing of all intergers in [0, 7]
- */
-#define LIST_8 LIST_5 X(5) X(6) X(7)
-
-/**
- * X-macro-enabled listing of all intergers in [0, 23]
- */
-#define LIST_24 LIST_8 X(8) X(9) X(10) X(11) X(12) X(13) X(14) X(15)\
-                X(16) X(17) X(18) X(19) X(20) X(21) X(22) X(23)
-
-/**
- * X-macro-enabled listing of all intergers in [0, 24]
- */
-#define LIST_25 LIST_24 X(24)
-
-#define X(N) (N % 5) * 5 + N / 5,
-/**
- * The order the lanes should be read when absorbing or squeezing,
- * it transposes the lanes in the sponge
- */
-static const long LANE_TRANSPOSE_MAP[] = { LIST_25 };
-#undef X
-
-/**
- * Keccak-f round constants
- */
-static const uint_fast64_t RC[] = {
-	0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808AULL, 0x8000000080008000ULL,
-	0x000000000000808BULL, 0x0000000080000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
-	0x000000000000008AULL, 0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000AULL,
-	0x000000008000808BULL, 0x800000000000008BULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
-	0x8000000000008002ULL, 0x8000000000000080ULL, 0x000000000000800AULL, 0x800000008000000AULL,
-	0x8000000080008081ULL, 0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL
-};
-
 /**
  * Rotate a word
  *
@@ -211,15 +175,6 @@ static const uint_fast64_t RC[] = {
  */
 #define rotate(x, n, w, wmod) ((((x) >> ((w) - ((n) % (w)))) | ((x) << ((n) % (w)))) & (wmod))
 
-/**
- * Rotate a 64-bit word
- *
- * @param   x:int_fast64_t  The value to rotate
- * @param   n:long          Rotation steps, may not be zero
- * @return   :int_fast64_t  The value rotated
- */
-#define rotate64(x, n) ((int_fast64_t)(((uint64_t)(x) >> (64L - (n))) | ((uint64_t)(x) << (n))))
-
 /**
  * Perform one round of computation
  *
@@ -273,43 +228,31 @@ static void libkeccak_f_round(register libkeccak_state_t *restrict state, regist
  */
 static void libkeccak_f_round64(register libkeccak_state_t *restrict state, register int_fast64_t rc)
 {
-	int_fast64_t *restrict A = state->S;
-	int_fast64_t B[25];
-	int_fast64_t C[5];
-	int_fast64_t da, db, dc, dd, de;
-
-	/* θ step (step 1 of 3). */
-#define X(N) C[N] = A[N * 5] ^ A[N * 5 + 1] ^ A[N * 5 + 2] ^ A[N * 5 + 3] ^ A[N * 5 + 4];
-	LIST_5;
-#undef X
-
-	/* θ step (step 2 of 3). */
-	da = C[4] ^ rotate64(C[1], 1);
-	dd = C[2] ^ rotate64(C[4], 1);
-	db = C[0] ^ rotate64(C[2], 1);
-	de = C[3] ^ rotate64(C[0], 1);
-	dc = C[1] ^ rotate64(C[3], 1);
-
-	/* ρ and π steps, with last two part of θ. */
-#define X(bi, ai, dv, r) B[bi] = rotate64(A[ai] ^ dv, r)
-	B[0] = A[0] ^ da;   X( 1, 15, dd, 28);  X( 2,  5, db,  1);  X( 3, 20, de, 27);  X( 4, 10, dc, 62);
-	X( 5,  6, db, 44);  X( 6, 21, de, 20);  X( 7, 11, dc,  6);  X( 8,  1, da, 36);  X( 9, 16, dd, 55);
-	X(10, 12, dc, 43);  X(11,  2, da,  3);  X(12, 17, dd, 25);  X(13,  7, db, 10);  X(14, 22, de, 39);
-	X(15, 18, dd, 21);  X(16,  8, db, 45);  X(17, 23, de,  8);  X(18, 13, dc, 15);  X(19,  3, da, 41);
-	X(20, 24, de, 14);  X(21, 14, dc, 61);  X(22,  4, da, 18);  X(23, 19, dd, 56);  X(24,  9, db,  2);
-#undef X
-
-	/* ξ step. */
-#define X(N) A[N] = B[N] ^ ((~(B[(N + 5) % 25])) & B[(N + 10) % 25]);
-	LIST_25;
-#undef X
-
-	/* ι step. */
-	A[0] ^= rc;
+	libkeccak_f1600_round(state->S, rc);
 }
 
 /**
- * Convert a chunk of bytes to a lane
+ * Narrow word version of `libkeccak_f`, the lanes are copied into native
+ * `T` words and permuted by `libkeccak_p<b>`, which has the ρ offsets
+ * reduced modulo the word size at compile time
+ *
+ * @param  T      The word type
+ * @param  P      The permutation, `libkeccak_p800`, `libkeccak_p400` or `libkeccak_p200`
+ * @param  state  The hashing state
+ */
+#define LIBKECCAK_F_NARROW(T, P, state)\
+	do {\
+		T A[25];\
+		long j;\
+		for (j = 0; j < 25; j++)\
+			A[j] = (T)(state)->S[j];\
+		P(A, (state)->nr);\
+		for (j = 0; j < 25; j++)\
+			(state)->S[j] = (int_fast64_t)A[j];\
+	} while (0)
+
+/**
+ * Apply the permutation to the sponge
  *
  * @param  state  The hashing state
  */
@@ -318,12 +261,26 @@ static inline void libkeccak_f(register libkeccak_state_t *restrict state)
 	register long i = 0;
 	register long nr = state->nr;
 	register long wmod = state->wmod;
-	if (nr == 24) {
+	switch (state->w) {
+	case 64:
+		LIBKECCAK_COUNT(LIBKECCAK_PERMUTATIONS, 1);
 		for (; i < nr; i++)
 			libkeccak_f_round64(state, (int_fast64_t)(RC[i]));
-	} else {
+		break;
+	case 32:
+		LIBKECCAK_F_NARROW(uint32_t, libkeccak_p800, state);
+		break;
+	case 16:
+		LIBKECCAK_F_NARROW(uint16_t, libkeccak_p400, state);
+		break;
+	case 8:
+		LIBKECCAK_F_NARROW(uint8_t, libkeccak_p200, state);
+		break;
+	default:
+		LIBKECCAK_COUNT(LIBKECCAK_PERMUTATIONS, 1);
 		for (; i < nr; i++)
 			libkeccak_f_round(state, (int_fast64_t)(RC[i] & wmod));
+		break;
 	}
 }
 
@@ -413,6 +370,7 @@ static void libkeccak_absorption_phase(register libkeccak_state_t *restrict stat
 	register long ww = state->w >> 3;
 	register long n = (long)len / rr;
 	register const char* restrict message = state->M;
+	register long i;
 	if (__builtin_expect(ww >= 8, 1)) { /* ww > 8 is impossible, it is just for optimisation possibilities. */
 		while (n--) {
 #define X(N) state->S[N] ^= libkeccak_to_lane64(message, len, rr, (size_t)(LANE_TRANSPOSE_MAP[N] * 8));
@@ -422,6 +380,19 @@ static void libkeccak_absorption_phase(register libkeccak_state_t *restrict stat
 			message += (size_t)rr;
 			len -= (size_t)rr;
 		}
+	} else if (!(rr % ww)) {
+		/* The bitrate is whole words, so they can be loaded at their native width. */
+#define X(LOAD)\
+		while (n--) {\
+			for (i = 0; i < rr / ww; i++)\
+				state->S[LANE_TRANSPOSE_MAP[i]] ^= (int_fast64_t)LOAD((const unsigned char *)message + i * ww);\
+			libkeccak_f(state);\
+			message += (size_t)rr;\
+		}
+		if (ww == 4)       X(libkeccak_load32)
+		else if (ww == 2)  X(libkeccak_load16)
+		else               X(libkeccak_load8)
+#undef X
 	} else {
 		while (n--) {
 #define X(N) state->S[N] ^= libkeccak_to_lane(message, len, rr, ww, (size_t)(LANE_TRANSPOSE_MAP[N] * ww));
@@ -478,11 +449,13 @@ int libkeccak_fast_update(libkeccak_state_t *restrict state, const char *restric
 	size_t len;
 	auto char *restrict new;
 
+	LIBKECCAK_COUNT(LIBKECCAK_CALLS, 1);
+	LIBKECCAK_COUNT(LIBKECCAK_BYTES, msglen);
 	if (__builtin_expect(state->mptr + msglen > state->mlen, 0)) {
 		state->mlen += msglen;
-		new = realloc(state->M, state->mlen * sizeof(char));
+		new = libkeccak_realloc(state->M, (state->mlen - msglen) * sizeof(char), state->mlen * sizeof(char));
 		if (!new)
-			return state->mlen -= msglen, -1;
+			return state->mlen -= msglen, LIBKECCAK_COUNT(LIBKECCAK_ERRORS, 1), -1;
 		state->M = new;
 	}
 
@@ -512,13 +485,15 @@ int libkeccak_update(libkeccak_state_t *restrict state, const char *restrict msg
 	size_t len;
 	auto char *restrict new;
 
+	LIBKECCAK_COUNT(LIBKECCAK_CALLS, 1);
+	LIBKECCAK_COUNT(LIBKECCAK_BYTES, msglen);
 	if (__builtin_expect(state->mptr + msglen > state->mlen, 0)) {
 		state->mlen += msglen;
-		new = malloc(state->mlen * sizeof(char));
+		new = libkeccak_malloc(state->mlen * sizeof(char));
 		if (new == NULL)
-			return state->mlen -= msglen, -1;
+			return state->mlen -= msglen, LIBKECCAK_COUNT(LIBKECCAK_ERRORS, 1), -1;
 		libkeccak_state_wipe_message(state);
-		free(state->M);
+		libkeccak_free(state->M);
 		state->M = new;
 	}
 
@@ -560,12 +535,14 @@ int libkeccak_fast_digest(libkeccak_state_t *restrict state, const char *restric
 	else
 		msglen += bits >> 3, bits &= 7;
 
+	LIBKECCAK_COUNT(LIBKECCAK_CALLS, 1);
+	LIBKECCAK_COUNT(LIBKECCAK_BYTES, msglen);
 	ext = msglen + ((bits + suffix_len + 7) >> 3) + (size_t)rr;
 	if (__builtin_expect(state->mptr + ext > state->mlen, 0)) {
 		state->mlen += ext;
-		new = realloc(state->M, state->mlen * sizeof(char));
+		new = libkeccak_realloc(state->M, (state->mlen - ext) * sizeof(char), state->mlen * sizeof(char));
 		if (!new)
-			return state->mlen -= ext, -1;
+			return state->mlen -= ext, LIBKECCAK_COUNT(LIBKECCAK_ERRORS, 1), -1;
 		state->M = new;
 	}
 
@@ -626,14 +603,16 @@ int libkeccak_digest(libkeccak_state_t *restrict state, const char *restrict msg
 	else
 		msglen += bits >> 3, bits &= 7;
 
+	LIBKECCAK_COUNT(LIBKECCAK_CALLS, 1);
+	LIBKECCAK_COUNT(LIBKECCAK_BYTES, msglen);
 	ext = msglen + ((bits + suffix_len + 7) >> 3) + (size_t)rr;
 	if (__builtin_expect(state->mptr + ext > state->mlen, 0)) {
 		state->mlen += ext;
-		new = malloc(state->mlen * sizeof(char));
+		new = libkeccak_malloc(state->mlen * sizeof(char));
 		if (!new)
-			return state->mlen -= ext, -1;
+			return state->mlen -= ext, LIBKECCAK_COUNT(LIBKECCAK_ERRORS, 1), -1;
 		libkeccak_state_wipe_message(state);
-		free(state->M);
+		libkeccak_free(state->M);
 		state->M = new;
 	}
 
@@ -707,3 +686,39 @@ libkeccak_squeeze(register libkeccak_state_t *restrict state, register char* res
 	libkeccak_f(state);
 	libkeccak_squeezing_phase(state, state->r >> 3, (state->n + 7) >> 3, state->w >> 3, hashsum);
 }
+
+/**
+ * Copy a byte range of the current output block, without squeezing the
+ * rest of the digest; use after `libkeccak_digest` or `libkeccak_fast_digest`
+ * with `hashsum` set to `NULL`, or after `libkeccak_simple_squeeze`
+ *
+ * @param   state    The hashing state, with a word size of 64
+ * @param   hashsum  Output parameter for the range, `len` bytes
+ * @param   offset   The first byte of the range
+ * @param   len      The length of the range
+ * @return           Zero on success, -1 if the range does not fit in the output block
+ */
+int libkeccak_squeeze_range(const libkeccak_state_t *restrict state, char *restrict hashsum, size_t offset, size_t len)
+{
+	register size_t rr = (size_t)(state->r >> 3);
+	if (state->w != 64 || offset > rr || len > rr - offset)
+		return -1;
+	libkeccak_sponge_extract(hashsum, state->S, offset, len);
+	return 0;
+}
+
+/**
+ * Convert a binary hashsum to lower case hexadecimal representation
+ *
+ * @param  output   Output array, should have an allocation size of at least `2 * n + 1`
+ * @param  hashsum  The hashsum to convert
+ * @param  n        The size of `hashsum`
+ */
+void libkeccak_behex_lower(char *restrict output, const char *restrict hashsum, size_t n)
+{
+	output[2 * n] = '\0';
+	while (n--) {
+		output[2 * n + 0] = "0123456789abcdef"[(hashsum[n] >> 4) & 15];
+		output[2 * n + 1] = "0123456789abcdef"[(hashsum[n] >> 0) & 15];
+	}
+}
@@ -8,6 +8,7 @@
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #include "spec.h"
+#include "alloc.h"
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -61,7 +62,7 @@ libkeccak_state_fast_destroy(libkeccak_state_t* state)
 {
   if (state == NULL)
     return;
-  free(state->M);
+  libkeccak_free(state->M);
   state->M = NULL;
 }
 
@@ -97,7 +98,7 @@ libkeccak_state_destroy(volatile libkeccak_state_t* state)
   if (!state)
     return;
   libkeccak_state_wipe(state);
-  free(state->M);
+  libkeccak_free(state->M);
   state->M = NULL;
 }
 
@@ -110,9 +111,9 @@ libkeccak_state_destroy(volatile libkeccak_state_t* state)
 static inline libkeccak_state_t *
 libkeccak_state_create(const libkeccak_spec_t* spec)
 {
-  libkeccak_state_t* state = (libkeccak_state_t*)malloc(sizeof(libkeccak_state_t));
+  libkeccak_state_t* state = (libkeccak_state_t*)libkeccak_malloc(sizeof(libkeccak_state_t));
   if (!state || libkeccak_state_initialise(state, spec))
-    return (libkeccak_state_t*)(free(state), NULL);
+    return (libkeccak_state_t*)(libkeccak_free(state), NULL);
   return state;
 }
 
@@ -125,7 +126,7 @@ static inline void
 libkeccak_state_fast_free(libkeccak_state_t* state)
 {
   libkeccak_state_fast_destroy(state);
-  free(state);
+  libkeccak_free(state);
 }
 
 /**
@@ -141,7 +142,7 @@ libkeccak_state_free(volatile libkeccak_state_t* state)
 # pragma GCC diagnostic ignored "-Wcast-qual"
 #endif
   libkeccak_state_destroy(state);
-  free((libkeccak_state_t *)state);
+  libkeccak_free((libkeccak_state_t *)state);
 #ifdef __GNUC__
 # pragma GCC diagnostic pop
 #endif
@@ -165,7 +166,7 @@ int libkeccak_state_copy(libkeccak_state_t* dest, const libkeccak_state_t* src);
 static inline libkeccak_state_t *
 libkeccak_state_duplicate(const libkeccak_state_t* src)
 {
-  libkeccak_state_t* dest = (libkeccak_state_t*)malloc(sizeof(libkeccak_state_t));
+  libkeccak_state_t* dest = (libkeccak_state_t*)libkeccak_malloc(sizeof(libkeccak_state_t));
   if (!dest || libkeccak_state_copy(dest, src))
     return (libkeccak_state_t*)(libkeccak_state_free(dest), NULL);
   return dest;
@@ -293,4 +294,26 @@ void libkeccak_fast_squeeze(register libkeccak_state_t* state, register long tim
  */
 void libkeccak_squeeze(register libkeccak_state_t* state, register char* hashsum);
 
+/**
+ * Copy a byte range of the current output block, without squeezing the
+ * rest of the digest; use after `libkeccak_digest` or `libkeccak_fast_digest`
+ * with `hashsum` set to `NULL`, or after `libkeccak_simple_squeeze`
+ *
+ * @param   state    The hashing state, with a word size of 64
+ * @param   hashsum  Output parameter for the range, `len` bytes
+ * @param   offset   The first byte of the range
+ * @param   len      The length of the range
+ * @return           Zero on success, -1 if the range does not fit in the output block
+ */
+int libkeccak_squeeze_range(const libkeccak_state_t* state, char* hashsum, size_t offset, size_t len);
+
+/**
+ * Convert a binary hashsum to lower case hexadecimal representation
+ *
+ * @param  output   Output array, should have an allocation size of at least `2 * n + 1`
+ * @param  hashsum  The hashsum to convert
+ * @param  n        The size of `hashsum`
+ */
+void libkeccak_behex_lower(char* output, const char* hashsum, size_t n);
+
 #endif
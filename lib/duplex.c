@@ -0,0 +1,59 @@
+#include "duplex.h"
+#include "keccak-f.h"
+
+/**
+ * Initialise a duplex object
+ *
+ * @param   duplex  The duplex object that should be initialised
+ * @param   rate    The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param   nr      The number of rounds, 24 for Keccak-f[1600], 12 for Keccak-p[1600, 12]
+ * @param   pad     The domain suffix bits followed by the first bit of pad10*1, e.g. `LIBKECCAK_KECCAK_PAD`
+ * @return          Zero on success, -1 on error
+ */
+int libkeccak_duplex_initialise(libkeccak_duplex_t *restrict duplex, long rate, long nr, unsigned char pad)
+{
+	if (rate <= 0 || rate > 192 || rate % 8 || nr < 1 || nr > 24 || !pad)
+		return -1;
+	memset(duplex->S, 0, sizeof(duplex->S));
+	duplex->rate = rate;
+	duplex->nr = nr;
+	duplex->pad = pad;
+	return 0;
+}
+
+/**
+ * Absorb one padded input block, apply one permutation and squeeze output
+ *
+ * @param   duplex  The duplex object
+ * @param   in      The input, may be `NULL` if `inlen` is zero
+ * @param   inlen   The length of the input, less than the bitrate, so the padding fits
+ * @param   out     Output parameter for the output, may be `NULL` if `outlen` is zero
+ * @param   outlen  The number of bytes to squeeze, no greater than the bitrate
+ * @return          Zero on success, -1 on error
+ */
+int libkeccak_duplex(libkeccak_duplex_t *restrict duplex, const char *restrict in, size_t inlen,
+                     char *restrict out, size_t outlen)
+{
+	const unsigned char *p = (const unsigned char *)in;
+	unsigned char lane[8] = { 0 };
+	register size_t i;
+
+	if (inlen >= (size_t)duplex->rate || outlen > (size_t)duplex->rate)
+		return -1;
+
+	/* XOR whole words of input, then the last partial word, then the padding, straight into the lanes. */
+	for (i = 0; i < inlen >> 3; i++)
+		duplex->S[LANE_TRANSPOSE_MAP[i]] ^= (int64_t)libkeccak_load64(p + (i << 3));
+	if (inlen & 7) {
+		memcpy(lane, p + (i << 3), inlen & 7);
+		duplex->S[LANE_TRANSPOSE_MAP[i]] ^= (int64_t)libkeccak_load64(lane);
+	}
+	duplex->S[LANE_TRANSPOSE_MAP[i]] ^= (int64_t)((uint64_t)duplex->pad << ((inlen & 7) << 3));
+	duplex->S[LANE_TRANSPOSE_MAP[(duplex->rate >> 3) - 1]] ^= (int64_t)((uint64_t)0x80 << 56);
+
+	libkeccak_p1600(duplex->S, duplex->nr);
+
+	if (outlen)
+		libkeccak_sponge_extract(out, duplex->S, 0, outlen);
+	return 0;
+}
@@ -0,0 +1,45 @@
+#ifndef LIBKECCAK_DUPLEX_H
+#define LIBKECCAK_DUPLEX_H
+
+#include "keccak-p.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Keccak duplex object: every call pads one input block into the
+ * lanes, applies one permutation and reads output straight back from
+ * the lanes, so absorbing and squeezing can be interleaved freely;
+ * it owns no heap memory
+ */
+typedef struct libkeccak_duplex {
+	int64_t S[25];     // The lanes (state/sponge)
+	long rate;         // The bitrate in bytes
+	long nr;           // The number of rounds
+	unsigned char pad; // The domain suffix bits followed by the first bit of pad10*1
+} libkeccak_duplex_t;
+
+/**
+ * Initialise a duplex object
+ *
+ * @param   duplex  The duplex object that should be initialised
+ * @param   rate    The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param   nr      The number of rounds, 24 for Keccak-f[1600], 12 for Keccak-p[1600, 12]
+ * @param   pad     The domain suffix bits followed by the first bit of pad10*1, e.g. `LIBKECCAK_KECCAK_PAD`
+ * @return          Zero on success, -1 on error
+ */
+int libkeccak_duplex_initialise(libkeccak_duplex_t* duplex, long rate, long nr, unsigned char pad);
+
+/**
+ * Absorb one padded input block, apply one permutation and squeeze output
+ *
+ * @param   duplex  The duplex object
+ * @param   in      The input, may be `NULL` if `inlen` is zero
+ * @param   inlen   The length of the input, less than the bitrate, so the padding fits
+ * @param   out     Output parameter for the output, may be `NULL` if `outlen` is zero
+ * @param   outlen  The number of bytes to squeeze, no greater than the bitrate
+ * @return          Zero on success, -1 on error
+ */
+int libkeccak_duplex(libkeccak_duplex_t* duplex, const char* in, size_t inlen, char* out, size_t outlen);
+
+#endif
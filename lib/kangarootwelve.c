@@ -0,0 +1,151 @@
+#include "kangarootwelve.h"
+#include "turboshake.h"
+#include "parallel.h"
+#include "alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Number of leaf chunks handed to a thread at a time, a multiple of `LIBKECCAK_X4`
+#define LIBKECCAK_K12_GRAIN 16
+
+// Domain separation byte for a message that fits in a single chunk
+#define LIBKECCAK_K12_DOMAIN_SINGLE 0x07
+
+// Domain separation byte for the leaf chunks
+#define LIBKECCAK_K12_DOMAIN_LEAF 0x0B
+
+// Domain separation byte for the final node
+#define LIBKECCAK_K12_DOMAIN_FINAL 0x06
+
+// The message, customisation string and its encoded length, seen as consecutive chunks
+struct libkeccak_k12_input {
+	const char *msg;  // The message, the first `full` chunks are read from here
+	const char *tail; // The rest of the input, starting at chunk `full`
+	size_t full;      // The number of chunks that lie entirely within the message
+	size_t taillen;   // The length of `tail`
+	char *cv;         // Output for the chaining values of the leaves, chunk `i` goes to `cv[(i - 1) * 32]`
+};
+
+/**
+ * Encode an integer as in KangarooTwelve's `length_encode`
+ *
+ * @param   out  Output buffer, at least `sizeof(size_t) + 1` bytes
+ * @param   x    The integer
+ * @return       The number of bytes written
+ */
+static size_t libkeccak_k12_length_encode(char *restrict out, size_t x)
+{
+	size_t n = 0, i;
+	for (i = x; i; i >>= 8)
+		n++;
+	for (i = 0; i < n; i++)
+		out[i] = (char)(x >> ((n - 1 - i) << 3));
+	out[n] = (char)n;
+	return n + 1;
+}
+
+/**
+ * Hash the leaf chunks `[begin + 1, end + 1)`
+ *
+ * @param  ctx    The `struct libkeccak_k12_input`
+ * @param  begin  The index of the first leaf
+ * @param  end    One past the index of the last leaf
+ */
+static void libkeccak_k12_leaves(void *ctx, size_t begin, size_t end)
+{
+	struct libkeccak_k12_input *in = ctx;
+	size_t c = begin + 1, e = end + 1, n, off;
+
+	if (c < in->full) {
+		n = (e < in->full ? e : in->full) - c;
+		libkeccak_sponge_many(in->msg + c * LIBKECCAK_K12_CHUNK, LIBKECCAK_K12_CHUNK, LIBKECCAK_K12_CHUNK,
+		                      n, 168, LIBKECCAK_TURBOSHAKE_ROUNDS, LIBKECCAK_K12_DOMAIN_LEAF,
+		                      in->cv + (c - 1) * LIBKECCAK_K12_CV, LIBKECCAK_K12_CV);
+		c += n;
+	}
+	if (c == e)
+		return;
+
+	off = (c - in->full) * LIBKECCAK_K12_CHUNK;
+	n = e - c;
+	if ((e - in->full) * LIBKECCAK_K12_CHUNK > in->taillen)
+		n--;
+	libkeccak_sponge_many(in->tail + off, LIBKECCAK_K12_CHUNK, LIBKECCAK_K12_CHUNK,
+	                      n, 168, LIBKECCAK_TURBOSHAKE_ROUNDS, LIBKECCAK_K12_DOMAIN_LEAF,
+	                      in->cv + (c - 1) * LIBKECCAK_K12_CV, LIBKECCAK_K12_CV);
+	if (c + n < e) {
+		off += n * LIBKECCAK_K12_CHUNK;
+		libkeccak_turboshake(128, LIBKECCAK_K12_DOMAIN_LEAF, in->tail + off, in->taillen - off,
+		                     in->cv + (e - 2) * LIBKECCAK_K12_CV, LIBKECCAK_K12_CV);
+	}
+}
+
+/**
+ * Calculate KangarooTwelve of a complete message
+ *
+ * Every 8 KiB chunk after the first is an independent TurboSHAKE128 leaf,
+ * the leaves are hashed four at a time with the multi-buffer kernel and
+ * spread across `threads` threads
+ *
+ * @param   msg        The message
+ * @param   msglen     The length of the message
+ * @param   custom     The customisation string, may be `NULL` if `customlen` is zero
+ * @param   customlen  The length of the customisation string
+ * @param   hashsum    Output parameter for the output
+ * @param   outlen     The number of bytes to output
+ * @param   threads    The number of threads, zero or negative for one per online processor
+ * @return             Zero on success, -1 on error
+ */
+int libkeccak_k12(const char *msg, size_t msglen, const char *custom, size_t customlen,
+                  char *hashsum, size_t outlen, long threads)
+{
+	struct libkeccak_k12_input in;
+	char enc[sizeof(size_t) + 1];
+	char *tail, *node, *p;
+	size_t enclen = libkeccak_k12_length_encode(enc, customlen);
+	size_t total = msglen + customlen + enclen;
+	size_t leaves, nodelen;
+
+	in.full = msglen / LIBKECCAK_K12_CHUNK;
+	in.taillen = total - in.full * LIBKECCAK_K12_CHUNK;
+	tail = libkeccak_malloc(in.taillen);
+	if (!tail)
+		return -1;
+	memcpy(tail, msg + in.full * LIBKECCAK_K12_CHUNK, msglen - in.full * LIBKECCAK_K12_CHUNK);
+	p = tail + msglen - in.full * LIBKECCAK_K12_CHUNK;
+	if (customlen)
+		memcpy(p, custom, customlen);
+	memcpy(p + customlen, enc, enclen);
+
+	if (total <= LIBKECCAK_K12_CHUNK) {
+		libkeccak_turboshake(128, LIBKECCAK_K12_DOMAIN_SINGLE, tail, total, hashsum, outlen);
+		libkeccak_free(tail);
+		return 0;
+	}
+
+	leaves = (total + LIBKECCAK_K12_CHUNK - 1) / LIBKECCAK_K12_CHUNK - 1;
+	nodelen = LIBKECCAK_K12_CHUNK + 8 + leaves * LIBKECCAK_K12_CV + sizeof(size_t) + 1 + 2;
+	node = libkeccak_malloc(nodelen);
+	if (!node)
+		return libkeccak_free(tail), -1;
+
+	memcpy(node, in.full ? msg : tail, LIBKECCAK_K12_CHUNK);
+	memset(node + LIBKECCAK_K12_CHUNK, 0, 8);
+	node[LIBKECCAK_K12_CHUNK] = 0x03;
+
+	in.msg = msg;
+	in.tail = tail;
+	in.cv = node + LIBKECCAK_K12_CHUNK + 8;
+	libkeccak_parallel_for(leaves, LIBKECCAK_K12_GRAIN, libkeccak_k12_leaves, &in, threads);
+
+	p = in.cv + leaves * LIBKECCAK_K12_CV;
+	p += libkeccak_k12_length_encode(p, leaves);
+	*p++ = (char)0xFF;
+	*p++ = (char)0xFF;
+	libkeccak_turboshake(128, LIBKECCAK_K12_DOMAIN_FINAL, node, (size_t)(p - node), hashsum, outlen);
+
+	libkeccak_free(node);
+	libkeccak_free(tail);
+	return 0;
+}
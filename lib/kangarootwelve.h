@@ -0,0 +1,31 @@
+#ifndef LIBKECCAK_KANGAROOTWELVE_H
+#define LIBKECCAK_KANGAROOTWELVE_H
+
+#include <stddef.h>
+
+// Size of the chunks KangarooTwelve splits its input into
+#define LIBKECCAK_K12_CHUNK 8192
+
+// Size of the chaining value of each leaf chunk
+#define LIBKECCAK_K12_CV 32
+
+/**
+ * Calculate KangarooTwelve of a complete message
+ *
+ * Every 8 KiB chunk after the first is an independent TurboSHAKE128 leaf,
+ * the leaves are hashed four at a time with the multi-buffer kernel and
+ * spread across `threads` threads
+ *
+ * @param   msg        The message
+ * @param   msglen     The length of the message
+ * @param   custom     The customisation string, may be `NULL` if `customlen` is zero
+ * @param   customlen  The length of the customisation string
+ * @param   hashsum    Output parameter for the output
+ * @param   outlen     The number of bytes to output
+ * @param   threads    The number of threads, zero or negative for one per online processor
+ * @return             Zero on success, -1 on error
+ */
+int libkeccak_k12(const char* msg, size_t msglen, const char* custom, size_t customlen,
+                  char* hashsum, size_t outlen, long threads);
+
+#endif
@@ -0,0 +1,325 @@
+#ifndef LIBKECCAK_KECCAK_F_H
+#define LIBKECCAK_KECCAK_F_H
+
+/*
+ * Internal header: the Keccak-f[1600] round function and the helpers shared by
+ * every translation unit that drives the permutation. Nothing in here is part
+ * of the public interface, everything is `static` so that each user gets its
+ * own inlinable copy.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * X-macro-enabled listing of all intergers in [0, 4]
+ */
+#define LIST_5 X(0) X(1) X(2) X(3) X(4)
+
+/**
+ * X-macro-enabled listing of all intergers in [0, 7]
+ */
+#define LIST_8 LIST_5 X(5) X(6) X(7)
+
+/**
+ * X-macro-enabled listing of all intergers in [0, 23]
+ */
+#define LIST_24 LIST_8 X(8) X(9) X(10) X(11) X(12) X(13) X(14) X(15)\
+                X(16) X(17) X(18) X(19) X(20) X(21) X(22) X(23)
+
+/**
+ * X-macro-enabled listing of all intergers in [0, 24]
+ */
+#define LIST_25 LIST_24 X(24)
+
+#define X(N) (N % 5) * 5 + N / 5,
+/**
+ * The order the lanes should be read when absorbing or squeezing,
+ * it transposes the lanes in the sponge
+ */
+static const long LANE_TRANSPOSE_MAP[] = { LIST_25 };
+#undef X
+
+/**
+ * Keccak-f round constants
+ */
+static const uint_fast64_t RC[] = {
+	0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808AULL, 0x8000000080008000ULL,
+	0x000000000000808BULL, 0x0000000080000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
+	0x000000000000008AULL, 0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000AULL,
+	0x000000008000808BULL, 0x800000000000008BULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
+	0x8000000000008002ULL, 0x8000000000000080ULL, 0x000000000000800AULL, 0x800000008000000AULL,
+	0x8000000080008081ULL, 0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL
+};
+
+/**
+ * Rotate a 64-bit word
+ *
+ * @param   x:int_fast64_t  The value to rotate
+ * @param   n:long          Rotation steps, may not be zero
+ * @return   :int_fast64_t  The value rotated
+ */
+#define rotate64(x, n) ((int_fast64_t)(((uint64_t)(x) >> (64L - (n))) | ((uint64_t)(x) << (n))))
+
+/**
+ * Rotate every 64-bit element of a vector of lanes
+ *
+ * @param   x:vector  The value to rotate
+ * @param   n:long    Rotation steps, may not be zero
+ * @return   :vector  The value rotated
+ */
+#define rotate64v(x, n) (((x) >> (64L - (n))) | ((x) << (n)))
+
+/**
+ * Rotate a `w`-bit word, or every `w`-bit element of a vector of lanes
+ *
+ * With constant `n` and `w` the offset is reduced modulo `w` at compile
+ * time, and a rotation by a multiple of `w` vanishes altogether. Scalar
+ * words narrower than `int` are promoted, so the result may carry bits
+ * above `w` until it is stored back into a `w`-bit lane
+ *
+ * @param   x:T     The value to rotate
+ * @param   n:long  Rotation steps, the ρ offset for Keccak-f[1600]
+ * @param   w:long  The word size
+ * @return   :T     The value rotated
+ */
+#define rotatew(x, n, w) ((n) % (w) ? ((x) >> ((w) - (n) % (w))) | ((x) << ((n) % (w))) : (x))
+
+/**
+ * Rotate a 32-bit word, or every element of a vector of 32-bit lanes
+ *
+ * @param   x:T     The value to rotate
+ * @param   n:long  Rotation steps, reduced modulo 32 at compile time
+ * @return   :T     The value rotated
+ */
+#define rotate32(x, n) rotatew(x, n, 32)
+
+/**
+ * Rotate a 16-bit word, or every element of a vector of 16-bit lanes
+ *
+ * @param   x:T     The value to rotate
+ * @param   n:long  Rotation steps, reduced modulo 16 at compile time
+ * @return   :T     The value rotated
+ */
+#define rotate16(x, n) rotatew(x, n, 16)
+
+/**
+ * Rotate an 8-bit word, or every element of a vector of 8-bit lanes
+ *
+ * @param   x:T     The value to rotate
+ * @param   n:long  Rotation steps, reduced modulo 8 at compile time
+ * @return   :T     The value rotated
+ */
+#define rotate8(x, n) rotatew(x, n, 8)
+
+/**
+ * One round of Keccak-f[1600]
+ *
+ * The body is shared between the scalar and the vectorised permutation,
+ * `T` is the lane type and `ROT` the matching rotation macro. With a
+ * narrower lane type and `rotate32`, `rotate16` or `rotate8` it is a
+ * round of Keccak-f[800], Keccak-f[400] or Keccak-f[200]; the ρ offsets
+ * are the same, taken modulo the word size
+ *
+ * @param  T    The lane type
+ * @param  ROT  The rotation macro for `T`
+ * @param  A    The lanes, `A[x * 5 + y]`
+ * @param  rc   The round constant, of type `T`
+ */
+#define LIBKECCAK_F1600_ROUND(T, ROT, A, rc)\
+	do {\
+		T B[25];\
+		T C[5];\
+		T da, db, dc, dd, de;\
+		\
+		/* θ step (step 1 of 3). */\
+		C[0] = A[0]  ^ A[1]  ^ A[2]  ^ A[3]  ^ A[4];\
+		C[1] = A[5]  ^ A[6]  ^ A[7]  ^ A[8]  ^ A[9];\
+		C[2] = A[10] ^ A[11] ^ A[12] ^ A[13] ^ A[14];\
+		C[3] = A[15] ^ A[16] ^ A[17] ^ A[18] ^ A[19];\
+		C[4] = A[20] ^ A[21] ^ A[22] ^ A[23] ^ A[24];\
+		\
+		/* θ step (step 2 of 3). */\
+		da = C[4] ^ ROT(C[1], 1);\
+		dd = C[2] ^ ROT(C[4], 1);\
+		db = C[0] ^ ROT(C[2], 1);\
+		de = C[3] ^ ROT(C[0], 1);\
+		dc = C[1] ^ ROT(C[3], 1);\
+		\
+		/* ρ and π steps, with last two part of θ. */\
+		B[0]  = A[0] ^ da;            B[1]  = ROT(A[15] ^ dd, 28);  B[2]  = ROT(A[5]  ^ db,  1);\
+		B[3]  = ROT(A[20] ^ de, 27);  B[4]  = ROT(A[10] ^ dc, 62);  B[5]  = ROT(A[6]  ^ db, 44);\
+		B[6]  = ROT(A[21] ^ de, 20);  B[7]  = ROT(A[11] ^ dc,  6);  B[8]  = ROT(A[1]  ^ da, 36);\
+		B[9]  = ROT(A[16] ^ dd, 55);  B[10] = ROT(A[12] ^ dc, 43);  B[11] = ROT(A[2]  ^ da,  3);\
+		B[12] = ROT(A[17] ^ dd, 25);  B[13] = ROT(A[7]  ^ db, 10);  B[14] = ROT(A[22] ^ de, 39);\
+		B[15] = ROT(A[18] ^ dd, 21);  B[16] = ROT(A[8]  ^ db, 45);  B[17] = ROT(A[23] ^ de,  8);\
+		B[18] = ROT(A[13] ^ dc, 15);  B[19] = ROT(A[3]  ^ da, 41);  B[20] = ROT(A[24] ^ de, 14);\
+		B[21] = ROT(A[14] ^ dc, 61);  B[22] = ROT(A[4]  ^ da, 18);  B[23] = ROT(A[19] ^ dd, 56);\
+		B[24] = ROT(A[9]  ^ db,  2);\
+		\
+		/* ξ step. */\
+		A[0]  = B[0]  ^ (~B[5]  & B[10]);  A[1]  = B[1]  ^ (~B[6]  & B[11]);  A[2]  = B[2]  ^ (~B[7]  & B[12]);\
+		A[3]  = B[3]  ^ (~B[8]  & B[13]);  A[4]  = B[4]  ^ (~B[9]  & B[14]);  A[5]  = B[5]  ^ (~B[10] & B[15]);\
+		A[6]  = B[6]  ^ (~B[11] & B[16]);  A[7]  = B[7]  ^ (~B[12] & B[17]);  A[8]  = B[8]  ^ (~B[13] & B[18]);\
+		A[9]  = B[9]  ^ (~B[14] & B[19]);  A[10] = B[10] ^ (~B[15] & B[20]);  A[11] = B[11] ^ (~B[16] & B[21]);\
+		A[12] = B[12] ^ (~B[17] & B[22]);  A[13] = B[13] ^ (~B[18] & B[23]);  A[14] = B[14] ^ (~B[19] & B[24]);\
+		A[15] = B[15] ^ (~B[20] & B[0]);   A[16] = B[16] ^ (~B[21] & B[1]);   A[17] = B[17] ^ (~B[22] & B[2]);\
+		A[18] = B[18] ^ (~B[23] & B[3]);   A[19] = B[19] ^ (~B[24] & B[4]);   A[20] = B[20] ^ (~B[0]  & B[5]);\
+		A[21] = B[21] ^ (~B[1]  & B[6]);   A[22] = B[22] ^ (~B[2]  & B[7]);   A[23] = B[23] ^ (~B[3]  & B[8]);\
+		A[24] = B[24] ^ (~B[4]  & B[9]);\
+		\
+		/* ι step. */\
+		A[0] ^= (rc);\
+	} while (0)
+
+/**
+ * Perform one round of Keccak-f[1600] on a 64-bit word sponge
+ *
+ * @param  A   The lanes, `A[x * 5 + y]`
+ * @param  rc  The round contant for this round
+ */
+static inline void libkeccak_f1600_round(int_fast64_t *restrict A, int_fast64_t rc)
+{
+	LIBKECCAK_F1600_ROUND(int_fast64_t, rotate64, A, rc);
+}
+
+/**
+ * Load a little-endian 64-bit lane from an unaligned buffer
+ *
+ * @param   p  The buffer, at least 8 bytes
+ * @return     The lane
+ */
+static inline uint64_t libkeccak_load64(const unsigned char *restrict p)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+#else
+	uint64_t v = 0;
+	int i;
+	for (i = 8; i--;)
+		v = (v << 8) | p[i];
+	return v;
+#endif
+}
+
+/**
+ * Load a little-endian 32-bit lane from an unaligned buffer
+ *
+ * @param   p  The buffer, at least 4 bytes
+ * @return     The lane
+ */
+static inline uint32_t libkeccak_load32(const unsigned char *restrict p)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+#else
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+#endif
+}
+
+/**
+ * Load a little-endian 16-bit lane from an unaligned buffer
+ *
+ * @param   p  The buffer, at least 2 bytes
+ * @return     The lane
+ */
+static inline uint16_t libkeccak_load16(const unsigned char *restrict p)
+{
+	return (uint16_t)(p[0] | p[1] << 8);
+}
+
+/**
+ * Load an 8-bit lane
+ *
+ * @param   p  The buffer, at least 1 byte
+ * @return     The lane
+ */
+static inline uint8_t libkeccak_load8(const unsigned char *restrict p)
+{
+	return *p;
+}
+
+/**
+ * Store a 64-bit lane to an unaligned buffer in little-endian order
+ *
+ * @param  p  The buffer, at least 8 bytes
+ * @param  v  The lane
+ */
+static inline void libkeccak_store64(unsigned char *restrict p, uint64_t v)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	memcpy(p, &v, sizeof(v));
+#else
+	int i;
+	for (i = 0; i < 8; i++, v >>= 8)
+		p[i] = (unsigned char)v;
+#endif
+}
+
+/**
+ * XOR a whole block into a sponge
+ *
+ * @param  S      The lanes
+ * @param  block  The block
+ * @param  rate   The bitrate in bytes
+ */
+static inline void libkeccak_sponge_absorb_block(int64_t *restrict S, const unsigned char *restrict block, long rate)
+{
+	register long i;
+	for (i = 0; i < rate >> 3; i++)
+		S[LANE_TRANSPOSE_MAP[i]] ^= (int64_t)libkeccak_load64(block + (i << 3));
+}
+
+/**
+ * Copy the last, partial, block of a message into a buffer and pad it
+ *
+ * @param  block  Output buffer of `rate` bytes
+ * @param  msg    The unabsorbed remainder of the message
+ * @param  len    The length of the remainder, less than `rate`
+ * @param  rate   The bitrate in bytes
+ * @param  pad    The domain suffix bits followed by the first bit of pad10*1
+ */
+static inline void libkeccak_sponge_pad_block(unsigned char *restrict block, const char *restrict msg,
+                                              size_t len, long rate, unsigned char pad)
+{
+	memset(block, 0, (size_t)rate);
+	memcpy(block, msg, len);
+	block[len] ^= pad;
+	block[rate - 1] ^= 0x80;
+}
+
+/**
+ * Copy a byte range of the current output block straight from the lanes,
+ * whole lanes are written with word-wide stores
+ *
+ * @param  out     Output buffer of `len` bytes
+ * @param  S       The lanes
+ * @param  offset  The first byte of the range
+ * @param  len     The length of the range, `offset + len` may not exceed the bitrate in bytes
+ */
+static inline void libkeccak_sponge_extract(char *restrict out, const int64_t *restrict S, size_t offset, size_t len)
+{
+	unsigned char lane[8];
+	register size_t i = offset >> 3;
+	register size_t n;
+
+	if (offset & 7) {
+		n = 8 - (offset & 7) < len ? 8 - (offset & 7) : len;
+		libkeccak_store64(lane, (uint64_t)S[LANE_TRANSPOSE_MAP[i++]]);
+		memcpy(out, lane + (offset & 7), n);
+		out += n, len -= n;
+	}
+	for (; len >= 8; i++, out += 8, len -= 8)
+		libkeccak_store64((unsigned char *)out, (uint64_t)S[LANE_TRANSPOSE_MAP[i]]);
+	if (len) {
+		libkeccak_store64(lane, (uint64_t)S[LANE_TRANSPOSE_MAP[i]]);
+		memcpy(out, lane, len);
+	}
+}
+
+#endif
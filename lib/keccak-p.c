@@ -0,0 +1,929 @@
+#include "keccak-p.h"
+#include "keccak-f.h"
+#include "metrics.h"
+
+#include <errno.h>
+
+/**
+ * Apply Keccak-p[1600, nr], that is, the last `nr` rounds of Keccak-f[1600]
+ *
+ * @param  S   The lanes, in the same layout as `libkeccak_state_t.S`
+ * @param  nr  The number of rounds, 24 for Keccak-f[1600], 12 for KangarooTwelve
+ */
+void libkeccak_p1600(int64_t *restrict S, long nr)
+{
+	register long i;
+	LIBKECCAK_COUNT(LIBKECCAK_PERMUTATIONS, 1);
+	for (i = 24 - nr; i < 24; i++)
+		libkeccak_f1600_round(S, (int_fast64_t)(RC[i]));
+}
+
+/**
+ * Apply Keccak-p[1600, nr] to two independent states at once, in one
+ * instruction stream; the two-element lanes fit the 128-bit vector
+ * registers every x86-64 and AArch64 core has, where two interleaved
+ * scalar states would not fit the general-purpose registers
+ *
+ * @param  S   The interleaved lanes, in the same layout as `libkeccak_state_t.S`
+ * @param  nr  The number of rounds
+ */
+void libkeccak_p1600_x2(libkeccak_lane_x2_t *restrict S, long nr)
+{
+	register long i;
+	libkeccak_lane_x2_t rc;
+	LIBKECCAK_COUNT(LIBKECCAK_PERMUTATIONS, LIBKECCAK_X2);
+	for (i = 24 - nr; i < 24; i++) {
+		rc = (libkeccak_lane_x2_t){ RC[i], RC[i] };
+		LIBKECCAK_F1600_ROUND(libkeccak_lane_x2_t, rotate64v, S, rc);
+	}
+}
+
+/**
+ * Apply Keccak-p[1600, nr] to four independent states at once
+ *
+ * @param  S   The interleaved lanes, in the same layout as `libkeccak_state_t.S`
+ * @param  nr  The number of rounds
+ */
+void libkeccak_p1600_x4(libkeccak_lane_x4_t *restrict S, long nr)
+{
+	register long i;
+	libkeccak_lane_x4_t rc;
+	LIBKECCAK_COUNT(LIBKECCAK_PERMUTATIONS, LIBKECCAK_X4);
+	for (i = 24 - nr; i < 24; i++) {
+		rc = (libkeccak_lane_x4_t){ RC[i], RC[i], RC[i], RC[i] };
+		LIBKECCAK_F1600_ROUND(libkeccak_lane_x4_t, rotate64v, S, rc);
+	}
+}
+
+/**
+ * Apply Keccak-p[800, nr], that is, the last `nr` rounds of Keccak-f[800],
+ * on native 32-bit words with the ρ offsets reduced at compile time
+ *
+ * @param  S   The lanes, in the same layout as `libkeccak_state_t.S`
+ * @param  nr  The number of rounds, 22 for Keccak-f[800]
+ */
+void libkeccak_p800(uint32_t *restrict S, long nr)
+{
+	register long i;
+	LIBKECCAK_COUNT(LIBKECCAK_PERMUTATIONS, 1);
+	for (i = 22 - nr; i < 22; i++)
+		LIBKECCAK_F1600_ROUND(uint32_t, rotate32, S, (uint32_t)RC[i]);
+}
+
+/**
+ * Apply Keccak-p[400, nr], that is, the last `nr` rounds of Keccak-f[400],
+ * on native 16-bit words with the ρ offsets reduced at compile time
+ *
+ * @param  S   The lanes, in the same layout as `libkeccak_state_t.S`
+ * @param  nr  The number of rounds, 20 for Keccak-f[400]
+ */
+void libkeccak_p400(uint16_t *restrict S, long nr)
+{
+	register long i;
+	LIBKECCAK_COUNT(LIBKECCAK_PERMUTATIONS, 1);
+	for (i = 20 - nr; i < 20; i++)
+		LIBKECCAK_F1600_ROUND(uint16_t, rotate16, S, (uint16_t)RC[i]);
+}
+
+/**
+ * Apply Keccak-p[200, nr], that is, the last `nr` rounds of Keccak-f[200],
+ * on native 8-bit words with the ρ offsets reduced at compile time
+ *
+ * @param  S   The lanes, in the same layout as `libkeccak_state_t.S`
+ * @param  nr  The number of rounds, 18 for Keccak-f[200]
+ */
+void libkeccak_p200(uint8_t *restrict S, long nr)
+{
+	register long i;
+	LIBKECCAK_COUNT(LIBKECCAK_PERMUTATIONS, 1);
+	for (i = 18 - nr; i < 18; i++)
+		LIBKECCAK_F1600_ROUND(uint8_t, rotate8, S, (uint8_t)RC[i]);
+}
+
+/**
+ * Apply Keccak-p[800, nr] to eight independent states at once; the
+ * narrow states are packed so that a lane of all eight fills a 256-bit
+ * vector, as a lane of four Keccak-f[1600] states does
+ *
+ * @param  S   The interleaved lanes, in the same layout as `libkeccak_state_t.S`
+ * @param  nr  The number of rounds
+ */
+void libkeccak_p800_x8(libkeccak_lane32_x8_t *restrict S, long nr)
+{
+	register long i;
+	LIBKECCAK_COUNT(LIBKECCAK_PERMUTATIONS, 8);
+	for (i = 22 - nr; i < 22; i++)
+		LIBKECCAK_F1600_ROUND(libkeccak_lane32_x8_t, rotate32, S, (uint32_t)RC[i]);
+}
+
+/**
+ * Apply Keccak-p[400, nr] to sixteen independent states at once
+ *
+ * @param  S   The interleaved lanes, in the same layout as `libkeccak_state_t.S`
+ * @param  nr  The number of rounds
+ */
+void libkeccak_p400_x16(libkeccak_lane16_x16_t *restrict S, long nr)
+{
+	register long i;
+	LIBKECCAK_COUNT(LIBKECCAK_PERMUTATIONS, 16);
+	for (i = 20 - nr; i < 20; i++)
+		LIBKECCAK_F1600_ROUND(libkeccak_lane16_x16_t, rotate16, S, (uint16_t)RC[i]);
+}
+
+/**
+ * Apply Keccak-p[200, nr] to thirty-two independent states at once
+ *
+ * @param  S   The interleaved lanes, in the same layout as `libkeccak_state_t.S`
+ * @param  nr  The number of rounds
+ */
+void libkeccak_p200_x32(libkeccak_lane8_x32_t *restrict S, long nr)
+{
+	register long i;
+	LIBKECCAK_COUNT(LIBKECCAK_PERMUTATIONS, 32);
+	for (i = 18 - nr; i < 18; i++)
+		LIBKECCAK_F1600_ROUND(libkeccak_lane8_x32_t, rotate8, S, (uint8_t)RC[i]);
+}
+
+/**
+ * Absorb a complete message into a byte-aligned Keccak-p[1600, nr] sponge
+ *
+ * @param  S       Output parameter for the lanes, ready to be squeezed
+ * @param  msg     The message
+ * @param  msglen  The length of the message
+ * @param  rate    The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param  nr      The number of rounds
+ * @param  pad     The domain suffix bits followed by the first bit of pad10*1
+ */
+static inline void libkeccak_sponge_absorb(int64_t *restrict S, const char *restrict msg, size_t msglen,
+                                           long rate, long nr, unsigned char pad)
+{
+	unsigned char block[200];
+
+	LIBKECCAK_COUNT(LIBKECCAK_BYTES, msglen);
+	memset(S, 0, 25 * sizeof(*S));
+	for (; msglen >= (size_t)rate; msg += rate, msglen -= (size_t)rate) {
+		libkeccak_sponge_absorb_block(S, (const unsigned char *)msg, rate);
+		libkeccak_p1600(S, nr);
+	}
+	libkeccak_sponge_pad_block(block, msg, msglen, rate, pad);
+	libkeccak_sponge_absorb_block(S, block, rate);
+	libkeccak_p1600(S, nr);
+}
+
+/**
+ * Hash a complete message with a byte-aligned Keccak-p[1600, nr] sponge,
+ * without allocating any memory
+ *
+ * @param  msg      The message
+ * @param  msglen   The length of the message
+ * @param  rate     The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param  nr       The number of rounds
+ * @param  pad      The domain suffix bits followed by the first bit of pad10*1, e.g. `LIBKECCAK_KECCAK_PAD`
+ * @param  hashsum  Output parameter for the hashsum
+ * @param  outlen   The number of bytes to squeeze
+ */
+void libkeccak_sponge(const char *restrict msg, size_t msglen, long rate, long nr,
+                      unsigned char pad, char *restrict hashsum, size_t outlen)
+{
+	int64_t S[25];
+	register size_t n;
+
+	libkeccak_sponge_absorb(S, msg, msglen, rate, nr, pad);
+	for (;;) {
+		n = outlen < (size_t)rate ? outlen : (size_t)rate;
+		libkeccak_sponge_extract(hashsum, S, 0, n);
+		hashsum += n, outlen -= n;
+		if (!outlen)
+			break;
+		libkeccak_p1600(S, nr);
+	}
+}
+
+/**
+ * Hash a complete message with a byte-aligned Keccak-p[1600, nr] sponge
+ * and output only a byte range of the first output block, without
+ * allocating any memory
+ *
+ * @param  msg      The message
+ * @param  msglen   The length of the message
+ * @param  rate     The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param  nr       The number of rounds
+ * @param  pad      The domain suffix bits followed by the first bit of pad10*1, e.g. `LIBKECCAK_KECCAK_PAD`
+ * @param  hashsum  Output parameter for the range, `outlen` bytes
+ * @param  offset   The first byte of the range
+ * @param  outlen   The length of the range, `offset + outlen` may not exceed `rate`
+ */
+void libkeccak_sponge_range(const char *restrict msg, size_t msglen, long rate, long nr,
+                            unsigned char pad, char *restrict hashsum, size_t offset, size_t outlen)
+{
+	int64_t S[25];
+
+	libkeccak_sponge_absorb(S, msg, msglen, rate, nr, pad);
+	libkeccak_sponge_extract(hashsum, S, offset, outlen);
+}
+
+/**
+ * Get the expected value of the part of an output lane that falls within a byte range
+ *
+ * @param   expected  The expected bytes of the range
+ * @param   offset    The first byte of the range
+ * @param   len       The length of the range
+ * @param   i         The lane, in output order, overlapping the range
+ * @param   mask      Output parameter for the bits of the lane within the range
+ * @return            The expected lane, zero outside the range
+ */
+static inline uint64_t libkeccak_sponge_expect(const char *restrict expected, size_t offset, size_t len,
+                                               size_t i, uint64_t *restrict mask)
+{
+	unsigned char want[8] = { 0 }, bits[8] = { 0 };
+	size_t lo = offset > i << 3 ? offset : i << 3;
+	size_t hi = offset + len < (i + 1) << 3 ? offset + len : (i + 1) << 3;
+
+	if (hi - lo == 8) {
+		*mask = UINT64_MAX;
+		return libkeccak_load64((const unsigned char *)expected + lo - offset);
+	}
+	memcpy(want + lo - (i << 3), expected + lo - offset, hi - lo);
+	memset(bits + lo - (i << 3), 0xFF, hi - lo);
+	*mask = libkeccak_load64(bits);
+	return libkeccak_load64(want);
+}
+
+/**
+ * Check whether a byte range of the first output block of a byte-aligned
+ * Keccak-p[1600, nr] sponge matches an expected value, comparing lane by
+ * lane and stopping at the first difference
+ *
+ * @param   msg       The message
+ * @param   msglen    The length of the message
+ * @param   rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param   nr        The number of rounds
+ * @param   pad       The domain suffix bits followed by the first bit of pad10*1, e.g. `LIBKECCAK_KECCAK_PAD`
+ * @param   expected  The expected range, `len` bytes
+ * @param   offset    The first byte of the range
+ * @param   len       The length of the range, `offset + len` may not exceed `rate`
+ * @return            1 if the range matches, 0 otherwise
+ */
+int libkeccak_sponge_verify(const char *restrict msg, size_t msglen, long rate, long nr,
+                            unsigned char pad, const char *restrict expected, size_t offset, size_t len)
+{
+	int64_t S[25];
+	uint64_t want, mask;
+	size_t i;
+
+	libkeccak_sponge_absorb(S, msg, msglen, rate, nr, pad);
+	for (i = offset >> 3; i << 3 < offset + len; i++) {
+		want = libkeccak_sponge_expect(expected, offset, len, i, &mask);
+		if (((uint64_t)S[LANE_TRANSPOSE_MAP[i]] ^ want) & mask)
+			return 0;
+	}
+	return 1;
+}
+
+/**
+ * XOR one block of each of four messages into interleaved sponges
+ *
+ * @param  S       The interleaved lanes
+ * @param  blocks  The blocks
+ * @param  rate    The bitrate in bytes
+ */
+static inline void libkeccak_sponge_absorb_block_x4(libkeccak_lane_x4_t *restrict S,
+                                                    const unsigned char *const *blocks, long rate)
+{
+	register long i;
+	for (i = 0; i < rate >> 3; i++) {
+		S[LANE_TRANSPOSE_MAP[i]] ^= (libkeccak_lane_x4_t){
+			libkeccak_load64(blocks[0] + (i << 3)), libkeccak_load64(blocks[1] + (i << 3)),
+			libkeccak_load64(blocks[2] + (i << 3)), libkeccak_load64(blocks[3] + (i << 3))
+		};
+	}
+}
+
+/**
+ * Absorb four complete messages spanning the same number of blocks into interleaved states
+ *
+ * @param  S        Output parameter for the interleaved lanes, ready to be squeezed
+ * @param  msgs     The messages
+ * @param  msglens  The lengths of the messages
+ * @param  rate     The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param  nr       The number of rounds
+ * @param  pad      The domain suffix bits followed by the first bit of pad10*1
+ */
+static void libkeccak_sponge_absorb_x4(libkeccak_lane_x4_t *restrict S, const char *const *msgs, const size_t *msglens,
+                                       long rate, long nr, unsigned char pad)
+{
+	unsigned char last[LIBKECCAK_X4][200];
+	const unsigned char *blocks[LIBKECCAK_X4];
+	size_t nblocks = msglens[0] / (size_t)rate;
+	size_t b;
+	int j;
+
+	LIBKECCAK_COUNT(LIBKECCAK_BYTES, msglens[0] + msglens[1] + msglens[2] + msglens[3]);
+	memset(S, 0, 25 * sizeof(*S));
+	for (b = 0; b < nblocks; b++) {
+		for (j = 0; j < LIBKECCAK_X4; j++)
+			blocks[j] = (const unsigned char *)msgs[j] + b * (size_t)rate;
+		libkeccak_sponge_absorb_block_x4(S, blocks, rate);
+		libkeccak_p1600_x4(S, nr);
+	}
+	for (j = 0; j < LIBKECCAK_X4; j++) {
+		b = nblocks * (size_t)rate;
+		libkeccak_sponge_pad_block(last[j], msgs[j] + b, msglens[j] - b, rate, pad);
+		blocks[j] = last[j];
+	}
+	libkeccak_sponge_absorb_block_x4(S, blocks, rate);
+	libkeccak_p1600_x4(S, nr);
+}
+
+/**
+ * Hash four complete messages at once with the multi-buffer kernel
+ *
+ * All messages must span the same number of blocks, that is,
+ * `msglens[i] / rate` must be equal for all `i`
+ *
+ * @param  msgs      The messages
+ * @param  msglens   The lengths of the messages
+ * @param  rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param  nr        The number of rounds
+ * @param  pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param  hashsums  Output parameters for the hashsums
+ * @param  outlen    The number of bytes to squeeze for each message
+ */
+void libkeccak_sponge_x4(const char *const *msgs, const size_t *msglens, long rate, long nr,
+                         unsigned char pad, char *const *hashsums, size_t outlen)
+{
+	libkeccak_lane_x4_t S[25];
+	unsigned char lane[8];
+	size_t off = 0, n;
+	register long i;
+	int j;
+
+	libkeccak_sponge_absorb_x4(S, msgs, msglens, rate, nr, pad);
+	for (;;) {
+		for (i = 0; i < rate >> 3 && off < outlen; i++, off += n) {
+			n = outlen - off < 8 ? outlen - off : 8;
+			for (j = 0; j < LIBKECCAK_X4; j++) {
+				libkeccak_store64(lane, S[LANE_TRANSPOSE_MAP[i]][j]);
+				memcpy(hashsums[j] + off, lane, n);
+			}
+		}
+		if (off == outlen)
+			break;
+		libkeccak_p1600_x4(S, nr);
+	}
+}
+
+/**
+ * Hash four complete messages at once and output only a byte range of the first
+ * output block of each, with the multi-buffer kernel
+ *
+ * All messages must span the same number of blocks, that is,
+ * `msglens[i] / rate` must be equal for all `i`
+ *
+ * @param  msgs      The messages
+ * @param  msglens   The lengths of the messages
+ * @param  rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param  nr        The number of rounds
+ * @param  pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param  hashsums  Output parameters for the ranges, `outlen` bytes each
+ * @param  offset    The first byte of the range
+ * @param  outlen    The length of the range, `offset + outlen` may not exceed `rate`
+ */
+void libkeccak_sponge_range_x4(const char *const *msgs, const size_t *msglens, long rate, long nr,
+                               unsigned char pad, char *const *hashsums, size_t offset, size_t outlen)
+{
+	libkeccak_lane_x4_t S[25];
+	unsigned char lane[8];
+	size_t i = offset >> 3, first = offset & 7, off = 0, n;
+	int j;
+
+	libkeccak_sponge_absorb_x4(S, msgs, msglens, rate, nr, pad);
+	for (; off < outlen; i++, off += n, first = 0) {
+		n = outlen - off < 8 - first ? outlen - off : 8 - first;
+		for (j = 0; j < LIBKECCAK_X4; j++) {
+			libkeccak_store64(lane, S[LANE_TRANSPOSE_MAP[i]][j]);
+			memcpy(hashsums[j] + off, lane + first, n);
+		}
+	}
+}
+
+/**
+ * Check whether a byte range of the first output block of four complete
+ * messages matches their expected values, with the multi-buffer kernel
+ *
+ * Only the lanes overlapping the range are compared, masked to the range,
+ * and the comparison stops as soon as every message has differed
+ *
+ * All messages must span the same number of blocks, that is,
+ * `msglens[i] / rate` must be equal for all `i`
+ *
+ * @param   msgs      The messages
+ * @param   msglens   The lengths of the messages
+ * @param   rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param   nr        The number of rounds
+ * @param   pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param   expected  The expected ranges, `len` bytes each
+ * @param   offset    The first byte of the range
+ * @param   len       The length of the range, `offset + len` may not exceed `rate`
+ * @return            Bit `i` set if the range of message `i` matches
+ */
+unsigned libkeccak_sponge_verify_x4(const char *const *msgs, const size_t *msglens, long rate, long nr,
+                                    unsigned char pad, const char *const *expected, size_t offset, size_t len)
+{
+	libkeccak_lane_x4_t S[25], diff = { 0, 0, 0, 0 };
+	uint64_t want[LIBKECCAK_X4], mask;
+	size_t i;
+	int j;
+
+	libkeccak_sponge_absorb_x4(S, msgs, msglens, rate, nr, pad);
+	for (i = offset >> 3; i << 3 < offset + len; i++) {
+		for (j = 0; j < LIBKECCAK_X4; j++)
+			want[j] = libkeccak_sponge_expect(expected[j], offset, len, i, &mask);
+		diff |= (S[LANE_TRANSPOSE_MAP[i]] ^ (libkeccak_lane_x4_t){ want[0], want[1], want[2], want[3] }) &
+		        (libkeccak_lane_x4_t){ mask, mask, mask, mask };
+		if (diff[0] && diff[1] && diff[2] && diff[3])
+			return 0;
+	}
+	return (unsigned)!diff[0] | (unsigned)!diff[1] << 1 | (unsigned)!diff[2] << 2 | (unsigned)!diff[3] << 3;
+}
+
+/**
+ * Absorb two complete messages spanning the same number of blocks into interleaved states
+ *
+ * @param  S        Output parameter for the interleaved lanes, ready to be squeezed
+ * @param  msgs     The messages
+ * @param  msglens  The lengths of the messages
+ * @param  rate     The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param  nr       The number of rounds
+ * @param  pad      The domain suffix bits followed by the first bit of pad10*1
+ */
+static void libkeccak_sponge_absorb_x2(libkeccak_lane_x2_t *restrict S, const char *const *msgs, const size_t *msglens,
+                                       long rate, long nr, unsigned char pad)
+{
+	unsigned char last[LIBKECCAK_X2][200];
+	const unsigned char *blocks[LIBKECCAK_X2];
+	size_t nblocks = msglens[0] / (size_t)rate;
+	size_t b;
+	register long i;
+	int j;
+
+	LIBKECCAK_COUNT(LIBKECCAK_BYTES, msglens[0] + msglens[1]);
+	memset(S, 0, 25 * sizeof(*S));
+	for (b = 0;; b++) {
+		if (b < nblocks) {
+			for (j = 0; j < LIBKECCAK_X2; j++)
+				blocks[j] = (const unsigned char *)msgs[j] + b * (size_t)rate;
+		} else {
+			for (j = 0; j < LIBKECCAK_X2; j++) {
+				libkeccak_sponge_pad_block(last[j], msgs[j] + b * (size_t)rate, msglens[j] - b * (size_t)rate,
+				                           rate, pad);
+				blocks[j] = last[j];
+			}
+		}
+		for (i = 0; i < rate >> 3; i++)
+			S[LANE_TRANSPOSE_MAP[i]] ^= (libkeccak_lane_x2_t){
+				libkeccak_load64(blocks[0] + (i << 3)), libkeccak_load64(blocks[1] + (i << 3))
+			};
+		libkeccak_p1600_x2(S, nr);
+		if (b == nblocks)
+			break;
+	}
+}
+
+/**
+ * Hash two complete messages at once with the two-state kernel
+ *
+ * Both messages must span the same number of blocks, that is,
+ * `msglens[0] / rate` must equal `msglens[1] / rate`
+ *
+ * @param  msgs      The messages
+ * @param  msglens   The lengths of the messages
+ * @param  rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param  nr        The number of rounds
+ * @param  pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param  hashsums  Output parameters for the hashsums
+ * @param  outlen    The number of bytes to squeeze for each message
+ */
+void libkeccak_sponge_x2(const char *const *msgs, const size_t *msglens, long rate, long nr,
+                         unsigned char pad, char *const *hashsums, size_t outlen)
+{
+	libkeccak_lane_x2_t S[25];
+	unsigned char lane[8];
+	size_t off = 0, n;
+	register long i;
+	int j;
+
+	libkeccak_sponge_absorb_x2(S, msgs, msglens, rate, nr, pad);
+	for (;;) {
+		for (i = 0; i < rate >> 3 && off < outlen; i++, off += n) {
+			n = outlen - off < 8 ? outlen - off : 8;
+			for (j = 0; j < LIBKECCAK_X2; j++) {
+				libkeccak_store64(lane, S[LANE_TRANSPOSE_MAP[i]][j]);
+				memcpy(hashsums[j] + off, lane, n);
+			}
+		}
+		if (off == outlen)
+			break;
+		libkeccak_p1600_x2(S, nr);
+	}
+}
+
+/**
+ * Hash two complete messages at once and output only a byte range of the first
+ * output block of each, with the two-state kernel
+ *
+ * Both messages must span the same number of blocks, that is,
+ * `msglens[0] / rate` must equal `msglens[1] / rate`
+ *
+ * @param  msgs      The messages
+ * @param  msglens   The lengths of the messages
+ * @param  rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param  nr        The number of rounds
+ * @param  pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param  hashsums  Output parameters for the ranges, `outlen` bytes each
+ * @param  offset    The first byte of the range
+ * @param  outlen    The length of the range, `offset + outlen` may not exceed `rate`
+ */
+void libkeccak_sponge_range_x2(const char *const *msgs, const size_t *msglens, long rate, long nr,
+                               unsigned char pad, char *const *hashsums, size_t offset, size_t outlen)
+{
+	libkeccak_lane_x2_t S[25];
+	unsigned char lane[8];
+	size_t i = offset >> 3, first = offset & 7, off = 0, n;
+	int j;
+
+	libkeccak_sponge_absorb_x2(S, msgs, msglens, rate, nr, pad);
+	for (; off < outlen; i++, off += n, first = 0) {
+		n = outlen - off < 8 - first ? outlen - off : 8 - first;
+		for (j = 0; j < LIBKECCAK_X2; j++) {
+			libkeccak_store64(lane, S[LANE_TRANSPOSE_MAP[i]][j]);
+			memcpy(hashsums[j] + off, lane + first, n);
+		}
+	}
+}
+
+/**
+ * Check whether a byte range of the first output block of two complete
+ * messages matches their expected values, with the two-state kernel
+ *
+ * Only the lanes overlapping the range are compared, masked to the range,
+ * and the comparison stops as soon as both messages have differed
+ *
+ * Both messages must span the same number of blocks, that is,
+ * `msglens[0] / rate` must equal `msglens[1] / rate`
+ *
+ * @param   msgs      The messages
+ * @param   msglens   The lengths of the messages
+ * @param   rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param   nr        The number of rounds
+ * @param   pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param   expected  The expected ranges, `len` bytes each
+ * @param   offset    The first byte of the range
+ * @param   len       The length of the range, `offset + len` may not exceed `rate`
+ * @return            Bit `i` set if the range of message `i` matches
+ */
+unsigned libkeccak_sponge_verify_x2(const char *const *msgs, const size_t *msglens, long rate, long nr,
+                                    unsigned char pad, const char *const *expected, size_t offset, size_t len)
+{
+	libkeccak_lane_x2_t S[25], diff = { 0, 0 };
+	uint64_t want[LIBKECCAK_X2], mask;
+	size_t i;
+	int j;
+
+	libkeccak_sponge_absorb_x2(S, msgs, msglens, rate, nr, pad);
+	for (i = offset >> 3; i << 3 < offset + len; i++) {
+		for (j = 0; j < LIBKECCAK_X2; j++)
+			want[j] = libkeccak_sponge_expect(expected[j], offset, len, i, &mask);
+		diff |= (S[LANE_TRANSPOSE_MAP[i]] ^ (libkeccak_lane_x2_t){ want[0], want[1] }) &
+		        (libkeccak_lane_x2_t){ mask, mask };
+		if (diff[0] && diff[1])
+			return 0;
+	}
+	return (unsigned)!diff[0] | (unsigned)!diff[1] << 1;
+}
+
+/**
+ * Hash one message with `libkeccak_sponge`, behind the
+ * signature the other kernels share
+ *
+ * @param  msgs      The message, only the first is used
+ * @param  msglens   The length of the message
+ * @param  rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param  nr        The number of rounds
+ * @param  pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param  hashsums  Output parameter for the hashsum
+ * @param  outlen    The number of bytes to squeeze
+ */
+static void libkeccak_sponge_x1(const char *const *msgs, const size_t *msglens, long rate, long nr,
+                                unsigned char pad, char *const *hashsums, size_t outlen)
+{
+	libkeccak_sponge(msgs[0], msglens[0], rate, nr, pad, hashsums[0], outlen);
+}
+
+/**
+ * Hash one message with `libkeccak_sponge_range`, behind the
+ * signature the other kernels share
+ *
+ * @param  msgs      The message, only the first is used
+ * @param  msglens   The length of the message
+ * @param  rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param  nr        The number of rounds
+ * @param  pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param  hashsums  Output parameter for the range
+ * @param  offset    The first byte of the range
+ * @param  outlen    The length of the range
+ */
+static void libkeccak_sponge_range_x1(const char *const *msgs, const size_t *msglens, long rate, long nr,
+                                      unsigned char pad, char *const *hashsums, size_t offset, size_t outlen)
+{
+	libkeccak_sponge_range(msgs[0], msglens[0], rate, nr, pad, hashsums[0], offset, outlen);
+}
+
+/**
+ * Verify one message with `libkeccak_sponge_verify`, behind the
+ * signature the other kernels share
+ *
+ * @param   msgs      The message, only the first is used
+ * @param   msglens   The length of the message
+ * @param   rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param   nr        The number of rounds
+ * @param   pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param   expected  The expected range
+ * @param   offset    The first byte of the range
+ * @param   len       The length of the range
+ * @return            1 if the range matches, 0 otherwise
+ */
+static unsigned libkeccak_sponge_verify_x1(const char *const *msgs, const size_t *msglens, long rate, long nr,
+                                           unsigned char pad, const char *const *expected, size_t offset, size_t len)
+{
+	return (unsigned)libkeccak_sponge_verify(msgs[0], msglens[0], rate, nr, pad, expected[0], offset, len);
+}
+
+/**
+ * Apply Keccak-p[1600, nr] to one state, behind the signature the other kernels share
+ *
+ * @param  S   The lanes
+ * @param  nr  The number of rounds
+ */
+static void libkeccak_permute_x1(uint64_t *restrict S, long nr)
+{
+	libkeccak_p1600((int64_t *)S, nr);
+}
+
+/**
+ * Apply Keccak-p[1600, nr] to two interleaved states, behind the signature the other kernels share
+ *
+ * @param  S   The interleaved lanes, aligned for `libkeccak_lane_x2_t`
+ * @param  nr  The number of rounds
+ */
+static void libkeccak_permute_x2(uint64_t *restrict S, long nr)
+{
+	libkeccak_p1600_x2((libkeccak_lane_x2_t *)S, nr);
+}
+
+/**
+ * Apply Keccak-p[1600, nr] to four interleaved states, behind the signature the other kernels share
+ *
+ * @param  S   The interleaved lanes, aligned for `libkeccak_lane_x4_t`
+ * @param  nr  The number of rounds
+ */
+static void libkeccak_permute_x4(uint64_t *restrict S, long nr)
+{
+	libkeccak_p1600_x4((libkeccak_lane_x4_t *)S, nr);
+}
+
+const libkeccak_kernel_t libkeccak_scalar_kernel = {
+	"scalar", 1, libkeccak_sponge_x1, libkeccak_sponge_range_x1, libkeccak_sponge_verify_x1, libkeccak_permute_x1
+};
+const libkeccak_kernel_t libkeccak_x2_kernel = {
+	"x2", LIBKECCAK_X2, libkeccak_sponge_x2, libkeccak_sponge_range_x2, libkeccak_sponge_verify_x2, libkeccak_permute_x2
+};
+const libkeccak_kernel_t libkeccak_x4_kernel = {
+	"x4", LIBKECCAK_X4, libkeccak_sponge_x4, libkeccak_sponge_range_x4, libkeccak_sponge_verify_x4, libkeccak_permute_x4
+};
+
+/* Without AVX2 the four-state kernel is compiled to pairs of 128-bit operations and loses to the two-state one. */
+#ifdef __AVX2__
+# define LIBKECCAK_DEFAULT_KERNEL libkeccak_x4_kernel
+#else
+# define LIBKECCAK_DEFAULT_KERNEL libkeccak_x2_kernel
+#endif
+
+const libkeccak_kernel_t *libkeccak_kernel = &LIBKECCAK_DEFAULT_KERNEL;
+
+/**
+ * Select the kernel for all subsequent multi-message hashing; safe to
+ * call while other threads are hashing, calls already running finish on
+ * the kernel they started with
+ *
+ * @param  kernel  The kernel, `NULL` for the default: `libkeccak_x4_kernel` when
+ *                 the library is built for AVX2, `libkeccak_x2_kernel` otherwise
+ */
+void libkeccak_set_kernel(const libkeccak_kernel_t *kernel)
+{
+	__atomic_store_n(&libkeccak_kernel, kernel ? kernel : &LIBKECCAK_DEFAULT_KERNEL, __ATOMIC_RELAXED);
+}
+
+/**
+ * Hash `count` equal-length messages laid out with a fixed stride,
+ * as many at a time as the kernel selected with `libkeccak_set_kernel` takes
+ *
+ * @param  msgs      The first message, message `i` starts at `msgs + i * stride`
+ * @param  stride    The distance between the start of two consecutive messages
+ * @param  msglen    The length of each message
+ * @param  count     The number of messages
+ * @param  rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param  nr        The number of rounds
+ * @param  pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param  hashsums  Output parameter for the hashsums, hashsum `i` is stored at `hashsums + i * outlen`
+ * @param  outlen    The number of bytes to squeeze for each message
+ */
+void libkeccak_sponge_many(const char *msgs, size_t stride, size_t msglen, size_t count, long rate,
+                           long nr, unsigned char pad, char *hashsums, size_t outlen)
+{
+	const libkeccak_kernel_t *kernel = libkeccak_get_kernel();
+	const char *in[LIBKECCAK_X4];
+	char *out[LIBKECCAK_X4];
+	size_t lens[LIBKECCAK_X4] = { msglen, msglen, msglen, msglen };
+	size_t j;
+
+	for (; count >= kernel->width; count -= kernel->width) {
+		for (j = 0; j < kernel->width; j++) {
+			in[j] = msgs, msgs += stride;
+			out[j] = hashsums, hashsums += outlen;
+		}
+		kernel->sponge(in, lens, rate, nr, pad, out, outlen);
+	}
+	for (; count--; msgs += stride, hashsums += outlen)
+		libkeccak_sponge(msgs, msglen, rate, nr, pad, hashsums, outlen);
+}
+
+/**
+ * Hash `count` equal-length messages laid out with a fixed stride and
+ * output only a byte range of the first output block of each, as many
+ * at a time as the kernel selected with `libkeccak_set_kernel` takes
+ *
+ * @param  msgs      The first message, message `i` starts at `msgs + i * stride`
+ * @param  stride    The distance between the start of two consecutive messages
+ * @param  msglen    The length of each message
+ * @param  count     The number of messages
+ * @param  rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param  nr        The number of rounds
+ * @param  pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param  hashsums  Output parameter for the ranges, range `i` is stored at `hashsums + i * outlen`
+ * @param  offset    The first byte of the range
+ * @param  outlen    The length of the range, `offset + outlen` may not exceed `rate`
+ */
+void libkeccak_sponge_range_many(const char *msgs, size_t stride, size_t msglen, size_t count, long rate,
+                                 long nr, unsigned char pad, char *hashsums, size_t offset, size_t outlen)
+{
+	const libkeccak_kernel_t *kernel = libkeccak_get_kernel();
+	const char *in[LIBKECCAK_X4];
+	char *out[LIBKECCAK_X4];
+	size_t lens[LIBKECCAK_X4] = { msglen, msglen, msglen, msglen };
+	size_t j;
+
+	for (; count >= kernel->width; count -= kernel->width) {
+		for (j = 0; j < kernel->width; j++) {
+			in[j] = msgs, msgs += stride;
+			out[j] = hashsums, hashsums += outlen;
+		}
+		kernel->range(in, lens, rate, nr, pad, out, offset, outlen);
+	}
+	for (; count--; msgs += stride, hashsums += outlen)
+		libkeccak_sponge_range(msgs, msglen, rate, nr, pad, hashsums, offset, outlen);
+}
+
+/**
+ * Check whether a byte range of the first output block of up to 64
+ * equal-length messages laid out with a fixed stride matches their
+ * expected values, as many at a time as the selected kernel takes
+ *
+ * @param   msgs      The first message, message `i` starts at `msgs + i * stride`
+ * @param   stride    The distance between the start of two consecutive messages
+ * @param   msglen    The length of each message
+ * @param   count     The number of messages, no greater than 64
+ * @param   rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param   nr        The number of rounds
+ * @param   pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param   expected  The expected ranges, range `i` is stored at `expected + i * len`
+ * @param   offset    The first byte of the range
+ * @param   len       The length of the range, `offset + len` may not exceed `rate`
+ * @return            Bit `i` set if the range of message `i` matches
+ */
+uint64_t libkeccak_sponge_verify_many(const char *msgs, size_t stride, size_t msglen, size_t count, long rate,
+                                      long nr, unsigned char pad, const char *expected, size_t offset, size_t len)
+{
+	const libkeccak_kernel_t *kernel = libkeccak_get_kernel();
+	const char *in[LIBKECCAK_X4], *want[LIBKECCAK_X4];
+	size_t lens[LIBKECCAK_X4] = { msglen, msglen, msglen, msglen };
+	uint64_t valid = 0;
+	size_t i = 0, j;
+
+	for (; i + kernel->width <= count; i += kernel->width) {
+		for (j = 0; j < kernel->width; j++) {
+			in[j] = msgs, msgs += stride;
+			want[j] = expected, expected += len;
+		}
+		valid |= (uint64_t)kernel->verify(in, lens, rate, nr, pad, want, offset, len) << i;
+	}
+	for (; i < count; i++, msgs += stride, expected += len)
+		valid |= (uint64_t)libkeccak_sponge_verify(msgs, msglen, rate, nr, pad, expected, offset, len) << i;
+	return valid;
+}
+
+/**
+ * Define a function hashing up to `N` equal-length messages laid out with a
+ * fixed stride at once, on `N` interleaved narrow states; when there are
+ * fewer than `N` messages the last one fills the unused states, whose
+ * hashsums are discarded
+ *
+ * @param  NAME  The name of the function
+ * @param  V     The interleaved lane type
+ * @param  T     The word type of one state
+ * @param  N     The number of states in a lane
+ * @param  P     The interleaved permutation
+ * @param  LOAD  The little-endian word loader
+ */
+#define LIBKECCAK_SPONGE_NARROW(NAME, V, T, N, P, LOAD)\
+	static void NAME(const char *msgs, size_t stride, size_t msglen, size_t count, long rate,\
+	                 long nr, unsigned char pad, char *hashsums, size_t outlen)\
+	{\
+		V S[25];\
+		unsigned char last[N][200];\
+		const unsigned char *blocks[N];\
+		size_t nblocks = msglen / (size_t)rate, b, off, k;\
+		long i;\
+		int j;\
+		LIBKECCAK_COUNT(LIBKECCAK_BYTES, msglen * count);\
+		memset(S, 0, sizeof(S));\
+		for (j = 0; j < N; j++) {\
+			blocks[j] = (const unsigned char *)msgs + ((size_t)j < count ? (size_t)j : count - 1) * stride;\
+			libkeccak_sponge_pad_block(last[j], (const char *)blocks[j] + nblocks * (size_t)rate,\
+			                           msglen - nblocks * (size_t)rate, rate, pad);\
+		}\
+		for (b = 0; b <= nblocks; b++) {\
+			for (i = 0; i < rate / (long)sizeof(T); i++)\
+				for (j = 0; j < N; j++)\
+					S[LANE_TRANSPOSE_MAP[i]][j] ^= LOAD((b < nblocks ? blocks[j] + b * (size_t)rate : last[j]) +\
+					                                    (size_t)i * sizeof(T));\
+			P(S, nr);\
+		}\
+		for (off = 0;;) {\
+			for (k = 0; k < (size_t)rate && off < outlen; k++, off++)\
+				for (j = 0; (size_t)j < count; j++)\
+					hashsums[(size_t)j * outlen + off] =\
+						(char)(S[LANE_TRANSPOSE_MAP[k / sizeof(T)]][j] >> (k % sizeof(T) * 8));\
+			if (off == outlen)\
+				break;\
+			P(S, nr);\
+		}\
+	}
+
+LIBKECCAK_SPONGE_NARROW(libkeccak_sponge_x8_800, libkeccak_lane32_x8_t, uint32_t, 8, libkeccak_p800_x8, libkeccak_load32)
+LIBKECCAK_SPONGE_NARROW(libkeccak_sponge_x16_400, libkeccak_lane16_x16_t, uint16_t, 16, libkeccak_p400_x16, libkeccak_load16)
+LIBKECCAK_SPONGE_NARROW(libkeccak_sponge_x32_200, libkeccak_lane8_x32_t, uint8_t, 32, libkeccak_p200_x32, libkeccak_load8)
+
+/**
+ * Hash `count` equal-length messages laid out with a fixed stride with a
+ * byte-aligned Keccak-p[25 * w, nr] sponge, packing 8, 16 or 32 states of
+ * 32, 16 or 8 bit words into each 256-bit lane vector
+ *
+ * @param   msgs      The first message, message `i` starts at `msgs + i * stride`
+ * @param   stride    The distance between the start of two consecutive messages
+ * @param   msglen    The length of each message
+ * @param   count     The number of messages
+ * @param   w         The word size in bits, 32, 16 or 8
+ * @param   rate      The bitrate in bytes, a multiple of `w / 8` less than `25 * w / 8`
+ * @param   nr        The number of rounds, no greater than 22, 20 or 18 respectively
+ * @param   pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param   hashsums  Output parameter for the hashsums, hashsum `i` is stored at `hashsums + i * outlen`
+ * @param   outlen    The number of bytes to squeeze for each message
+ * @return            Zero on success, -1 on error; `errno` is `EINVAL` if `w` is not 32, 16 or 8
+ */
+int libkeccak_sponge_many_narrow(const char *msgs, size_t stride, size_t msglen, size_t count, long w, long rate,
+                                 long nr, unsigned char pad, char *hashsums, size_t outlen)
+{
+	void (*sponge)(const char *, size_t, size_t, size_t, long, long, unsigned char, char *, size_t);
+	size_t n;
+
+	switch (w) {
+	case 32:
+		sponge = libkeccak_sponge_x8_800, n = 8;
+		break;
+	case 16:
+		sponge = libkeccak_sponge_x16_400, n = 16;
+		break;
+	case 8:
+		sponge = libkeccak_sponge_x32_200, n = 32;
+		break;
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+	for (; count; count -= n < count ? n : count) {
+		sponge(msgs, stride, msglen, n < count ? n : count, rate, nr, pad, hashsums, outlen);
+		msgs += n * stride, hashsums += n * outlen;
+	}
+	return 0;
+}
@@ -0,0 +1,463 @@
+#ifndef LIBKECCAK_KECCAK_P_H
+#define LIBKECCAK_KECCAK_P_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Number of independent states processed together by the multi-buffer kernel
+#define LIBKECCAK_X4 4
+
+// Number of independent states processed together by the two-state kernel
+#define LIBKECCAK_X2 2
+
+// Padding byte for the original Keccak (and thus Ethereum's Keccak-256)
+#define LIBKECCAK_KECCAK_PAD 0x01
+
+// Padding byte for SHA3, `LIBKECCAK_SHA3_SUFFIX` followed by the first bit of pad10*1
+#define LIBKECCAK_SHA3_PAD 0x06
+
+// Padding byte for SHAKE, `LIBKECCAK_SHAKE_SUFFIX` followed by the first bit of pad10*1
+#define LIBKECCAK_SHAKE_PAD 0x1F
+
+// Padding byte for cSHAKE, `LIBKECCAK_CSHAKE_SUFFIX` followed by the first bit of pad10*1
+#define LIBKECCAK_CSHAKE_PAD 0x04
+
+// Bitrate, in bytes, of Keccak-256
+#define LIBKECCAK_KECCAK256_RATE 136
+
+// One lane of four interleaved Keccak-f[1600] states, element `i` belongs to state `i`
+typedef uint64_t libkeccak_lane_x4_t __attribute__((vector_size(32)));
+
+// One lane of two interleaved Keccak-f[1600] states, a 128-bit vector
+typedef uint64_t libkeccak_lane_x2_t __attribute__((vector_size(16)));
+
+// One lane of eight interleaved Keccak-f[800] states, element `i` belongs to state `i`
+typedef uint32_t libkeccak_lane32_x8_t __attribute__((vector_size(32)));
+
+// One lane of sixteen interleaved Keccak-f[400] states, element `i` belongs to state `i`
+typedef uint16_t libkeccak_lane16_x16_t __attribute__((vector_size(32)));
+
+// One lane of thirty-two interleaved Keccak-f[200] states, element `i` belongs to state `i`
+typedef uint8_t libkeccak_lane8_x32_t __attribute__((vector_size(32)));
+
+/**
+ * Apply Keccak-p[1600, nr], that is, the last `nr` rounds of Keccak-f[1600]
+ *
+ * @param  S   The lanes, in the same layout as `libkeccak_state_t.S`
+ * @param  nr  The number of rounds, 24 for Keccak-f[1600], 12 for KangarooTwelve
+ */
+void libkeccak_p1600(int64_t* S, long nr);
+
+/**
+ * Apply Keccak-p[1600, nr] to two independent states at once
+ *
+ * @param  S   The interleaved lanes, in the same layout as `libkeccak_state_t.S`
+ * @param  nr  The number of rounds
+ */
+void libkeccak_p1600_x2(libkeccak_lane_x2_t* S, long nr);
+
+/**
+ * Apply Keccak-p[1600, nr] to four independent states at once
+ *
+ * @param  S   The interleaved lanes, in the same layout as `libkeccak_state_t.S`
+ * @param  nr  The number of rounds
+ */
+void libkeccak_p1600_x4(libkeccak_lane_x4_t* S, long nr);
+
+/**
+ * Apply Keccak-p[800, nr], that is, the last `nr` rounds of Keccak-f[800]
+ *
+ * @param  S   The lanes, in the same layout as `libkeccak_state_t.S`
+ * @param  nr  The number of rounds, 22 for Keccak-f[800]
+ */
+void libkeccak_p800(uint32_t* S, long nr);
+
+/**
+ * Apply Keccak-p[400, nr], that is, the last `nr` rounds of Keccak-f[400]
+ *
+ * @param  S   The lanes, in the same layout as `libkeccak_state_t.S`
+ * @param  nr  The number of rounds, 20 for Keccak-f[400]
+ */
+void libkeccak_p400(uint16_t* S, long nr);
+
+/**
+ * Apply Keccak-p[200, nr], that is, the last `nr` rounds of Keccak-f[200]
+ *
+ * @param  S   The lanes, in the same layout as `libkeccak_state_t.S`
+ * @param  nr  The number of rounds, 18 for Keccak-f[200]
+ */
+void libkeccak_p200(uint8_t* S, long nr);
+
+/**
+ * Apply Keccak-p[800, nr] to eight independent states at once
+ *
+ * @param  S   The interleaved lanes, in the same layout as `libkeccak_state_t.S`
+ * @param  nr  The number of rounds
+ */
+void libkeccak_p800_x8(libkeccak_lane32_x8_t* S, long nr);
+
+/**
+ * Apply Keccak-p[400, nr] to sixteen independent states at once
+ *
+ * @param  S   The interleaved lanes, in the same layout as `libkeccak_state_t.S`
+ * @param  nr  The number of rounds
+ */
+void libkeccak_p400_x16(libkeccak_lane16_x16_t* S, long nr);
+
+/**
+ * Apply Keccak-p[200, nr] to thirty-two independent states at once
+ *
+ * @param  S   The interleaved lanes, in the same layout as `libkeccak_state_t.S`
+ * @param  nr  The number of rounds
+ */
+void libkeccak_p200_x32(libkeccak_lane8_x32_t* S, long nr);
+
+/**
+ * Hash a complete message with a byte-aligned Keccak-p[1600, nr] sponge,
+ * without allocating any memory
+ *
+ * @param  msg      The message
+ * @param  msglen   The length of the message
+ * @param  rate     The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param  nr       The number of rounds
+ * @param  pad      The domain suffix bits followed by the first bit of pad10*1, e.g. `LIBKECCAK_KECCAK_PAD`
+ * @param  hashsum  Output parameter for the hashsum
+ * @param  outlen   The number of bytes to squeeze
+ */
+void libkeccak_sponge(const char* msg, size_t msglen, long rate, long nr,
+                      unsigned char pad, char* hashsum, size_t outlen);
+
+/**
+ * Hash a complete message with a byte-aligned Keccak-p[1600, nr] sponge
+ * and output only a byte range of the first output block, without
+ * allocating any memory
+ *
+ * @param  msg      The message
+ * @param  msglen   The length of the message
+ * @param  rate     The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param  nr       The number of rounds
+ * @param  pad      The domain suffix bits followed by the first bit of pad10*1, e.g. `LIBKECCAK_KECCAK_PAD`
+ * @param  hashsum  Output parameter for the range, `outlen` bytes
+ * @param  offset   The first byte of the range
+ * @param  outlen   The length of the range, `offset + outlen` may not exceed `rate`
+ */
+void libkeccak_sponge_range(const char* msg, size_t msglen, long rate, long nr,
+                            unsigned char pad, char* hashsum, size_t offset, size_t outlen);
+
+/**
+ * Check whether a byte range of the first output block of a byte-aligned
+ * Keccak-p[1600, nr] sponge matches an expected value, comparing lane by
+ * lane and stopping at the first difference
+ *
+ * @param   msg       The message
+ * @param   msglen    The length of the message
+ * @param   rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param   nr        The number of rounds
+ * @param   pad       The domain suffix bits followed by the first bit of pad10*1, e.g. `LIBKECCAK_KECCAK_PAD`
+ * @param   expected  The expected range, `len` bytes
+ * @param   offset    The first byte of the range
+ * @param   len       The length of the range, `offset + len` may not exceed `rate`
+ * @return            1 if the range matches, 0 otherwise
+ */
+int libkeccak_sponge_verify(const char* msg, size_t msglen, long rate, long nr,
+                            unsigned char pad, const char* expected, size_t offset, size_t len);
+
+/**
+ * Hash four complete messages at once with the multi-buffer kernel
+ *
+ * All messages must span the same number of blocks, that is,
+ * `msglens[i] / rate` must be equal for all `i`
+ *
+ * @param  msgs      The messages
+ * @param  msglens   The lengths of the messages
+ * @param  rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param  nr        The number of rounds
+ * @param  pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param  hashsums  Output parameters for the hashsums
+ * @param  outlen    The number of bytes to squeeze for each message
+ */
+void libkeccak_sponge_x4(const char* const* msgs, const size_t* msglens, long rate, long nr,
+                         unsigned char pad, char* const* hashsums, size_t outlen);
+
+/**
+ * Hash four complete messages at once and output only a byte range of the first
+ * output block of each, with the multi-buffer kernel
+ *
+ * All messages must span the same number of blocks, that is,
+ * `msglens[i] / rate` must be equal for all `i`
+ *
+ * @param  msgs      The messages
+ * @param  msglens   The lengths of the messages
+ * @param  rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param  nr        The number of rounds
+ * @param  pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param  hashsums  Output parameters for the ranges, `outlen` bytes each
+ * @param  offset    The first byte of the range
+ * @param  outlen    The length of the range, `offset + outlen` may not exceed `rate`
+ */
+void libkeccak_sponge_range_x4(const char* const* msgs, const size_t* msglens, long rate, long nr,
+                               unsigned char pad, char* const* hashsums, size_t offset, size_t outlen);
+
+/**
+ * Check whether a byte range of the first output block of four complete
+ * messages matches their expected values, with the multi-buffer kernel
+ *
+ * Only the lanes overlapping the range are compared, masked to the range,
+ * and the comparison stops as soon as every message has differed
+ *
+ * All messages must span the same number of blocks, that is,
+ * `msglens[i] / rate` must be equal for all `i`
+ *
+ * @param   msgs      The messages
+ * @param   msglens   The lengths of the messages
+ * @param   rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param   nr        The number of rounds
+ * @param   pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param   expected  The expected ranges, `len` bytes each
+ * @param   offset    The first byte of the range
+ * @param   len       The length of the range, `offset + len` may not exceed `rate`
+ * @return            Bit `i` set if the range of message `i` matches
+ */
+unsigned libkeccak_sponge_verify_x4(const char* const* msgs, const size_t* msglens, long rate, long nr,
+                                    unsigned char pad, const char* const* expected, size_t offset, size_t len);
+
+/**
+ * Hash two complete messages at once with the two-state kernel
+ *
+ * Both messages must span the same number of blocks, that is,
+ * `msglens[0] / rate` must equal `msglens[1] / rate`
+ *
+ * @param  msgs      The messages
+ * @param  msglens   The lengths of the messages
+ * @param  rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param  nr        The number of rounds
+ * @param  pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param  hashsums  Output parameters for the hashsums
+ * @param  outlen    The number of bytes to squeeze for each message
+ */
+void libkeccak_sponge_x2(const char* const* msgs, const size_t* msglens, long rate, long nr,
+                         unsigned char pad, char* const* hashsums, size_t outlen);
+
+/**
+ * Hash two complete messages at once and output only a byte range of the first
+ * output block of each, with the two-state kernel
+ *
+ * Both messages must span the same number of blocks, that is,
+ * `msglens[0] / rate` must equal `msglens[1] / rate`
+ *
+ * @param  msgs      The messages
+ * @param  msglens   The lengths of the messages
+ * @param  rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param  nr        The number of rounds
+ * @param  pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param  hashsums  Output parameters for the ranges, `outlen` bytes each
+ * @param  offset    The first byte of the range
+ * @param  outlen    The length of the range, `offset + outlen` may not exceed `rate`
+ */
+void libkeccak_sponge_range_x2(const char* const* msgs, const size_t* msglens, long rate, long nr,
+                               unsigned char pad, char* const* hashsums, size_t offset, size_t outlen);
+
+/**
+ * Check whether a byte range of the first output block of two complete
+ * messages matches their expected values, with the two-state kernel
+ *
+ * Only the lanes overlapping the range are compared, masked to the range,
+ * and the comparison stops as soon as both messages have differed
+ *
+ * Both messages must span the same number of blocks, that is,
+ * `msglens[0] / rate` must equal `msglens[1] / rate`
+ *
+ * @param   msgs      The messages
+ * @param   msglens   The lengths of the messages
+ * @param   rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param   nr        The number of rounds
+ * @param   pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param   expected  The expected ranges, `len` bytes each
+ * @param   offset    The first byte of the range
+ * @param   len       The length of the range, `offset + len` may not exceed `rate`
+ * @return            Bit `i` set if the range of message `i` matches
+ */
+unsigned libkeccak_sponge_verify_x2(const char* const* msgs, const size_t* msglens, long rate, long nr,
+                                    unsigned char pad, const char* const* expected, size_t offset, size_t len);
+
+/**
+ * Kernel that hashes several messages spanning the same number of blocks at once
+ *
+ * `libkeccak_sponge_many` and `libkeccak_sponge_range_many`, and through
+ * them `PublicKeysToAddresses`, run on
+ * the selected kernel. The four-state kernel wants 256-bit vectors; on
+ * hosts without AVX2 it is split into pairs of 128-bit operations, and the
+ * two-state kernel, which fits the 128-bit registers exactly, is the faster one
+ */
+typedef struct libkeccak_kernel {
+	const char* name; // The name of the kernel
+	size_t width;     // The number of messages per call, no greater than `LIBKECCAK_X4`
+	void (*sponge)(const char* const* msgs, const size_t* msglens, long rate, long nr,
+	               unsigned char pad, char* const* hashsums, size_t outlen); // Like `libkeccak_sponge_x4`, for `width` messages
+	void (*range)(const char* const* msgs, const size_t* msglens, long rate, long nr, unsigned char pad,
+	              char* const* hashsums, size_t offset, size_t outlen); // Like `libkeccak_sponge_range_x4`, for `width` messages
+	unsigned (*verify)(const char* const* msgs, const size_t* msglens, long rate, long nr, unsigned char pad,
+	                   const char* const* expected, size_t offset, size_t len); // Like `libkeccak_sponge_verify_x4`, for `width` messages
+	void (*permute)(uint64_t* S, long nr); // Keccak-p[1600, nr] on `width` interleaved states, lane `i` of state `j` at
+	                                       // `S[i * width + j]`, `S` aligned as `libkeccak_lane_x4_t`
+} libkeccak_kernel_t;
+
+// The kernel that is used, the default unless changed with `libkeccak_set_kernel`;
+// only accessed atomically, read it with `libkeccak_get_kernel`
+extern const libkeccak_kernel_t* libkeccak_kernel;
+
+// One message at a time with `libkeccak_sponge`
+extern const libkeccak_kernel_t libkeccak_scalar_kernel;
+
+// Two messages at a time with `libkeccak_sponge_x2`
+extern const libkeccak_kernel_t libkeccak_x2_kernel;
+
+// Four messages at a time with `libkeccak_sponge_x4`
+extern const libkeccak_kernel_t libkeccak_x4_kernel;
+
+/**
+ * Select the kernel for all subsequent multi-message hashing; safe to
+ * call while other threads are hashing, calls already running finish on
+ * the kernel they started with
+ *
+ * @param  kernel  The kernel, `NULL` for the default: `libkeccak_x4_kernel` when
+ *                 the library is built for AVX2, `libkeccak_x2_kernel` otherwise
+ */
+void libkeccak_set_kernel(const libkeccak_kernel_t* kernel);
+
+/**
+ * Get the kernel selected with `libkeccak_set_kernel`
+ *
+ * The kernels are constants, so a relaxed load is enough: a call that
+ * races with `libkeccak_set_kernel` reads the kernel once and runs
+ * entirely on either the old or the new one
+ *
+ * @return  The kernel
+ */
+static inline const libkeccak_kernel_t* libkeccak_get_kernel(void)
+{
+	return __atomic_load_n(&libkeccak_kernel, __ATOMIC_RELAXED);
+}
+
+/**
+ * Hash `count` equal-length messages laid out with a fixed stride,
+ * as many at a time as the kernel selected with `libkeccak_set_kernel` takes
+ *
+ * @param  msgs      The first message, message `i` starts at `msgs + i * stride`
+ * @param  stride    The distance between the start of two consecutive messages
+ * @param  msglen    The length of each message
+ * @param  count     The number of messages
+ * @param  rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param  nr        The number of rounds
+ * @param  pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param  hashsums  Output parameter for the hashsums, hashsum `i` is stored at `hashsums + i * outlen`
+ * @param  outlen    The number of bytes to squeeze for each message
+ */
+void libkeccak_sponge_many(const char* msgs, size_t stride, size_t msglen, size_t count, long rate,
+                           long nr, unsigned char pad, char* hashsums, size_t outlen);
+
+/**
+ * Hash `count` equal-length messages laid out with a fixed stride and
+ * output only a byte range of the first output block of each, as many
+ * at a time as the kernel selected with `libkeccak_set_kernel` takes
+ *
+ * @param  msgs      The first message, message `i` starts at `msgs + i * stride`
+ * @param  stride    The distance between the start of two consecutive messages
+ * @param  msglen    The length of each message
+ * @param  count     The number of messages
+ * @param  rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param  nr        The number of rounds
+ * @param  pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param  hashsums  Output parameter for the ranges, range `i` is stored at `hashsums + i * outlen`
+ * @param  offset    The first byte of the range
+ * @param  outlen    The length of the range, `offset + outlen` may not exceed `rate`
+ */
+void libkeccak_sponge_range_many(const char* msgs, size_t stride, size_t msglen, size_t count, long rate,
+                                 long nr, unsigned char pad, char* hashsums, size_t offset, size_t outlen);
+
+/**
+ * Check whether a byte range of the first output block of up to 64
+ * equal-length messages laid out with a fixed stride matches their
+ * expected values, as many at a time as the selected kernel takes
+ *
+ * @param   msgs      The first message, message `i` starts at `msgs + i * stride`
+ * @param   stride    The distance between the start of two consecutive messages
+ * @param   msglen    The length of each message
+ * @param   count     The number of messages, no greater than 64
+ * @param   rate      The bitrate in bytes, a multiple of 8 no greater than 192
+ * @param   nr        The number of rounds
+ * @param   pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param   expected  The expected ranges, range `i` is stored at `expected + i * len`
+ * @param   offset    The first byte of the range
+ * @param   len       The length of the range, `offset + len` may not exceed `rate`
+ * @return            Bit `i` set if the range of message `i` matches
+ */
+uint64_t libkeccak_sponge_verify_many(const char* msgs, size_t stride, size_t msglen, size_t count, long rate,
+                                      long nr, unsigned char pad, const char* expected, size_t offset, size_t len);
+
+/**
+ * Hash `count` equal-length messages laid out with a fixed stride with a
+ * byte-aligned Keccak-p[25 * w, nr] sponge, packing 8, 16 or 32 states of
+ * 32, 16 or 8 bit words into each 256-bit lane vector
+ *
+ * @param   msgs      The first message, message `i` starts at `msgs + i * stride`
+ * @param   stride    The distance between the start of two consecutive messages
+ * @param   msglen    The length of each message
+ * @param   count     The number of messages
+ * @param   w         The word size in bits, 32, 16 or 8
+ * @param   rate      The bitrate in bytes, a multiple of `w / 8` less than `25 * w / 8`
+ * @param   nr        The number of rounds, no greater than 22, 20 or 18 respectively
+ * @param   pad       The domain suffix bits followed by the first bit of pad10*1
+ * @param   hashsums  Output parameter for the hashsums, hashsum `i` is stored at `hashsums + i * outlen`
+ * @param   outlen    The number of bytes to squeeze for each message
+ * @return            Zero on success, -1 on error; `errno` is `EINVAL` if `w` is not 32, 16 or 8
+ */
+int libkeccak_sponge_many_narrow(const char* msgs, size_t stride, size_t msglen, size_t count, long w, long rate,
+                                 long nr, unsigned char pad, char* hashsums, size_t outlen);
+
+/**
+ * Calculate the Keccak-256 hashsum, as used by Ethereum, of a message
+ *
+ * @param  msg      The message
+ * @param  msglen   The length of the message
+ * @param  hashsum  Output parameter for the 32 byte hashsum
+ */
+static inline void libkeccak_keccak256(const char* msg, size_t msglen, char* hashsum)
+{
+	libkeccak_sponge(msg, msglen, LIBKECCAK_KECCAK256_RATE, 24, LIBKECCAK_KECCAK_PAD, hashsum, 32);
+}
+
+/**
+ * Calculate only a byte range of the Keccak-256 hashsum of a message,
+ * e.g. bytes 0 to 3 for a function selector or 12 to 31 for an address
+ *
+ * @param  msg      The message
+ * @param  msglen   The length of the message
+ * @param  hashsum  Output parameter for the range, `outlen` bytes
+ * @param  offset   The first byte of the range
+ * @param  outlen   The length of the range, `offset + outlen` may not exceed 32
+ */
+static inline void libkeccak_keccak256_range(const char* msg, size_t msglen, char* hashsum,
+                                             size_t offset, size_t outlen)
+{
+	libkeccak_sponge_range(msg, msglen, LIBKECCAK_KECCAK256_RATE, 24, LIBKECCAK_KECCAK_PAD, hashsum, offset, outlen);
+}
+
+/**
+ * Check whether a byte range of the Keccak-256 hashsum of a message matches
+ * an expected value, without writing out the hashsum
+ *
+ * @param   msg       The message
+ * @param   msglen    The length of the message
+ * @param   expected  The expected range, `len` bytes
+ * @param   offset    The first byte of the range
+ * @param   len       The length of the range, `offset + len` may not exceed 32
+ * @return            1 if the range matches, 0 otherwise
+ */
+static inline int libkeccak_keccak256_verify(const char* msg, size_t msglen, const char* expected,
+                                             size_t offset, size_t len)
+{
+	return libkeccak_sponge_verify(msg, msglen, LIBKECCAK_KECCAK256_RATE, 24, LIBKECCAK_KECCAK_PAD, expected, offset, len);
+}
+
+#endif
@@ -1,7 +1,7 @@
 #include "keccak256.h"
 
 static void* emalloc(size_t n){
-  void* r = malloc(n);
+  void* r = libkeccak_malloc(n);
 
   if(!r)
     return (void*)-1;
@@ -18,11 +18,13 @@ int generalised_sum_fd_hex(const char* publicKey, libkeccak_state_t* state, cons
   char even = 1;
   char buf = 0;
   char c;
+  LIBKECCAK_TIMER(stage);
 
   if(libkeccak_state_initialise(state, spec) < 0)
     return -1;
 
-  chunk = (char*)malloc(blksize);
+  chunk = (char*)libkeccak_malloc(blksize);
+  LIBKECCAK_RECORD(LIBKECCAK_STAGE_SETUP, stage);
 
   for(int i = 0; i < strlen(publicKey); i++){
     c = publicKey[i];
@@ -35,18 +37,20 @@ int generalised_sum_fd_hex(const char* publicKey, libkeccak_state_t* state, cons
   }
 
   w = 64; // w should ALWAYS be 64
+  LIBKECCAK_RECORD(LIBKECCAK_STAGE_PARSE, stage);
 
   if(libkeccak_fast_update(state, chunk, w) < 0){
-    free(chunk);
+    libkeccak_free(chunk);
     return -1;
   }
 
-  free(chunk);
+  libkeccak_free(chunk);
 
   if(!even)
     return -1;
 
   libkeccak_fast_digest(state, NULL, 0, 0, "", hash);
+  LIBKECCAK_RECORD(LIBKECCAK_STAGE_HASH, stage);
   return 0;
 }
 
@@ -64,14 +68,6 @@ int hash(const char* publicKey, const libkeccak_spec_t* spec){
   return 0;
 }
 
-void libkeccak_behex_lower(char* output, const char* hashsum, size_t n){
-  output[2 * n] = '\0';
-  while (n--) {
-    output[2 * n + 0] = "0123456789abcdef"[(hashsum[n] >> 4) & 15];
-    output[2 * n + 1] = "0123456789abcdef"[(hashsum[n] >> 0) & 15];
-  }
-}
-
 int print_checksum(const char* publicKey, const libkeccak_spec_t* spec){
   size_t n = (size_t)((spec->output + 7) / 8);
 
@@ -82,29 +78,121 @@ int print_checksum(const char* publicKey, const libkeccak_spec_t* spec){
   return 0;
 }
 
+// Returns "0x" and the 40 hex digits of the address, or (char*)-1 if the key
+// does not parse. The string is allocated with new[], not libkeccak_malloc,
+// whatever allocator is set: callers of this, and of the precompiled build,
+// release it with delete[]
 char* PublicKeyToAddress(const char* publicKey){
   libkeccak_generalised_spec_t gspec;
   libkeccak_spec_t              spec;
+  LIBKECCAK_TIMER(start);
+
+  LIBKECCAK_COUNT(LIBKECCAK_CALLS, 1);
 
   libkeccak_generalised_spec_initialise(&gspec);
   libkeccak_spec_sha3((libkeccak_spec_t *)&gspec, 256);
 
   libkeccak_degeneralise_spec(&gspec, &spec);
 
-  if(print_checksum(publicKey, &spec) == -1)
-    return (char*)-1;
+  libkeccak_state_t state;
+  char binary[ADDRESS_SIZE];
 
+  // Squeeze only the address bytes out of the sponge, the first 12 bytes
+  // of the hashsum are never produced
   //                      24 | 40
   // 3bb89452fe5544e057767a22|e7b8a14e8338963e64fb146cd22746b543d339e8
   //                         |e7B8a14E8338963E64fB146cd22746B543D339e8
+  if(generalised_sum_fd_hex(publicKey, &state, &spec, NULL) == -1){
+    LIBKECCAK_COUNT(LIBKECCAK_ERRORS, 1);
+    return (char*)-1;
+  }
+
+  LIBKECCAK_TIMER(stage);
+  libkeccak_squeeze_range(&state, binary, 32 - ADDRESS_SIZE, ADDRESS_SIZE);
+  libkeccak_state_fast_destroy(&state);
+
   char* address = new char[43];
   address[0] = '0';
   address[1] = 'x';
-  memcpy(&address[2], &hexsum[24], 40);
-  address[42] = '\0';
+  libkeccak_behex_lower(&address[2], binary, ADDRESS_SIZE);
+  LIBKECCAK_RECORD(LIBKECCAK_STAGE_FORMAT, stage);
+  LIBKECCAK_RECORD(LIBKECCAK_LATENCY_KEY, start);
+
+  return address;
+}
+
+// Cached form of PublicKeyToAddress: repeated keys cost a hex decode, a cache
+// lookup and a hex encode; a miss additionally costs one permutation. The
+// string is released with delete[], as for the uncached form
+char* PublicKeyToAddress(const char* publicKey, libkeccak_cache_t* cache){
+  char key[PUBLIC_KEY_SIZE];
+  char binary[ADDRESS_SIZE];
+  size_t w = 0;
+  char even = 1;
+  char buf = 0;
+  char c;
+  LIBKECCAK_TIMER(start);
+  LIBKECCAK_TIMER(stage);
+
+  LIBKECCAK_COUNT(LIBKECCAK_CALLS, 1);
+  for(size_t i = 0; publicKey[i] && w < PUBLIC_KEY_SIZE; i++){
+    c = publicKey[i];
+
+    if(isxdigit(c)){
+      buf = (buf << 4) | ((c & 15) + (c > '9' ? 9 : 0));
+      if((even ^= 1))
+        key[w++] = buf;
+    }
+  }
+
+  if(w != PUBLIC_KEY_SIZE){
+    LIBKECCAK_COUNT(LIBKECCAK_ERRORS, 1);
+    return (char*)-1;
+  }
+  LIBKECCAK_RECORD(LIBKECCAK_STAGE_PARSE, stage);
 
-  free(hexsum);
-  free(hashsum);
+  libkeccak_cache_address(cache, key, binary);
+  LIBKECCAK_RECORD(LIBKECCAK_STAGE_HASH, stage);
+
+  char* address = new char[43];
+  address[0] = '0';
+  address[1] = 'x';
+  libkeccak_behex_lower(&address[2], binary, ADDRESS_SIZE);
+  LIBKECCAK_RECORD(LIBKECCAK_STAGE_FORMAT, stage);
+  LIBKECCAK_RECORD(LIBKECCAK_LATENCY_KEY, start);
 
   return address;
 }
+
+// Binary batch form of PublicKeyToAddress: count keys of PUBLIC_KEY_SIZE bytes
+// in, count addresses of ADDRESS_SIZE bytes out, on the kernel selected with
+// libkeccak_set_kernel
+void PublicKeysToAddresses(const char* publicKeys, size_t count, char* addresses){
+  LIBKECCAK_TIMER(start);
+
+  LIBKECCAK_COUNT(LIBKECCAK_CALLS, 1);
+  libkeccak_sponge_range_many(publicKeys, PUBLIC_KEY_SIZE, PUBLIC_KEY_SIZE, count, LIBKECCAK_KECCAK256_RATE, 24,
+                              LIBKECCAK_KECCAK_PAD, addresses, 32 - ADDRESS_SIZE, ADDRESS_SIZE);
+  LIBKECCAK_RECORD(LIBKECCAK_LATENCY_KEYS, start);
+}
+
+// Checks count keys of PUBLIC_KEY_SIZE bytes against count addresses of
+// ADDRESS_SIZE bytes without deriving them: only the hash lanes holding the
+// address are compared. Bit i % 64 of valid[i / 64] is set if key i matches,
+// and the number of matches is returned
+size_t VerifyAddresses(const char* publicKeys, size_t count, const char* addresses, uint64_t* valid){
+  size_t matches = 0;
+  LIBKECCAK_TIMER(start);
+
+  LIBKECCAK_COUNT(LIBKECCAK_CALLS, 1);
+  for(size_t i = 0; i < count; i += 64){
+    size_t n = count - i < 64 ? count - i : 64;
+
+    valid[i / 64] = libkeccak_sponge_verify_many(&publicKeys[i * PUBLIC_KEY_SIZE], PUBLIC_KEY_SIZE, PUBLIC_KEY_SIZE, n,
+                                                 LIBKECCAK_KECCAK256_RATE, 24, LIBKECCAK_KECCAK_PAD,
+                                                 &addresses[i * ADDRESS_SIZE], 32 - ADDRESS_SIZE, ADDRESS_SIZE);
+    matches += __builtin_popcountll(valid[i / 64]);
+  }
+  LIBKECCAK_RECORD(LIBKECCAK_LATENCY_KEYS, start);
+  return matches;
+}
@@ -4,18 +4,29 @@
 extern "C" {
   #include "generalised-spec.h"
   #include "digest.h"
+  #include "keccak-p.h"
+  #include "cache.h"
+  #include "compact.h"
+  #include "secp256k1.h"
+  #include "checkpoint.h"
+  #include "metrics.h"
 }
 
 #include <sys/stat.h>
 #include <ctype.h>
 
+#define PUBLIC_KEY_SIZE 64 // Binary uncompressed public key, without the 0x04 prefix
+#define ADDRESS_SIZE    20 // Binary address, the last 20 bytes of the Keccak-256 hashsum
+
 static char* hashsum = NULL;
 static char* hexsum  = NULL;
 static void* emalloc(size_t n);
 int generalised_sum_fd_hex(const char* publicKey, libkeccak_state_t* state, const libkeccak_spec_t* spec, char* hash);
 int hash(const char* publicKey, const libkeccak_spec_t* spec);
-void libkeccak_behex_lower(char* output, const char* hashsum, size_t n);
 int print_checksum(const char* publicKey, const libkeccak_spec_t* spec);
 char* PublicKeyToAddress(const char* publicKey);
+char* PublicKeyToAddress(const char* publicKey, libkeccak_cache_t* cache);
+void PublicKeysToAddresses(const char* publicKeys, size_t count, char* addresses);
+size_t VerifyAddresses(const char* publicKeys, size_t count, const char* addresses, uint64_t* valid);
 
 #endif
@@ -0,0 +1,202 @@
+#include "logs-bloom.h"
+#include "parallel.h"
+
+#include <string.h>
+
+// Number of hashsum bytes that select the bits of an item, three 11-bit indices
+#define LIBKECCAK_LOGS_BLOOM_BYTES 6
+
+// Receipts handed to a thread at a time
+#define LIBKECCAK_LOGS_BLOOM_GRAIN 16
+
+// Addresses, and topics, gathered into a column before they are hashed
+#define LIBKECCAK_LOGS_BLOOM_COLUMN 64
+
+/**
+ * Locate one of the three bits selected by the leading bytes of a
+ * hashsum; the bloom is a big-endian 2048-bit number and each pair
+ * of bytes, modulo 2048, is the index of a bit
+ *
+ * @param   h     The first `LIBKECCAK_LOGS_BLOOM_BYTES` bytes of the hashsum
+ * @param   i     Which of the three bits, 0, 1 or 2
+ * @param   mask  Output parameter for the bit within its byte
+ * @return        The byte of the bloom holding the bit
+ */
+static inline size_t libkeccak_logs_bloom_bit(const unsigned char *restrict h, int i, unsigned char *restrict mask)
+{
+	unsigned bit = ((unsigned)h[2 * i] << 8 | h[2 * i + 1]) & 2047;
+	*mask = (unsigned char)(1 << (bit & 7));
+	return LIBKECCAK_LOGS_BLOOM_SIZE - 1 - (bit >> 3);
+}
+
+/**
+ * Set the three bits selected by the leading bytes of a hashsum
+ *
+ * @param  bloom  The bloom
+ * @param  h      The first `LIBKECCAK_LOGS_BLOOM_BYTES` bytes of the hashsum
+ */
+static inline void libkeccak_logs_bloom_set(unsigned char *restrict bloom, const unsigned char *restrict h)
+{
+	unsigned char mask;
+	int i;
+	for (i = 0; i < LIBKECCAK_LOGS_BLOOM_BYTES / 2; i++)
+		bloom[libkeccak_logs_bloom_bit(h, i, &mask)] |= mask;
+}
+
+/**
+ * Hash only the bytes of an item that select its bits
+ *
+ * @param  item     The item
+ * @param  itemlen  The length of the item
+ * @param  h        Output parameter for the first `LIBKECCAK_LOGS_BLOOM_BYTES` bytes of the hashsum
+ */
+static inline void libkeccak_logs_bloom_hash(const char *restrict item, size_t itemlen, unsigned char *restrict h)
+{
+	libkeccak_keccak256_range(item, itemlen, (char *)h, 0, LIBKECCAK_LOGS_BLOOM_BYTES);
+}
+
+/**
+ * Add an item to a logs bloom, setting the three bits selected by the
+ * first six bytes of its Keccak-256 hashsum
+ *
+ * @param  bloom    The bloom, `LIBKECCAK_LOGS_BLOOM_SIZE` bytes
+ * @param  item     The item, an address or a topic
+ * @param  itemlen  The length of the item
+ */
+void libkeccak_logs_bloom_add(unsigned char *restrict bloom, const char *restrict item, size_t itemlen)
+{
+	unsigned char h[LIBKECCAK_LOGS_BLOOM_BYTES];
+	libkeccak_logs_bloom_hash(item, itemlen, h);
+	libkeccak_logs_bloom_set(bloom, h);
+}
+
+/**
+ * Check whether an item may have been added to a logs bloom
+ *
+ * @param   bloom    The bloom, `LIBKECCAK_LOGS_BLOOM_SIZE` bytes
+ * @param   item     The item, an address or a topic
+ * @param   itemlen  The length of the item
+ * @return           0 if the item certainly was not added, 1 if it may have been
+ */
+int libkeccak_logs_bloom_test(const unsigned char *restrict bloom, const char *restrict item, size_t itemlen)
+{
+	unsigned char h[LIBKECCAK_LOGS_BLOOM_BYTES], mask;
+	int i;
+
+	libkeccak_logs_bloom_hash(item, itemlen, h);
+	for (i = 0; i < LIBKECCAK_LOGS_BLOOM_BYTES / 2; i++)
+		if (!(bloom[libkeccak_logs_bloom_bit(h, i, &mask)] & mask))
+			return 0;
+	return 1;
+}
+
+/**
+ * Hash a column of equal-length items and set the bits each selects
+ *
+ * @param  bloom    The bloom
+ * @param  column   The items, item `i` is stored at `column + i * itemlen`
+ * @param  itemlen  The length of each item
+ * @param  n        The number of items, at most `LIBKECCAK_LOGS_BLOOM_COLUMN`
+ */
+static void libkeccak_logs_bloom_column(unsigned char *restrict bloom, const char *restrict column,
+                                        size_t itemlen, size_t n)
+{
+	unsigned char h[LIBKECCAK_LOGS_BLOOM_COLUMN][LIBKECCAK_LOGS_BLOOM_BYTES];
+	size_t k;
+
+	libkeccak_sponge_many(column, itemlen, itemlen, n, LIBKECCAK_KECCAK256_RATE, 24, LIBKECCAK_KECCAK_PAD,
+	                      (char *)h[0], LIBKECCAK_LOGS_BLOOM_BYTES);
+	for (k = 0; k < n; k++)
+		libkeccak_logs_bloom_set(bloom, h[k]);
+}
+
+/**
+ * Add the addresses and topics of logs to a logs bloom; addresses and
+ * topics are gathered into a column each and hashed on the kernel
+ * selected with `libkeccak_set_kernel`
+ *
+ * @param  logs   The logs
+ * @param  count  The number of logs
+ * @param  bloom  The bloom, `LIBKECCAK_LOGS_BLOOM_SIZE` bytes, the bits are ORed into it
+ */
+void libkeccak_logs_bloom(const libkeccak_log_t *restrict logs, size_t count, unsigned char *restrict bloom)
+{
+	char addresses[LIBKECCAK_LOGS_BLOOM_COLUMN * LIBKECCAK_LOGS_BLOOM_ADDRESS];
+	char topics[LIBKECCAK_LOGS_BLOOM_COLUMN * LIBKECCAK_LOGS_BLOOM_TOPIC];
+	size_t i, t, na = 0, nt = 0;
+
+	for (i = 0; i < count; i++) {
+		memcpy(addresses + na * LIBKECCAK_LOGS_BLOOM_ADDRESS, logs[i].address, LIBKECCAK_LOGS_BLOOM_ADDRESS);
+		if (++na == LIBKECCAK_LOGS_BLOOM_COLUMN) {
+			libkeccak_logs_bloom_column(bloom, addresses, LIBKECCAK_LOGS_BLOOM_ADDRESS, na);
+			na = 0;
+		}
+		for (t = 0; t < logs[i].ntopics; t++) {
+			memcpy(topics + nt * LIBKECCAK_LOGS_BLOOM_TOPIC, logs[i].topics + t * LIBKECCAK_LOGS_BLOOM_TOPIC,
+			       LIBKECCAK_LOGS_BLOOM_TOPIC);
+			if (++nt == LIBKECCAK_LOGS_BLOOM_COLUMN) {
+				libkeccak_logs_bloom_column(bloom, topics, LIBKECCAK_LOGS_BLOOM_TOPIC, nt);
+				nt = 0;
+			}
+		}
+	}
+
+	if (na)
+		libkeccak_logs_bloom_column(bloom, addresses, LIBKECCAK_LOGS_BLOOM_ADDRESS, na);
+	if (nt)
+		libkeccak_logs_bloom_column(bloom, topics, LIBKECCAK_LOGS_BLOOM_TOPIC, nt);
+}
+
+// A block of receipts
+struct libkeccak_logs_bloom_input {
+	const libkeccak_log_t *logs; // The logs of the block
+	const size_t *receipts;      // The positions of the receipts in `logs`
+	unsigned char *blooms;       // The receipt blooms
+};
+
+/**
+ * Build the blooms of the receipts at `[begin, end)`
+ *
+ * @param  ctx    The `struct libkeccak_logs_bloom_input`
+ * @param  begin  The first receipt
+ * @param  end    One past the last receipt
+ */
+static void libkeccak_logs_bloom_range(void *ctx, size_t begin, size_t end)
+{
+	const struct libkeccak_logs_bloom_input *in = ctx;
+	unsigned char *bloom;
+	for (; begin < end; begin++) {
+		bloom = in->blooms + begin * LIBKECCAK_LOGS_BLOOM_SIZE;
+		memset(bloom, 0, LIBKECCAK_LOGS_BLOOM_SIZE);
+		libkeccak_logs_bloom(in->logs + in->receipts[begin], in->receipts[begin + 1] - in->receipts[begin], bloom);
+	}
+}
+
+/**
+ * Build the logs bloom of every receipt of a block, and of the block,
+ * with receipts spread across `threads` threads
+ *
+ * @param  logs      The logs of the block
+ * @param  receipts  `count + 1` positions in `logs`, receipt `i` holds the logs
+ *                   from `receipts[i]` up to, but not including, `receipts[i + 1]`
+ * @param  count     The number of receipts
+ * @param  blooms    Output parameter for the receipt blooms, bloom `i` is stored at
+ *                   `blooms + i * LIBKECCAK_LOGS_BLOOM_SIZE`
+ * @param  block     Output parameter for the block bloom, the OR of every receipt bloom, may be `NULL`
+ * @param  threads   The number of threads, zero or negative for one per online processor
+ */
+void libkeccak_logs_bloom_block(const libkeccak_log_t *restrict logs, const size_t *restrict receipts, size_t count,
+                                unsigned char *restrict blooms, unsigned char *restrict block, long threads)
+{
+	struct libkeccak_logs_bloom_input in = {logs, receipts, blooms};
+	size_t i, j;
+
+	libkeccak_parallel_for(count, LIBKECCAK_LOGS_BLOOM_GRAIN, libkeccak_logs_bloom_range, &in, threads);
+
+	if (!block)
+		return;
+	memset(block, 0, LIBKECCAK_LOGS_BLOOM_SIZE);
+	for (i = 0; i < count; i++)
+		for (j = 0; j < LIBKECCAK_LOGS_BLOOM_SIZE; j++)
+			block[j] |= blooms[i * LIBKECCAK_LOGS_BLOOM_SIZE + j];
+}
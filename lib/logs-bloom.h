@@ -0,0 +1,71 @@
+#ifndef LIBKECCAK_LOGS_BLOOM_H
+#define LIBKECCAK_LOGS_BLOOM_H
+
+#include "keccak-p.h"
+
+#include <stddef.h>
+
+// Size of a logs bloom, 2048 bits
+#define LIBKECCAK_LOGS_BLOOM_SIZE 256
+
+// Size of a log address
+#define LIBKECCAK_LOGS_BLOOM_ADDRESS 20
+
+// Size of a log topic
+#define LIBKECCAK_LOGS_BLOOM_TOPIC 32
+
+// A log entry, as far as its bloom is concerned
+typedef struct libkeccak_log {
+	const char* address; // The address of the emitting contract, `LIBKECCAK_LOGS_BLOOM_ADDRESS` bytes
+	const char* topics;  // The topics, `ntopics * LIBKECCAK_LOGS_BLOOM_TOPIC` bytes
+	size_t ntopics;      // The number of topics
+} libkeccak_log_t;
+
+/**
+ * Add an item to a logs bloom, setting the three bits selected by the
+ * first six bytes of its Keccak-256 hashsum
+ *
+ * @param  bloom    The bloom, `LIBKECCAK_LOGS_BLOOM_SIZE` bytes
+ * @param  item     The item, an address or a topic
+ * @param  itemlen  The length of the item
+ */
+void libkeccak_logs_bloom_add(unsigned char* bloom, const char* item, size_t itemlen);
+
+/**
+ * Check whether an item may have been added to a logs bloom
+ *
+ * @param   bloom    The bloom, `LIBKECCAK_LOGS_BLOOM_SIZE` bytes
+ * @param   item     The item, an address or a topic
+ * @param   itemlen  The length of the item
+ * @return           0 if the item certainly was not added, 1 if it may have been
+ */
+int libkeccak_logs_bloom_test(const unsigned char* bloom, const char* item, size_t itemlen);
+
+/**
+ * Add the addresses and topics of logs to a logs bloom; addresses and
+ * topics are gathered into a column each and hashed on the kernel
+ * selected with `libkeccak_set_kernel`
+ *
+ * @param  logs   The logs
+ * @param  count  The number of logs
+ * @param  bloom  The bloom, `LIBKECCAK_LOGS_BLOOM_SIZE` bytes, the bits are ORed into it
+ */
+void libkeccak_logs_bloom(const libkeccak_log_t* logs, size_t count, unsigned char* bloom);
+
+/**
+ * Build the logs bloom of every receipt of a block, and of the block,
+ * with receipts spread across `threads` threads
+ *
+ * @param  logs      The logs of the block
+ * @param  receipts  `count + 1` positions in `logs`, receipt `i` holds the logs
+ *                   from `receipts[i]` up to, but not including, `receipts[i + 1]`
+ * @param  count     The number of receipts
+ * @param  blooms    Output parameter for the receipt blooms, bloom `i` is stored at
+ *                   `blooms + i * LIBKECCAK_LOGS_BLOOM_SIZE`
+ * @param  block     Output parameter for the block bloom, the OR of every receipt bloom, may be `NULL`
+ * @param  threads   The number of threads, zero or negative for one per online processor
+ */
+void libkeccak_logs_bloom_block(const libkeccak_log_t* logs, const size_t* receipts, size_t count,
+                                unsigned char* blooms, unsigned char* block, long threads);
+
+#endif
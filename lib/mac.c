@@ -0,0 +1,351 @@
+#include "mac.h"
+#include "keccak-f.h"
+#include "sp800-185.h"
+
+// Padding of the HMAC inner key block
+#define LIBKECCAK_HMAC_IPAD 0x36
+
+// Padding of the HMAC outer key block
+#define LIBKECCAK_HMAC_OPAD 0x5C
+
+/**
+ * Finish a `bytepad`, absorbing zeroes up to the next block boundary
+ *
+ * @param  state  The hashing state
+ */
+static void libkeccak_mac_bytepad_end(libkeccak_compact_t *restrict state)
+{
+	static const char zeroes[LIBKECCAK_COMPACT_MAX_RATE];
+	if (state->mptr)
+		libkeccak_compact_update(state, zeroes, (size_t)(state->rate - state->mptr));
+}
+
+/**
+ * Absorb `encode_string(str)` into a compact sponge
+ *
+ * @param  state  The hashing state
+ * @param  str    The string, may be `NULL` if `len` is zero
+ * @param  len    The length of the string, in bytes
+ */
+static void libkeccak_mac_encode_string(libkeccak_compact_t *restrict state, const char *restrict str, size_t len)
+{
+	char enc[LIBKECCAK_ENCODE_MAX];
+	libkeccak_compact_update(state, enc, libkeccak_left_encode(enc, len << 3));
+	if (len)
+		libkeccak_compact_update(state, str, len);
+}
+
+/**
+ * Compare a calculated MAC with a claimed one, in time independent of their contents
+ *
+ * @param   a    The calculated MAC
+ * @param   b    The claimed MAC
+ * @param   len  The length of the MACs
+ * @return       1 if they are equal, 0 otherwise
+ */
+static inline int libkeccak_mac_equal(const char *restrict a, const char *restrict b, size_t len)
+{
+	unsigned char d = 0;
+	while (len--)
+		d |= (unsigned char)(a[len] ^ b[len]);
+	return !d;
+}
+
+/**
+ * Calculate as many MACs at once from one midstate as the kernel
+ * selected with `libkeccak_set_kernel` takes, with its permutation
+ *
+ * The midstate must be on a block boundary, `msglens[i] + suffixlen`
+ * must span the same number of whole blocks for all `i`, and `outlen`
+ * may not exceed the bitrate
+ *
+ * @param  kernel     The kernel
+ * @param  mid        The midstate
+ * @param  msgs       The messages, `kernel->width` of them
+ * @param  msglens    The lengths of the messages
+ * @param  suffix     Bytes absorbed after every message, may be `NULL` if `suffixlen` is zero
+ * @param  suffixlen  The length of `suffix`, less than the bitrate
+ * @param  outs       Output parameters for the MACs
+ * @param  outlen     The length of each MAC
+ */
+static void libkeccak_mac_many(const libkeccak_kernel_t *restrict kernel, const libkeccak_compact_t *restrict mid,
+                               const char *const *msgs, const size_t *msglens, const char *restrict suffix,
+                               size_t suffixlen, char *const *outs, size_t outlen)
+{
+	libkeccak_lane_x4_t lanes[25];
+	uint64_t *S = (uint64_t *)lanes;
+	unsigned char last[LIBKECCAK_X4][2 * LIBKECCAK_COMPACT_MAX_RATE];
+	const unsigned char *blocks[LIBKECCAK_X4];
+	size_t rate = mid->rate, nblocks = (msglens[0] + suffixlen) / rate + 1;
+	size_t w = kernel->width, whole[LIBKECCAK_X4], tail, b, j;
+	unsigned char lane[8];
+	long i;
+
+	for (i = 0; i < 25; i++)
+		for (j = 0; j < w; j++)
+			S[(size_t)i * w + j] = (uint64_t)mid->S[i];
+
+	/* Whole blocks are read in place, the tail, the suffix and the padding are assembled in `last`. */
+	for (j = 0; j < w; j++) {
+		whole[j] = msglens[j] / rate;
+		tail = msglens[j] % rate;
+		memset(last[j], 0, (nblocks - whole[j]) * rate);
+		memcpy(last[j], msgs[j] + whole[j] * rate, tail);
+		if (suffixlen)
+			memcpy(last[j] + tail, suffix, suffixlen);
+		last[j][tail + suffixlen] ^= mid->pad;
+		last[j][(nblocks - whole[j]) * rate - 1] ^= 0x80;
+	}
+
+	for (b = 0; b < nblocks; b++) {
+		for (j = 0; j < w; j++)
+			blocks[j] = b < whole[j] ? (const unsigned char *)msgs[j] + b * rate : last[j] + (b - whole[j]) * rate;
+		for (i = 0; i < (long)(rate >> 3); i++)
+			for (j = 0; j < w; j++)
+				S[(size_t)LANE_TRANSPOSE_MAP[i] * w + j] ^= libkeccak_load64(blocks[j] + (i << 3));
+		kernel->permute(S, 24);
+	}
+
+	for (i = 0; (size_t)i << 3 < outlen; i++) {
+		b = outlen - ((size_t)i << 3) < 8 ? outlen - ((size_t)i << 3) : 8;
+		for (j = 0; j < w; j++) {
+			libkeccak_store64(lane, S[(size_t)LANE_TRANSPOSE_MAP[i] * w + j]);
+			memcpy(outs[j] + (i << 3), lane, b);
+		}
+	}
+}
+
+/**
+ * Check whether the next messages can go through `libkeccak_mac_many` together
+ *
+ * @param   msglens    The lengths of the messages, at least `n`
+ * @param   n          The number of messages
+ * @param   suffixlen  The length of the suffix absorbed after every message
+ * @param   rate       The bitrate in bytes
+ * @return             1 if they span the same number of blocks, 0 otherwise
+ */
+static inline int libkeccak_mac_many_fits(const size_t *msglens, size_t n, size_t suffixlen, size_t rate)
+{
+	size_t blocks = (msglens[0] + suffixlen) / rate, j;
+	for (j = 1; j < n; j++)
+		if ((msglens[j] + suffixlen) / rate != blocks)
+			return 0;
+	return 1;
+}
+
+/**
+ * Absorb a key into a KMAC midstate
+ *
+ * @param   kmac       The key that should be initialised
+ * @param   x          The value of x in `KMACx`, 128 or 256
+ * @param   key        The key K
+ * @param   keylen     The length of the key
+ * @param   custom     The customisation string S, may be `NULL` if `customlen` is zero
+ * @param   customlen  The length of the customisation string
+ * @return             Zero on success, -1 on error
+ */
+int libkeccak_kmac_initialise(libkeccak_kmac_t *restrict kmac, long x, const char *key, size_t keylen,
+                              const char *custom, size_t customlen)
+{
+	libkeccak_compact_t *state = &kmac->midstate;
+	char enc[LIBKECCAK_ENCODE_MAX];
+
+	if ((x != 128 && x != 256) || libkeccak_compact_initialise(state, 200 - x / 4, LIBKECCAK_CSHAKE_PAD) < 0)
+		return -1;
+
+	libkeccak_compact_update(state, enc, libkeccak_left_encode(enc, state->rate));
+	libkeccak_mac_encode_string(state, "KMAC", 4);
+	libkeccak_mac_encode_string(state, custom, customlen);
+	libkeccak_mac_bytepad_end(state);
+
+	libkeccak_compact_update(state, enc, libkeccak_left_encode(enc, state->rate));
+	libkeccak_mac_encode_string(state, key, keylen);
+	libkeccak_mac_bytepad_end(state);
+	return 0;
+}
+
+/**
+ * Calculate KMAC, or KMACXOF, of a message
+ *
+ * @param  kmac    The key
+ * @param  msg     The message
+ * @param  msglen  The length of the message
+ * @param  mac     Output parameter for the MAC
+ * @param  maclen  The length of the MAC
+ * @param  xof     Non-zero for KMACXOF
+ */
+void libkeccak_kmac(const libkeccak_kmac_t *restrict kmac, const char *restrict msg, size_t msglen,
+                    char *restrict mac, size_t maclen, int xof)
+{
+	libkeccak_compact_t state = kmac->midstate;
+	char enc[LIBKECCAK_ENCODE_MAX];
+
+	if (msglen)
+		libkeccak_compact_update(&state, msg, msglen);
+	libkeccak_compact_digest(&state, enc, libkeccak_right_encode(enc, xof ? 0 : maclen << 3), mac, maclen);
+}
+
+/**
+ * Verify KMAC tags of many messages under one key, as many at a time as
+ * the kernel selected with `libkeccak_set_kernel` takes; tags are
+ * compared in constant time
+ *
+ * @param   kmac     The key
+ * @param   msgs     The messages
+ * @param   msglens  The lengths of the messages
+ * @param   macs     The claimed MACs, MAC `i` is stored at `macs + i * maclen`
+ * @param   maclen   The length of each MAC
+ * @param   count    The number of messages
+ * @param   valid    Output parameter for the results, bit `i % 64` of `valid[i / 64]`
+ *                   is set if and only if MAC `i` is correct
+ * @return           The number of correct MACs
+ */
+size_t libkeccak_kmac_verify(const libkeccak_kmac_t *restrict kmac, const char *const *msgs, const size_t *msglens,
+                             const char *macs, size_t maclen, size_t count, uint64_t *restrict valid)
+{
+	const libkeccak_kernel_t *kernel = libkeccak_get_kernel();
+	char tags[LIBKECCAK_X4][LIBKECCAK_COMPACT_MAX_RATE];
+	char *outs[LIBKECCAK_X4] = { tags[0], tags[1], tags[2], tags[3] };
+	char enc[LIBKECCAK_ENCODE_MAX];
+	size_t rate = kmac->midstate.rate, enclen, i, j, n = 0, off, len;
+	libkeccak_compact_t state;
+	int ok;
+
+	enclen = libkeccak_right_encode(enc, maclen << 3);
+	memset(valid, 0, (count + 63) / 64 * sizeof(*valid));
+
+	for (i = 0; i < count;) {
+		if (maclen <= rate && count - i >= kernel->width &&
+		    libkeccak_mac_many_fits(msglens + i, kernel->width, enclen, rate)) {
+			libkeccak_mac_many(kernel, &kmac->midstate, msgs + i, msglens + i, enc, enclen, outs, maclen);
+			for (j = 0; j < kernel->width; j++, i++) {
+				ok = libkeccak_mac_equal(tags[j], macs + i * maclen, maclen);
+				valid[i / 64] |= (uint64_t)ok << (i % 64);
+				n += (size_t)ok;
+			}
+			continue;
+		}
+
+		/* Scalar path, squeezing and comparing a block at a time so any MAC length works. */
+		state = kmac->midstate;
+		if (msglens[i])
+			libkeccak_compact_update(&state, msgs[i], msglens[i]);
+		libkeccak_compact_update(&state, enc, enclen);
+		for (ok = 1, off = 0; off < maclen; off += len) {
+			len = maclen - off < rate ? maclen - off : rate;
+			libkeccak_compact_squeeze(&state, tags[0], len);
+			ok &= libkeccak_mac_equal(tags[0], macs + i * maclen + off, len);
+		}
+		valid[i / 64] |= (uint64_t)ok << (i % 64);
+		n += (size_t)ok;
+		i++;
+	}
+	return n;
+}
+
+/**
+ * Absorb a key into the HMAC-Keccak-256 inner and outer midstates
+ *
+ * @param  hmac    The key that should be initialised
+ * @param  key     The key, hashed first if it is longer than the bitrate
+ * @param  keylen  The length of the key
+ */
+void libkeccak_hmac_keccak256_initialise(libkeccak_hmac_t *restrict hmac, const char *restrict key, size_t keylen)
+{
+	char block[LIBKECCAK_KECCAK256_RATE] = { 0 };
+	volatile char *wipe;
+	size_t i;
+
+	if (keylen > LIBKECCAK_KECCAK256_RATE)
+		libkeccak_keccak256(key, keylen, block);
+	else if (keylen)
+		memcpy(block, key, keylen);
+
+	for (i = 0; i < sizeof(block); i++)
+		block[i] ^= LIBKECCAK_HMAC_IPAD;
+	libkeccak_compact_keccak256_initialise(&hmac->inner);
+	libkeccak_compact_update(&hmac->inner, block, sizeof(block));
+
+	for (i = 0; i < sizeof(block); i++)
+		block[i] ^= LIBKECCAK_HMAC_IPAD ^ LIBKECCAK_HMAC_OPAD;
+	libkeccak_compact_keccak256_initialise(&hmac->outer);
+	libkeccak_compact_update(&hmac->outer, block, sizeof(block));
+
+	/* Wipe the key block, through a volatile pointer so the stores are not elided. */
+	wipe = block;
+	for (i = 0; i < sizeof(block); i++)
+		wipe[i] = 0;
+}
+
+/**
+ * Calculate HMAC-Keccak-256 of a message
+ *
+ * @param  hmac    The key
+ * @param  msg     The message
+ * @param  msglen  The length of the message
+ * @param  mac     Output parameter for the MAC, `LIBKECCAK_HMAC_KECCAK256_SIZE` bytes
+ */
+void libkeccak_hmac_keccak256(const libkeccak_hmac_t *restrict hmac, const char *restrict msg, size_t msglen,
+                              char *restrict mac)
+{
+	libkeccak_compact_t state = hmac->inner;
+	char inner[LIBKECCAK_HMAC_KECCAK256_SIZE];
+
+	libkeccak_compact_digest(&state, msg, msglen, inner, sizeof(inner));
+	state = hmac->outer;
+	libkeccak_compact_digest(&state, inner, sizeof(inner), mac, LIBKECCAK_HMAC_KECCAK256_SIZE);
+}
+
+/**
+ * Verify HMAC-Keccak-256 tags of many messages under one key, as many at a
+ * time as the kernel selected with `libkeccak_set_kernel` takes; tags are
+ * compared in constant time
+ *
+ * @param   hmac     The key
+ * @param   msgs     The messages
+ * @param   msglens  The lengths of the messages
+ * @param   macs     The claimed MACs, MAC `i` is stored at `macs + i * LIBKECCAK_HMAC_KECCAK256_SIZE`
+ * @param   count    The number of messages
+ * @param   valid    Output parameter for the results, bit `i % 64` of `valid[i / 64]`
+ *                   is set if and only if MAC `i` is correct
+ * @return           The number of correct MACs
+ */
+size_t libkeccak_hmac_keccak256_verify(const libkeccak_hmac_t *restrict hmac, const char *const *msgs,
+                                       const size_t *msglens, const char *macs, size_t count, uint64_t *restrict valid)
+{
+	const libkeccak_kernel_t *kernel = libkeccak_get_kernel();
+	char inner[LIBKECCAK_X4][LIBKECCAK_HMAC_KECCAK256_SIZE];
+	char tags[LIBKECCAK_X4][LIBKECCAK_HMAC_KECCAK256_SIZE];
+	const char *inners[LIBKECCAK_X4] = { inner[0], inner[1], inner[2], inner[3] };
+	char *inouts[LIBKECCAK_X4] = { inner[0], inner[1], inner[2], inner[3] };
+	char *outs[LIBKECCAK_X4] = { tags[0], tags[1], tags[2], tags[3] };
+	const size_t lens[LIBKECCAK_X4] = { LIBKECCAK_HMAC_KECCAK256_SIZE, LIBKECCAK_HMAC_KECCAK256_SIZE,
+	                                    LIBKECCAK_HMAC_KECCAK256_SIZE, LIBKECCAK_HMAC_KECCAK256_SIZE };
+	size_t i, j, n = 0;
+	int ok;
+
+	memset(valid, 0, (count + 63) / 64 * sizeof(*valid));
+
+	for (i = 0; i < count;) {
+		if (count - i >= kernel->width &&
+		    libkeccak_mac_many_fits(msglens + i, kernel->width, 0, LIBKECCAK_KECCAK256_RATE)) {
+			libkeccak_mac_many(kernel, &hmac->inner, msgs + i, msglens + i, NULL, 0, inouts,
+			                   LIBKECCAK_HMAC_KECCAK256_SIZE);
+			libkeccak_mac_many(kernel, &hmac->outer, inners, lens, NULL, 0, outs, LIBKECCAK_HMAC_KECCAK256_SIZE);
+			for (j = 0; j < kernel->width; j++, i++) {
+				ok = libkeccak_mac_equal(tags[j], macs + i * LIBKECCAK_HMAC_KECCAK256_SIZE,
+				                         LIBKECCAK_HMAC_KECCAK256_SIZE);
+				valid[i / 64] |= (uint64_t)ok << (i % 64);
+				n += (size_t)ok;
+			}
+			continue;
+		}
+
+		libkeccak_hmac_keccak256(hmac, msgs[i], msglens[i], tags[0]);
+		ok = libkeccak_mac_equal(tags[0], macs + i * LIBKECCAK_HMAC_KECCAK256_SIZE, LIBKECCAK_HMAC_KECCAK256_SIZE);
+		valid[i / 64] |= (uint64_t)ok << (i % 64);
+		n += (size_t)ok;
+		i++;
+	}
+	return n;
+}
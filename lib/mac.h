@@ -0,0 +1,112 @@
+#ifndef LIBKECCAK_MAC_H
+#define LIBKECCAK_MAC_H
+
+#include "compact.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Size of an HMAC-Keccak-256 tag
+#define LIBKECCAK_HMAC_KECCAK256_SIZE 32
+
+/**
+ * KMAC128 or KMAC256 key, the sponge after absorbing
+ * `bytepad(encode_string("KMAC") || encode_string(S), rate) || bytepad(encode_string(K), rate)`
+ *
+ * Every MAC starts from a by-value copy of the midstate, so
+ * the key is never absorbed again and nothing is allocated
+ */
+typedef struct libkeccak_kmac {
+	libkeccak_compact_t midstate; // The keyed sponge, on a block boundary
+} libkeccak_kmac_t;
+
+/**
+ * HMAC-Keccak-256 key, as used by legacy Ethereum tooling: HMAC over
+ * the original Keccak-256 with its 136 byte bitrate as block size
+ */
+typedef struct libkeccak_hmac {
+	libkeccak_compact_t inner; // The sponge after absorbing the key XOR ipad
+	libkeccak_compact_t outer; // The sponge after absorbing the key XOR opad
+} libkeccak_hmac_t;
+
+/**
+ * Absorb a key into a KMAC midstate
+ *
+ * @param   kmac       The key that should be initialised
+ * @param   x          The value of x in `KMACx`, 128 or 256
+ * @param   key        The key K
+ * @param   keylen     The length of the key
+ * @param   custom     The customisation string S, may be `NULL` if `customlen` is zero
+ * @param   customlen  The length of the customisation string
+ * @return             Zero on success, -1 on error
+ */
+int libkeccak_kmac_initialise(libkeccak_kmac_t* kmac, long x, const char* key, size_t keylen,
+                              const char* custom, size_t customlen);
+
+/**
+ * Calculate KMAC, or KMACXOF, of a message
+ *
+ * @param  kmac    The key
+ * @param  msg     The message
+ * @param  msglen  The length of the message
+ * @param  mac     Output parameter for the MAC
+ * @param  maclen  The length of the MAC
+ * @param  xof     Non-zero for KMACXOF
+ */
+void libkeccak_kmac(const libkeccak_kmac_t* kmac, const char* msg, size_t msglen, char* mac, size_t maclen, int xof);
+
+/**
+ * Verify KMAC tags of many messages under one key, as many at a time as
+ * the kernel selected with `libkeccak_set_kernel` takes; tags are
+ * compared in constant time
+ *
+ * @param   kmac     The key
+ * @param   msgs     The messages
+ * @param   msglens  The lengths of the messages
+ * @param   macs     The claimed MACs, MAC `i` is stored at `macs + i * maclen`
+ * @param   maclen   The length of each MAC
+ * @param   count    The number of messages
+ * @param   valid    Output parameter for the results, bit `i % 64` of `valid[i / 64]`
+ *                   is set if and only if MAC `i` is correct
+ * @return           The number of correct MACs
+ */
+size_t libkeccak_kmac_verify(const libkeccak_kmac_t* kmac, const char* const* msgs, const size_t* msglens,
+                             const char* macs, size_t maclen, size_t count, uint64_t* valid);
+
+/**
+ * Absorb a key into the HMAC-Keccak-256 inner and outer midstates
+ *
+ * @param  hmac    The key that should be initialised
+ * @param  key     The key, hashed first if it is longer than the bitrate
+ * @param  keylen  The length of the key
+ */
+void libkeccak_hmac_keccak256_initialise(libkeccak_hmac_t* hmac, const char* key, size_t keylen);
+
+/**
+ * Calculate HMAC-Keccak-256 of a message
+ *
+ * @param  hmac    The key
+ * @param  msg     The message
+ * @param  msglen  The length of the message
+ * @param  mac     Output parameter for the MAC, `LIBKECCAK_HMAC_KECCAK256_SIZE` bytes
+ */
+void libkeccak_hmac_keccak256(const libkeccak_hmac_t* hmac, const char* msg, size_t msglen, char* mac);
+
+/**
+ * Verify HMAC-Keccak-256 tags of many messages under one key, as many at a
+ * time as the kernel selected with `libkeccak_set_kernel` takes; tags are
+ * compared in constant time
+ *
+ * @param   hmac     The key
+ * @param   msgs     The messages
+ * @param   msglens  The lengths of the messages
+ * @param   macs     The claimed MACs, MAC `i` is stored at `macs + i * LIBKECCAK_HMAC_KECCAK256_SIZE`
+ * @param   count    The number of messages
+ * @param   valid    Output parameter for the results, bit `i % 64` of `valid[i / 64]`
+ *                   is set if and only if MAC `i` is correct
+ * @return           The number of correct MACs
+ */
+size_t libkeccak_hmac_keccak256_verify(const libkeccak_hmac_t* hmac, const char* const* msgs, const size_t* msglens,
+                                       const char* macs, size_t count, uint64_t* valid);
+
+#endif
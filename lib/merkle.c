@@ -0,0 +1,362 @@
+#include "merkle.h"
+#include "keccak-p.h"
+#include "parallel.h"
+#include "alloc.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Binary logarithm of the number of leaves in the smallest subtree handed to a thread
+#define LIBKECCAK_MERKLE_SUBTREE_MIN 10
+
+// Number of pairs reordered at a time when hashing sorted pairs
+#define LIBKECCAK_MERKLE_BATCH 64
+
+// Largest number of levels above the leaves
+#define LIBKECCAK_MERKLE_MAX_DEPTH (sizeof(size_t) * 8)
+
+// Work description for hashing subtrees in parallel
+struct libkeccak_merkle_job {
+	char *const *levels;  // The nodes of each level
+	const size_t *counts; // The number of nodes on each level
+	size_t height;        // The number of levels in each subtree
+	int mode;             // The pairing mode
+};
+
+/**
+ * Hash consecutive pairs of nodes
+ *
+ * @param  in     The nodes, `2 * pairs` of them
+ * @param  out    Output parameter for the parents, `pairs` of them
+ * @param  pairs  The number of pairs
+ * @param  mode   `LIBKECCAK_MERKLE_POSITIONAL` or `LIBKECCAK_MERKLE_SORTED`
+ */
+static void libkeccak_merkle_hash_pairs(const char *in, char *out, size_t pairs, int mode)
+{
+	char buf[LIBKECCAK_MERKLE_BATCH * 2 * LIBKECCAK_MERKLE_NODE];
+	const char *a, *b;
+	size_t i, n;
+
+	if (mode != LIBKECCAK_MERKLE_SORTED) {
+		libkeccak_sponge_many(in, 2 * LIBKECCAK_MERKLE_NODE, 2 * LIBKECCAK_MERKLE_NODE, pairs,
+		                      LIBKECCAK_KECCAK256_RATE, 24, LIBKECCAK_KECCAK_PAD, out, LIBKECCAK_MERKLE_NODE);
+		return;
+	}
+
+	for (; pairs; pairs -= n) {
+		n = pairs < LIBKECCAK_MERKLE_BATCH ? pairs : LIBKECCAK_MERKLE_BATCH;
+		for (i = 0; i < n; i++) {
+			a = in + i * 2 * LIBKECCAK_MERKLE_NODE;
+			b = a + LIBKECCAK_MERKLE_NODE;
+			if (memcmp(a, b, LIBKECCAK_MERKLE_NODE) > 0)
+				a = b, b -= LIBKECCAK_MERKLE_NODE;
+			memcpy(buf + i * 2 * LIBKECCAK_MERKLE_NODE, a, LIBKECCAK_MERKLE_NODE);
+			memcpy(buf + i * 2 * LIBKECCAK_MERKLE_NODE + LIBKECCAK_MERKLE_NODE, b, LIBKECCAK_MERKLE_NODE);
+		}
+		libkeccak_sponge_many(buf, 2 * LIBKECCAK_MERKLE_NODE, 2 * LIBKECCAK_MERKLE_NODE, n,
+		                      LIBKECCAK_KECCAK256_RATE, 24, LIBKECCAK_KECCAK_PAD, out, LIBKECCAK_MERKLE_NODE);
+		in += n * 2 * LIBKECCAK_MERKLE_NODE;
+		out += n * LIBKECCAK_MERKLE_NODE;
+	}
+}
+
+/**
+ * Calculate the nodes `[start, end)` of a level from the level below it
+ *
+ * @param  levels  The nodes of each level
+ * @param  counts  The number of nodes on each level
+ * @param  j       The level to calculate, at least 1
+ * @param  start   The index of the first node to calculate
+ * @param  end     One past the index of the last node to calculate
+ * @param  mode    `LIBKECCAK_MERKLE_POSITIONAL` or `LIBKECCAK_MERKLE_SORTED`
+ */
+static void libkeccak_merkle_level(char *const *levels, const size_t *counts, size_t j,
+                                   size_t start, size_t end, int mode)
+{
+	size_t pairs = end - start;
+	if (2 * end > counts[j - 1]) {
+		pairs--;
+		memcpy(levels[j] + (end - 1) * LIBKECCAK_MERKLE_NODE,
+		       levels[j - 1] + 2 * (end - 1) * LIBKECCAK_MERKLE_NODE, LIBKECCAK_MERKLE_NODE);
+	}
+	libkeccak_merkle_hash_pairs(levels[j - 1] + 2 * start * LIBKECCAK_MERKLE_NODE,
+	                            levels[j] + start * LIBKECCAK_MERKLE_NODE, pairs, mode);
+}
+
+/**
+ * Hash the subtrees `[begin, end)` up to their roots
+ *
+ * Subtrees are aligned to their size, so a subtree computes exactly
+ * the nodes the whole tree has above its leaves
+ *
+ * @param  ctx    The `struct libkeccak_merkle_job`
+ * @param  begin  The index of the first subtree
+ * @param  end    One past the index of the last subtree
+ */
+static void libkeccak_merkle_subtrees(void *ctx, size_t begin, size_t end)
+{
+	struct libkeccak_merkle_job *job = ctx;
+	size_t t, j, s, e;
+	for (t = begin; t < end; t++) {
+		for (j = 1; j <= job->height; j++) {
+			s = (t << job->height) >> j;
+			e = ((t + 1) << job->height) >> j;
+			e = e < job->counts[j] ? e : job->counts[j];
+			libkeccak_merkle_level(job->levels, job->counts, j, s, e, job->mode);
+		}
+	}
+}
+
+/**
+ * Calculate the number of nodes on each level of a tree
+ *
+ * @param   counts  Output parameter for the number of nodes on each level,
+ *                  `LIBKECCAK_MERKLE_MAX_DEPTH + 1` elements
+ * @param   count   The number of leaves, at least 1
+ * @return          The number of levels above the leaves
+ */
+static size_t libkeccak_merkle_layout(size_t *counts, size_t count)
+{
+	size_t depth = 0;
+	for (counts[0] = count; counts[depth] > 1; depth++)
+		counts[depth + 1] = counts[depth] / 2 + (counts[depth] & 1);
+	return depth;
+}
+
+/**
+ * Calculate every level of a tree whose leaves and storage are in place
+ *
+ * @param  levels   The nodes of each level, `levels[0]` filled in
+ * @param  counts   The number of nodes on each level
+ * @param  depth    The number of levels above the leaves
+ * @param  mode     `LIBKECCAK_MERKLE_POSITIONAL` or `LIBKECCAK_MERKLE_SORTED`
+ * @param  threads  The number of threads, zero or negative for one per online processor
+ */
+static void libkeccak_merkle_build(char *const *levels, const size_t *counts, size_t depth, int mode, long threads)
+{
+	struct libkeccak_merkle_job job;
+	size_t k = depth, j;
+
+	threads = libkeccak_parallel_threads(threads);
+	if (threads > 1)
+		for (k = LIBKECCAK_MERKLE_SUBTREE_MIN; k < depth && ((counts[0] - 1) >> k) + 1 > (size_t)threads * 4;)
+			k++;
+	if (k > depth)
+		k = depth;
+
+	job.levels = levels;
+	job.counts = counts;
+	job.height = k;
+	job.mode = mode;
+	libkeccak_parallel_for(((counts[0] - 1) >> k) + 1, 1, libkeccak_merkle_subtrees, &job, threads);
+
+	for (j = k + 1; j <= depth; j++)
+		libkeccak_merkle_level(levels, counts, j, 0, counts[j], mode);
+}
+
+/**
+ * Calculate the root of a Merkle tree without keeping the inner nodes
+ *
+ * Each level is hashed with the multi-buffer kernel, and large trees are
+ * split into subtrees that are hashed on separate threads
+ *
+ * @param   leaves   The leaves, `count * LIBKECCAK_MERKLE_NODE` bytes
+ * @param   count    The number of leaves, at least 1
+ * @param   mode     `LIBKECCAK_MERKLE_POSITIONAL` or `LIBKECCAK_MERKLE_SORTED`
+ * @param   root     Output parameter for the root, `LIBKECCAK_MERKLE_NODE` bytes
+ * @param   threads  The number of threads, zero or negative for one per online processor
+ * @return           Zero on success, -1 on error
+ */
+int libkeccak_merkle_root(const char *leaves, size_t count, int mode, char *root, long threads)
+{
+	char *levels[LIBKECCAK_MERKLE_MAX_DEPTH + 1];
+	size_t counts[LIBKECCAK_MERKLE_MAX_DEPTH + 1];
+	size_t depth, j, total = 0;
+	char *storage;
+
+	if (!count)
+		return -1;
+	depth = libkeccak_merkle_layout(counts, count);
+	for (j = 1; j <= depth; j++)
+		total += counts[j];
+
+	storage = libkeccak_malloc(total * LIBKECCAK_MERKLE_NODE + 1);
+	if (!storage)
+		return -1;
+	levels[0] = (char *)leaves;
+	for (j = 1, total = 0; j <= depth; total += counts[j++])
+		levels[j] = storage + total * LIBKECCAK_MERKLE_NODE;
+
+	libkeccak_merkle_build(levels, counts, depth, mode, threads);
+	memcpy(root, levels[depth], LIBKECCAK_MERKLE_NODE);
+	libkeccak_free(storage);
+	return 0;
+}
+
+/**
+ * Build a Merkle tree, keeping every level for proof generation
+ *
+ * @param   tree     The tree that should be initialised
+ * @param   leaves   The leaves, `count * LIBKECCAK_MERKLE_NODE` bytes, they are copied
+ * @param   count    The number of leaves, at least 1
+ * @param   mode     `LIBKECCAK_MERKLE_POSITIONAL` or `LIBKECCAK_MERKLE_SORTED`
+ * @param   threads  The number of threads, zero or negative for one per online processor
+ * @return           Zero on success, -1 on error
+ */
+int libkeccak_merkle_tree_initialise(libkeccak_merkle_tree_t *restrict tree, const char *leaves, size_t count,
+                                     int mode, long threads)
+{
+	size_t counts[LIBKECCAK_MERKLE_MAX_DEPTH + 1];
+	size_t depth, j, total = 0;
+	char *storage;
+
+	if (!count)
+		return -1;
+	depth = libkeccak_merkle_layout(counts, count);
+	for (j = 0; j <= depth; j++)
+		total += counts[j];
+
+	tree->levels = libkeccak_malloc((depth + 1) * (sizeof(char *) + sizeof(size_t)) + total * LIBKECCAK_MERKLE_NODE);
+	if (!tree->levels)
+		return -1;
+	tree->counts = (size_t *)(tree->levels + depth + 1);
+	tree->depth = depth;
+	tree->mode = mode;
+	storage = (char *)(tree->counts + depth + 1);
+	for (j = 0, total = 0; j <= depth; total += counts[j++]) {
+		tree->levels[j] = storage + total * LIBKECCAK_MERKLE_NODE;
+		tree->counts[j] = counts[j];
+	}
+	memcpy(tree->levels[0], leaves, count * LIBKECCAK_MERKLE_NODE);
+
+	libkeccak_merkle_build(tree->levels, tree->counts, depth, mode, threads);
+	return 0;
+}
+
+/**
+ * Release the resources of a Merkle tree
+ *
+ * @param  tree  The tree that should be destroyed
+ */
+void libkeccak_merkle_tree_destroy(libkeccak_merkle_tree_t *tree)
+{
+	if (!tree)
+		return;
+	libkeccak_free(tree->levels);
+	tree->levels = NULL;
+	tree->counts = NULL;
+}
+
+/**
+ * Generate the proof for a leaf, the siblings on its path to the root, bottom-up
+ *
+ * @param   tree   The tree
+ * @param   index  The index of the leaf
+ * @param   proof  Output parameter for the siblings, at least `tree->depth * LIBKECCAK_MERKLE_NODE` bytes
+ * @return         The number of siblings written to `proof`
+ */
+size_t libkeccak_merkle_tree_proof(const libkeccak_merkle_tree_t *tree, size_t index, char *proof)
+{
+	size_t j, n = 0;
+	for (j = 0; j < tree->depth; j++, index >>= 1)
+		if ((index ^ 1) < tree->counts[j])
+			memcpy(proof + n++ * LIBKECCAK_MERKLE_NODE,
+			       tree->levels[j] + (index ^ 1) * LIBKECCAK_MERKLE_NODE, LIBKECCAK_MERKLE_NODE);
+	return n;
+}
+
+/**
+ * Verify a batch of Merkle proofs against one root, four proofs at a time
+ * on the kernel selected with `libkeccak_set_kernel`
+ *
+ * @param   root     The expected root, `LIBKECCAK_MERKLE_NODE` bytes
+ * @param   leaves   The leaves to verify, `n * LIBKECCAK_MERKLE_NODE` bytes
+ * @param   indices  The indices of the leaves in the tree, ignored, and may be `NULL`, for sorted pairs
+ * @param   count    The number of leaves in the tree, ignored for sorted pairs
+ * @param   proofs   The proofs, proof `i` starts at `proofs + i * stride`
+ * @param   stride   The distance between the start of two consecutive proofs
+ * @param   lens     The number of siblings in each proof
+ * @param   n        The number of proofs
+ * @param   mode     `LIBKECCAK_MERKLE_POSITIONAL` or `LIBKECCAK_MERKLE_SORTED`
+ * @param   results  Output parameter for the results, bit `i % 8` of byte `i / 8` is set if proof `i` is valid
+ */
+void libkeccak_merkle_verify_batch(const char *root, const char *leaves, const size_t *indices, size_t count,
+                                   const char *proofs, size_t stride, const size_t *lens, size_t n,
+                                   int mode, unsigned char *results)
+{
+	char block[LIBKECCAK_X4][2 * LIBKECCAK_MERKLE_NODE];
+	char node[LIBKECCAK_X4][LIBKECCAK_MERKLE_NODE];
+	char digest[LIBKECCAK_X4][LIBKECCAK_MERKLE_NODE];
+	size_t step[LIBKECCAK_X4], idx[LIBKECCAK_X4], cnt[LIBKECCAK_X4];
+	int state[LIBKECCAK_X4]; /* 1 while hashing, 0 when done, -1 on failure */
+	size_t g, l, m, i;
+	const char *sib;
+	int active;
+
+	memset(results, 0, (n + 7) / 8);
+	memset(block, 0, sizeof(block));
+
+	for (g = 0; g < n; g += LIBKECCAK_X4) {
+		m = n - g < LIBKECCAK_X4 ? n - g : LIBKECCAK_X4;
+		for (l = 0; l < LIBKECCAK_X4; l++) {
+			i = g + (l < m ? l : 0);
+			memcpy(node[l], leaves + i * LIBKECCAK_MERKLE_NODE, LIBKECCAK_MERKLE_NODE);
+			step[l] = 0;
+			idx[l] = mode == LIBKECCAK_MERKLE_SORTED ? 0 : indices[i];
+			cnt[l] = count;
+			state[l] = l < m ? 1 : 0;
+			if (mode != LIBKECCAK_MERKLE_SORTED && idx[l] >= cnt[l])
+				state[l] = -state[l];
+		}
+
+		for (;;) {
+			for (active = 0, l = 0; l < m; l++) {
+				if (state[l] != 1)
+					continue;
+				if (mode == LIBKECCAK_MERKLE_SORTED) {
+					if (step[l] == lens[g + l]) {
+						state[l] = 0;
+						continue;
+					}
+					sib = proofs + (g + l) * stride + step[l]++ * LIBKECCAK_MERKLE_NODE;
+					if (memcmp(node[l], sib, LIBKECCAK_MERKLE_NODE) > 0) {
+						memcpy(block[l], sib, LIBKECCAK_MERKLE_NODE);
+						memcpy(block[l] + LIBKECCAK_MERKLE_NODE, node[l], LIBKECCAK_MERKLE_NODE);
+					} else {
+						memcpy(block[l], node[l], LIBKECCAK_MERKLE_NODE);
+						memcpy(block[l] + LIBKECCAK_MERKLE_NODE, sib, LIBKECCAK_MERKLE_NODE);
+					}
+				} else {
+					while (cnt[l] > 1 && (idx[l] ^ 1) >= cnt[l])
+						idx[l] >>= 1, cnt[l] = cnt[l] / 2 + (cnt[l] & 1);
+					if (cnt[l] == 1) {
+						state[l] = step[l] == lens[g + l] ? 0 : -1;
+						continue;
+					}
+					if (step[l] == lens[g + l]) {
+						state[l] = -1;
+						continue;
+					}
+					sib = proofs + (g + l) * stride + step[l]++ * LIBKECCAK_MERKLE_NODE;
+					memcpy(block[l] + (idx[l] & 1 ? LIBKECCAK_MERKLE_NODE : 0), node[l], LIBKECCAK_MERKLE_NODE);
+					memcpy(block[l] + (idx[l] & 1 ? 0 : LIBKECCAK_MERKLE_NODE), sib, LIBKECCAK_MERKLE_NODE);
+					idx[l] >>= 1, cnt[l] = cnt[l] / 2 + (cnt[l] & 1);
+				}
+				active++;
+			}
+			if (!active)
+				break;
+			/* Proofs that are done hash stale blocks into their slot of `digest`, which is not copied back. */
+			libkeccak_sponge_many(block[0], 2 * LIBKECCAK_MERKLE_NODE, 2 * LIBKECCAK_MERKLE_NODE, m,
+			                      LIBKECCAK_KECCAK256_RATE, 24, LIBKECCAK_KECCAK_PAD, digest[0], LIBKECCAK_MERKLE_NODE);
+			for (l = 0; l < m; l++)
+				if (state[l] == 1)
+					memcpy(node[l], digest[l], LIBKECCAK_MERKLE_NODE);
+		}
+
+		for (l = 0; l < m; l++)
+			if (!state[l] && !memcmp(node[l], root, LIBKECCAK_MERKLE_NODE))
+				results[(g + l) >> 3] |= (unsigned char)(1 << ((g + l) & 7));
+	}
+}
@@ -0,0 +1,102 @@
+#ifndef LIBKECCAK_MERKLE_H
+#define LIBKECCAK_MERKLE_H
+
+#include <stddef.h>
+
+// Size of a Merkle tree node, a Keccak-256 hashsum
+#define LIBKECCAK_MERKLE_NODE 32
+
+// Pair nodes as `keccak256(left || right)`, proofs need the leaf index
+#define LIBKECCAK_MERKLE_POSITIONAL 0
+
+// Pair nodes as `keccak256(min(a, b) || max(a, b))`, as OpenZeppelin's `MerkleProof` does
+#define LIBKECCAK_MERKLE_SORTED 1
+
+/**
+ * Binary Merkle tree over 32 byte leaves; a node without a sibling,
+ * the last node of a level with an odd number of nodes, is promoted
+ * to the next level unchanged
+ */
+typedef struct libkeccak_merkle_tree {
+	char** levels;   // The nodes of each level, `levels[0]` are the leaves and `levels[depth]` the root
+	size_t* counts;  // The number of nodes on each level
+	size_t depth;    // The number of levels above the leaves
+	int mode;        // `LIBKECCAK_MERKLE_POSITIONAL` or `LIBKECCAK_MERKLE_SORTED`
+} libkeccak_merkle_tree_t;
+
+/**
+ * Calculate the root of a Merkle tree without keeping the inner nodes
+ *
+ * Each level is hashed with the multi-buffer kernel, and large trees are
+ * split into subtrees that are hashed on separate threads
+ *
+ * @param   leaves   The leaves, `count * LIBKECCAK_MERKLE_NODE` bytes
+ * @param   count    The number of leaves, at least 1
+ * @param   mode     `LIBKECCAK_MERKLE_POSITIONAL` or `LIBKECCAK_MERKLE_SORTED`
+ * @param   root     Output parameter for the root, `LIBKECCAK_MERKLE_NODE` bytes
+ * @param   threads  The number of threads, zero or negative for one per online processor
+ * @return           Zero on success, -1 on error
+ */
+int libkeccak_merkle_root(const char* leaves, size_t count, int mode, char* root, long threads);
+
+/**
+ * Build a Merkle tree, keeping every level for proof generation
+ *
+ * @param   tree     The tree that should be initialised
+ * @param   leaves   The leaves, `count * LIBKECCAK_MERKLE_NODE` bytes, they are copied
+ * @param   count    The number of leaves, at least 1
+ * @param   mode     `LIBKECCAK_MERKLE_POSITIONAL` or `LIBKECCAK_MERKLE_SORTED`
+ * @param   threads  The number of threads, zero or negative for one per online processor
+ * @return           Zero on success, -1 on error
+ */
+int libkeccak_merkle_tree_initialise(libkeccak_merkle_tree_t* tree, const char* leaves, size_t count,
+                                     int mode, long threads);
+
+/**
+ * Release the resources of a Merkle tree
+ *
+ * @param  tree  The tree that should be destroyed
+ */
+void libkeccak_merkle_tree_destroy(libkeccak_merkle_tree_t* tree);
+
+/**
+ * Get the root of a Merkle tree
+ *
+ * @param   tree  The tree
+ * @return        The root, `LIBKECCAK_MERKLE_NODE` bytes
+ */
+static inline const char* libkeccak_merkle_tree_root(const libkeccak_merkle_tree_t* tree)
+{
+	return tree->levels[tree->depth];
+}
+
+/**
+ * Generate the proof for a leaf, the siblings on its path to the root, bottom-up
+ *
+ * @param   tree   The tree
+ * @param   index  The index of the leaf
+ * @param   proof  Output parameter for the siblings, at least `tree->depth * LIBKECCAK_MERKLE_NODE` bytes
+ * @return         The number of siblings written to `proof`
+ */
+size_t libkeccak_merkle_tree_proof(const libkeccak_merkle_tree_t* tree, size_t index, char* proof);
+
+/**
+ * Verify a batch of Merkle proofs against one root, four proofs at a time
+ * on the kernel selected with `libkeccak_set_kernel`
+ *
+ * @param   root     The expected root, `LIBKECCAK_MERKLE_NODE` bytes
+ * @param   leaves   The leaves to verify, `n * LIBKECCAK_MERKLE_NODE` bytes
+ * @param   indices  The indices of the leaves in the tree, ignored, and may be `NULL`, for sorted pairs
+ * @param   count    The number of leaves in the tree, ignored for sorted pairs
+ * @param   proofs   The proofs, proof `i` starts at `proofs + i * stride`
+ * @param   stride   The distance between the start of two consecutive proofs
+ * @param   lens     The number of siblings in each proof
+ * @param   n        The number of proofs
+ * @param   mode     `LIBKECCAK_MERKLE_POSITIONAL` or `LIBKECCAK_MERKLE_SORTED`
+ * @param   results  Output parameter for the results, bit `i % 8` of byte `i / 8` is set if proof `i` is valid
+ */
+void libkeccak_merkle_verify_batch(const char* root, const char* leaves, const size_t* indices, size_t count,
+                                   const char* proofs, size_t stride, const size_t* lens, size_t n,
+                                   int mode, unsigned char* results);
+
+#endif
@@ -0,0 +1,271 @@
+#include "metrics.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Smallest and largest power of two nanoseconds whose predecessor is exported as a Prometheus bucket boundary
+#define LIBKECCAK_METRICS_LE_MIN 8
+#define LIBKECCAK_METRICS_LE_MAX 35
+
+static const char *const libkeccak_counter_names[LIBKECCAK_COUNTERS][2] = {
+	{"keccak_calls_total", "Calls to the streaming, batch and key entry points"},
+	{"keccak_absorbed_bytes_total", "Message bytes absorbed"},
+	{"keccak_permutations_total", "Permutations applied, per state"},
+	{"keccak_allocations_total", "Allocations and reallocations"},
+	{"keccak_errors_total", "Failed calls and rejected keys"},
+};
+
+// The metric and label of every histogram
+static const char *const libkeccak_histogram_names[LIBKECCAK_HISTOGRAMS][2] = {
+	{"keccak_latency_seconds", "entry=\"key\""},
+	{"keccak_latency_seconds", "entry=\"keys\""},
+	{"keccak_latency_seconds", "entry=\"batch\""},
+	{"keccak_latency_seconds", "entry=\"secp256k1\""},
+	{"keccak_stage_seconds", "stage=\"setup\""},
+	{"keccak_stage_seconds", "stage=\"parse\""},
+	{"keccak_stage_seconds", "stage=\"hash\""},
+	{"keccak_stage_seconds", "stage=\"format\""},
+};
+
+#ifdef LIBKECCAK_METRICS
+
+// A thread's metrics, linked into the list of live threads
+struct libkeccak_metrics_thread {
+	libkeccak_metrics_t metrics; // First, so the thread's `libkeccak_metrics_self` points at both
+	struct libkeccak_metrics_thread *next;
+	struct libkeccak_metrics_thread **prev;
+};
+
+__thread libkeccak_metrics_t *libkeccak_metrics_self = NULL;
+
+static struct libkeccak_metrics_thread *libkeccak_metrics_threads = NULL;
+static libkeccak_metrics_t libkeccak_metrics_exited;
+static pthread_mutex_t libkeccak_metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t libkeccak_metrics_key;
+static pthread_once_t libkeccak_metrics_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Add one thread's metrics to a sum
+ *
+ * @param  sum      The sum
+ * @param  metrics  The thread's metrics, possibly being written by the thread
+ */
+static void libkeccak_metrics_merge(libkeccak_metrics_t *restrict sum, const libkeccak_metrics_t *restrict metrics)
+{
+	const libkeccak_metrics_histogram_t *h;
+	size_t i, b;
+
+	for (i = 0; i < LIBKECCAK_COUNTERS; i++)
+		sum->counters[i] += __atomic_load_n(&metrics->counters[i], __ATOMIC_RELAXED);
+	for (i = 0; i < LIBKECCAK_HISTOGRAMS; i++) {
+		h = &metrics->histograms[i];
+		sum->histograms[i].count += __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+		sum->histograms[i].sum += __atomic_load_n(&h->sum, __ATOMIC_RELAXED);
+		for (b = 0; b < LIBKECCAK_METRICS_BUCKETS; b++)
+			sum->histograms[i].buckets[b] += __atomic_load_n(&h->buckets[b], __ATOMIC_RELAXED);
+	}
+}
+
+/**
+ * Fold a thread's metrics into the totals when the thread exits
+ *
+ * @param  thread  The thread's metrics
+ */
+static void libkeccak_metrics_destructor(void *thread)
+{
+	struct libkeccak_metrics_thread *t = thread;
+
+	pthread_mutex_lock(&libkeccak_metrics_lock);
+	libkeccak_metrics_merge(&libkeccak_metrics_exited, &t->metrics);
+	if (t->next)
+		t->next->prev = t->prev;
+	*t->prev = t->next;
+	pthread_mutex_unlock(&libkeccak_metrics_lock);
+	libkeccak_metrics_self = NULL;
+	free(t);
+}
+
+static void libkeccak_metrics_key_create(void)
+{
+	pthread_key_create(&libkeccak_metrics_key, libkeccak_metrics_destructor);
+}
+
+/**
+ * Give the calling thread its metrics, merged into the totals when it exits
+ *
+ * The metrics are allocated with `calloc` rather than `libkeccak_malloc`,
+ * which they count, and whose arena allocator would not outlive the thread
+ *
+ * @return  The thread's metrics, `NULL` if they could not be allocated
+ */
+libkeccak_metrics_t *libkeccak_metrics_attach(void)
+{
+	struct libkeccak_metrics_thread *t = calloc(1, sizeof(*t));
+	if (!t)
+		return NULL;
+
+	pthread_once(&libkeccak_metrics_once, libkeccak_metrics_key_create);
+	pthread_setspecific(libkeccak_metrics_key, t);
+
+	pthread_mutex_lock(&libkeccak_metrics_lock);
+	t->next = libkeccak_metrics_threads;
+	t->prev = &libkeccak_metrics_threads;
+	if (t->next)
+		t->next->prev = &t->next;
+	libkeccak_metrics_threads = t;
+	pthread_mutex_unlock(&libkeccak_metrics_lock);
+
+	return libkeccak_metrics_self = &t->metrics;
+}
+
+#endif
+
+/**
+ * Sum the metrics of every thread, live or exited, since the process started
+ *
+ * @param   snapshot  Output parameter for the metrics, zeroed if the library
+ *                    is built without `LIBKECCAK_METRICS`
+ * @return            Zero on success, -1 with `errno` set to `ENOTSUP` if the
+ *                    library is built without `LIBKECCAK_METRICS`
+ */
+int libkeccak_metrics_snapshot(libkeccak_metrics_t *snapshot)
+{
+#ifdef LIBKECCAK_METRICS
+	struct libkeccak_metrics_thread *t;
+
+	pthread_mutex_lock(&libkeccak_metrics_lock);
+	*snapshot = libkeccak_metrics_exited;
+	for (t = libkeccak_metrics_threads; t; t = t->next)
+		libkeccak_metrics_merge(snapshot, &t->metrics);
+	pthread_mutex_unlock(&libkeccak_metrics_lock);
+	return 0;
+#else
+	memset(snapshot, 0, sizeof(*snapshot));
+	errno = ENOTSUP;
+	return -1;
+#endif
+}
+
+/**
+ * Get the smallest sample that falls after a bucket
+ *
+ * @param   bucket  The bucket
+ * @return          The bucket's exclusive upper bound
+ */
+static uint64_t libkeccak_metrics_upper(size_t bucket)
+{
+	size_t e, m;
+	if (bucket < (2 << LIBKECCAK_METRICS_SUB_BITS))
+		return (uint64_t)bucket + 1;
+	e = (bucket >> LIBKECCAK_METRICS_SUB_BITS) - 1;
+	m = (bucket & ((1 << LIBKECCAK_METRICS_SUB_BITS) - 1)) + (1 << LIBKECCAK_METRICS_SUB_BITS) + 1;
+	return e >= 64 - LIBKECCAK_METRICS_SUB_BITS - 1 && m >> (64 - e) ? UINT64_MAX : (uint64_t)m << e;
+}
+
+/**
+ * Estimate a quantile of a latency histogram
+ *
+ * @param   histogram  The histogram
+ * @param   q          The quantile, between 0 and 1
+ * @return             The upper bound of the bucket holding the quantile, 0 if the histogram is empty
+ */
+uint64_t libkeccak_metrics_quantile(const libkeccak_metrics_histogram_t *histogram, double q)
+{
+	uint64_t rank, seen = 0;
+	size_t b;
+
+	if (!histogram->count)
+		return 0;
+	q = q < 0 ? 0 : q > 1 ? 1 : q;
+	rank = (uint64_t)(q * (double)(histogram->count - 1)) + 1;
+	for (b = 0; b < LIBKECCAK_METRICS_BUCKETS; b++)
+		if ((seen += histogram->buckets[b]) >= rank)
+			break;
+	rank = libkeccak_metrics_upper(b < LIBKECCAK_METRICS_BUCKETS ? b : LIBKECCAK_METRICS_BUCKETS - 1);
+	return rank == UINT64_MAX ? rank : rank - 1;
+}
+
+// Output being formatted by `libkeccak_metrics_prometheus`
+struct libkeccak_metrics_output {
+	char *buf;
+	size_t size;
+	size_t len;
+};
+
+static void libkeccak_metrics_printf(struct libkeccak_metrics_output *out, const char *format, ...)
+{
+	va_list args;
+	int n;
+
+	va_start(args, format);
+	n = vsnprintf(out->len < out->size ? out->buf + out->len : NULL,
+	              out->len < out->size ? out->size - out->len : 0, format, args);
+	va_end(args);
+	if (n > 0)
+		out->len += (size_t)n;
+}
+
+/**
+ * Format metrics in the Prometheus text exposition format
+ *
+ * Latency histograms are exported in seconds with a `le` bucket one
+ * nanosecond short of every power of two nanoseconds from 2^8 to 2^35.
+ * Samples are whole nanoseconds, so those at most 2^k - 1 are exactly
+ * those below 2^k, a bucket boundary, and the exported buckets are exact
+ *
+ * @param   snapshot  The metrics
+ * @param   buf       Output buffer, may be `NULL` if `size` is zero
+ * @param   size      The size of `buf`; the output is truncated and NUL-terminated to fit
+ * @return            The length of the complete output, excluding the NUL, as for `snprintf`
+ */
+size_t libkeccak_metrics_prometheus(const libkeccak_metrics_t *snapshot, char *buf, size_t size)
+{
+	struct libkeccak_metrics_output out = {buf, size, 0};
+	const libkeccak_metrics_histogram_t *h;
+	uint64_t cumulative;
+	size_t i, b, end;
+	int k;
+
+	if (size)
+		*buf = '\0';
+
+	for (i = 0; i < LIBKECCAK_COUNTERS; i++) {
+		libkeccak_metrics_printf(&out, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+		                         libkeccak_counter_names[i][0], libkeccak_counter_names[i][1],
+		                         libkeccak_counter_names[i][0], libkeccak_counter_names[i][0],
+		                         (unsigned long long)snapshot->counters[i]);
+	}
+
+	for (i = 0; i < LIBKECCAK_HISTOGRAMS; i++) {
+		h = &snapshot->histograms[i];
+		if (!i || strcmp(libkeccak_histogram_names[i][0], libkeccak_histogram_names[i - 1][0]))
+			libkeccak_metrics_printf(&out, "# HELP %s %s\n# TYPE %s histogram\n", libkeccak_histogram_names[i][0],
+			                         i < LIBKECCAK_STAGE_SETUP ? "Latency of the entry points" : "Latency of the stages",
+			                         libkeccak_histogram_names[i][0]);
+
+		/* 2^k is the lower bound of bucket `libkeccak_metrics_bucket(2^k)`, so everything before it is at most 2^k - 1. */
+		cumulative = 0;
+		b = 0;
+		for (k = LIBKECCAK_METRICS_LE_MIN; k <= LIBKECCAK_METRICS_LE_MAX; k++) {
+			end = libkeccak_metrics_bucket((uint64_t)1 << k);
+			for (; b < end; b++)
+				cumulative += h->buckets[b];
+			libkeccak_metrics_printf(&out, "%s_bucket{%s,le=\"%.9f\"} %llu\n", libkeccak_histogram_names[i][0],
+			                         libkeccak_histogram_names[i][1], (double)(((uint64_t)1 << k) - 1) / 1e9,
+			                         (unsigned long long)cumulative);
+		}
+		libkeccak_metrics_printf(&out, "%s_bucket{%s,le=\"+Inf\"} %llu\n%s_sum{%s} %.9f\n%s_count{%s} %llu\n",
+		                         libkeccak_histogram_names[i][0], libkeccak_histogram_names[i][1],
+		                         (unsigned long long)h->count,
+		                         libkeccak_histogram_names[i][0], libkeccak_histogram_names[i][1],
+		                         (double)h->sum / 1e9,
+		                         libkeccak_histogram_names[i][0], libkeccak_histogram_names[i][1],
+		                         (unsigned long long)h->count);
+	}
+
+	return out.len;
+}
@@ -0,0 +1,175 @@
+#ifndef LIBKECCAK_METRICS_H
+#define LIBKECCAK_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Sub-buckets per power of two in a latency histogram, for a relative error of at most 1/8
+#define LIBKECCAK_METRICS_SUB_BITS 3
+
+// Buckets in a latency histogram, enough for any 64-bit number of nanoseconds
+#define LIBKECCAK_METRICS_BUCKETS ((64 - LIBKECCAK_METRICS_SUB_BITS + 1) << LIBKECCAK_METRICS_SUB_BITS)
+
+// Counters, each kept per thread and summed by `libkeccak_metrics_snapshot`
+enum libkeccak_counter {
+	LIBKECCAK_CALLS,        // Calls to the streaming, batch and key entry points, including those they make to each other
+	LIBKECCAK_BYTES,        // Message bytes absorbed by the streaming functions and the one-shot sponges
+	LIBKECCAK_PERMUTATIONS, // Permutations applied, a multi-buffer permutation counting once per state
+	LIBKECCAK_ALLOCATIONS,  // Allocations and reallocations through `libkeccak_malloc` and `libkeccak_realloc`
+	LIBKECCAK_ERRORS,       // Failed calls and rejected keys
+	LIBKECCAK_COUNTERS
+};
+
+// Latency histograms, in nanoseconds
+enum libkeccak_histogram {
+	LIBKECCAK_LATENCY_KEY,       // `PublicKeyToAddress`, per call
+	LIBKECCAK_LATENCY_KEYS,      // `PublicKeysToAddresses` and `VerifyAddresses`, per call
+	LIBKECCAK_LATENCY_BATCH,     // `libkeccak_batch` and `libkeccak_batch_verify`, per call
+	LIBKECCAK_LATENCY_SECP256K1, // `libkeccak_secp256k1_addresses`, `libkeccak_secp256k1_addresses_hex` and `libkeccak_secp256k1_verify`, per call
+	LIBKECCAK_STAGE_SETUP,       // State initialisation, per key
+	LIBKECCAK_STAGE_PARSE,       // Hexadecimal decoding and key decompression, per key or group of keys
+	LIBKECCAK_STAGE_HASH,        // Absorbing and permuting, per key or group of keys
+	LIBKECCAK_STAGE_FORMAT,      // Squeezing and writing out addresses, per key or group of keys
+	LIBKECCAK_HISTOGRAMS
+};
+
+// A latency histogram with log-linear buckets, `LIBKECCAK_METRICS_SUB_BITS` bits of precision
+typedef struct libkeccak_metrics_histogram {
+	uint64_t count;                              // The number of samples
+	uint64_t sum;                                // The sum of the samples
+	uint64_t buckets[LIBKECCAK_METRICS_BUCKETS]; // Samples by `libkeccak_metrics_bucket`
+} libkeccak_metrics_histogram_t;
+
+// Every counter and histogram
+typedef struct libkeccak_metrics {
+	uint64_t counters[LIBKECCAK_COUNTERS];
+	libkeccak_metrics_histogram_t histograms[LIBKECCAK_HISTOGRAMS];
+} libkeccak_metrics_t;
+
+/**
+ * Sum the metrics of every thread, live or exited, since the process started
+ *
+ * @param   snapshot  Output parameter for the metrics, zeroed if the library
+ *                    is built without `LIBKECCAK_METRICS`
+ * @return            Zero on success, -1 with `errno` set to `ENOTSUP` if the
+ *                    library is built without `LIBKECCAK_METRICS`
+ */
+int libkeccak_metrics_snapshot(libkeccak_metrics_t* snapshot);
+
+/**
+ * Estimate a quantile of a latency histogram
+ *
+ * @param   histogram  The histogram
+ * @param   q          The quantile, between 0 and 1
+ * @return             The upper bound of the bucket holding the quantile, 0 if the histogram is empty
+ */
+uint64_t libkeccak_metrics_quantile(const libkeccak_metrics_histogram_t* histogram, double q);
+
+/**
+ * Format metrics in the Prometheus text exposition format
+ *
+ * Latency histograms are exported in seconds with a `le` bucket one
+ * nanosecond short of every power of two nanoseconds from 2^8 to 2^35.
+ * Samples are whole nanoseconds, so those at most 2^k - 1 are exactly
+ * those below 2^k, a bucket boundary, and the exported buckets are exact
+ *
+ * @param   snapshot  The metrics
+ * @param   buf       Output buffer, may be `NULL` if `size` is zero
+ * @param   size      The size of `buf`; the output is truncated and NUL-terminated to fit
+ * @return            The length of the complete output, excluding the NUL, as for `snprintf`
+ */
+size_t libkeccak_metrics_prometheus(const libkeccak_metrics_t* snapshot, char* buf, size_t size);
+
+/**
+ * Get the histogram bucket of a sample
+ *
+ * @param   value  The sample
+ * @return         The bucket, samples up to 2^(LIBKECCAK_METRICS_SUB_BITS + 1) get one each
+ */
+static inline size_t libkeccak_metrics_bucket(uint64_t value)
+{
+	int e;
+	if (value < (2 << LIBKECCAK_METRICS_SUB_BITS))
+		return (size_t)value;
+	e = 63 - __builtin_clzll(value);
+	return ((size_t)(e - LIBKECCAK_METRICS_SUB_BITS) << LIBKECCAK_METRICS_SUB_BITS) +
+	       (size_t)(value >> (e - LIBKECCAK_METRICS_SUB_BITS));
+}
+
+#ifdef LIBKECCAK_METRICS
+
+// The calling thread's metrics, `NULL` until it records anything
+extern __thread libkeccak_metrics_t* libkeccak_metrics_self;
+
+/**
+ * Give the calling thread its metrics, merged into the totals when it exits
+ *
+ * @return  The thread's metrics, `NULL` if they could not be allocated
+ */
+libkeccak_metrics_t* libkeccak_metrics_attach(void);
+
+/**
+ * Get the time for latency measurements
+ *
+ * @return  Monotonic time in nanoseconds
+ */
+static inline uint64_t libkeccak_metrics_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Add to one of the calling thread's counters
+ *
+ * Only the owning thread writes its metrics, so a plain add suffices;
+ * the relaxed store keeps readers on other threads from tearing it
+ *
+ * @param  counter  The counter
+ * @param  n        The amount to add
+ */
+static inline void libkeccak_metrics_add(enum libkeccak_counter counter, uint64_t n)
+{
+	libkeccak_metrics_t* m = libkeccak_metrics_self ? libkeccak_metrics_self : libkeccak_metrics_attach();
+	if (m)
+		__atomic_store_n(&m->counters[counter], m->counters[counter] + n, __ATOMIC_RELAXED);
+}
+
+/**
+ * Record the time since a start time in one of the calling thread's histograms
+ *
+ * @param  histogram  The histogram
+ * @param  start      The start time, replaced by the current time so that stages can be timed back to back
+ */
+static inline void libkeccak_metrics_record(enum libkeccak_histogram histogram, uint64_t* start)
+{
+	libkeccak_metrics_t* m = libkeccak_metrics_self ? libkeccak_metrics_self : libkeccak_metrics_attach();
+	uint64_t now = libkeccak_metrics_now(), value = now - *start;
+	libkeccak_metrics_histogram_t* h;
+	size_t b;
+
+	*start = now;
+	if (!m)
+		return;
+	h = &m->histograms[histogram];
+	b = libkeccak_metrics_bucket(value);
+	__atomic_store_n(&h->buckets[b], h->buckets[b] + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&h->sum, h->sum + value, __ATOMIC_RELAXED);
+	__atomic_store_n(&h->count, h->count + 1, __ATOMIC_RELAXED);
+}
+
+# define LIBKECCAK_COUNT(counter, n)          libkeccak_metrics_add((counter), (uint64_t)(n))
+# define LIBKECCAK_TIMER(timer)               uint64_t timer = libkeccak_metrics_now()
+# define LIBKECCAK_RECORD(histogram, timer)   libkeccak_metrics_record((histogram), &(timer))
+
+#else
+
+# define LIBKECCAK_COUNT(counter, n)          ((void)0)
+# define LIBKECCAK_TIMER(timer)               ((void)0)
+# define LIBKECCAK_RECORD(histogram, timer)   ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,952 @@
+#include "mpt.h"
+#include "keccak-p.h"
+#include "parallel.h"
+#include "alloc.h"
+
+#include <errno.h>
+#include <string.h>
+
+// Minimum size of an arena block
+#define LIBKECCAK_MPT_BLOCK ((size_t)1 << 20)
+
+// Nodes encoded at a time before being hashed together
+#define LIBKECCAK_MPT_CHUNK 1024
+
+// Encodings spanning fewer than this many blocks are grouped for the selected kernel
+#define LIBKECCAK_MPT_BUCKETS 8
+
+// Number of levels below the root that may be split off into independent subtrees
+#define LIBKECCAK_MPT_SPLIT_DEPTH 3
+
+// Space reserved in front of an encoding for its list header
+#define LIBKECCAK_MPT_HEADER 9
+
+// Root of the empty trie, `keccak256(rlp(""))`
+static const unsigned char LIBKECCAK_MPT_EMPTY_ROOT[LIBKECCAK_MPT_ROOT] = {
+	0x56, 0xe8, 0x1f, 0x17, 0x1b, 0xcc, 0x55, 0xa6, 0xff, 0x83, 0x45, 0xe6, 0x92, 0xc0, 0xf8, 0x6e,
+	0x5b, 0x48, 0xe0, 0x1b, 0x99, 0x6c, 0xad, 0xc0, 0x01, 0x62, 0x2f, 0xb5, 0xe3, 0x63, 0xb4, 0x21
+};
+
+// A dirty node and its height above the lowest dirty node under it
+struct libkeccak_mpt_item {
+	libkeccak_mpt_node_t *node;
+	size_t height;
+};
+
+// Growable array of nodes
+struct libkeccak_mpt_vector {
+	struct libkeccak_mpt_item *v;
+	size_t n;
+	size_t cap;
+};
+
+// Scratch space for encoding and hashing nodes
+struct libkeccak_mpt_scratch {
+	unsigned char *buf;   // Encodings
+	size_t cap;           // The size of `buf`
+	const char *msgs[LIBKECCAK_MPT_CHUNK];
+	size_t lens[LIBKECCAK_MPT_CHUNK];
+	char *outs[LIBKECCAK_MPT_CHUNK];
+};
+
+// Subtrees hashed in parallel
+struct libkeccak_mpt_job {
+	libkeccak_mpt_node_t **subtrees;
+	int error;
+};
+
+/**
+ * Allocate memory from a trie's arena
+ *
+ * @param   mpt   The trie
+ * @param   size  The number of bytes
+ * @return        The allocation, 8 byte aligned, `NULL` on error
+ */
+static void *libkeccak_mpt_alloc(libkeccak_mpt_t *mpt, size_t size)
+{
+	libkeccak_mpt_block_t *b = mpt->arena;
+	size_t bs;
+	size = (size + 7) & ~(size_t)7;
+	if (!b || b->size - b->used < size) {
+		bs = size > LIBKECCAK_MPT_BLOCK ? size : LIBKECCAK_MPT_BLOCK;
+		b = libkeccak_malloc(sizeof(*b) + bs);
+		if (!b)
+			return NULL;
+		b->next = mpt->arena;
+		b->used = 0;
+		b->size = bs;
+		mpt->arena = b;
+	}
+	b->used += size;
+	return b->data + b->used - size;
+}
+
+/**
+ * Allocate a dirty node without path or value
+ *
+ * @param   mpt   The trie
+ * @param   type  The node type
+ * @return        The node, `NULL` on error
+ */
+static libkeccak_mpt_node_t *libkeccak_mpt_node(libkeccak_mpt_t *mpt, unsigned char type)
+{
+	size_t nchildren = type == LIBKECCAK_MPT_BRANCH ? 16 : type == LIBKECCAK_MPT_EXTENSION;
+	libkeccak_mpt_node_t *node = libkeccak_mpt_alloc(mpt, sizeof(*node) + nchildren * sizeof(node));
+	if (!node)
+		return NULL;
+	memset(node, 0, sizeof(*node) + nchildren * sizeof(node));
+	node->type = type;
+	node->dirty = 1;
+	node->children = nchildren ? (libkeccak_mpt_node_t **)(node + 1) : NULL;
+	return node;
+}
+
+/**
+ * Get a nibble of a key
+ *
+ * @param   key  The key
+ * @param   i    The index of the nibble
+ * @return       The nibble
+ */
+static inline unsigned char libkeccak_mpt_nibble(const char *key, size_t i)
+{
+	return (unsigned char)((unsigned char)key[i >> 1] >> (i & 1 ? 0 : 4)) & 15;
+}
+
+/**
+ * Copy a range of a key's nibbles into the arena
+ *
+ * @param   mpt   The trie
+ * @param   key   The key
+ * @param   from  The index of the first nibble
+ * @param   to    One past the index of the last nibble
+ * @return        The nibbles, `NULL` on error
+ */
+static unsigned char *libkeccak_mpt_nibbles(libkeccak_mpt_t *mpt, const char *key, size_t from, size_t to)
+{
+	unsigned char *p = libkeccak_mpt_alloc(mpt, to - from);
+	size_t i;
+	if (p)
+		for (i = from; i < to; i++)
+			p[i - from] = libkeccak_mpt_nibble(key, i);
+	return p;
+}
+
+/**
+ * Copy a value into the arena
+ *
+ * @param   mpt       The trie
+ * @param   node      The node whose value to set
+ * @param   value     The value
+ * @param   valuelen  The length of the value
+ * @return            Zero on success, -1 on error
+ */
+static int libkeccak_mpt_set_value(libkeccak_mpt_t *mpt, libkeccak_mpt_node_t *node, const char *value, size_t valuelen)
+{
+	char *p = libkeccak_mpt_alloc(mpt, valuelen);
+	if (!p)
+		return -1;
+	memcpy(p, value, valuelen);
+	node->value = p;
+	node->valuelen = valuelen;
+	return 0;
+}
+
+// The sorted key/value stream given to `libkeccak_mpt_build`
+struct libkeccak_mpt_input {
+	const char *const *keys;
+	const size_t *keylens;
+	const char *const *values;
+	const size_t *valuelens;
+};
+
+static libkeccak_mpt_node_t *libkeccak_mpt_build_range(libkeccak_mpt_t *, const struct libkeccak_mpt_input *,
+                                                       size_t, size_t, size_t);
+
+/**
+ * Build a branch for the keys `[lo, hi)`, which share their first `depth` nibbles
+ *
+ * @param   mpt    The trie
+ * @param   in     The key/value stream
+ * @param   lo     The index of the first key
+ * @param   hi     One past the index of the last key
+ * @param   depth  The number of nibbles already consumed
+ * @return         The node, `NULL` on error
+ */
+static libkeccak_mpt_node_t *libkeccak_mpt_build_branch(libkeccak_mpt_t *mpt, const struct libkeccak_mpt_input *in,
+                                                        size_t lo, size_t hi, size_t depth)
+{
+	libkeccak_mpt_node_t *node = libkeccak_mpt_node(mpt, LIBKECCAK_MPT_BRANCH);
+	unsigned char nib;
+	size_t j;
+
+	if (!node)
+		return NULL;
+	if (2 * in->keylens[lo] == depth) {
+		if (libkeccak_mpt_set_value(mpt, node, in->values[lo], in->valuelens[lo]) < 0)
+			return NULL;
+		lo++;
+	}
+	for (; lo < hi; lo = j) {
+		nib = libkeccak_mpt_nibble(in->keys[lo], depth);
+		for (j = lo + 1; j < hi && libkeccak_mpt_nibble(in->keys[j], depth) == nib; j++);
+		node->children[nib] = libkeccak_mpt_build_range(mpt, in, lo, j, depth + 1);
+		if (!node->children[nib])
+			return NULL;
+	}
+	return node;
+}
+
+/**
+ * Build the subtrie for the keys `[lo, hi)`, which share their first `depth` nibbles
+ *
+ * @param   mpt    The trie
+ * @param   in     The key/value stream
+ * @param   lo     The index of the first key
+ * @param   hi     One past the index of the last key
+ * @param   depth  The number of nibbles already consumed
+ * @return         The node, `NULL` on error
+ */
+static libkeccak_mpt_node_t *libkeccak_mpt_build_range(libkeccak_mpt_t *mpt, const struct libkeccak_mpt_input *in,
+                                                       size_t lo, size_t hi, size_t depth)
+{
+	libkeccak_mpt_node_t *node;
+	size_t end, c;
+
+	if (hi - lo == 1) {
+		node = libkeccak_mpt_node(mpt, LIBKECCAK_MPT_LEAF);
+		if (!node)
+			return NULL;
+		node->pathlen = 2 * in->keylens[lo] - depth;
+		node->path = libkeccak_mpt_nibbles(mpt, in->keys[lo], depth, 2 * in->keylens[lo]);
+		if (!node->path || libkeccak_mpt_set_value(mpt, node, in->values[lo], in->valuelens[lo]) < 0)
+			return NULL;
+		return node;
+	}
+
+	/* The keys are sorted, so the prefix shared by the first and the last is shared by all. */
+	end = 2 * (in->keylens[lo] < in->keylens[hi - 1] ? in->keylens[lo] : in->keylens[hi - 1]);
+	for (c = depth; c < end && libkeccak_mpt_nibble(in->keys[lo], c) == libkeccak_mpt_nibble(in->keys[hi - 1], c);)
+		c++;
+	if (c == depth)
+		return libkeccak_mpt_build_branch(mpt, in, lo, hi, depth);
+
+	node = libkeccak_mpt_node(mpt, LIBKECCAK_MPT_EXTENSION);
+	if (!node)
+		return NULL;
+	node->pathlen = c - depth;
+	node->path = libkeccak_mpt_nibbles(mpt, in->keys[lo], depth, c);
+	if (!node->path)
+		return NULL;
+	node->children[0] = libkeccak_mpt_build_branch(mpt, in, lo, hi, c);
+	return node->children[0] ? node : NULL;
+}
+
+/**
+ * Release every node of a trie
+ *
+ * @param  mpt  The trie that should be destroyed
+ */
+void libkeccak_mpt_destroy(libkeccak_mpt_t *mpt)
+{
+	libkeccak_mpt_block_t *b, *next;
+	if (!mpt)
+		return;
+	for (b = mpt->arena; b; b = next) {
+		next = b->next;
+		libkeccak_free(b);
+	}
+	mpt->arena = NULL;
+	mpt->root = NULL;
+}
+
+/**
+ * Build an empty trie from a stream of key/value pairs,
+ * the keys and values are copied into the arena
+ *
+ * @param   mpt        The trie, it must be empty
+ * @param   keys       The keys, sorted in ascending byte order without duplicates
+ * @param   keylens    The lengths of the keys
+ * @param   values     The values
+ * @param   valuelens  The lengths of the values, none may be zero
+ * @param   count      The number of pairs
+ * @return             Zero on success, -1 on error
+ */
+int libkeccak_mpt_build(libkeccak_mpt_t *mpt, const char *const *keys, const size_t *keylens,
+                        const char *const *values, const size_t *valuelens, size_t count)
+{
+	struct libkeccak_mpt_input in;
+	size_t i, n;
+	int cmp;
+
+	if (mpt->root)
+		return -1;
+	for (i = 0; i < count; i++) {
+		if (!valuelens[i])
+			return -1;
+		if (!i)
+			continue;
+		n = keylens[i - 1] < keylens[i] ? keylens[i - 1] : keylens[i];
+		cmp = memcmp(keys[i - 1], keys[i], n);
+		if (cmp > 0 || (!cmp && keylens[i - 1] >= keylens[i]))
+			return -1;
+	}
+	if (!count)
+		return 0;
+
+	in.keys = keys;
+	in.keylens = keylens;
+	in.values = values;
+	in.valuelens = valuelens;
+	mpt->root = libkeccak_mpt_build_range(mpt, &in, 0, count, 0);
+	return mpt->root ? 0 : -1;
+}
+
+/**
+ * Insert or replace a key in a subtrie
+ *
+ * @param   mpt       The trie
+ * @param   slot      The reference to the subtrie
+ * @param   key       The key
+ * @param   nibs      The number of nibbles in the key
+ * @param   pos       The number of nibbles already consumed
+ * @param   value     The value, already in the arena
+ * @param   valuelen  The length of the value
+ * @return            Zero on success, -1 on error
+ */
+static int libkeccak_mpt_insert(libkeccak_mpt_t *mpt, libkeccak_mpt_node_t **slot, const char *key, size_t nibs,
+                                size_t pos, const char *value, size_t valuelen)
+{
+	libkeccak_mpt_node_t *node = *slot, *branch, *ext;
+	const unsigned char *path;
+	size_t c;
+
+	if (!node) {
+		node = libkeccak_mpt_node(mpt, LIBKECCAK_MPT_LEAF);
+		if (!node || !(node->path = libkeccak_mpt_nibbles(mpt, key, pos, nibs)))
+			return -1;
+		node->pathlen = nibs - pos;
+		node->value = value;
+		node->valuelen = valuelen;
+		*slot = node;
+		return 0;
+	}
+
+	node->dirty = 1;
+	if (node->type == LIBKECCAK_MPT_BRANCH) {
+		if (pos == nibs) {
+			node->value = value;
+			node->valuelen = valuelen;
+			return 0;
+		}
+		return libkeccak_mpt_insert(mpt, &node->children[libkeccak_mpt_nibble(key, pos)],
+		                            key, nibs, pos + 1, value, valuelen);
+	}
+
+	for (c = 0; c < node->pathlen && pos + c < nibs && node->path[c] == libkeccak_mpt_nibble(key, pos + c);)
+		c++;
+	if (c == node->pathlen) {
+		if (node->type == LIBKECCAK_MPT_EXTENSION)
+			return libkeccak_mpt_insert(mpt, &node->children[0], key, nibs, pos + c, value, valuelen);
+		if (pos + c == nibs) {
+			node->value = value;
+			node->valuelen = valuelen;
+			return 0;
+		}
+	}
+
+	/* Split the leaf or extension where the key diverges from its path. */
+	branch = libkeccak_mpt_node(mpt, LIBKECCAK_MPT_BRANCH);
+	if (!branch)
+		return -1;
+	path = node->path;
+	if (c == node->pathlen) {
+		branch->value = node->value;
+		branch->valuelen = node->valuelen;
+	} else if (node->type == LIBKECCAK_MPT_EXTENSION && node->pathlen - c == 1) {
+		branch->children[path[c]] = node->children[0];
+	} else {
+		branch->children[path[c]] = node;
+		node->path += c + 1;
+		node->pathlen -= c + 1;
+	}
+
+	if (c) {
+		ext = libkeccak_mpt_node(mpt, LIBKECCAK_MPT_EXTENSION);
+		if (!ext)
+			return -1;
+		ext->path = path;
+		ext->pathlen = c;
+		ext->children[0] = branch;
+		*slot = ext;
+	} else {
+		*slot = branch;
+	}
+	return libkeccak_mpt_insert(mpt, c ? &(*slot)->children[0] : slot, key, nibs, pos + c, value, valuelen);
+}
+
+/**
+ * Restore the trie invariants of a node whose subtrie lost a key
+ *
+ * @param   mpt   The trie
+ * @param   slot  The reference to the node
+ * @return        Zero on success, -1 on error
+ */
+static int libkeccak_mpt_normalise(libkeccak_mpt_t *mpt, libkeccak_mpt_node_t **slot)
+{
+	libkeccak_mpt_node_t *node = *slot, *child = NULL;
+	unsigned char *path;
+	size_t i, n = 0, k = 0;
+
+	if (node->type == LIBKECCAK_MPT_EXTENSION) {
+		child = node->children[0];
+		if (child->type == LIBKECCAK_MPT_BRANCH)
+			return 0;
+		path = libkeccak_mpt_alloc(mpt, node->pathlen + child->pathlen);
+		if (!path)
+			return -1;
+		memcpy(path, node->path, node->pathlen);
+		memcpy(path + node->pathlen, child->path, child->pathlen);
+		child->path = path;
+		child->pathlen += node->pathlen;
+		child->dirty = 1;
+		*slot = child;
+		return 0;
+	}
+
+	if (node->type != LIBKECCAK_MPT_BRANCH)
+		return 0;
+	for (i = 0; i < 16; i++)
+		if (node->children[i])
+			n++, k = i, child = node->children[i];
+
+	if (!n) {
+		if (!node->value) {
+			*slot = NULL;
+			return 0;
+		}
+		child = libkeccak_mpt_node(mpt, LIBKECCAK_MPT_LEAF);
+		if (!child)
+			return -1;
+		child->path = (const unsigned char *)node->value;
+		child->value = node->value;
+		child->valuelen = node->valuelen;
+		*slot = child;
+	} else if (n == 1 && !node->value) {
+		if (child->type == LIBKECCAK_MPT_BRANCH) {
+			node = libkeccak_mpt_node(mpt, LIBKECCAK_MPT_EXTENSION);
+			path = libkeccak_mpt_alloc(mpt, 1);
+			if (!node || !path)
+				return -1;
+			path[0] = (unsigned char)k;
+			node->path = path;
+			node->pathlen = 1;
+			node->children[0] = child;
+			*slot = node;
+		} else {
+			path = libkeccak_mpt_alloc(mpt, child->pathlen + 1);
+			if (!path)
+				return -1;
+			path[0] = (unsigned char)k;
+			memcpy(path + 1, child->path, child->pathlen);
+			child->path = path;
+			child->pathlen++;
+			child->dirty = 1;
+			*slot = child;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Delete a key from a subtrie
+ *
+ * @param   mpt   The trie
+ * @param   slot  The reference to the subtrie
+ * @param   key   The key
+ * @param   nibs  The number of nibbles in the key
+ * @param   pos   The number of nibbles already consumed
+ * @return        1 if the key was deleted, 0 if it was not present, -1 on error
+ */
+static int libkeccak_mpt_remove(libkeccak_mpt_t *mpt, libkeccak_mpt_node_t **slot, const char *key, size_t nibs, size_t pos)
+{
+	libkeccak_mpt_node_t *node = *slot;
+	size_t i;
+	int r;
+
+	if (!node)
+		return 0;
+
+	if (node->type == LIBKECCAK_MPT_BRANCH) {
+		if (pos == nibs) {
+			if (!node->value)
+				return 0;
+			node->value = NULL;
+			node->valuelen = 0;
+			r = 1;
+		} else {
+			r = libkeccak_mpt_remove(mpt, &node->children[libkeccak_mpt_nibble(key, pos)], key, nibs, pos + 1);
+		}
+	} else {
+		if (node->pathlen > nibs - pos)
+			return 0;
+		for (i = 0; i < node->pathlen; i++)
+			if (node->path[i] != libkeccak_mpt_nibble(key, pos + i))
+				return 0;
+		if (node->type == LIBKECCAK_MPT_LEAF) {
+			if (pos + node->pathlen != nibs)
+				return 0;
+			*slot = NULL;
+			return 1;
+		}
+		r = libkeccak_mpt_remove(mpt, &node->children[0], key, nibs, pos + node->pathlen);
+	}
+
+	if (r <= 0)
+		return r;
+	node->dirty = 1;
+	return libkeccak_mpt_normalise(mpt, slot) < 0 ? -1 : 1;
+}
+
+/**
+ * Insert, replace or delete a key, marking the nodes on its path dirty
+ *
+ * @param   mpt       The trie
+ * @param   key       The key
+ * @param   keylen    The length of the key
+ * @param   value     The value, may be `NULL` if `valuelen` is zero
+ * @param   valuelen  The length of the value, zero to delete the key
+ * @return            Zero on success, -1 on error
+ */
+int libkeccak_mpt_update(libkeccak_mpt_t *mpt, const char *key, size_t keylen, const char *value, size_t valuelen)
+{
+	char *p;
+	if (!valuelen)
+		return libkeccak_mpt_remove(mpt, &mpt->root, key, 2 * keylen, 0) < 0 ? -1 : 0;
+	p = libkeccak_mpt_alloc(mpt, valuelen);
+	if (!p)
+		return -1;
+	memcpy(p, value, valuelen);
+	return libkeccak_mpt_insert(mpt, &mpt->root, key, 2 * keylen, 0, p, valuelen);
+}
+
+/**
+ * Write an RLP string or list header
+ *
+ * @param   p     Output buffer
+ * @param   base  0x80 for a string, 0xC0 for a list
+ * @param   len   The length of the payload
+ * @return        The end of the header
+ */
+static unsigned char *libkeccak_mpt_rlp_header(unsigned char *p, unsigned char base, size_t len)
+{
+	size_t n = 0, x;
+	if (len < 56) {
+		*p++ = (unsigned char)(base + len);
+		return p;
+	}
+	for (x = len; x; x >>= 8)
+		n++;
+	*p++ = (unsigned char)(base + 55 + n);
+	while (n--)
+		*p++ = (unsigned char)(len >> (n << 3));
+	return p;
+}
+
+/**
+ * Write an RLP string
+ *
+ * @param   p    Output buffer
+ * @param   s    The string
+ * @param   len  The length of the string
+ * @return       The end of the encoding
+ */
+static unsigned char *libkeccak_mpt_rlp_string(unsigned char *p, const char *s, size_t len)
+{
+	if (len == 1 && (unsigned char)s[0] < 0x80) {
+		*p++ = (unsigned char)s[0];
+		return p;
+	}
+	p = libkeccak_mpt_rlp_header(p, 0x80, len);
+	memcpy(p, s, len);
+	return p + len;
+}
+
+/**
+ * Write a reference to a child node
+ *
+ * @param   p      Output buffer
+ * @param   child  The child, may be `NULL`
+ * @return         The end of the reference
+ */
+static unsigned char *libkeccak_mpt_rlp_ref(unsigned char *p, const libkeccak_mpt_node_t *child)
+{
+	if (!child) {
+		*p++ = 0x80;
+		return p;
+	}
+	if (child->reflen == 32)
+		*p++ = 0xA0;
+	memcpy(p, child->ref, child->reflen);
+	return p + child->reflen;
+}
+
+/**
+ * Write a path in hex-prefix encoding, as an RLP string
+ *
+ * @param   p     Output buffer
+ * @param   path  The nibbles
+ * @param   n     The number of nibbles
+ * @param   leaf  Whether the path belongs to a leaf
+ * @return        The end of the encoding
+ */
+static unsigned char *libkeccak_mpt_rlp_path(unsigned char *p, const unsigned char *path, size_t n, int leaf)
+{
+	size_t i = 0;
+	if (n / 2 + 1 > 1)
+		p = libkeccak_mpt_rlp_header(p, 0x80, n / 2 + 1);
+	*p++ = (unsigned char)((((leaf ? 2 : 0) | (n & 1)) << 4) | (n & 1 ? path[i++] : 0));
+	for (; i < n; i += 2)
+		*p++ = (unsigned char)((path[i] << 4) | path[i + 1]);
+	return p;
+}
+
+/**
+ * Get an upper bound of the size of a node's encoding, including header space
+ *
+ * @param   node  The node
+ * @return        The bound
+ */
+static size_t libkeccak_mpt_encode_bound(const libkeccak_mpt_node_t *node)
+{
+	return LIBKECCAK_MPT_HEADER + 16 * 33 + 2 * LIBKECCAK_MPT_HEADER + node->valuelen + node->pathlen / 2 + 1;
+}
+
+/**
+ * RLP encode a node whose children are all up to date
+ *
+ * @param   node  The node
+ * @param   buf   Output buffer, at least `libkeccak_mpt_encode_bound(node)` bytes
+ * @param   out   Output parameter for the start of the encoding within `buf`
+ * @return        The length of the encoding
+ */
+static size_t libkeccak_mpt_encode(const libkeccak_mpt_node_t *node, unsigned char *buf, unsigned char **out)
+{
+	unsigned char *start = buf + LIBKECCAK_MPT_HEADER, *p = start;
+	size_t i, len, hlen = 1, x;
+
+	if (node->type == LIBKECCAK_MPT_BRANCH) {
+		for (i = 0; i < 16; i++)
+			p = libkeccak_mpt_rlp_ref(p, node->children[i]);
+		if (node->value)
+			p = libkeccak_mpt_rlp_string(p, node->value, node->valuelen);
+		else
+			*p++ = 0x80;
+	} else {
+		p = libkeccak_mpt_rlp_path(p, node->path, node->pathlen, node->type == LIBKECCAK_MPT_LEAF);
+		if (node->type == LIBKECCAK_MPT_LEAF)
+			p = libkeccak_mpt_rlp_string(p, node->value, node->valuelen);
+		else
+			p = libkeccak_mpt_rlp_ref(p, node->children[0]);
+	}
+
+	len = (size_t)(p - start);
+	if (len >= 56)
+		for (x = len; x; x >>= 8)
+			hlen++;
+	*out = start - hlen;
+	libkeccak_mpt_rlp_header(*out, 0xC0, len);
+	return len + hlen;
+}
+
+/**
+ * Hash variable-length encodings, grouping those that span the same
+ * number of blocks for the kernel selected with `libkeccak_set_kernel`
+ *
+ * @param  msgs  The encodings
+ * @param  lens  The lengths of the encodings
+ * @param  outs  Output parameters for the hashes
+ * @param  n     The number of encodings
+ */
+static void libkeccak_mpt_hash_batch(const char *const *msgs, const size_t *lens, char *const *outs, size_t n)
+{
+	const libkeccak_kernel_t *kernel = libkeccak_get_kernel();
+	const char *in[LIBKECCAK_X4];
+	size_t l[LIBKECCAK_X4];
+	char *o[LIBKECCAK_X4];
+	size_t i, k, b;
+
+	for (b = 0; b < LIBKECCAK_MPT_BUCKETS; b++) {
+		for (k = i = 0; i < n; i++) {
+			if (lens[i] / LIBKECCAK_KECCAK256_RATE != b)
+				continue;
+			in[k] = msgs[i], l[k] = lens[i], o[k] = outs[i];
+			if (++k == kernel->width) {
+				kernel->sponge(in, l, LIBKECCAK_KECCAK256_RATE, 24, LIBKECCAK_KECCAK_PAD, o, 32);
+				k = 0;
+			}
+		}
+		while (k--)
+			libkeccak_keccak256(in[k], l[k], o[k]);
+	}
+	for (i = 0; i < n; i++)
+		if (lens[i] / LIBKECCAK_KECCAK256_RATE >= LIBKECCAK_MPT_BUCKETS)
+			libkeccak_keccak256(msgs[i], lens[i], outs[i]);
+}
+
+/**
+ * Encode and hash nodes whose children are all up to date
+ *
+ * @param   items    The nodes
+ * @param   n        The number of nodes, at most `LIBKECCAK_MPT_CHUNK`
+ * @param   scratch  Scratch space
+ * @return           Zero on success, -1 on error
+ */
+static int libkeccak_mpt_seal(const struct libkeccak_mpt_item *items, size_t n, struct libkeccak_mpt_scratch *scratch)
+{
+	libkeccak_mpt_node_t *node;
+	unsigned char *enc, *p;
+	size_t i, m = 0, need = 0, len;
+
+	for (i = 0; i < n; i++)
+		need += libkeccak_mpt_encode_bound(items[i].node);
+	if (need > scratch->cap) {
+		p = libkeccak_realloc(scratch->buf, scratch->cap, need);
+		if (!p)
+			return -1;
+		scratch->buf = p;
+		scratch->cap = need;
+	}
+
+	for (p = scratch->buf, i = 0; i < n; i++) {
+		node = items[i].node;
+		len = libkeccak_mpt_encode(node, p, &enc);
+		p += libkeccak_mpt_encode_bound(node);
+		node->dirty = 0;
+		if (len < 32) {
+			memcpy(node->ref, enc, len);
+			node->reflen = (unsigned char)len;
+		} else {
+			node->reflen = 32;
+			scratch->msgs[m] = (const char *)enc;
+			scratch->lens[m] = len;
+			scratch->outs[m++] = (char *)node->ref;
+		}
+	}
+	libkeccak_mpt_hash_batch(scratch->msgs, scratch->lens, scratch->outs, m);
+	return 0;
+}
+
+/**
+ * Allocate empty scratch space
+ *
+ * @return  The scratch space, `NULL` on error
+ */
+static struct libkeccak_mpt_scratch *libkeccak_mpt_scratch_create(void)
+{
+	struct libkeccak_mpt_scratch *scratch = libkeccak_malloc(sizeof(*scratch));
+	if (scratch) {
+		scratch->buf = NULL;
+		scratch->cap = 0;
+	}
+	return scratch;
+}
+
+/**
+ * Release scratch space
+ *
+ * @param  scratch  The scratch space, may be `NULL`
+ */
+static void libkeccak_mpt_scratch_free(struct libkeccak_mpt_scratch *scratch)
+{
+	if (scratch)
+		libkeccak_free(scratch->buf);
+	libkeccak_free(scratch);
+}
+
+/**
+ * Collect the dirty nodes of a subtrie, children before parents
+ *
+ * @param   node    The root of the subtrie
+ * @param   vec     The vector to append to
+ * @param   height  Output parameter for the height of `node`
+ * @return          Zero on success, -1 on error
+ */
+static int libkeccak_mpt_collect(libkeccak_mpt_node_t *node, struct libkeccak_mpt_vector *vec, size_t *height)
+{
+	struct libkeccak_mpt_item *v;
+	size_t i, h = 0, ch, cap;
+	size_t nchildren = node->type == LIBKECCAK_MPT_BRANCH ? 16 : node->type == LIBKECCAK_MPT_EXTENSION;
+
+	for (i = 0; i < nchildren; i++) {
+		if (!node->children[i] || !node->children[i]->dirty)
+			continue;
+		if (libkeccak_mpt_collect(node->children[i], vec, &ch) < 0)
+			return -1;
+		h = ch + 1 > h ? ch + 1 : h;
+	}
+
+	if (vec->n == vec->cap) {
+		cap = vec->cap ? vec->cap * 2 : 64;
+		v = libkeccak_realloc(vec->v, vec->cap * sizeof(*v), cap * sizeof(*v));
+		if (!v)
+			return -1;
+		vec->v = v;
+		vec->cap = cap;
+	}
+	vec->v[vec->n].node = node;
+	vec->v[vec->n++].height = *height = h;
+	return 0;
+}
+
+/**
+ * Rehash the dirty nodes of a subtrie, one height at a time
+ * so that every batch only depends on earlier batches
+ *
+ * @param   node  The root of the subtrie, must be dirty
+ * @return        Zero on success, -1 on error
+ */
+static int libkeccak_mpt_rehash(libkeccak_mpt_node_t *node)
+{
+	struct libkeccak_mpt_vector vec = { NULL, 0, 0 };
+	struct libkeccak_mpt_item *sorted = NULL;
+	struct libkeccak_mpt_scratch *scratch;
+	size_t *starts = NULL, h, height, i, n;
+	int r = -1;
+
+	scratch = libkeccak_mpt_scratch_create();
+	if (!scratch || libkeccak_mpt_collect(node, &vec, &height) < 0)
+		goto fail;
+	sorted = libkeccak_malloc(vec.n * sizeof(*sorted));
+	starts = libkeccak_malloc((height + 2) * sizeof(*starts));
+	if (!sorted || !starts)
+		goto fail;
+	memset(starts, 0, (height + 2) * sizeof(*starts));
+
+	for (i = 0; i < vec.n; i++)
+		starts[vec.v[i].height + 1]++;
+	for (h = 1; h <= height + 1; h++)
+		starts[h] += starts[h - 1];
+	for (i = 0; i < vec.n; i++)
+		sorted[starts[vec.v[i].height]++] = vec.v[i];
+
+	for (i = 0, h = 0; h <= height; h++) {
+		for (; i < starts[h]; i += n) {
+			n = starts[h] - i < LIBKECCAK_MPT_CHUNK ? starts[h] - i : LIBKECCAK_MPT_CHUNK;
+			if (libkeccak_mpt_seal(sorted + i, n, scratch) < 0)
+				goto fail;
+		}
+	}
+	r = 0;
+
+fail:
+	libkeccak_mpt_scratch_free(scratch);
+	libkeccak_free(sorted);
+	libkeccak_free(starts);
+	libkeccak_free(vec.v);
+	return r;
+}
+
+/**
+ * Rehash the subtries `[begin, end)`
+ *
+ * @param  ctx    The `struct libkeccak_mpt_job`
+ * @param  begin  The index of the first subtrie
+ * @param  end    One past the index of the last subtrie
+ */
+static void libkeccak_mpt_rehash_subtrees(void *ctx, size_t begin, size_t end)
+{
+	struct libkeccak_mpt_job *job = ctx;
+	for (; begin < end; begin++)
+		if (libkeccak_mpt_rehash(job->subtrees[begin]) < 0)
+			__atomic_store_n(&job->error, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Calculate the root hash of a trie, rehashing only dirty nodes
+ *
+ * Independent subtrees are hashed on separate threads, and within a subtree
+ * the nodes of each height are hashed together with the multi-buffer kernel
+ *
+ * @param   mpt      The trie
+ * @param   root     Output parameter for the root hash, `LIBKECCAK_MPT_ROOT` bytes
+ * @param   threads  The number of threads, zero or negative for one per online processor
+ * @return           Zero on success, -1 on error
+ */
+int libkeccak_mpt_root(libkeccak_mpt_t *mpt, char *root, long threads)
+{
+	struct libkeccak_mpt_item *top = NULL;
+	libkeccak_mpt_node_t **frontier = NULL, **next = NULL, *node;
+	struct libkeccak_mpt_scratch *scratch = NULL;
+	struct libkeccak_mpt_job job;
+	size_t ntop = 0, nfrontier = 0, nnext, i, j, nchildren, depth;
+	int saved;
+
+	if (!mpt->root) {
+		memcpy(root, LIBKECCAK_MPT_EMPTY_ROOT, LIBKECCAK_MPT_ROOT);
+		return 0;
+	}
+
+	if (mpt->root->dirty) {
+		/* Up to three levels of branches above at most 16^3 subtries: over 64 KB, kept off the caller's stack. */
+		top = libkeccak_malloc((1 + 16 + 256) * sizeof(*top));
+		frontier = libkeccak_malloc(16 * 16 * 16 * sizeof(*frontier));
+		next = libkeccak_malloc(16 * 16 * 16 * sizeof(*next));
+		if (!top || !frontier || !next)
+			goto fail;
+
+		/* Split the top of the trie off, leaving independent subtries below it. */
+		threads = libkeccak_parallel_threads(threads);
+		frontier[nfrontier++] = mpt->root;
+		for (depth = 0; threads > 1 && depth < LIBKECCAK_MPT_SPLIT_DEPTH && nfrontier < (size_t)threads * 4; depth++) {
+			for (nnext = 0, i = 0; i < nfrontier; i++) {
+				node = frontier[i];
+				if (node->type == LIBKECCAK_MPT_LEAF) {
+					next[nnext++] = node;
+					continue;
+				}
+				top[ntop].node = node;
+				top[ntop++].height = 0;
+				nchildren = node->type == LIBKECCAK_MPT_BRANCH ? 16 : 1;
+				for (j = 0; j < nchildren; j++)
+					if (node->children[j] && node->children[j]->dirty)
+						next[nnext++] = node->children[j];
+			}
+			memcpy(frontier, next, nnext * sizeof(*next));
+			nfrontier = nnext;
+		}
+
+		job.subtrees = frontier;
+		job.error = 0;
+		libkeccak_parallel_for(nfrontier, 1, libkeccak_mpt_rehash_subtrees, &job, threads);
+		if (job.error)
+			goto fail;
+
+		scratch = libkeccak_mpt_scratch_create();
+		if (!scratch)
+			goto fail;
+		while (ntop--)
+			if (libkeccak_mpt_seal(&top[ntop], 1, scratch) < 0)
+				goto fail;
+		libkeccak_mpt_scratch_free(scratch);
+		libkeccak_free(next);
+		libkeccak_free(frontier);
+		libkeccak_free(top);
+	}
+
+	node = mpt->root;
+	if (node->reflen == 32)
+		memcpy(root, node->ref, LIBKECCAK_MPT_ROOT);
+	else
+		libkeccak_keccak256((const char *)node->ref, node->reflen, root);
+	return 0;
+
+fail:
+	saved = errno;
+	libkeccak_mpt_scratch_free(scratch);
+	libkeccak_free(next);
+	libkeccak_free(frontier);
+	libkeccak_free(top);
+	errno = saved;
+	return -1;
+}
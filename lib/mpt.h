@@ -0,0 +1,103 @@
+#ifndef LIBKECCAK_MPT_H
+#define LIBKECCAK_MPT_H
+
+#include <stddef.h>
+
+// Size of a Merkle Patricia Trie root
+#define LIBKECCAK_MPT_ROOT 32
+
+// `libkeccak_mpt_node_t.type` of a leaf node
+#define LIBKECCAK_MPT_LEAF 0
+
+// `libkeccak_mpt_node_t.type` of an extension node
+#define LIBKECCAK_MPT_EXTENSION 1
+
+// `libkeccak_mpt_node_t.type` of a branch node
+#define LIBKECCAK_MPT_BRANCH 2
+
+// A node of a Merkle Patricia Trie, allocated in the trie's arena
+typedef struct libkeccak_mpt_node {
+	struct libkeccak_mpt_node** children; // 16 children of a branch, the child of an extension, `NULL` for a leaf
+	const unsigned char* path;            // The partial path of a leaf or extension, one nibble per byte
+	const char* value;                    // The value of a leaf or branch, `NULL` if none
+	size_t pathlen;                       // The number of nibbles in `path`
+	size_t valuelen;                      // The length of `value`
+	unsigned char type;                   // `LIBKECCAK_MPT_LEAF`, `LIBKECCAK_MPT_EXTENSION` or `LIBKECCAK_MPT_BRANCH`
+	unsigned char dirty;                  // Whether `ref` is out of date
+	unsigned char reflen;                 // The length of `ref`, 32 if it is a hash
+	unsigned char ref[32];                // How the parent refers to the node: its RLP encoding if shorter than 32 bytes, otherwise its hash
+} libkeccak_mpt_node_t;
+
+// A block of the trie's arena
+typedef struct libkeccak_mpt_block {
+	struct libkeccak_mpt_block* next; // The previously filled block
+	size_t used;                      // The number of bytes used in `data`
+	size_t size;                      // The size of `data`
+	char data[];                      // The allocations
+} libkeccak_mpt_block_t;
+
+// Ethereum Merkle Patricia Trie; every node, path and value lives in an arena released as a whole
+typedef struct libkeccak_mpt {
+	libkeccak_mpt_node_t* root;   // The root node, `NULL` for an empty trie
+	libkeccak_mpt_block_t* arena; // The current arena block
+} libkeccak_mpt_t;
+
+/**
+ * Initialise an empty trie
+ *
+ * @param  mpt  The trie that should be initialised
+ */
+static inline void libkeccak_mpt_initialise(libkeccak_mpt_t* mpt)
+{
+	mpt->root = NULL;
+	mpt->arena = NULL;
+}
+
+/**
+ * Release every node of a trie
+ *
+ * @param  mpt  The trie that should be destroyed
+ */
+void libkeccak_mpt_destroy(libkeccak_mpt_t* mpt);
+
+/**
+ * Build an empty trie from a stream of key/value pairs,
+ * the keys and values are copied into the arena
+ *
+ * @param   mpt        The trie, it must be empty
+ * @param   keys       The keys, sorted in ascending byte order without duplicates
+ * @param   keylens    The lengths of the keys
+ * @param   values     The values
+ * @param   valuelens  The lengths of the values, none may be zero
+ * @param   count      The number of pairs
+ * @return             Zero on success, -1 on error
+ */
+int libkeccak_mpt_build(libkeccak_mpt_t* mpt, const char* const* keys, const size_t* keylens,
+                        const char* const* values, const size_t* valuelens, size_t count);
+
+/**
+ * Insert, replace or delete a key, marking the nodes on its path dirty
+ *
+ * @param   mpt       The trie
+ * @param   key       The key
+ * @param   keylen    The length of the key
+ * @param   value     The value, may be `NULL` if `valuelen` is zero
+ * @param   valuelen  The length of the value, zero to delete the key
+ * @return            Zero on success, -1 on error
+ */
+int libkeccak_mpt_update(libkeccak_mpt_t* mpt, const char* key, size_t keylen, const char* value, size_t valuelen);
+
+/**
+ * Calculate the root hash of a trie, rehashing only dirty nodes
+ *
+ * Independent subtrees are hashed on separate threads, and within a subtree
+ * the nodes of each height are hashed together with the multi-buffer kernel
+ *
+ * @param   mpt      The trie
+ * @param   root     Output parameter for the root hash, `LIBKECCAK_MPT_ROOT` bytes
+ * @param   threads  The number of threads, zero or negative for one per online processor
+ * @return           Zero on success, -1 on error
+ */
+int libkeccak_mpt_root(libkeccak_mpt_t* mpt, char* root, long threads);
+
+#endif
@@ -0,0 +1,100 @@
+#include "parallel.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+// Largest number of threads a single `libkeccak_parallel_for` starts
+#define LIBKECCAK_PARALLEL_MAX_THREADS 256
+
+// Shared state of one `libkeccak_parallel_for` call
+struct libkeccak_parallel_job {
+	libkeccak_parallel_fn_t *fn;
+	void *ctx;
+	size_t count;
+	size_t grain;
+	size_t next; // The next unclaimed index, updated atomically
+};
+
+/**
+ * Resolve a requested thread count
+ *
+ * @param   threads  The requested number of threads, zero or negative for one per online processor
+ * @return           The number of threads to use, at least 1
+ */
+long libkeccak_parallel_threads(long threads)
+{
+	if (threads <= 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads <= 0)
+		threads = 1;
+	return threads > LIBKECCAK_PARALLEL_MAX_THREADS ? LIBKECCAK_PARALLEL_MAX_THREADS : threads;
+}
+
+/**
+ * Claim and process ranges until none are left
+ *
+ * @param   arg  The `struct libkeccak_parallel_job`
+ * @return       `NULL`
+ */
+static void *libkeccak_parallel_worker(void *arg)
+{
+	struct libkeccak_parallel_job *job = arg;
+	size_t begin, end;
+	for (;;) {
+		begin = __atomic_fetch_add(&job->next, job->grain, __ATOMIC_RELAXED);
+		if (begin >= job->count)
+			return NULL;
+		end = job->count - begin < job->grain ? job->count : begin + job->grain;
+		job->fn(job->ctx, begin, end);
+	}
+}
+
+/**
+ * Run `fn` over `[0, count)` split into ranges of `grain` indices,
+ * on the calling thread and up to `threads - 1` helper threads
+ *
+ * Ranges are handed out dynamically, so `fn` must not depend on which
+ * thread runs it; the function returns when every range is done
+ *
+ * @param   count    The number of indices
+ * @param   grain    The number of indices per range, at least 1
+ * @param   fn       The work function
+ * @param   ctx      The user context passed to `fn`
+ * @param   threads  The number of threads, zero or negative for one per online processor
+ * @return           Zero on success, -1 if no helper thread could be started (the work is still done)
+ */
+int libkeccak_parallel_for(size_t count, size_t grain, libkeccak_parallel_fn_t *fn, void *ctx, long threads)
+{
+	pthread_t tids[LIBKECCAK_PARALLEL_MAX_THREADS];
+	struct libkeccak_parallel_job job;
+	size_t ranges;
+	long i, started = 0;
+
+	if (!grain)
+		grain = 1;
+	ranges = (count + grain - 1) / grain;
+	threads = libkeccak_parallel_threads(threads);
+	if ((size_t)threads > ranges)
+		threads = (long)ranges;
+
+	if (threads <= 1) {
+		if (count)
+			fn(ctx, 0, count);
+		return 0;
+	}
+
+	job.fn = fn;
+	job.ctx = ctx;
+	job.count = count;
+	job.grain = grain;
+	job.next = 0;
+
+	for (i = 1; i < threads; i++)
+		if (!pthread_create(&tids[started], NULL, libkeccak_parallel_worker, &job))
+			started++;
+	libkeccak_parallel_worker(&job);
+	for (i = 0; i < started; i++)
+		pthread_join(tids[i], NULL);
+
+	return started ? 0 : -1;
+}
@@ -0,0 +1,39 @@
+#ifndef LIBKECCAK_PARALLEL_H
+#define LIBKECCAK_PARALLEL_H
+
+#include <stddef.h>
+
+/**
+ * Work function for `libkeccak_parallel_for`
+ *
+ * @param  ctx    The user context
+ * @param  begin  The first index of the range to process
+ * @param  end    One past the last index of the range to process
+ */
+typedef void libkeccak_parallel_fn_t(void* ctx, size_t begin, size_t end);
+
+/**
+ * Resolve a requested thread count
+ *
+ * @param   threads  The requested number of threads, zero or negative for one per online processor
+ * @return           The number of threads to use, at least 1
+ */
+long libkeccak_parallel_threads(long threads);
+
+/**
+ * Run `fn` over `[0, count)` split into ranges of `grain` indices,
+ * on the calling thread and up to `threads - 1` helper threads
+ *
+ * Ranges are handed out dynamically, so `fn` must not depend on which
+ * thread runs it; the function returns when every range is done
+ *
+ * @param   count    The number of indices
+ * @param   grain    The number of indices per range, at least 1
+ * @param   fn       The work function
+ * @param   ctx      The user context passed to `fn`
+ * @param   threads  The number of threads, zero or negative for one per online processor
+ * @return           Zero on success, -1 if no helper thread could be started (the work is still done)
+ */
+int libkeccak_parallel_for(size_t count, size_t grain, libkeccak_parallel_fn_t* fn, void* ctx, long threads);
+
+#endif
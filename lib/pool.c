@@ -0,0 +1,150 @@
+#include "pool.h"
+
+/**
+ * Initialise a pool
+ *
+ * @param   pool      The pool that should be initialised
+ * @param   capacity  The high-water mark: the number of states kept for reuse, over
+ *                    all specifications; states acquired beyond it are allocated and
+ *                    released individually
+ * @return            Zero on success, -1 on error
+ */
+int libkeccak_pool_initialise(libkeccak_pool_t *restrict pool, size_t capacity)
+{
+	if (capacity >= UINT32_MAX)
+		return -1;
+	pool->contexts = capacity ? libkeccak_malloc(capacity * sizeof(*pool->contexts)) : NULL;
+	if (capacity && !pool->contexts)
+		return -1;
+	pool->capacity = capacity;
+	pool->used = 0;
+	memset(pool->lists, 0, sizeof(pool->lists));
+	return 0;
+}
+
+/**
+ * Release every state of a pool, none may be acquired
+ *
+ * @param  pool  The pool that should be destroyed
+ */
+void libkeccak_pool_destroy(libkeccak_pool_t *restrict pool)
+{
+	size_t i, n;
+	if (!pool)
+		return;
+	n = pool->used < pool->capacity ? pool->used : pool->capacity;
+	for (i = 0; i < n; i++)
+		libkeccak_state_fast_destroy(&pool->contexts[i].state);
+	libkeccak_free(pool->contexts);
+	pool->contexts = NULL;
+	pool->capacity = pool->used = 0;
+}
+
+/**
+ * Find, or claim, the free list for a specification
+ *
+ * @param   pool  The pool
+ * @param   spec  The specifications
+ * @return        The index of the list, `LIBKECCAK_POOL_SPECS` if every list is taken
+ */
+static uint32_t libkeccak_pool_list(libkeccak_pool_t *restrict pool, const libkeccak_spec_t *restrict spec)
+{
+	libkeccak_pool_list_t *list;
+	uint32_t i;
+	int ready;
+
+	for (i = 0; i < LIBKECCAK_POOL_SPECS; i++) {
+		list = &pool->lists[i];
+		ready = __atomic_load_n(&list->ready, __ATOMIC_ACQUIRE);
+		if (!ready) {
+			if (__atomic_compare_exchange_n(&list->ready, &ready, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+				list->spec = *spec;
+				__atomic_store_n(&list->ready, 2, __ATOMIC_RELEASE);
+				return i;
+			}
+		}
+		while (ready != 2)
+			ready = __atomic_load_n(&list->ready, __ATOMIC_ACQUIRE);
+		if (list->spec.bitrate == spec->bitrate && list->spec.capacity == spec->capacity &&
+		    list->spec.output == spec->output)
+			return i;
+	}
+	return LIBKECCAK_POOL_SPECS;
+}
+
+/**
+ * Take a state, ready for hashing, from a pool
+ *
+ * @param   pool  The pool
+ * @param   spec  The specifications for the state
+ * @return        The state, `NULL` on error
+ */
+libkeccak_state_t *libkeccak_pool_acquire(libkeccak_pool_t *restrict pool, const libkeccak_spec_t *restrict spec)
+{
+	libkeccak_pool_context_t *ctx;
+	uint32_t l = libkeccak_pool_list(pool, spec);
+	uint64_t head, next;
+	size_t i;
+
+	if (l < LIBKECCAK_POOL_SPECS) {
+		/* Pop; the tag changes on every update, so a context popped and pushed back meanwhile fails the CAS. */
+		head = __atomic_load_n(&pool->lists[l].head, __ATOMIC_ACQUIRE);
+		while ((uint32_t)head) {
+			ctx = &pool->contexts[(uint32_t)head - 1];
+			next = ((head >> 32) + 1) << 32 | __atomic_load_n(&ctx->next, __ATOMIC_RELAXED);
+			if (__atomic_compare_exchange_n(&pool->lists[l].head, &head, next, 1, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+				return &ctx->state;
+		}
+
+		if (__atomic_load_n(&pool->used, __ATOMIC_RELAXED) < pool->capacity) {
+			i = __atomic_fetch_add(&pool->used, 1, __ATOMIC_RELAXED);
+			if (i < pool->capacity) {
+				ctx = &pool->contexts[i];
+				ctx->list = l;
+				if (libkeccak_state_initialise(&ctx->state, spec) < 0) {
+					/* The slot is lost, but `libkeccak_pool_destroy` can still release it. */
+					ctx->state.M = NULL;
+					return NULL;
+				}
+				return &ctx->state;
+			}
+		}
+	}
+
+	ctx = libkeccak_malloc(sizeof(*ctx));
+	if (!ctx)
+		return NULL;
+	ctx->list = UINT32_MAX;
+	if (libkeccak_state_initialise(&ctx->state, spec) < 0)
+		return libkeccak_free(ctx), NULL;
+	return &ctx->state;
+}
+
+/**
+ * Return a state to the pool it was taken from, it is reset so
+ * that the next `libkeccak_pool_acquire` can use it directly
+ *
+ * @param  pool   The pool
+ * @param  state  The state, as returned by `libkeccak_pool_acquire`
+ */
+void libkeccak_pool_release(libkeccak_pool_t *restrict pool, libkeccak_state_t *restrict state)
+{
+	libkeccak_pool_context_t *ctx = (libkeccak_pool_context_t *)state;
+	libkeccak_pool_list_t *list;
+	uint64_t head, next;
+
+	if (ctx->list == UINT32_MAX) {
+		libkeccak_state_fast_destroy(state);
+		libkeccak_free(ctx);
+		return;
+	}
+
+	libkeccak_state_reset(state);
+	list = &pool->lists[ctx->list];
+	next = (uint64_t)(ctx - pool->contexts) + 1;
+	head = __atomic_load_n(&list->head, __ATOMIC_RELAXED);
+	do
+		__atomic_store_n(&ctx->next, (uint32_t)head, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&list->head, &head, ((head >> 32) + 1) << 32 | next, 1,
+	                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
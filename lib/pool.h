@@ -0,0 +1,69 @@
+#ifndef LIBKECCAK_POOL_H
+#define LIBKECCAK_POOL_H
+
+#include "digest.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Number of distinct specifications a pool keeps free lists for
+#define LIBKECCAK_POOL_SPECS 16
+
+// A pooled hashing state
+typedef struct libkeccak_pool_context {
+	libkeccak_state_t state; // The state handed out, must be first
+	uint32_t next;           // The index, plus 1, of the next free context on the same list, 0 for none
+	uint32_t list;           // The free list the context belongs to, `UINT32_MAX` if not pooled
+} libkeccak_pool_context_t;
+
+// The free list of one specification
+typedef struct libkeccak_pool_list {
+	libkeccak_spec_t spec; // The specification of the states on the list
+	uint64_t head;         // Tag in the upper 32 bits, index plus 1 of the first free context in the lower, 0 if empty
+	int ready;             // 0 if unused, 1 while `spec` is being set, 2 once set
+} libkeccak_pool_list_t;
+
+// Thread-safe pool of initialised hashing states, with lock-free acquire and release
+typedef struct libkeccak_pool {
+	libkeccak_pool_context_t* contexts;               // The pooled contexts
+	size_t capacity;                                  // The high-water mark, at most this many contexts are kept
+	size_t used;                                      // The number of contexts that have been initialised
+	libkeccak_pool_list_t lists[LIBKECCAK_POOL_SPECS]; // One free list per specification
+} libkeccak_pool_t;
+
+/**
+ * Initialise a pool
+ *
+ * @param   pool      The pool that should be initialised
+ * @param   capacity  The high-water mark: the number of states kept for reuse, over
+ *                    all specifications; states acquired beyond it are allocated and
+ *                    released individually
+ * @return            Zero on success, -1 on error
+ */
+int libkeccak_pool_initialise(libkeccak_pool_t* pool, size_t capacity);
+
+/**
+ * Release every state of a pool, none may be acquired
+ *
+ * @param  pool  The pool that should be destroyed
+ */
+void libkeccak_pool_destroy(libkeccak_pool_t* pool);
+
+/**
+ * Take a state, ready for hashing, from a pool
+ *
+ * @param   pool  The pool
+ * @param   spec  The specifications for the state
+ * @return        The state, `NULL` on error
+ */
+libkeccak_state_t* libkeccak_pool_acquire(libkeccak_pool_t* pool, const libkeccak_spec_t* spec);
+
+/**
+ * Return a state to the pool it was taken from, it is reset so
+ * that the next `libkeccak_pool_acquire` can use it directly
+ *
+ * @param  pool   The pool
+ * @param  state  The state, as returned by `libkeccak_pool_acquire`
+ */
+void libkeccak_pool_release(libkeccak_pool_t* pool, libkeccak_state_t* state);
+
+#endif
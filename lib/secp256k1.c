@@ -0,0 +1,435 @@
+#include "secp256k1.h"
+#include "keccak-p.h"
+#include "keccak-f.h"
+#include "parallel.h"
+#include "metrics.h"
+
+// 2^256 modulo the field prime p = 2^256 - 2^32 - 977
+#define LIBKECCAK_SECP256K1_C 0x1000003D1ULL
+
+// Keys decompressed into one column and hashed together, one word of the result bitmap
+#define LIBKECCAK_SECP256K1_GROUP 64
+
+// Keys handed to a thread at a time, a multiple of `LIBKECCAK_SECP256K1_GROUP`
+#define LIBKECCAK_SECP256K1_GRAIN 256
+
+// The field prime, least significant limb first
+static const uint64_t LIBKECCAK_SECP256K1_P[4] = {
+	0xFFFFFFFEFFFFFC2FULL, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL
+};
+
+/**
+ * Multiply two field elements, the product is less than 2^256 but not necessarily less than p
+ *
+ * @param  r  Output parameter for the product, may alias `a` or `b`
+ * @param  a  The multiplicand, less than 2^256
+ * @param  b  The multiplier, less than 2^256
+ */
+static void libkeccak_fe_mul(uint64_t *r, const uint64_t *a, const uint64_t *b)
+{
+	uint64_t t[8] = {0};
+	unsigned __int128 uv;
+	uint64_t carry;
+	int i, j;
+
+	for (i = 0; i < 4; i++) {
+		for (carry = 0, j = 0; j < 4; j++) {
+			uv = (unsigned __int128)a[i] * b[j] + t[i + j] + carry;
+			t[i + j] = (uint64_t)uv;
+			carry = (uint64_t)(uv >> 64);
+		}
+		t[i + 4] = carry;
+	}
+
+	/* Fold the high half in as 2^256 = C, three times; the second fold carries at most 1,
+	 * and only when it leaves less than 2^68, so the third cannot carry at all. */
+	for (carry = 0, i = 0; i < 4; i++) {
+		uv = (unsigned __int128)t[i + 4] * LIBKECCAK_SECP256K1_C + t[i] + carry;
+		t[i] = (uint64_t)uv;
+		carry = (uint64_t)(uv >> 64);
+	}
+	for (j = 0; j < 2; j++) {
+		uv = (unsigned __int128)carry * LIBKECCAK_SECP256K1_C;
+		for (i = 0; i < 4; i++) {
+			uv += t[i];
+			t[i] = (uint64_t)uv;
+			uv >>= 64;
+		}
+		carry = (uint64_t)uv;
+	}
+	memcpy(r, t, 4 * sizeof(*r));
+}
+
+/**
+ * Square a field element `n` times
+ *
+ * @param  r  Output parameter for `a^(2^n)`, may alias `a`
+ * @param  a  The field element
+ * @param  n  The number of squarings, at least 1
+ */
+static void libkeccak_fe_sqr(uint64_t *r, const uint64_t *a, int n)
+{
+	libkeccak_fe_mul(r, a, a);
+	while (--n)
+		libkeccak_fe_mul(r, r, r);
+}
+
+/**
+ * Reduce a field element below p, without branching on its value
+ *
+ * @param  r  The field element, less than 2^256
+ */
+static void libkeccak_fe_normalise(uint64_t *r)
+{
+	uint64_t s[4], mask;
+	unsigned __int128 uv = (unsigned __int128)r[0] + LIBKECCAK_SECP256K1_C;
+	int i;
+
+	/* r + C overflows 2^256 exactly when r >= p, and then r + C - 2^256 = r - p. */
+	s[0] = (uint64_t)uv;
+	for (i = 1; i < 4; i++) {
+		uv = (uv >> 64) + r[i];
+		s[i] = (uint64_t)uv;
+	}
+	mask = -(uint64_t)(uv >> 64);
+	for (i = 0; i < 4; i++)
+		r[i] = (s[i] & mask) | (r[i] & ~mask);
+}
+
+/**
+ * Calculate a square root of a field element, as `a^((p + 1) / 4)`, with
+ * the 253 squarings and 13 multiplications of a fixed addition chain
+ *
+ * The result is only a root if `a` is a quadratic residue
+ *
+ * @param  r  Output parameter for the root candidate
+ * @param  a  The field element
+ */
+static void libkeccak_fe_sqrt(uint64_t *restrict r, const uint64_t *restrict a)
+{
+	uint64_t x2[4], x3[4], x6[4], x9[4], x11[4], x22[4], x44[4], x88[4], x176[4], x220[4], x223[4], t[4];
+
+	/* xN = a^(2^N - 1); (p + 1) / 4 is 223 ones, a zero, 22 ones, four zeros, 2 ones, two zeros. */
+	libkeccak_fe_sqr(x2, a, 1);       libkeccak_fe_mul(x2, x2, a);
+	libkeccak_fe_sqr(x3, x2, 1);      libkeccak_fe_mul(x3, x3, a);
+	libkeccak_fe_sqr(x6, x3, 3);      libkeccak_fe_mul(x6, x6, x3);
+	libkeccak_fe_sqr(x9, x6, 3);      libkeccak_fe_mul(x9, x9, x3);
+	libkeccak_fe_sqr(x11, x9, 2);     libkeccak_fe_mul(x11, x11, x2);
+	libkeccak_fe_sqr(x22, x11, 11);   libkeccak_fe_mul(x22, x22, x11);
+	libkeccak_fe_sqr(x44, x22, 22);   libkeccak_fe_mul(x44, x44, x22);
+	libkeccak_fe_sqr(x88, x44, 44);   libkeccak_fe_mul(x88, x88, x44);
+	libkeccak_fe_sqr(x176, x88, 88);  libkeccak_fe_mul(x176, x176, x88);
+	libkeccak_fe_sqr(x220, x176, 44); libkeccak_fe_mul(x220, x220, x44);
+	libkeccak_fe_sqr(x223, x220, 3);  libkeccak_fe_mul(x223, x223, x3);
+	libkeccak_fe_sqr(t, x223, 23);    libkeccak_fe_mul(t, t, x22);
+	libkeccak_fe_sqr(t, t, 6);        libkeccak_fe_mul(t, t, x2);
+	libkeccak_fe_sqr(r, t, 2);
+}
+
+/**
+ * Load a big-endian field element
+ *
+ * @param   r  Output parameter for the field element
+ * @param   p  The 32 bytes
+ * @return     Zero on success, -1 if the value is not less than p
+ */
+static int libkeccak_fe_load(uint64_t *restrict r, const unsigned char *restrict p)
+{
+	uint64_t s[4];
+	int i, j;
+	for (i = 0; i < 4; i++)
+		for (r[3 - i] = 0, j = 0; j < 8; j++)
+			r[3 - i] = r[3 - i] << 8 | p[i * 8 + j];
+	memcpy(s, r, sizeof(s));
+	libkeccak_fe_normalise(s);
+	return memcmp(s, r, sizeof(s)) ? -1 : 0;
+}
+
+/**
+ * Store a normalised field element in big-endian order
+ *
+ * @param  p  Output parameter for the 32 bytes
+ * @param  a  The field element, less than p
+ */
+static void libkeccak_fe_store(unsigned char *restrict p, const uint64_t *restrict a)
+{
+	int i, j;
+	for (i = 0; i < 4; i++)
+		for (j = 0; j < 8; j++)
+			p[i * 8 + j] = (unsigned char)(a[3 - i] >> (56 - 8 * j));
+}
+
+/**
+ * Decompress a SEC1 compressed secp256k1 public key
+ *
+ * The square root is taken with a fixed addition chain, so every key
+ * costs the same sequence of field operations, and the point is
+ * validated by squaring the root back
+ *
+ * @param   compressed    The compressed key, `LIBKECCAK_SECP256K1_COMPRESSED` bytes
+ * @param   uncompressed  Output parameter for X and Y, big-endian, `LIBKECCAK_SECP256K1_UNCOMPRESSED` bytes
+ * @return                Zero on success, -1 if the prefix is neither 0x02 nor 0x03,
+ *                        X is not a field element or X is not on the curve
+ */
+int libkeccak_secp256k1_decompress(const char *restrict compressed, char *restrict uncompressed)
+{
+	const unsigned char *c = (const unsigned char *)compressed;
+	uint64_t x[4], rhs[4], y[4], check[4], neg[4], mask, diff = 0;
+	unsigned __int128 uv;
+	int i;
+
+	if ((c[0] | 1) != 0x03 || libkeccak_fe_load(x, c + 1))
+		return -1;
+
+	/* y^2 = x^3 + 7 */
+	libkeccak_fe_sqr(rhs, x, 1);
+	libkeccak_fe_mul(rhs, rhs, x);
+	uv = (unsigned __int128)rhs[0] + 7;
+	rhs[0] = (uint64_t)uv;
+	for (i = 1; i < 4; i++) {
+		uv = (uv >> 64) + rhs[i];
+		rhs[i] = (uint64_t)uv;
+	}
+	rhs[0] += (uint64_t)(uv >> 64) * LIBKECCAK_SECP256K1_C;
+	libkeccak_fe_normalise(rhs);
+
+	libkeccak_fe_sqrt(y, rhs);
+	libkeccak_fe_normalise(y);
+	libkeccak_fe_sqr(check, y, 1);
+	libkeccak_fe_normalise(check);
+	for (i = 0; i < 4; i++)
+		diff |= check[i] ^ rhs[i];
+	if (diff)
+		return -1;
+
+	/* Pick the root with the parity of the prefix; y is never zero as the group has odd order. */
+	for (uv = 0, i = 0; i < 4; i++) {
+		uv = (unsigned __int128)LIBKECCAK_SECP256K1_P[i] - y[i] - (uint64_t)uv;
+		neg[i] = (uint64_t)uv;
+		uv = (uv >> 64) & 1;
+	}
+	mask = -((y[0] ^ c[0]) & 1);
+	for (i = 0; i < 4; i++)
+		y[i] = (neg[i] & mask) | (y[i] & ~mask);
+
+	libkeccak_fe_store((unsigned char *)uncompressed, x);
+	libkeccak_fe_store((unsigned char *)uncompressed + 32, y);
+	return 0;
+}
+
+/**
+ * Decode eight hexadecimal digits as one word: the digits are classified
+ * and converted in the bytes of the word, then the nibbles are gathered
+ *
+ * @param   hex     The eight digits
+ * @param   binary  Output parameter for the four bytes
+ * @return          Zero on success, -1 if a character is not a hexadecimal digit
+ */
+static inline int libkeccak_unhex8(const unsigned char *restrict hex, unsigned char *restrict binary)
+{
+#define B(x) (0x0101010101010101ULL * (x))
+	uint64_t v = libkeccak_load64(hex);
+	uint64_t l = v | B(0x20);
+	uint64_t digit, letter;
+	int i;
+
+	/* With the top bits clear, adding 0x80 - k sets the top bit of the bytes that are at least k. */
+	digit = ((v + B(0x80 - '0')) & ~(v + B(0x80 - '9' - 1))) & B(0x80);
+	letter = ((l + B(0x80 - 'a')) & ~(l + B(0x80 - 'f' - 1))) & B(0x80);
+	if ((v & B(0x80)) || (digit | letter) != B(0x80))
+		return -1;
+
+	v = (v & B(0x0F)) + (letter >> 7) * 9;
+	v = ((v & 0x000F000F000F000FULL) << 4) | ((v >> 8) & 0x000F000F000F000FULL);
+	v = (v | v >> 8) & 0x0000FFFF0000FFFFULL;
+	v = (v | v >> 16) & 0x00000000FFFFFFFFULL;
+	for (i = 0; i < 4; i++, v >>= 8)
+		binary[i] = (unsigned char)v;
+	return 0;
+#undef B
+}
+
+/**
+ * Decode hexadecimal, eight digits at a time
+ *
+ * @param   hex     The hexadecimal digits, upper or lower case, without a `0x` prefix
+ * @param   binary  Output parameter for the bytes, `n` bytes
+ * @param   n       The number of bytes, half the number of digits
+ * @return          Zero on success, -1 if a character is not a hexadecimal digit
+ */
+int libkeccak_secp256k1_unhex(const char *restrict hex, char *restrict binary, size_t n)
+{
+	const unsigned char *h = (const unsigned char *)hex;
+	unsigned char *b = (unsigned char *)binary;
+	unsigned char tail[8], out[4];
+	int bad = 0;
+
+	for (; n >= 4; n -= 4, h += 8, b += 4)
+		bad |= libkeccak_unhex8(h, b);
+	if (n) {
+		memset(tail, '0', sizeof(tail));
+		memcpy(tail, h, n * 2);
+		bad |= libkeccak_unhex8(tail, out);
+		memcpy(b, out, n);
+	}
+	return bad;
+}
+
+// A column of compressed keys
+struct libkeccak_secp256k1_input {
+	const char *keys;     // The keys
+	size_t stride;        // The distance between two keys
+	int hex;              // Whether the keys are hexadecimal
+	char *addresses;      // The output column, `NULL` when verifying
+	const char *expected; // The expected addresses when verifying, `NULL` when deriving
+	uint64_t *valid;      // The result bitmap, may be `NULL` unless verifying
+	size_t nvalid;        // The number of valid, or matching, keys, updated atomically
+};
+
+/**
+ * Derive, or verify, the addresses of the keys at `[begin, end)`, a group at a time
+ *
+ * @param  ctx    The `struct libkeccak_secp256k1_input`
+ * @param  begin  The first key, a multiple of `LIBKECCAK_SECP256K1_GROUP`
+ * @param  end    One past the last key
+ */
+static void libkeccak_secp256k1_range(void *ctx, size_t begin, size_t end)
+{
+	struct libkeccak_secp256k1_input *in = ctx;
+	char keys[LIBKECCAK_SECP256K1_GROUP * LIBKECCAK_SECP256K1_UNCOMPRESSED];
+	char digests[LIBKECCAK_SECP256K1_GROUP * 32];
+	char key[LIBKECCAK_SECP256K1_COMPRESSED];
+	const char *k;
+	char *out;
+	uint64_t bits;
+	size_t n, j;
+	int bad;
+
+	for (; begin < end; begin += n) {
+		LIBKECCAK_TIMER(stage);
+		n = end - begin < LIBKECCAK_SECP256K1_GROUP ? end - begin : LIBKECCAK_SECP256K1_GROUP;
+
+		for (bits = 0, j = 0; j < n; j++) {
+			k = in->keys + (begin + j) * in->stride;
+			if (in->hex) {
+				bad = libkeccak_secp256k1_unhex(k, key, LIBKECCAK_SECP256K1_COMPRESSED);
+				k = key;
+			} else {
+				bad = 0;
+			}
+			bad = bad || libkeccak_secp256k1_decompress(k, keys + j * LIBKECCAK_SECP256K1_UNCOMPRESSED);
+			if (bad)
+				memset(keys + j * LIBKECCAK_SECP256K1_UNCOMPRESSED, 0, LIBKECCAK_SECP256K1_UNCOMPRESSED);
+			bits |= (uint64_t)!bad << j;
+		}
+		LIBKECCAK_RECORD(LIBKECCAK_STAGE_PARSE, stage);
+
+		if (in->expected) {
+			LIBKECCAK_COUNT(LIBKECCAK_ERRORS, n - (size_t)__builtin_popcountll(bits));
+			bits &= libkeccak_sponge_verify_many(keys, LIBKECCAK_SECP256K1_UNCOMPRESSED, LIBKECCAK_SECP256K1_UNCOMPRESSED,
+			                                     n, LIBKECCAK_KECCAK256_RATE, 24, LIBKECCAK_KECCAK_PAD,
+			                                     in->expected + begin * LIBKECCAK_SECP256K1_ADDRESS,
+			                                     32 - LIBKECCAK_SECP256K1_ADDRESS, LIBKECCAK_SECP256K1_ADDRESS);
+			LIBKECCAK_RECORD(LIBKECCAK_STAGE_HASH, stage);
+			in->valid[begin / LIBKECCAK_SECP256K1_GROUP] = bits;
+			__atomic_add_fetch(&in->nvalid, (size_t)__builtin_popcountll(bits), __ATOMIC_RELAXED);
+			continue;
+		}
+
+		/* Invalid keys keep their slot in the column, so the kernel always sees whole groups. */
+		libkeccak_sponge_many(keys, LIBKECCAK_SECP256K1_UNCOMPRESSED, LIBKECCAK_SECP256K1_UNCOMPRESSED, n,
+		                      LIBKECCAK_KECCAK256_RATE, 24, LIBKECCAK_KECCAK_PAD, digests, 32);
+		LIBKECCAK_RECORD(LIBKECCAK_STAGE_HASH, stage);
+
+		for (j = 0; j < n; j++) {
+			out = in->addresses + (begin + j) * LIBKECCAK_SECP256K1_ADDRESS;
+			if (bits >> j & 1)
+				memcpy(out, digests + j * 32 + 32 - LIBKECCAK_SECP256K1_ADDRESS, LIBKECCAK_SECP256K1_ADDRESS);
+			else
+				memset(out, 0, LIBKECCAK_SECP256K1_ADDRESS);
+		}
+		if (in->valid)
+			in->valid[begin / LIBKECCAK_SECP256K1_GROUP] = bits;
+		__atomic_add_fetch(&in->nvalid, (size_t)__builtin_popcountll(bits), __ATOMIC_RELAXED);
+		LIBKECCAK_RECORD(LIBKECCAK_STAGE_FORMAT, stage);
+		LIBKECCAK_COUNT(LIBKECCAK_ERRORS, n - (size_t)__builtin_popcountll(bits));
+	}
+}
+
+/**
+ * Derive the addresses of many compressed public keys
+ *
+ * Keys are decompressed in groups into a column of uncompressed keys that
+ * is hashed with the kernel selected with `libkeccak_set_kernel`, and the
+ * groups are spread across `threads` threads
+ *
+ * @param   compressed  The keys, key `i` is stored at `compressed + i * LIBKECCAK_SECP256K1_COMPRESSED`
+ * @param   count       The number of keys
+ * @param   addresses   Output parameter for the addresses, address `i` is stored at
+ *                      `addresses + i * LIBKECCAK_SECP256K1_ADDRESS`, all zero for an invalid key
+ * @param   valid       Output parameter for the results, may be `NULL`, bit `i % 64` of `valid[i / 64]`
+ *                      is set if and only if key `i` is valid
+ * @param   threads     The number of threads, zero or negative for one per online processor
+ * @return              The number of valid keys
+ */
+size_t libkeccak_secp256k1_addresses(const char *compressed, size_t count, char *addresses,
+                                     uint64_t *valid, long threads)
+{
+	struct libkeccak_secp256k1_input in = {compressed, LIBKECCAK_SECP256K1_COMPRESSED, 0, addresses, NULL, valid, 0};
+	LIBKECCAK_TIMER(start);
+
+	LIBKECCAK_COUNT(LIBKECCAK_CALLS, 1);
+	libkeccak_parallel_for(count, LIBKECCAK_SECP256K1_GRAIN, libkeccak_secp256k1_range, &in, threads);
+	LIBKECCAK_RECORD(LIBKECCAK_LATENCY_SECP256K1, start);
+	return in.nvalid;
+}
+
+/**
+ * Derive the addresses of many compressed public keys given in hexadecimal
+ *
+ * @param   hex        The keys, key `i` is the `LIBKECCAK_SECP256K1_COMPRESSED_HEX` digits at `hex + i * stride`
+ * @param   stride     The distance between the start of two consecutive keys, at least
+ *                     `LIBKECCAK_SECP256K1_COMPRESSED_HEX`, e.g. one more for newline-separated keys
+ * @param   count      The number of keys
+ * @param   addresses  Output parameter for the addresses, address `i` is stored at
+ *                     `addresses + i * LIBKECCAK_SECP256K1_ADDRESS`, all zero for an invalid key
+ * @param   valid      Output parameter for the results, may be `NULL`, bit `i % 64` of `valid[i / 64]`
+ *                     is set if and only if key `i` is valid
+ * @param   threads    The number of threads, zero or negative for one per online processor
+ * @return             The number of valid keys
+ */
+size_t libkeccak_secp256k1_addresses_hex(const char *hex, size_t stride, size_t count, char *addresses,
+                                         uint64_t *valid, long threads)
+{
+	struct libkeccak_secp256k1_input in = {hex, stride, 1, addresses, NULL, valid, 0};
+	LIBKECCAK_TIMER(start);
+
+	LIBKECCAK_COUNT(LIBKECCAK_CALLS, 1);
+	libkeccak_parallel_for(count, LIBKECCAK_SECP256K1_GRAIN, libkeccak_secp256k1_range, &in, threads);
+	LIBKECCAK_RECORD(LIBKECCAK_LATENCY_SECP256K1, start);
+	return in.nvalid;
+}
+
+/**
+ * Check the addresses of many compressed public keys against expected
+ * addresses, comparing only the hash lanes that hold the address
+ *
+ * @param   compressed  The keys, key `i` is stored at `compressed + i * LIBKECCAK_SECP256K1_COMPRESSED`
+ * @param   count       The number of keys
+ * @param   addresses   The expected addresses, address `i` is stored at `addresses + i * LIBKECCAK_SECP256K1_ADDRESS`
+ * @param   valid       Output parameter for the results, bit `i % 64` of `valid[i / 64]` is set
+ *                      if and only if key `i` is valid and has the expected address
+ * @param   threads     The number of threads, zero or negative for one per online processor
+ * @return              The number of keys with the expected address
+ */
+size_t libkeccak_secp256k1_verify(const char *compressed, size_t count, const char *addresses,
+                                  uint64_t *valid, long threads)
+{
+	struct libkeccak_secp256k1_input in = {compressed, LIBKECCAK_SECP256K1_COMPRESSED, 0, NULL, addresses, valid, 0};
+	LIBKECCAK_TIMER(start);
+
+	LIBKECCAK_COUNT(LIBKECCAK_CALLS, 1);
+	libkeccak_parallel_for(count, LIBKECCAK_SECP256K1_GRAIN, libkeccak_secp256k1_range, &in, threads);
+	LIBKECCAK_RECORD(LIBKECCAK_LATENCY_SECP256K1, start);
+	return in.nvalid;
+}
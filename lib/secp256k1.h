@@ -0,0 +1,94 @@
+#ifndef LIBKECCAK_SECP256K1_H
+#define LIBKECCAK_SECP256K1_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Size of a SEC1 compressed public key, the 0x02 or 0x03 prefix followed by X
+#define LIBKECCAK_SECP256K1_COMPRESSED 33
+
+// Size of a compressed public key in hexadecimal, without a `0x` prefix
+#define LIBKECCAK_SECP256K1_COMPRESSED_HEX 66
+
+// Size of an uncompressed public key, X followed by Y, without the 0x04 prefix
+#define LIBKECCAK_SECP256K1_UNCOMPRESSED 64
+
+// Size of a binary address, the last 20 bytes of the Keccak-256 hashsum of the uncompressed key
+#define LIBKECCAK_SECP256K1_ADDRESS 20
+
+/**
+ * Decompress a SEC1 compressed secp256k1 public key
+ *
+ * The square root is taken with a fixed addition chain, so every key
+ * costs the same sequence of field operations, and the point is
+ * validated by squaring the root back
+ *
+ * @param   compressed    The compressed key, `LIBKECCAK_SECP256K1_COMPRESSED` bytes
+ * @param   uncompressed  Output parameter for X and Y, big-endian, `LIBKECCAK_SECP256K1_UNCOMPRESSED` bytes
+ * @return                Zero on success, -1 if the prefix is neither 0x02 nor 0x03,
+ *                        X is not a field element or X is not on the curve
+ */
+int libkeccak_secp256k1_decompress(const char* compressed, char* uncompressed);
+
+/**
+ * Decode hexadecimal, eight digits at a time
+ *
+ * @param   hex     The hexadecimal digits, upper or lower case, without a `0x` prefix
+ * @param   binary  Output parameter for the bytes, `n` bytes
+ * @param   n       The number of bytes, half the number of digits
+ * @return          Zero on success, -1 if a character is not a hexadecimal digit
+ */
+int libkeccak_secp256k1_unhex(const char* hex, char* binary, size_t n);
+
+/**
+ * Derive the addresses of many compressed public keys
+ *
+ * Keys are decompressed in groups into a column of uncompressed keys that
+ * is hashed with the kernel selected with `libkeccak_set_kernel`, and the
+ * groups are spread across `threads` threads
+ *
+ * @param   compressed  The keys, key `i` is stored at `compressed + i * LIBKECCAK_SECP256K1_COMPRESSED`
+ * @param   count       The number of keys
+ * @param   addresses   Output parameter for the addresses, address `i` is stored at
+ *                      `addresses + i * LIBKECCAK_SECP256K1_ADDRESS`, all zero for an invalid key
+ * @param   valid       Output parameter for the results, may be `NULL`, bit `i % 64` of `valid[i / 64]`
+ *                      is set if and only if key `i` is valid
+ * @param   threads     The number of threads, zero or negative for one per online processor
+ * @return              The number of valid keys
+ */
+size_t libkeccak_secp256k1_addresses(const char* compressed, size_t count, char* addresses,
+                                     uint64_t* valid, long threads);
+
+/**
+ * Derive the addresses of many compressed public keys given in hexadecimal
+ *
+ * @param   hex        The keys, key `i` is the `LIBKECCAK_SECP256K1_COMPRESSED_HEX` digits at `hex + i * stride`
+ * @param   stride     The distance between the start of two consecutive keys, at least
+ *                     `LIBKECCAK_SECP256K1_COMPRESSED_HEX`, e.g. one more for newline-separated keys
+ * @param   count      The number of keys
+ * @param   addresses  Output parameter for the addresses, address `i` is stored at
+ *                     `addresses + i * LIBKECCAK_SECP256K1_ADDRESS`, all zero for an invalid key
+ * @param   valid      Output parameter for the results, may be `NULL`, bit `i % 64` of `valid[i / 64]`
+ *                     is set if and only if key `i` is valid
+ * @param   threads    The number of threads, zero or negative for one per online processor
+ * @return             The number of valid keys
+ */
+size_t libkeccak_secp256k1_addresses_hex(const char* hex, size_t stride, size_t count, char* addresses,
+                                         uint64_t* valid, long threads);
+
+/**
+ * Check the addresses of many compressed public keys against expected
+ * addresses, comparing only the hash lanes that hold the address
+ *
+ * @param   compressed  The keys, key `i` is stored at `compressed + i * LIBKECCAK_SECP256K1_COMPRESSED`
+ * @param   count       The number of keys
+ * @param   addresses   The expected addresses, address `i` is stored at `addresses + i * LIBKECCAK_SECP256K1_ADDRESS`
+ * @param   valid       Output parameter for the results, bit `i % 64` of `valid[i / 64]` is set
+ *                      if and only if key `i` is valid and has the expected address
+ * @param   threads     The number of threads, zero or negative for one per online processor
+ * @return              The number of keys with the expected address
+ */
+size_t libkeccak_secp256k1_verify(const char* compressed, size_t count, const char* addresses,
+                                  uint64_t* valid, long threads);
+
+#endif
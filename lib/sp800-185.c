@@ -0,0 +1,254 @@
+#include "sp800-185.h"
+#include "keccak-p.h"
+#include "parallel.h"
+
+// Approximate number of message bytes handed to a ParallelHash thread at a time
+#define LIBKECCAK_PARALLELHASH_GRAIN_BYTES (256 << 10)
+
+// The full blocks of a ParallelHash message
+struct libkeccak_parallelhash_input {
+	const char *msg;  // The message
+	size_t blocksize; // The block size B
+	long rate;        // The bitrate in bytes
+	char *cv;         // Output for the chaining values
+	size_t cvlen;     // The size of each chaining value
+};
+
+/**
+ * Encode an integer as in NIST SP 800-185 `left_encode`
+ *
+ * @param   out  Output buffer, at least `LIBKECCAK_ENCODE_MAX` bytes
+ * @param   x    The integer
+ * @return       The number of bytes written
+ */
+size_t libkeccak_left_encode(char *restrict out, size_t x)
+{
+	size_t n = 1, i;
+	for (i = x >> 8; i; i >>= 8)
+		n++;
+	out[0] = (char)n;
+	for (i = 0; i < n; i++)
+		out[1 + i] = (char)(x >> ((n - 1 - i) << 3));
+	return n + 1;
+}
+
+/**
+ * Encode an integer as in NIST SP 800-185 `right_encode`
+ *
+ * @param   out  Output buffer, at least `LIBKECCAK_ENCODE_MAX` bytes
+ * @param   x    The integer
+ * @return       The number of bytes written
+ */
+size_t libkeccak_right_encode(char *restrict out, size_t x)
+{
+	size_t n = 1, i;
+	for (i = x >> 8; i; i >>= 8)
+		n++;
+	for (i = 0; i < n; i++)
+		out[i] = (char)(x >> ((n - 1 - i) << 3));
+	out[n] = (char)n;
+	return n + 1;
+}
+
+/**
+ * Absorb `encode_string(str)` into a sponge
+ *
+ * @param   state   The hashing state
+ * @param   str     The string, may be `NULL` if `len` is zero
+ * @param   len     The length of the string, in bytes
+ * @return          Zero on success, -1 on error
+ */
+int libkeccak_encode_string_update(libkeccak_state_t *restrict state, const char *restrict str, size_t len)
+{
+	char enc[LIBKECCAK_ENCODE_MAX];
+	if (libkeccak_fast_update(state, enc, libkeccak_left_encode(enc, len << 3)) < 0)
+		return -1;
+	return len ? libkeccak_fast_update(state, str, len) : 0;
+}
+
+/**
+ * Initialise a state for cSHAKE and absorb `bytepad(encode_string(N) || encode_string(S), rate)`
+ *
+ * Finish the hashing with `libkeccak_fast_digest` or `libkeccak_digest`,
+ * using the suffix returned by `libkeccak_cshake_suffix`
+ *
+ * @param   state      The state that should be initialised
+ * @param   x          The value of x in `cSHAKEx`, 128 or 256
+ * @param   outlen     The output size in bytes
+ * @param   name       The function name string N, may be `NULL` if `namelen` is zero
+ * @param   namelen    The length of the function name string
+ * @param   custom     The customisation string S, may be `NULL` if `customlen` is zero
+ * @param   customlen  The length of the customisation string
+ * @return             Zero on success, -1 on error
+ */
+int libkeccak_cshake_initialise(libkeccak_state_t *restrict state, long x, size_t outlen, const char *name,
+                                size_t namelen, const char *custom, size_t customlen)
+{
+	libkeccak_spec_t spec;
+	size_t rate, len;
+	char *buf, *p;
+	int r;
+
+	if ((x != 128 && x != 256) || !outlen)
+		return -1;
+	libkeccak_spec_shake(&spec, x, (long)(outlen << 3));
+	if (libkeccak_state_initialise(state, &spec) < 0)
+		return -1;
+	if (!namelen && !customlen)
+		return 0;
+
+	rate = (size_t)(spec.bitrate >> 3);
+	len = 3 * LIBKECCAK_ENCODE_MAX + namelen + customlen;
+	len += rate - len % rate;
+	buf = libkeccak_malloc(len);
+	if (!buf)
+		return libkeccak_state_fast_destroy(state), -1;
+
+	p = buf + libkeccak_left_encode(buf, rate);
+	p += libkeccak_left_encode(p, namelen << 3);
+	if (namelen)
+		memcpy(p, name, namelen), p += namelen;
+	p += libkeccak_left_encode(p, customlen << 3);
+	if (customlen)
+		memcpy(p, custom, customlen), p += customlen;
+	len = (size_t)(p - buf);
+	len = (len + rate - 1) / rate * rate;
+	memset(p, 0, len - (size_t)(p - buf));
+
+	r = libkeccak_fast_update(state, buf, len);
+	libkeccak_free(buf);
+	if (r < 0)
+		libkeccak_state_fast_destroy(state);
+	return r;
+}
+
+/**
+ * Calculate cSHAKE of a complete message
+ *
+ * @param   x          The value of x in `cSHAKEx`, 128 or 256
+ * @param   msg        The message
+ * @param   msglen     The length of the message
+ * @param   name       The function name string N, may be `NULL` if `namelen` is zero
+ * @param   namelen    The length of the function name string
+ * @param   custom     The customisation string S, may be `NULL` if `customlen` is zero
+ * @param   customlen  The length of the customisation string
+ * @param   hashsum    Output parameter for the output
+ * @param   outlen     The number of bytes to output
+ * @return             Zero on success, -1 on error
+ */
+int libkeccak_cshake(long x, const char *msg, size_t msglen, const char *name, size_t namelen,
+                     const char *custom, size_t customlen, char *hashsum, size_t outlen)
+{
+	libkeccak_state_t state;
+	int r;
+	if (libkeccak_cshake_initialise(&state, x, outlen, name, namelen, custom, customlen) < 0)
+		return -1;
+	r = libkeccak_fast_digest(&state, msg, msglen, 0, libkeccak_cshake_suffix(namelen, customlen), hashsum);
+	libkeccak_state_fast_destroy(&state);
+	return r;
+}
+
+/**
+ * Calculate TupleHash, or TupleHashXOF, of a tuple of strings
+ *
+ * @param   x          The value of x in `TupleHashx`, 128 or 256
+ * @param   tuple      The strings
+ * @param   lens       The lengths of the strings
+ * @param   n          The number of strings
+ * @param   custom     The customisation string S, may be `NULL` if `customlen` is zero
+ * @param   customlen  The length of the customisation string
+ * @param   hashsum    Output parameter for the output
+ * @param   outlen     The number of bytes to output
+ * @param   xof        Non-zero for TupleHashXOF
+ * @return             Zero on success, -1 on error
+ */
+int libkeccak_tuplehash(long x, const char *const *tuple, const size_t *lens, size_t n,
+                        const char *custom, size_t customlen, char *hashsum, size_t outlen, int xof)
+{
+	libkeccak_state_t state;
+	char enc[LIBKECCAK_ENCODE_MAX];
+	size_t i;
+	int r = 0;
+
+	if (libkeccak_cshake_initialise(&state, x, outlen, "TupleHash", 9, custom, customlen) < 0)
+		return -1;
+	for (i = 0; i < n && !r; i++)
+		r = libkeccak_encode_string_update(&state, tuple[i], lens[i]);
+	if (!r)
+		r = libkeccak_fast_digest(&state, enc, libkeccak_right_encode(enc, xof ? 0 : outlen << 3), 0,
+		                          LIBKECCAK_CSHAKE_SUFFIX, hashsum);
+	libkeccak_state_fast_destroy(&state);
+	return r;
+}
+
+/**
+ * Hash the full blocks `[begin, end)` of a ParallelHash message
+ *
+ * @param  ctx    The `struct libkeccak_parallelhash_input`
+ * @param  begin  The index of the first block
+ * @param  end    One past the index of the last block
+ */
+static void libkeccak_parallelhash_leaves(void *ctx, size_t begin, size_t end)
+{
+	struct libkeccak_parallelhash_input *in = ctx;
+	libkeccak_sponge_many(in->msg + begin * in->blocksize, in->blocksize, in->blocksize, end - begin,
+	                      in->rate, 24, LIBKECCAK_SHAKE_PAD, in->cv + begin * in->cvlen, in->cvlen);
+}
+
+/**
+ * Calculate ParallelHash, or ParallelHashXOF, of a complete message
+ *
+ * The message is split into blocks of `blocksize` bytes that are hashed
+ * independently, four at a time with the multi-buffer kernel and spread
+ * across `threads` threads
+ *
+ * @param   x          The value of x in `ParallelHashx`, 128 or 256
+ * @param   msg        The message
+ * @param   msglen     The length of the message
+ * @param   blocksize  The block size B, in bytes, greater than zero
+ * @param   custom     The customisation string S, may be `NULL` if `customlen` is zero
+ * @param   customlen  The length of the customisation string
+ * @param   hashsum    Output parameter for the output
+ * @param   outlen     The number of bytes to output
+ * @param   xof        Non-zero for ParallelHashXOF
+ * @param   threads    The number of threads, zero or negative for one per online processor
+ * @return             Zero on success, -1 on error
+ */
+int libkeccak_parallelhash(long x, const char *msg, size_t msglen, size_t blocksize, const char *custom,
+                           size_t customlen, char *hashsum, size_t outlen, int xof, long threads)
+{
+	struct libkeccak_parallelhash_input in;
+	size_t n, full, grain;
+	char *z, *p;
+	int r;
+
+	if ((x != 128 && x != 256) || !blocksize)
+		return -1;
+
+	n = (msglen + blocksize - 1) / blocksize;
+	full = msglen / blocksize;
+	in.msg = msg;
+	in.blocksize = blocksize;
+	in.rate = 200 - x / 4;
+	in.cvlen = (size_t)(x / 4);
+
+	z = libkeccak_malloc(3 * LIBKECCAK_ENCODE_MAX + n * in.cvlen);
+	if (!z)
+		return -1;
+	p = z + libkeccak_left_encode(z, blocksize);
+	in.cv = p;
+
+	grain = LIBKECCAK_PARALLELHASH_GRAIN_BYTES / blocksize;
+	grain = (grain + LIBKECCAK_X4 - 1) / LIBKECCAK_X4 * LIBKECCAK_X4;
+	libkeccak_parallel_for(full, grain ? grain : LIBKECCAK_X4, libkeccak_parallelhash_leaves, &in, threads);
+	if (full < n)
+		libkeccak_sponge(msg + full * blocksize, msglen - full * blocksize, in.rate, 24,
+		                 LIBKECCAK_SHAKE_PAD, in.cv + full * in.cvlen, in.cvlen);
+
+	p += n * in.cvlen;
+	p += libkeccak_right_encode(p, n);
+	p += libkeccak_right_encode(p, xof ? 0 : outlen << 3);
+	r = libkeccak_cshake(x, z, (size_t)(p - z), "ParallelHash", 12, custom, customlen, hashsum, outlen);
+	libkeccak_free(z);
+	return r;
+}
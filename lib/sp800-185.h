@@ -0,0 +1,125 @@
+#ifndef LIBKECCAK_SP800_185_H
+#define LIBKECCAK_SP800_185_H
+
+#include "digest.h"
+#include <stddef.h>
+
+// Largest number of bytes written by `libkeccak_left_encode` and `libkeccak_right_encode`
+#define LIBKECCAK_ENCODE_MAX (sizeof(size_t) + 1)
+
+/**
+ * Encode an integer as in NIST SP 800-185 `left_encode`
+ *
+ * @param   out  Output buffer, at least `LIBKECCAK_ENCODE_MAX` bytes
+ * @param   x    The integer
+ * @return       The number of bytes written
+ */
+size_t libkeccak_left_encode(char* out, size_t x);
+
+/**
+ * Encode an integer as in NIST SP 800-185 `right_encode`
+ *
+ * @param   out  Output buffer, at least `LIBKECCAK_ENCODE_MAX` bytes
+ * @param   x    The integer
+ * @return       The number of bytes written
+ */
+size_t libkeccak_right_encode(char* out, size_t x);
+
+/**
+ * Absorb `encode_string(str)` into a sponge
+ *
+ * @param   state   The hashing state
+ * @param   str     The string, may be `NULL` if `len` is zero
+ * @param   len     The length of the string, in bytes
+ * @return          Zero on success, -1 on error
+ */
+int libkeccak_encode_string_update(libkeccak_state_t* state, const char* str, size_t len);
+
+/**
+ * Initialise a state for cSHAKE and absorb `bytepad(encode_string(N) || encode_string(S), rate)`
+ *
+ * Finish the hashing with `libkeccak_fast_digest` or `libkeccak_digest`,
+ * using the suffix returned by `libkeccak_cshake_suffix`
+ *
+ * @param   state      The state that should be initialised
+ * @param   x          The value of x in `cSHAKEx`, 128 or 256
+ * @param   outlen     The output size in bytes
+ * @param   name       The function name string N, may be `NULL` if `namelen` is zero
+ * @param   namelen    The length of the function name string
+ * @param   custom     The customisation string S, may be `NULL` if `customlen` is zero
+ * @param   customlen  The length of the customisation string
+ * @return             Zero on success, -1 on error
+ */
+int libkeccak_cshake_initialise(libkeccak_state_t* state, long x, size_t outlen, const char* name,
+                                size_t namelen, const char* custom, size_t customlen);
+
+/**
+ * Get the message suffix for a cSHAKE hashing,
+ * cSHAKE with empty N and S is SHAKE
+ *
+ * @param   namelen    The length of the function name string
+ * @param   customlen  The length of the customisation string
+ * @return             `LIBKECCAK_CSHAKE_SUFFIX` or `LIBKECCAK_SHAKE_SUFFIX`
+ */
+static inline const char* libkeccak_cshake_suffix(size_t namelen, size_t customlen)
+{
+	return namelen || customlen ? LIBKECCAK_CSHAKE_SUFFIX : LIBKECCAK_SHAKE_SUFFIX;
+}
+
+/**
+ * Calculate cSHAKE of a complete message
+ *
+ * @param   x          The value of x in `cSHAKEx`, 128 or 256
+ * @param   msg        The message
+ * @param   msglen     The length of the message
+ * @param   name       The function name string N, may be `NULL` if `namelen` is zero
+ * @param   namelen    The length of the function name string
+ * @param   custom     The customisation string S, may be `NULL` if `customlen` is zero
+ * @param   customlen  The length of the customisation string
+ * @param   hashsum    Output parameter for the output
+ * @param   outlen     The number of bytes to output
+ * @return             Zero on success, -1 on error
+ */
+int libkeccak_cshake(long x, const char* msg, size_t msglen, const char* name, size_t namelen,
+                     const char* custom, size_t customlen, char* hashsum, size_t outlen);
+
+/**
+ * Calculate TupleHash, or TupleHashXOF, of a tuple of strings
+ *
+ * @param   x          The value of x in `TupleHashx`, 128 or 256
+ * @param   tuple      The strings
+ * @param   lens       The lengths of the strings
+ * @param   n          The number of strings
+ * @param   custom     The customisation string S, may be `NULL` if `customlen` is zero
+ * @param   customlen  The length of the customisation string
+ * @param   hashsum    Output parameter for the output
+ * @param   outlen     The number of bytes to output
+ * @param   xof        Non-zero for TupleHashXOF
+ * @return             Zero on success, -1 on error
+ */
+int libkeccak_tuplehash(long x, const char* const* tuple, const size_t* lens, size_t n,
+                        const char* custom, size_t customlen, char* hashsum, size_t outlen, int xof);
+
+/**
+ * Calculate ParallelHash, or ParallelHashXOF, of a complete message
+ *
+ * The message is split into blocks of `blocksize` bytes that are hashed
+ * independently, four at a time with the multi-buffer kernel and spread
+ * across `threads` threads
+ *
+ * @param   x          The value of x in `ParallelHashx`, 128 or 256
+ * @param   msg        The message
+ * @param   msglen     The length of the message
+ * @param   blocksize  The block size B, in bytes, greater than zero
+ * @param   custom     The customisation string S, may be `NULL` if `customlen` is zero
+ * @param   customlen  The length of the customisation string
+ * @param   hashsum    Output parameter for the output
+ * @param   outlen     The number of bytes to output
+ * @param   xof        Non-zero for ParallelHashXOF
+ * @param   threads    The number of threads, zero or negative for one per online processor
+ * @return             Zero on success, -1 on error
+ */
+int libkeccak_parallelhash(long x, const char* msg, size_t msglen, size_t blocksize, const char* custom,
+                           size_t customlen, char* hashsum, size_t outlen, int xof, long threads);
+
+#endif
@@ -7,6 +7,7 @@
 #define LIBKECCAK_SHA3_SUFFIX "01" // Message suffix for SHA3 hashing
 #define LIBKECCAK_RAWSHAKE_SUFFIX "11" // Message suffix for RawSHAKE hashing
 #define LIBKECCAK_SHAKE_SUFFIX "1111" // Message suffix for SHAKE hashing
+#define LIBKECCAK_CSHAKE_SUFFIX "00" // Message suffix for cSHAKE hashing
 #define LIBKECCAK_SPEC_ERROR_BITRATE_NONPOSITIVE 1 // Invalid `libkeccak_spec_t.bitrate`: non-positive
 #define LIBKECCAK_SPEC_ERROR_BITRATE_MOD_8 2 // Invalid `libkeccak_spec_t.bitrate`: not a multiple of 8
 #define LIBKECCAK_SPEC_ERROR_CAPACITY_NONPOSITIVE 3 // Invalid `libkeccak_spec_t.capacity`: non-positive
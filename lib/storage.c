@@ -0,0 +1,120 @@
+#include "storage.h"
+#include "parallel.h"
+
+#include <string.h>
+
+// Records handed to a thread at a time, a multiple of `LIBKECCAK_STORAGE_COLUMN`
+#define LIBKECCAK_STORAGE_GRAIN 1024
+
+// Preimages gathered into a column before they are hashed
+#define LIBKECCAK_STORAGE_COLUMN 64
+
+// A column of mapping keys against one declared slot
+struct libkeccak_storage_input {
+	const char *slot; // The declared slot of the outermost mapping
+	const char *keys; // The keys
+	size_t levels;    // The number of words per record
+	char *slots;      // The output column
+};
+
+/**
+ * Calculate the slots of the records at `[begin, end)`, level by level,
+ * gathering the 64-byte preimages of a column of records and hashing
+ * them on the kernel selected with `libkeccak_set_kernel`
+ *
+ * @param  ctx    The `struct libkeccak_storage_input`
+ * @param  begin  The first record
+ * @param  end    One past the last record
+ */
+static void libkeccak_storage_range(void *ctx, size_t begin, size_t end)
+{
+	const struct libkeccak_storage_input *in = ctx;
+	char pre[LIBKECCAK_STORAGE_COLUMN][2 * LIBKECCAK_STORAGE_WORD];
+	char *out;
+	size_t n, l, j;
+
+	for (; begin < end; begin += n) {
+		n = end - begin < LIBKECCAK_STORAGE_COLUMN ? end - begin : LIBKECCAK_STORAGE_COLUMN;
+		out = in->slots + begin * LIBKECCAK_STORAGE_WORD;
+
+		/* The declared slot is the second half of every outermost preimage. */
+		for (j = 0; j < n; j++)
+			memcpy(pre[j] + LIBKECCAK_STORAGE_WORD, in->slot, LIBKECCAK_STORAGE_WORD);
+
+		for (l = 0; l < in->levels; l++) {
+			for (j = 0; j < n; j++) {
+				memcpy(pre[j], in->keys + ((begin + j) * in->levels + l) * LIBKECCAK_STORAGE_WORD,
+				       LIBKECCAK_STORAGE_WORD);
+				/* Inner levels hash against the slot of the level above, which is in the output column. */
+				if (l)
+					memcpy(pre[j] + LIBKECCAK_STORAGE_WORD, out + j * LIBKECCAK_STORAGE_WORD, LIBKECCAK_STORAGE_WORD);
+			}
+			libkeccak_sponge_many(pre[0], 2 * LIBKECCAK_STORAGE_WORD, 2 * LIBKECCAK_STORAGE_WORD, n,
+			                      LIBKECCAK_KECCAK256_RATE, 24, LIBKECCAK_KECCAK_PAD, out, LIBKECCAK_STORAGE_WORD);
+		}
+	}
+}
+
+/**
+ * Calculate the storage slots of mapping entries for many keys against
+ * one declared slot, following Solidity's layout, `keccak256(key . slot)`,
+ * with nested mappings chained level by level, so the slot of
+ * `m[a][b]` is `keccak256(b . keccak256(a . slot))`
+ *
+ * Every level is a single-block hash of a 64-byte preimage; the preimages
+ * of a column of records are gathered, with the declared slot copied in
+ * once per column, and hashed with `libkeccak_sponge_many` on the
+ * kernel selected with `libkeccak_set_kernel`
+ *
+ * @param  keys     The keys, `count` records of `levels` words, each word padded to
+ *                  `LIBKECCAK_STORAGE_WORD` bytes as by `abi.encode`, outermost mapping first
+ * @param  levels   The number of nested mappings, at least 1
+ * @param  count    The number of records
+ * @param  slot     The declared slot of the outermost mapping, `LIBKECCAK_STORAGE_WORD` bytes
+ * @param  slots    Output parameter for the slots, slot `i` is stored at `slots + i * LIBKECCAK_STORAGE_WORD`
+ * @param  threads  The number of threads, zero or negative for one per online processor
+ */
+void libkeccak_storage_mapping(const char *keys, size_t levels, size_t count, const char *slot,
+                               char *slots, long threads)
+{
+	struct libkeccak_storage_input in = {slot, keys, levels, slots};
+
+	if (!count || !levels)
+		return;
+
+	libkeccak_parallel_for(count, LIBKECCAK_STORAGE_GRAIN, libkeccak_storage_range, &in, threads);
+}
+
+/**
+ * Calculate the storage slots of dynamic array elements, `keccak256(slot) + index * width`;
+ * the slot is hashed once for the whole column
+ *
+ * @param  slot     The declared slot of the array, `LIBKECCAK_STORAGE_WORD` bytes
+ * @param  indices  The indices of the elements
+ * @param  count    The number of indices
+ * @param  width    The number of slots each element occupies
+ * @param  slots    Output parameter for the slots, slot `i` is stored at `slots + i * LIBKECCAK_STORAGE_WORD`
+ */
+void libkeccak_storage_array(const char *restrict slot, const uint64_t *restrict indices, size_t count,
+                             uint64_t width, char *restrict slots)
+{
+	unsigned char base[LIBKECCAK_STORAGE_WORD];
+	unsigned char *out;
+	unsigned __int128 add;
+	unsigned sum;
+	size_t i;
+	int k;
+
+	libkeccak_keccak256(slot, LIBKECCAK_STORAGE_WORD, (char *)base);
+
+	/* Big-endian 256-bit addition of the 128-bit offset, the carry runs off the top modulo 2^256. */
+	for (i = 0; i < count; i++) {
+		out = (unsigned char *)slots + i * LIBKECCAK_STORAGE_WORD;
+		add = (unsigned __int128)indices[i] * width;
+		for (sum = 0, k = LIBKECCAK_STORAGE_WORD - 1; k >= 0; k--, add >>= 8) {
+			sum += base[k] + (unsigned)(add & 255);
+			out[k] = (unsigned char)sum;
+			sum >>= 8;
+		}
+	}
+}
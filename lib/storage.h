@@ -0,0 +1,46 @@
+#ifndef LIBKECCAK_STORAGE_H
+#define LIBKECCAK_STORAGE_H
+
+#include "keccak-p.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Size of an EVM word: a key, a slot or a slot hash, big-endian
+#define LIBKECCAK_STORAGE_WORD 32
+
+/**
+ * Calculate the storage slots of mapping entries for many keys against
+ * one declared slot, following Solidity's layout, `keccak256(key . slot)`,
+ * with nested mappings chained level by level, so the slot of
+ * `m[a][b]` is `keccak256(b . keccak256(a . slot))`
+ *
+ * Every level is a single-block hash of a 64-byte preimage; the preimages
+ * of a column of records are gathered, with the declared slot copied in
+ * once per column, and hashed with `libkeccak_sponge_many` on the
+ * kernel selected with `libkeccak_set_kernel`
+ *
+ * @param  keys     The keys, `count` records of `levels` words, each word padded to
+ *                  `LIBKECCAK_STORAGE_WORD` bytes as by `abi.encode`, outermost mapping first
+ * @param  levels   The number of nested mappings, at least 1
+ * @param  count    The number of records
+ * @param  slot     The declared slot of the outermost mapping, `LIBKECCAK_STORAGE_WORD` bytes
+ * @param  slots    Output parameter for the slots, slot `i` is stored at `slots + i * LIBKECCAK_STORAGE_WORD`
+ * @param  threads  The number of threads, zero or negative for one per online processor
+ */
+void libkeccak_storage_mapping(const char* keys, size_t levels, size_t count, const char* slot,
+                               char* slots, long threads);
+
+/**
+ * Calculate the storage slots of dynamic array elements, `keccak256(slot) + index * width`;
+ * the slot is hashed once for the whole column
+ *
+ * @param  slot     The declared slot of the array, `LIBKECCAK_STORAGE_WORD` bytes
+ * @param  indices  The indices of the elements
+ * @param  count    The number of indices
+ * @param  width    The number of slots each element occupies
+ * @param  slots    Output parameter for the slots, slot `i` is stored at `slots + i * LIBKECCAK_STORAGE_WORD`
+ */
+void libkeccak_storage_array(const char* slot, const uint64_t* indices, size_t count, uint64_t width, char* slots);
+
+#endif
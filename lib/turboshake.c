@@ -0,0 +1,90 @@
+#include "turboshake.h"
+#include "keccak-f.h"
+
+/**
+ * Initialise a TurboSHAKE state
+ *
+ * @param   state   The state that should be initialised
+ * @param   x       The value of x in `TurboSHAKEx`, 128 or 256
+ * @param   domain  The domain separation byte, in [0x01, 0x7F]
+ * @return          Zero on success, -1 on error
+ */
+int libkeccak_turboshake_initialise(libkeccak_turboshake_t *restrict state, long x, unsigned char domain)
+{
+	if ((x != 128 && x != 256) || !domain || domain > 0x7F)
+		return -1;
+	memset(state->S, 0, sizeof(state->S));
+	state->rate = 200 - x / 4;
+	state->mptr = 0;
+	state->domain = domain;
+	state->squeezing = 0;
+	return 0;
+}
+
+/**
+ * Absorb more of the message to the TurboSHAKE sponge
+ *
+ * @param  state   The hashing state, must not be squeezing
+ * @param  msg     The partial message
+ * @param  msglen  The length of the partial message
+ */
+void libkeccak_turboshake_update(libkeccak_turboshake_t *restrict state, const char *restrict msg, size_t msglen)
+{
+	size_t rate = (size_t)state->rate;
+	size_t n;
+
+	if (state->mptr) {
+		n = rate - state->mptr < msglen ? rate - state->mptr : msglen;
+		memcpy(state->M + state->mptr, msg, n);
+		state->mptr += n, msg += n, msglen -= n;
+		if (state->mptr < rate)
+			return;
+		libkeccak_sponge_absorb_block(state->S, state->M, state->rate);
+		libkeccak_p1600(state->S, LIBKECCAK_TURBOSHAKE_ROUNDS);
+		state->mptr = 0;
+	}
+
+	for (; msglen >= rate; msg += rate, msglen -= rate) {
+		libkeccak_sponge_absorb_block(state->S, (const unsigned char *)msg, state->rate);
+		libkeccak_p1600(state->S, LIBKECCAK_TURBOSHAKE_ROUNDS);
+	}
+
+	memcpy(state->M, msg, msglen);
+	state->mptr = msglen;
+}
+
+/**
+ * Squeeze output from the TurboSHAKE sponge, padding the message on the first call;
+ * consecutive calls continue the output stream
+ *
+ * @param  state    The hashing state
+ * @param  hashsum  Output parameter for the output
+ * @param  outlen   The number of bytes to squeeze
+ */
+void libkeccak_turboshake_squeeze(libkeccak_turboshake_t *restrict state, char *restrict hashsum, size_t outlen)
+{
+	size_t rate = (size_t)state->rate;
+	size_t n;
+	long i;
+
+	if (!state->squeezing) {
+		memset(state->M + state->mptr, 0, rate - state->mptr);
+		state->M[state->mptr] ^= state->domain;
+		state->M[rate - 1] ^= 0x80;
+		libkeccak_sponge_absorb_block(state->S, state->M, state->rate);
+		state->squeezing = 1;
+		state->mptr = rate;
+	}
+
+	while (outlen) {
+		if (state->mptr == rate) {
+			libkeccak_p1600(state->S, LIBKECCAK_TURBOSHAKE_ROUNDS);
+			for (i = 0; i < state->rate >> 3; i++)
+				libkeccak_store64(state->M + (i << 3), (uint64_t)state->S[LANE_TRANSPOSE_MAP[i]]);
+			state->mptr = 0;
+		}
+		n = rate - state->mptr < outlen ? rate - state->mptr : outlen;
+		memcpy(hashsum, state->M + state->mptr, n);
+		state->mptr += n, hashsum += n, outlen -= n;
+	}
+}
@@ -0,0 +1,69 @@
+#ifndef LIBKECCAK_TURBOSHAKE_H
+#define LIBKECCAK_TURBOSHAKE_H
+
+#include "keccak-p.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Number of rounds of Keccak-p[1600, 12], used by TurboSHAKE and KangarooTwelve
+#define LIBKECCAK_TURBOSHAKE_ROUNDS 12
+
+// Default domain separation byte for TurboSHAKE
+#define LIBKECCAK_TURBOSHAKE_DEFAULT_DOMAIN 0x1F
+
+// Datastructure that describes the state of a TurboSHAKE hashing process, it owns no heap memory
+typedef struct libkeccak_turboshake {
+	int64_t S[25];        // The lanes (state/sponge)
+	unsigned char M[168]; // The partial block not yet absorbed, or the block being squeezed
+	long rate;            // The bitrate in bytes, 168 for TurboSHAKE128 and 136 for TurboSHAKE256
+	size_t mptr;          // Number of bytes used in `M`
+	unsigned char domain; // The domain separation byte
+	char squeezing;       // Whether the message has been padded and the sponge is being squeezed
+} libkeccak_turboshake_t;
+
+/**
+ * Initialise a TurboSHAKE state
+ *
+ * @param   state   The state that should be initialised
+ * @param   x       The value of x in `TurboSHAKEx`, 128 or 256
+ * @param   domain  The domain separation byte, in [0x01, 0x7F]
+ * @return          Zero on success, -1 on error
+ */
+int libkeccak_turboshake_initialise(libkeccak_turboshake_t* state, long x, unsigned char domain);
+
+/**
+ * Absorb more of the message to the TurboSHAKE sponge
+ *
+ * @param  state   The hashing state, must not be squeezing
+ * @param  msg     The partial message
+ * @param  msglen  The length of the partial message
+ */
+void libkeccak_turboshake_update(libkeccak_turboshake_t* state, const char* msg, size_t msglen);
+
+/**
+ * Squeeze output from the TurboSHAKE sponge, padding the message on the first call;
+ * consecutive calls continue the output stream
+ *
+ * @param  state    The hashing state
+ * @param  hashsum  Output parameter for the output
+ * @param  outlen   The number of bytes to squeeze
+ */
+void libkeccak_turboshake_squeeze(libkeccak_turboshake_t* state, char* hashsum, size_t outlen);
+
+/**
+ * Calculate TurboSHAKE of a complete message
+ *
+ * @param  x        The value of x in `TurboSHAKEx`, 128 or 256
+ * @param  domain   The domain separation byte, in [0x01, 0x7F]
+ * @param  msg      The message
+ * @param  msglen   The length of the message
+ * @param  hashsum  Output parameter for the output
+ * @param  outlen   The number of bytes to output
+ */
+static inline void libkeccak_turboshake(long x, unsigned char domain, const char* msg, size_t msglen,
+                                        char* hashsum, size_t outlen)
+{
+	libkeccak_sponge(msg, msglen, 200 - x / 4, LIBKECCAK_TURBOSHAKE_ROUNDS, domain, hashsum, outlen);
+}
+
+#endif
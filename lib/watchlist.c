@@ -0,0 +1,312 @@
+#include "watchlist.h"
+#include "alloc.h"
+#include "digest.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Number of bits set per address in its Bloom filter block
+#define LIBKECCAK_WATCHLIST_PROBES 7
+
+// How many addresses ahead `libkeccak_watchlist_match` prefetches filter blocks
+#define LIBKECCAK_WATCHLIST_PREFETCH 8
+
+// Number of entries in the prefix table, one per value of the first two bytes
+#define LIBKECCAK_WATCHLIST_PREFIXES 65536
+
+/**
+ * Load a little-endian 64-bit word from an address
+ *
+ * @param   p  The first byte
+ * @return     The word
+ */
+static inline uint64_t libkeccak_watchlist_word(const char *p)
+{
+	uint64_t x = 0;
+	int i;
+	for (i = 0; i < 8; i++)
+		x |= (uint64_t)(unsigned char)p[i] << (i << 3);
+	return x;
+}
+
+/**
+ * Get the Bloom filter block of an address; addresses are hash output,
+ * so their bytes serve as the filter's hash functions directly
+ *
+ * @param   watchlist  The watchlist
+ * @param   address    The binary address
+ * @return             The first word of the block
+ */
+static inline const uint64_t *libkeccak_watchlist_block(const libkeccak_watchlist_t *restrict watchlist,
+                                                      const char *restrict address)
+{
+	return watchlist->bloom + ((libkeccak_watchlist_word(address) & watchlist->mask) << 3);
+}
+
+/**
+ * Check an address against its Bloom filter block
+ *
+ * @param   block    The block
+ * @param   address  The binary address
+ * @return           0 if the address is certainly not watched, 1 if it may be
+ */
+static inline int libkeccak_watchlist_probe(const uint64_t *restrict block, const char *restrict address)
+{
+	uint64_t h = libkeccak_watchlist_word(address + 8);
+	unsigned bit;
+	int i;
+	for (i = 0; i < LIBKECCAK_WATCHLIST_PROBES; i++, h >>= 9) {
+		bit = (unsigned)h & 511;
+		if (!(block[bit >> 6] >> (bit & 63) & 1))
+			return 0;
+	}
+	return 1;
+}
+
+/**
+ * Get the first two bytes of an address as a number
+ *
+ * @param   address  The binary address
+ * @return           The prefix
+ */
+static inline size_t libkeccak_watchlist_prefix(const char *address)
+{
+	return (size_t)(unsigned char)address[0] << 8 | (unsigned char)address[1];
+}
+
+static int libkeccak_watchlist_compare(const void *a, const void *b)
+{
+	return memcmp(a, b, LIBKECCAK_WATCHLIST_ADDRESS);
+}
+
+/**
+ * Sort binary addresses and drop duplicates, producing an index
+ * suitable for `libkeccak_watchlist_initialise` or for writing to
+ * a file for `libkeccak_watchlist_open`
+ *
+ * @param   addresses  The addresses, `count * LIBKECCAK_WATCHLIST_ADDRESS` bytes, sorted in place
+ * @param   count      The number of addresses
+ * @return             The number of unique addresses, which are at the beginning of `addresses`
+ */
+size_t libkeccak_watchlist_sort(char *addresses, size_t count)
+{
+	size_t i, n = 0;
+	qsort(addresses, count, LIBKECCAK_WATCHLIST_ADDRESS, libkeccak_watchlist_compare);
+	for (i = 0; i < count; i++) {
+		if (n && !memcmp(addresses + (n - 1) * LIBKECCAK_WATCHLIST_ADDRESS,
+		                 addresses + i * LIBKECCAK_WATCHLIST_ADDRESS, LIBKECCAK_WATCHLIST_ADDRESS))
+			continue;
+		if (n != i)
+			memcpy(addresses + n * LIBKECCAK_WATCHLIST_ADDRESS,
+			       addresses + i * LIBKECCAK_WATCHLIST_ADDRESS, LIBKECCAK_WATCHLIST_ADDRESS);
+		n++;
+	}
+	return n;
+}
+
+/**
+ * Initialise a watchlist over an index in memory
+ *
+ * @param   watchlist  The watchlist that should be initialised
+ * @param   index      The addresses, sorted without duplicates, they are not copied
+ * @param   count      The number of addresses
+ * @return             Zero on success, -1 on error, including an unsorted index
+ */
+int libkeccak_watchlist_initialise(libkeccak_watchlist_t *restrict watchlist, const char *index, size_t count)
+{
+	size_t blocks = 1, i, p, bloomsize, prefixsize;
+	const char *address;
+	uint64_t *block, h;
+	unsigned bit;
+	int j;
+
+	while (blocks * 512 < count * LIBKECCAK_WATCHLIST_BITS_PER_KEY)
+		blocks <<= 1;
+	bloomsize = blocks * 64;
+	prefixsize = (LIBKECCAK_WATCHLIST_PREFIXES + 1) * sizeof(size_t);
+
+	/* Over-allocate so the filter can start on a cache line. */
+	watchlist->storage = libkeccak_malloc(bloomsize + 63 + prefixsize);
+	if (!watchlist->storage)
+		return -1;
+	watchlist->bloom = (uint64_t *)(((uintptr_t)watchlist->storage + 63) & ~(uintptr_t)63);
+	watchlist->prefix = (size_t *)((char *)watchlist->bloom + bloomsize);
+	watchlist->mask = blocks - 1;
+	watchlist->index = index;
+	watchlist->count = count;
+	watchlist->map = NULL;
+	watchlist->maplen = 0;
+	memset(watchlist->bloom, 0, bloomsize);
+
+	for (p = 0, i = 0; i < count; i++) {
+		address = index + i * LIBKECCAK_WATCHLIST_ADDRESS;
+		if (i && memcmp(address - LIBKECCAK_WATCHLIST_ADDRESS, address, LIBKECCAK_WATCHLIST_ADDRESS) >= 0) {
+			libkeccak_free(watchlist->storage);
+			watchlist->storage = NULL;
+			return -1;
+		}
+		for (; p <= libkeccak_watchlist_prefix(address); p++)
+			watchlist->prefix[p] = i;
+		block = (uint64_t *)libkeccak_watchlist_block(watchlist, address);
+		h = libkeccak_watchlist_word(address + 8);
+		for (j = 0; j < LIBKECCAK_WATCHLIST_PROBES; j++, h >>= 9) {
+			bit = (unsigned)h & 511;
+			block[bit >> 6] |= (uint64_t)1 << (bit & 63);
+		}
+	}
+	for (; p <= LIBKECCAK_WATCHLIST_PREFIXES; p++)
+		watchlist->prefix[p] = count;
+	return 0;
+}
+
+/**
+ * Initialise a watchlist over an index file, which is mapped into memory
+ *
+ * @param   watchlist  The watchlist that should be initialised
+ * @param   path       The file, sorted binary addresses without duplicates
+ * @return             Zero on success, -1 on error
+ */
+int libkeccak_watchlist_open(libkeccak_watchlist_t *restrict watchlist, const char *restrict path)
+{
+	struct stat attr;
+	void *map = NULL;
+	size_t len;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &attr) < 0 || attr.st_size % LIBKECCAK_WATCHLIST_ADDRESS) {
+		close(fd);
+		return -1;
+	}
+	len = (size_t)attr.st_size;
+	if (len) {
+		map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) {
+			close(fd);
+			return -1;
+		}
+	}
+	close(fd);
+
+	if (libkeccak_watchlist_initialise(watchlist, map, len / LIBKECCAK_WATCHLIST_ADDRESS) < 0) {
+		if (map)
+			munmap(map, len);
+		return -1;
+	}
+	/* Confirmations touch the index at random once the filter is built. */
+	if (map)
+		madvise(map, len, MADV_RANDOM);
+	watchlist->map = map;
+	watchlist->maplen = len;
+	return 0;
+}
+
+/**
+ * Release the resources of a watchlist
+ *
+ * @param  watchlist  The watchlist that should be destroyed
+ */
+void libkeccak_watchlist_destroy(libkeccak_watchlist_t *restrict watchlist)
+{
+	if (!watchlist)
+		return;
+	libkeccak_free(watchlist->storage);
+	if (watchlist->map)
+		munmap(watchlist->map, watchlist->maplen);
+	watchlist->storage = watchlist->map = NULL;
+	watchlist->index = NULL;
+	watchlist->count = 0;
+}
+
+/**
+ * Look an address up in the sorted index
+ *
+ * @param   watchlist  The watchlist
+ * @param   address    The binary address
+ * @return             1 if the address is in the index, 0 otherwise
+ */
+static int libkeccak_watchlist_confirm(const libkeccak_watchlist_t *restrict watchlist, const char *restrict address)
+{
+	size_t p = libkeccak_watchlist_prefix(address);
+	size_t lo = watchlist->prefix[p], hi = watchlist->prefix[p + 1], mid;
+	int cmp;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		cmp = memcmp(watchlist->index + mid * LIBKECCAK_WATCHLIST_ADDRESS, address, LIBKECCAK_WATCHLIST_ADDRESS);
+		if (!cmp)
+			return 1;
+		if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return 0;
+}
+
+/**
+ * Check whether an address is watched
+ *
+ * @param   watchlist  The watchlist
+ * @param   address    The binary address
+ * @return             1 if the address is watched, 0 otherwise
+ */
+int libkeccak_watchlist_contains(const libkeccak_watchlist_t *restrict watchlist, const char *restrict address)
+{
+	if (!libkeccak_watchlist_probe(libkeccak_watchlist_block(watchlist, address), address))
+		return 0;
+	return libkeccak_watchlist_confirm(watchlist, address);
+}
+
+/**
+ * Match a column of binary addresses, such as the output of
+ * `PublicKeysToAddresses`, against a watchlist
+ *
+ * @param   watchlist  The watchlist
+ * @param   addresses  The addresses, `count * LIBKECCAK_WATCHLIST_ADDRESS` bytes
+ * @param   count      The number of addresses
+ * @param   hits       Output parameter for the indices of the watched addresses, in ascending order,
+ *                     room for `count` indices
+ * @return             The number of watched addresses
+ */
+size_t libkeccak_watchlist_match(const libkeccak_watchlist_t *restrict watchlist, const char *restrict addresses,
+                                 size_t count, size_t *restrict hits)
+{
+	size_t i, n = 0, m = 0;
+	const char *address;
+
+	/* First pass: the filter, with its blocks prefetched ahead of use; candidates go to `hits`. */
+	for (i = 0; i < count; i++) {
+		if (i + LIBKECCAK_WATCHLIST_PREFETCH < count)
+			__builtin_prefetch(libkeccak_watchlist_block(watchlist, addresses +
+			                   (i + LIBKECCAK_WATCHLIST_PREFETCH) * LIBKECCAK_WATCHLIST_ADDRESS));
+		address = addresses + i * LIBKECCAK_WATCHLIST_ADDRESS;
+		if (libkeccak_watchlist_probe(libkeccak_watchlist_block(watchlist, address), address))
+			hits[n++] = i;
+	}
+
+	/* Second pass: confirm the few candidates against the index. */
+	for (i = 0; i < n; i++)
+		if (libkeccak_watchlist_confirm(watchlist, addresses + hits[i] * LIBKECCAK_WATCHLIST_ADDRESS))
+			hits[m++] = hits[i];
+	return m;
+}
+
+/**
+ * Format a binary address as `0x`-prefixed lower-case hexadecimal
+ *
+ * @param  address  The binary address
+ * @param  hex      Output buffer, `LIBKECCAK_WATCHLIST_HEX` bytes
+ */
+void libkeccak_watchlist_hex(const char *restrict address, char *restrict hex)
+{
+	hex[0] = '0';
+	hex[1] = 'x';
+	libkeccak_behex_lower(hex + 2, address, LIBKECCAK_WATCHLIST_ADDRESS);
+}
@@ -0,0 +1,103 @@
+#ifndef LIBKECCAK_WATCHLIST_H
+#define LIBKECCAK_WATCHLIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Size of a binary address
+#define LIBKECCAK_WATCHLIST_ADDRESS 20
+
+// Size of a `0x`-prefixed, NUL-terminated hexadecimal address
+#define LIBKECCAK_WATCHLIST_HEX 43
+
+// Bloom filter bits per watched address
+#define LIBKECCAK_WATCHLIST_BITS_PER_KEY 16
+
+/**
+ * Set of addresses to match derived addresses against
+ *
+ * The index is a sorted array of binary addresses, the same layout as the
+ * file `libkeccak_watchlist_open` maps. In front of it sits a blocked Bloom
+ * filter: each address selects one 64 byte block and sets 7 bits in it, so
+ * rejecting an address costs a single cache miss
+ */
+typedef struct libkeccak_watchlist {
+	const char* index; // The sorted addresses, `LIBKECCAK_WATCHLIST_ADDRESS` bytes each
+	size_t count;      // The number of addresses
+	size_t* prefix;    // `prefix[p]` is the position of the first address whose first two bytes are at least `p`
+	uint64_t* bloom;   // The Bloom filter, 8 words per block
+	size_t mask;       // The number of blocks minus 1
+	void* storage;     // The allocation holding `prefix` and `bloom`
+	void* map;         // The mapped index file, `NULL` if the index is borrowed
+	size_t maplen;     // The size of `map`
+} libkeccak_watchlist_t;
+
+/**
+ * Sort binary addresses and drop duplicates, producing an index
+ * suitable for `libkeccak_watchlist_initialise` or for writing to
+ * a file for `libkeccak_watchlist_open`
+ *
+ * @param   addresses  The addresses, `count * LIBKECCAK_WATCHLIST_ADDRESS` bytes, sorted in place
+ * @param   count      The number of addresses
+ * @return             The number of unique addresses, which are at the beginning of `addresses`
+ */
+size_t libkeccak_watchlist_sort(char* addresses, size_t count);
+
+/**
+ * Initialise a watchlist over an index in memory
+ *
+ * @param   watchlist  The watchlist that should be initialised
+ * @param   index      The addresses, sorted without duplicates, they are not copied
+ * @param   count      The number of addresses
+ * @return             Zero on success, -1 on error, including an unsorted index
+ */
+int libkeccak_watchlist_initialise(libkeccak_watchlist_t* watchlist, const char* index, size_t count);
+
+/**
+ * Initialise a watchlist over an index file, which is mapped into memory
+ *
+ * @param   watchlist  The watchlist that should be initialised
+ * @param   path       The file, sorted binary addresses without duplicates
+ * @return             Zero on success, -1 on error
+ */
+int libkeccak_watchlist_open(libkeccak_watchlist_t* watchlist, const char* path);
+
+/**
+ * Release the resources of a watchlist
+ *
+ * @param  watchlist  The watchlist that should be destroyed
+ */
+void libkeccak_watchlist_destroy(libkeccak_watchlist_t* watchlist);
+
+/**
+ * Check whether an address is watched
+ *
+ * @param   watchlist  The watchlist
+ * @param   address    The binary address
+ * @return             1 if the address is watched, 0 otherwise
+ */
+int libkeccak_watchlist_contains(const libkeccak_watchlist_t* watchlist, const char* address);
+
+/**
+ * Match a column of binary addresses, such as the output of
+ * `PublicKeysToAddresses`, against a watchlist
+ *
+ * @param   watchlist  The watchlist
+ * @param   addresses  The addresses, `count * LIBKECCAK_WATCHLIST_ADDRESS` bytes
+ * @param   count      The number of addresses
+ * @param   hits       Output parameter for the indices of the watched addresses, in ascending order,
+ *                     room for `count` indices
+ * @return             The number of watched addresses
+ */
+size_t libkeccak_watchlist_match(const libkeccak_watchlist_t* watchlist, const char* addresses,
+                                 size_t count, size_t* hits);
+
+/**
+ * Format a binary address as `0x`-prefixed lower-case hexadecimal
+ *
+ * @param  address  The binary address
+ * @param  hex      Output buffer, `LIBKECCAK_WATCHLIST_HEX` bytes
+ */
+void libkeccak_watchlist_hex(const char* address, char* hex);
+
+#endif
@@ -0,0 +1,41 @@
+#!/bin/sh
+# Splits a file of mixed public keys into many small shards over three local
+# workers, and checks the merged output against a single-shard run, the known
+# address of one key, and a record of dashes for every invalid line
+set -e
+cd "$(dirname "$0")"
+dir=$(mktemp -d /tmp/keccak256-shard-test.XXXXXX)
+trap 'rm -rf "$dir"' EXIT
+
+key=64c9992d70d56cf60383b86dcba395ee0ccdb780b13d1b52803b010ae62574b68ebc46f0b25acf3721da182a180b985500669ec8541244752ec1331ea61aacee
+{
+  head -c 640000 /dev/urandom | od -An -v -tx1 | tr -d ' \n' | fold -w 128
+  echo
+} > "$dir/random"
+{
+  head -n 2000 "$dir/random"
+  echo "$key"
+  echo "0x$key"
+  echo "04$key"
+  echo 0264c9992d70d56cf60383b86dcba395ee0ccdb780b13d1b52803b010ae62574b6
+  echo not-a-key
+  echo 0279be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798
+  tail -n 2000 "$dir/random" | sed 's/^/0x/'
+} > "$dir/input"
+
+./keccak256-shard -i "$dir/input" -o "$dir/whole" -l "$dir/whole.sock" -n 1 -S 100000 > /dev/null
+./keccak256-shard -i "$dir/input" -o "$dir/sharded" -l "$dir/sharded.sock" -n 3 -S 4 > /dev/null
+
+cmp "$dir/whole" "$dir/sharded"
+test "$(wc -l < "$dir/sharded")" -eq "$(wc -l < "$dir/input")"
+sed -n '2001,2006p' "$dir/sharded" > "$dir/known"
+cat > "$dir/want" <<END
+0xe7b8a14e8338963e64fb146cd22746b543d339e8
+0xe7b8a14e8338963e64fb146cd22746b543d339e8
+0xe7b8a14e8338963e64fb146cd22746b543d339e8
+0xe7b8a14e8338963e64fb146cd22746b543d339e8
+------------------------------------------
+0x7e5f4552091a69125d5dfcb7b8c2659029395bdf
+END
+diff "$dir/want" "$dir/known"
+echo "keccak256-shard: ok"
@@ -0,0 +1,40 @@
+#!/bin/sh
+# Hashes a tree of small, batched files and large, streamed files in one run,
+# and checks every line against the digest of that file on its own: SHA3-256
+# from OpenSSL, and Keccak-256 from a separate run per file
+set -e
+cd "$(dirname "$0")"
+dir=$(mktemp -d /tmp/keccak256sum-test.XXXXXX)
+trap 'rm -rf "$dir"' EXIT
+
+mkdir -p "$dir/tree/a/b" "$dir/tree/c"
+n=0
+for size in 0 1 135 136 137 1000 4096 65535 65536 65537 100000 524287 524288 524289 1500000 3 7 50000; do
+  case $((n % 3)) in
+    0) path="$dir/tree/a/f$n" ;;
+    1) path="$dir/tree/a/b/f$n" ;;
+    2) path="$dir/tree/c/f$n" ;;
+  esac
+  head -c "$size" /dev/urandom > "$path"
+  n=$((n + 1))
+done
+for i in 0 1 2 3 4 5 6 7 8 9; do
+  head -c $((i * 37)) /dev/urandom > "$dir/tree/c/small$i"
+done
+: > "$dir/tree/empty"
+
+find "$dir/tree" -type f | LC_ALL=C sort > "$dir/files"
+
+./keccak256sum -a sha3 -j 3 "$dir/tree" > "$dir/sha3"
+while read -r path; do
+  openssl dgst -sha3-256 -r "$path" | sed 's/ \*/  /'
+done < "$dir/files" > "$dir/sha3.want"
+diff "$dir/sha3.want" "$dir/sha3"
+
+./keccak256sum -j 3 "$dir/tree" > "$dir/keccak"
+while read -r path; do
+  ./keccak256sum -j 1 "$path"
+done < "$dir/files" > "$dir/keccak.want"
+diff "$dir/keccak.want" "$dir/keccak"
+grep -q "^c5d2460186f7233c927e7db2dcc703c0e500b653ca82273b7bfad8045d85a470  $dir/tree/empty\$" "$dir/keccak"
+echo "keccak256sum: ok"
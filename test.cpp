@@ -1,5 +1,27 @@
 #include "libkeccak/keccak256.h"
+#include "libkeccak/async-hasher.h"
+extern "C" {
+  #include "libkeccak/alloc.h"
+  #include "libkeccak/batch.h"
+  #include "libkeccak/duplex.h"
+  #include "libkeccak/kangarootwelve.h"
+  #include "libkeccak/logs-bloom.h"
+  #include "libkeccak/mac.h"
+  #include "libkeccak/merkle.h"
+  #include "libkeccak/mpt.h"
+  #include "libkeccak/pool.h"
+  #include "libkeccak/sp800-185.h"
+  #include "libkeccak/storage.h"
+  #include "libkeccak/turboshake.h"
+  #include "libkeccak/watchlist.h"
+}
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
 #include <iostream>
+#include <string>
+#include <thread>
 
 // Only for debugging; testing code execution time
 #include <chrono>
@@ -10,6 +32,1010 @@
 
 const char alphanum[] = "0123456789abcdef";
 
+static int failures = 0;
+
+// Report a failed check
+static void Expect(const char* name, bool ok){
+  if(!ok){
+    std::cout << "FAIL " << name << "\n";
+    failures++;
+  }
+}
+
+// Check bytes against their known answer, given in lowercase hex
+static void Expect(const char* name, const char* got, const char* hex){
+  std::string out(strlen(hex) + 1, '\0');
+  libkeccak_behex_lower(&out[0], got, strlen(hex) / 2);
+  out.resize(strlen(hex));
+  if(out != hex){
+    std::cout << "FAIL " << name << ": " << out << ", expected " << hex << "\n";
+    failures++;
+  }
+}
+
+// The test pattern of RFC 9861: n bytes counting 0 to 250 over and over
+static std::string Ptn(size_t n){
+  std::string out(n, '\0');
+
+  for(size_t i = 0; i < n; i++)
+    out[i] = (char)(i % 251);
+  return out;
+}
+
+// TurboSHAKE vectors from RFC 9861, and the incremental interface against the one-shot sponge
+static void TestTurboShake(){
+  std::string out(10032, '\0'), more(10032, '\0');
+  std::string ff(7, '\xff');
+  libkeccak_turboshake_t state;
+
+  libkeccak_turboshake(128, 0x1F, "", 0, &out[0], 64);
+  Expect("turboshake128 empty", out.data(), "1e415f1c5983aff2169217277d17bb538cd945a397ddec541f1ce41af2c1b74c"
+                                            "3e8ccae2a4dae56c84a04c2385c03c15e8193bdf58737363321691c05462c8df");
+  libkeccak_turboshake(128, 0x1F, "", 0, &out[0], 10032);
+  Expect("turboshake128 empty 10032", &out[10000], "a3b9b0385900ce761f22aed548e754da10a5242d62e8c658e3f3a923a7555607");
+  libkeccak_turboshake(128, 0x1F, Ptn(1).data(), 1, &out[0], 32);
+  Expect("turboshake128 ptn(1)", out.data(), "55cedd6f60af7bb29a4042ae832ef3f58db7299f893ebb9247247d856958daa9");
+  libkeccak_turboshake(128, 0x1F, Ptn(17).data(), 17, &out[0], 32);
+  Expect("turboshake128 ptn(17)", out.data(), "9c97d036a3bac819db70ede0ca554ec6e4c2a1a4ffbfd9ec269ca6a111161233");
+  libkeccak_turboshake(128, 0x1F, Ptn(17 * 17).data(), 17 * 17, &out[0], 32);
+  Expect("turboshake128 ptn(17^2)", out.data(), "96c77c279e0126f7fc07c9b07f5cdae1e0be60bdbe10620040e75d7223a624d2");
+  libkeccak_turboshake(128, 0x1F, Ptn(17 * 17 * 17).data(), 17 * 17 * 17, &out[0], 32);
+  Expect("turboshake128 ptn(17^3)", out.data(), "d4976eb56bcf118520582b709f73e1d6853e001fdaf80e1b13e0d0599d5fb372");
+  libkeccak_turboshake(128, 0x01, ff.data(), 3, &out[0], 32);
+  Expect("turboshake128 D=01", out.data(), "bf323f940494e88ee1c540fe660be8a0c93f43d15ec006998462fa994eed5dab");
+  libkeccak_turboshake(128, 0x06, ff.data(), 1, &out[0], 32);
+  Expect("turboshake128 D=06", out.data(), "8ec9c66465ed0d4a6c35d13506718d687a25cb05c74cca1e42501abd83874a67");
+  libkeccak_turboshake(128, 0x07, ff.data(), 3, &out[0], 32);
+  Expect("turboshake128 D=07", out.data(), "b658576001cad9b1e5f399a9f77723bba05458042d68206f7252682dba3663ed");
+  libkeccak_turboshake(128, 0x0B, ff.data(), 7, &out[0], 32);
+  Expect("turboshake128 D=0B", out.data(), "8deeaa1aec47ccee569f659c21dfa8e112db3cee37b18178b2acd805b799cc37");
+  libkeccak_turboshake(128, 0x30, ff.data(), 1, &out[0], 32);
+  Expect("turboshake128 D=30", out.data(), "553122e2135e363c3292bed2c6421fa232bab03daa07c7d6636603286506325b");
+  libkeccak_turboshake(128, 0x7F, ff.data(), 3, &out[0], 32);
+  Expect("turboshake128 D=7F", out.data(), "16274cc656d44cefd422395d0f9053bda6d28e122aba15c765e5ad0e6eaf26f9");
+
+  libkeccak_turboshake(256, 0x1F, "", 0, &out[0], 64);
+  Expect("turboshake256 empty", out.data(), "367a329dafea871c7802ec67f905ae13c57695dc2c6663c61035f59a18f8e7db"
+                                            "11edc0e12e91ea60eb6b32df06dd7f002fbafabb6e13ec1cc20d995547600db0");
+  libkeccak_turboshake(256, 0x1F, "", 0, &out[0], 10032);
+  Expect("turboshake256 empty 10032", &out[10000], "abefa11630c661269249742685ec082f207265dccf2f43534e9c61ba0c9d1d75");
+  libkeccak_turboshake(256, 0x1F, Ptn(17).data(), 17, &out[0], 64);
+  Expect("turboshake256 ptn(17)", out.data(), "b3bab0300e6a191fbe6137939835923578794ea54843f5011090fa2f3780a9e5"
+                                              "cb22c59d78b40a0fbff9e672c0fbe0970bd2c845091c6044d687054da5d8e9c7");
+  libkeccak_turboshake(256, 0x1F, Ptn(17 * 17 * 17).data(), 17 * 17 * 17, &out[0], 64);
+  Expect("turboshake256 ptn(17^3)", out.data(), "c74ebc919a5b3b0dd1228185ba02d29ef442d69d3d4276a93efe0bf9a16a7dc0"
+                                                "cd4eabadab8cd7a5edd96695f5d360abe09e2c6511a3ec397da3b76b9e1674fb");
+
+  for(long x : {128L, 256L}){
+    std::string msg = Ptn(17 * 17 * 17);
+    libkeccak_turboshake(x, 0x1F, msg.data(), msg.size(), &out[0], 1000);
+    libkeccak_turboshake_initialise(&state, x, 0x1F);
+    libkeccak_turboshake_update(&state, msg.data(), 1);
+    libkeccak_turboshake_update(&state, msg.data() + 1, 135);
+    libkeccak_turboshake_update(&state, msg.data() + 136, 168);
+    libkeccak_turboshake_update(&state, msg.data() + 304, msg.size() - 304);
+    libkeccak_turboshake_squeeze(&state, &more[0], 1);
+    libkeccak_turboshake_squeeze(&state, &more[1], 167);
+    libkeccak_turboshake_squeeze(&state, &more[168], 832);
+    Expect("turboshake incremental", !memcmp(out.data(), more.data(), 1000));
+  }
+}
+
+// KangarooTwelve vectors from RFC 9861, including the chunk boundary, threaded over the leaves
+static void TestKangarooTwelve(){
+  std::string out(10032, '\0'), msg;
+  std::string ff(7, '\xff');
+  const char* ptn17[] = {
+    "2bda92450e8b147f8a7cb629e784a058efca7cf7d8218e02d345dfaa65244a1f",
+    "6bf75fa2239198db4772e36478f8e19b0f371205f6a9a93a273f51df37122888",
+    "0c315ebcdedbf61426de7dcf8fb725d1e74675d7f5327a5067f367b108ecb67c",
+    "cb552e2ec77d9910701d578b457ddf772c12e322e4ee7fe417f92c758f0d59d0",
+    "8701045e22205345ff4dda05555cbb5c3af1a771c2b89baef37db43d9998b9fe",
+    "844d610933b1b9963cbdeb5ae3b6b05cc7cbd67ceedf883eb678a0a8e0371682",
+  };
+  size_t n = 1;
+
+  libkeccak_k12("", 0, "", 0, &out[0], 64, 1);
+  Expect("k12 empty", out.data(), "1ac2d450fc3b4205d19da7bfca1b37513c0803577ac7167f06fe2ce1f0ef39e5"
+                                  "4269c056b8c82e48276038b6d292966cc07a3d4645272e31ff38508139eb0a71");
+  libkeccak_k12("", 0, "", 0, &out[0], 10032, 1);
+  Expect("k12 empty 10032", &out[10000], "e8dc563642f7228c84684c898405d3a834799158c079b12880277a1d28e2ff6d");
+  for(const char* hex : ptn17){
+    msg = Ptn(n);
+    libkeccak_k12(msg.data(), msg.size(), "", 0, &out[0], 32, 1);
+    Expect("k12 ptn(17^i)", out.data(), hex);
+    libkeccak_k12(msg.data(), msg.size(), "", 0, &out[0], 32, 4);
+    Expect("k12 ptn(17^i) threaded", out.data(), hex);
+    n *= 17;
+  }
+
+  libkeccak_k12(ff.data(), 0, Ptn(1).data(), 1, &out[0], 32, 1);
+  Expect("k12 custom ptn(1)", out.data(), "fab658db63e94a246188bf7af69a133045f46ee984c56e3c3328caaf1aa1a583");
+  libkeccak_k12(ff.data(), 1, Ptn(41).data(), 41, &out[0], 32, 1);
+  Expect("k12 custom ptn(41)", out.data(), "d848c5068ced736f4462159b9867fd4c20b808acc3d5bc48e0b06ba0a3762ec4");
+  libkeccak_k12(ff.data(), 3, Ptn(41 * 41).data(), 41 * 41, &out[0], 32, 1);
+  Expect("k12 custom ptn(41^2)", out.data(), "c389e5009ae57120854c2e8c64670ac01358cf4c1baf89447a724234dc7ced74");
+  libkeccak_k12(ff.data(), 7, Ptn(41 * 41 * 41).data(), 41 * 41 * 41, &out[0], 32, 2);
+  Expect("k12 custom ptn(41^3)", out.data(), "75d2f86a2e644566726b4fbcfc5657b9dbcf070c7b0dca06450ab291d7443bcf");
+  libkeccak_k12(Ptn(8191).data(), 8191, Ptn(8189).data(), 8189, &out[0], 32, 2);
+  Expect("k12 8191 and 8189", out.data(), "1dddc889b38bc1d3e8b53b5af7a10d16de67719b165e84e468a469c5d89a86ba");
+  libkeccak_k12(Ptn(8192).data(), 8192, Ptn(8189).data(), 8189, &out[0], 32, 2);
+  Expect("k12 8192 and 8189", out.data(), "3ed12f70fb05ddb58689510ab3e4d23c6c6033849aa01e1d8c220a297fedcd0b");
+}
+
+// The NIST SP 800-185 samples, and ParallelHash of messages long enough to be spread across threads
+static void TestSp800185(){
+  const char* email = "Email Signature";
+  const char* app = "My Tuple App";
+  const char* parallel = "Parallel Data";
+  const char* tuple[] = {"\x00\x01\x02", "\x10\x11\x12\x13\x14\x15", "\x20\x21\x22\x23\x24\x25\x26\x27\x28"};
+  size_t lens[] = {3, 6, 9};
+  char data[200], out[64];
+  std::string msg(300001, '\0');
+
+  for(int i = 0; i < 200; i++)
+    data[i] = (char)i;
+  for(size_t i = 0; i < msg.size(); i++)
+    msg[i] = (char)(i * 7 + i / 251);
+
+  libkeccak_cshake(128, data, 4, "", 0, email, strlen(email), out, 32);
+  Expect("cshake128 sample 1", out, "c1c36925b6409a04f1b504fcbca9d82b4017277cb5ed2b2065fc1d3814d5aaf5");
+  libkeccak_cshake(128, data, 200, "", 0, email, strlen(email), out, 32);
+  Expect("cshake128 sample 2", out, "c5221d50e4f822d96a2e8881a961420f294b7b24fe3d2094baed2c6524cc166b");
+  libkeccak_cshake(256, data, 4, "", 0, email, strlen(email), out, 64);
+  Expect("cshake256 sample 3", out, "d008828e2b80ac9d2218ffee1d070c48b8e4c87bff32c9699d5b6896eee0edd1"
+                                    "64020e2be0560858d9c00c037e34a96937c561a74c412bb4c746469527281c8c");
+  libkeccak_cshake(256, data, 200, "", 0, email, strlen(email), out, 64);
+  Expect("cshake256 sample 4", out, "07dc27b11e51fbac75bc7b3c1d983e8b4b85fb1defaf218912ac864302730917"
+                                    "27f42b17ed1df63e8ec118f04b23633c1dfb1574c8fb55cb45da8e25afb092bb");
+
+  libkeccak_tuplehash(128, tuple, lens, 2, "", 0, out, 32, 0);
+  Expect("tuplehash128 sample 1", out, "c5d8786c1afb9b82111ab34b65b2c0048fa64e6d48e263264ce1707d3ffc8ed1");
+  libkeccak_tuplehash(128, tuple, lens, 2, app, strlen(app), out, 32, 0);
+  Expect("tuplehash128 sample 2", out, "75cdb20ff4db1154e841d758e24160c54bae86eb8c13e7f5f40eb35588e96dfb");
+  libkeccak_tuplehash(128, tuple, lens, 3, app, strlen(app), out, 32, 0);
+  Expect("tuplehash128 sample 3", out, "e60f202c89a2631eda8d4c588ca5fd07f39e5151998deccf973adb3804bb6e84");
+  libkeccak_tuplehash(256, tuple, lens, 2, "", 0, out, 64, 0);
+  Expect("tuplehash256 sample 4", out, "cfb7058caca5e668f81a12a20a2195ce97a925f1dba3e7449a56f82201ec6073"
+                                       "11ac2696b1ab5ea2352df1423bde7bd4bb78c9aed1a853c78672f9eb23bbe194");
+  libkeccak_tuplehash(256, tuple, lens, 3, app, strlen(app), out, 64, 0);
+  Expect("tuplehash256 sample 6", out, "45000be63f9b6bfd89f54717670f69a9bc763591a4f05c50d68891a744bcc6e7"
+                                       "d6d5b5e82c018da999ed35b0bb49c9678e526abd8e85c13ed254021db9e790ce");
+  libkeccak_tuplehash(128, tuple, lens, 2, "", 0, out, 32, 1);
+  Expect("tuplehashxof128 sample 1", out, "2f103cd7c32320353495c68de1a8129245c6325f6f2a3d608d92179c96e68488");
+  libkeccak_tuplehash(256, tuple, lens, 3, app, strlen(app), out, 64, 1);
+  Expect("tuplehashxof256 sample 6", out, "0c59b11464f2336c34663ed51b2b950bec743610856f36c28d1d088d8a244628"
+                                          "4dd09830a6a178dc752376199fae935d86cfdee5913d4922dfd369b66a53c897");
+
+  memcpy(data, "\x00\x01\x02\x03\x04\x05\x06\x07\x10\x11\x12\x13\x14\x15\x16\x17\x20\x21\x22\x23\x24\x25\x26\x27", 24);
+  libkeccak_parallelhash(128, data, 24, 8, "", 0, out, 32, 0, 1);
+  Expect("parallelhash128 sample 1", out, "ba8dc1d1d979331d3f813603c67f72609ab5e44b94a0b8f9af46514454a2b4f5");
+  libkeccak_parallelhash(128, data, 24, 8, parallel, strlen(parallel), out, 32, 0, 1);
+  Expect("parallelhash128 sample 2", out, "fc484dcb3f84dceedc353438151bee58157d6efed0445a81f165e495795b7206");
+  libkeccak_parallelhash(256, data, 24, 8, "", 0, out, 64, 0, 1);
+  Expect("parallelhash256 sample 4", out, "bc1ef124da34495e948ead207dd9842235da432d2bbc54b4c110e64c45110553"
+                                          "1b7f2a3e0ce055c02805e7c2de1fb746af97a1dd01f43b824e31b87612410429");
+  libkeccak_parallelhash(256, data, 24, 8, parallel, strlen(parallel), out, 64, 0, 1);
+  Expect("parallelhash256 sample 5", out, "cdf15289b54f6212b4bc270528b49526006dd9b54e2b6add1ef6900dda3963bb"
+                                          "33a72491f236969ca8afaea29c682d47a393c065b38e29fae651a2091c833110");
+  libkeccak_parallelhash(128, data, 24, 8, "", 0, out, 32, 1, 1);
+  Expect("parallelhashxof128 sample 1", out, "fe47d661e49ffe5b7d999922c062356750caf552985b8e8ce6667f2727c3c8d3");
+  libkeccak_parallelhash(256, data, 24, 8, parallel, strlen(parallel), out, 64, 1, 1);
+  Expect("parallelhashxof256 sample 5", out, "538e105f1a22f44ed2f5cc1674fbd40be803d9c99bf5f8d90a2c8193f3fe6ea7"
+                                             "68e5c1a20987e2c9c65febed03887a51d35624ed12377594b5585541dc377efc");
+
+  libkeccak_parallelhash(128, msg.data(), msg.size(), 64, parallel, strlen(parallel), out, 32, 0, 4);
+  Expect("parallelhash128 threaded", out, "24b2cc808c59bcb438dfc46138841ad147fe507ccd883fcd20cf5a686644ec4c");
+  libkeccak_parallelhash(256, msg.data(), msg.size(), 8192, "", 0, out, 8, 1, 4);
+  Expect("parallelhashxof256 threaded", out, "1a071bbf1994f2fa");
+}
+
+// Merkle roots over keccak256(i) for 13 leaves, and a proof for every leaf
+static void TestMerkle(){
+  char leaves[13 * 32], root[32], proofs[13][4 * 32];
+  size_t indices[13], lens[13];
+  unsigned char results[2];
+  libkeccak_merkle_tree_t tree;
+
+  for(int i = 0; i < 13; i++){
+    char byte = (char)i;
+    libkeccak_keccak256(&byte, 1, leaves + i * 32);
+  }
+  libkeccak_merkle_root(leaves, 1, LIBKECCAK_MERKLE_POSITIONAL, root, 1);
+  Expect("merkle single leaf", root, "bc36789e7a1e281436464229828f817d6612f7b477d66591ff96a9e064bcc98a");
+  libkeccak_merkle_root(leaves, 5, LIBKECCAK_MERKLE_POSITIONAL, root, 1);
+  Expect("merkle positional 5", root, "f4373a0c8ba18e0252bb42a7368238af84803172e38c6df2a9b7e431bc02a84b");
+  libkeccak_merkle_root(leaves, 13, LIBKECCAK_MERKLE_POSITIONAL, root, 0);
+  Expect("merkle positional 13", root, "b8baa4764755c46e33f019f8ef70d63d28bbef3854acf13425d444ea8acf8139");
+  libkeccak_merkle_root(leaves, 13, LIBKECCAK_MERKLE_SORTED, root, 0);
+  Expect("merkle sorted 13", root, "1479e391f9e4c98a28c1093004fabb3fa15ecc3c60de3db7053a6273d4e1f2af");
+
+  for(int mode = LIBKECCAK_MERKLE_POSITIONAL; mode <= LIBKECCAK_MERKLE_SORTED; mode++){
+    if(libkeccak_merkle_tree_initialise(&tree, leaves, 13, mode, 1) < 0){
+      Expect("merkle tree", false);
+      continue;
+    }
+    libkeccak_merkle_root(leaves, 13, mode, root, 1);
+    Expect("merkle tree root", !memcmp(libkeccak_merkle_tree_root(&tree), root, 32));
+    for(size_t i = 0; i < 13; i++){
+      indices[i] = i;
+      lens[i] = libkeccak_merkle_tree_proof(&tree, i, proofs[i]);
+    }
+    libkeccak_merkle_verify_batch(root, leaves, indices, 13, proofs[0], sizeof(proofs[0]), lens, 13, mode, results);
+    Expect("merkle proofs", results[0] == 0xFF && results[1] == 0x1F);
+    proofs[6][0] ^= 1;
+    libkeccak_merkle_verify_batch(root, leaves, indices, 13, proofs[0], sizeof(proofs[0]), lens, 13, mode, results);
+    Expect("merkle tampered proof", results[0] == 0xBF && results[1] == 0x1F);
+    libkeccak_merkle_tree_destroy(&tree);
+  }
+}
+
+// Merkle Patricia Trie roots from the Ethereum trie tests, then 200 hashed keys updated and deleted
+static void TestMpt(){
+  const char* keys[] = {"doe", "dog", "dogglesworth"};
+  const char* values[] = {"reindeer", "puppy", "cat"};
+  size_t keylens[] = {3, 3, 12}, valuelens[] = {8, 5, 3};
+  char root[32], key[32], value[50];
+  libkeccak_mpt_t mpt;
+
+  libkeccak_mpt_initialise(&mpt);
+  libkeccak_mpt_root(&mpt, root, 1);
+  Expect("mpt empty", root, "56e81f171bcc55a6ff8345e692c0f86e5b48e01b996cadc001622fb5e363b421");
+  libkeccak_mpt_build(&mpt, keys, keylens, values, valuelens, 3);
+  libkeccak_mpt_root(&mpt, root, 1);
+  Expect("mpt build", root, "8aad789dff2f538bca5d8ea56e8abe10f4c7ba3a5dea95fea4cd6e7c3a1168d3");
+  libkeccak_mpt_destroy(&mpt);
+
+  libkeccak_mpt_initialise(&mpt);
+  libkeccak_mpt_update(&mpt, "do", 2, "verb", 4);
+  libkeccak_mpt_update(&mpt, "horse", 5, "stallion", 8);
+  libkeccak_mpt_update(&mpt, "doge", 4, "coin", 4);
+  libkeccak_mpt_update(&mpt, "dog", 3, "puppy", 5);
+  libkeccak_mpt_root(&mpt, root, 1);
+  Expect("mpt update", root, "5991bb8c6514148a29db676a14ac506cd2cd5775ace63c30a4fe457715e9ac84");
+  libkeccak_mpt_destroy(&mpt);
+
+  memset(value, 'v', sizeof(value));
+  libkeccak_mpt_initialise(&mpt);
+  for(int i = 0; i < 200; i++){
+    char byte = (char)i;
+    libkeccak_keccak256(&byte, 1, key);
+    libkeccak_mpt_update(&mpt, key, 32, value, (size_t)(i % 50 + 1));
+  }
+  libkeccak_mpt_root(&mpt, root, 0);
+  Expect("mpt 200 keys", root, "044557c91a23f2c16a4c8d931d763aa78b96335481c9aa35ff26c6be904586e9");
+  for(int i = 0; i < 200; i += 3){
+    char byte = (char)i;
+    libkeccak_keccak256(&byte, 1, key);
+    libkeccak_mpt_update(&mpt, key, 32, NULL, 0);
+  }
+  libkeccak_mpt_root(&mpt, root, 0);
+  Expect("mpt delete", root, "a5a5caa3cc818e6143febcb823ab9dac16fc1e22e2e96c9e355d70d0ea7871bf");
+  libkeccak_mpt_destroy(&mpt);
+}
+
+// Packed records of every block count up to the scalar cut-off, on every kernel, against one-at-a-time hashing
+static void TestBatch(){
+  const libkeccak_kernel_t* kernels[] = {&libkeccak_scalar_kernel, &libkeccak_x2_kernel, &libkeccak_x4_kernel};
+  size_t lengths[] = {0, 3, 1, 135, 136, 137, 271, 272, 500, 64 * 136, 64 * 136 + 1, 40, 0};
+  size_t count = sizeof(lengths) / sizeof(*lengths), offsets[sizeof(lengths) / sizeof(*lengths) + 1];
+  std::string buf;
+  uint64_t valid;
+
+  offsets[0] = 0;
+  for(size_t i = 0; i < count; i++){
+    for(size_t j = 0; j < lengths[i]; j++)
+      buf += (char)(i * 31 + j);
+    offsets[i + 1] = buf.size();
+  }
+  buf.replace(offsets[1], 3, "abc");
+  std::string want(count * 32, '\0'), got(count * 32, '\0');
+  for(size_t i = 0; i < count; i++)
+    libkeccak_sponge(&buf[offsets[i]], lengths[i], LIBKECCAK_KECCAK256_RATE, 24, LIBKECCAK_KECCAK_PAD, &want[i * 32], 32);
+  Expect("batch scalar empty", &want[0], "c5d2460186f7233c927e7db2dcc703c0e500b653ca82273b7bfad8045d85a470");
+  Expect("batch scalar abc", &want[32], "4e03657aea45a94fc7d47ba826c8d667c0d1e6e33a64a036ec44f58fa12d6c45");
+
+  for(const libkeccak_kernel_t* kernel : kernels){
+    libkeccak_set_kernel(kernel);
+    libkeccak_keccak256_batch(buf.data(), offsets, NULL, count, &got[0], 2);
+    Expect((std::string("batch ") + kernel->name).c_str(), got == want);
+    Expect("batch verify", libkeccak_keccak256_batch_verify(buf.data(), offsets, NULL, count, want.data(), &valid, 2) == count);
+    want[5 * 32 + 31] ^= 1;
+    Expect("batch verify mismatch", libkeccak_keccak256_batch_verify(buf.data(), offsets, lengths, count, want.data(),
+                                                                      &valid, 1) == count - 1 &&
+                                    valid == ((uint64_t)1 << count) - 1 - (1 << 5));
+    want[5 * 32 + 31] ^= 1;
+  }
+  libkeccak_set_kernel(NULL);
+}
+
+// Runs to completion without ever suspending its caller, for coroutines nobody awaits
+struct Detached{
+  struct promise_type{
+    Detached get_return_object(){ return Detached(); }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void(){}
+    void unhandled_exception(){ std::terminate(); }
+  };
+};
+
+// Await the address of a binary public key and store it
+static Detached AwaitAddress(AsyncHasher& hasher, const char* publicKey, char* address){
+  std::array<char, ADDRESS_SIZE> result = co_await hasher.address(publicKey);
+  memcpy(address, result.data(), ADDRESS_SIZE);
+}
+
+// Addresses of 100 keys awaited through two workers in batches of 8 and a partial batch, against Keccak-256
+static void TestAsyncHasher(){
+  char keys[100 * PUBLIC_KEY_SIZE], addresses[100 * ADDRESS_SIZE], hashsum[32];
+  AsyncHasher::Options options;
+
+  for(int i = 0; i < 100; i++){
+    char byte = (char)i;
+    libkeccak_keccak256(&byte, 1, keys + i * PUBLIC_KEY_SIZE);
+    libkeccak_keccak256(keys + i * PUBLIC_KEY_SIZE, 32, keys + i * PUBLIC_KEY_SIZE + 32);
+  }
+  memset(addresses, 0, sizeof(addresses));
+  options.batch = 8;
+  options.workers = 2;
+
+  {
+    AsyncHasher hasher(options);
+    for(int i = 0; i < 100; i++)
+      AwaitAddress(hasher, keys + i * PUBLIC_KEY_SIZE, addresses + i * ADDRESS_SIZE);
+  } // Every request is answered before the hasher is destroyed
+
+  for(int i = 0; i < 100; i++){
+    libkeccak_keccak256(keys + i * PUBLIC_KEY_SIZE, PUBLIC_KEY_SIZE, hashsum);
+    Expect("async hasher address", !memcmp(hashsum + 32 - ADDRESS_SIZE, addresses + i * ADDRESS_SIZE, ADDRESS_SIZE));
+  }
+}
+
+// The same hashes on the arena allocator, before and after a reset, as on the default allocator
+static void TestArena(){
+  std::string msg = Ptn(100000);
+  char want[3][32], got[32];
+  libkeccak_spec_t spec;
+  libkeccak_state_t state;
+
+  libkeccak_spec_sha3(&spec, 256);
+  libkeccak_keccak256(msg.data(), msg.size(), want[0]);
+  libkeccak_parallelhash(256, msg.data(), msg.size(), 1000, "", 0, want[1], 32, 0, 2);
+  libkeccak_k12(msg.data(), msg.size(), "", 0, want[2], 32, 2);
+
+  libkeccak_set_allocator(&libkeccak_arena_allocator);
+  for(int round = 0; round < 2; round++){
+    Expect("arena state", libkeccak_state_initialise(&state, &spec) == 0);
+    libkeccak_fast_update(&state, msg.data(), msg.size());
+    libkeccak_fast_digest(&state, NULL, 0, 0, "", got);
+    libkeccak_state_fast_destroy(&state);
+    Expect("arena keccak256", !memcmp(got, want[0], 32));
+    libkeccak_parallelhash(256, msg.data(), msg.size(), 1000, "", 0, got, 32, 0, 2);
+    Expect("arena parallelhash", !memcmp(got, want[1], 32));
+    libkeccak_k12(msg.data(), msg.size(), "", 0, got, 32, 2);
+    Expect("arena k12", !memcmp(got, want[2], 32));
+    libkeccak_arena_reset();
+  }
+  libkeccak_set_allocator(NULL);
+}
+
+// Whether a state was handed out from a pool's contexts rather than the heap
+static bool Pooled(const libkeccak_pool_t* pool, const libkeccak_state_t* state){
+  for(size_t i = 0; i < pool->capacity; i++)
+    if(&pool->contexts[i].state == state)
+      return true;
+  return false;
+}
+
+// A pool of two states: acquire, release and reuse, the high-water mark, and the heap once both are out
+static void TestPool(){
+  libkeccak_pool_t pool;
+  libkeccak_spec_t spec;
+  libkeccak_state_t *a, *b, *c, *d;
+  char hashsum[32];
+
+  libkeccak_spec_sha3(&spec, 256);
+  if(libkeccak_pool_initialise(&pool, 2) < 0){
+    Expect("pool initialise", false);
+    return;
+  }
+
+  a = libkeccak_pool_acquire(&pool, &spec);
+  b = libkeccak_pool_acquire(&pool, &spec);
+  Expect("pool acquire", a && b && a != b && Pooled(&pool, a) && Pooled(&pool, b) && pool.used == 2);
+  c = libkeccak_pool_acquire(&pool, &spec);
+  Expect("pool heap fallback", c && !Pooled(&pool, c) && pool.used == 2);
+  libkeccak_fast_digest(c, "abc", 3, 0, "", hashsum);
+  Expect("pool heap state", hashsum, "4e03657aea45a94fc7d47ba826c8d667c0d1e6e33a64a036ec44f58fa12d6c45");
+  libkeccak_pool_release(&pool, c);
+
+  libkeccak_fast_digest(a, "abc", 3, 0, "", hashsum);
+  Expect("pool state", hashsum, "4e03657aea45a94fc7d47ba826c8d667c0d1e6e33a64a036ec44f58fa12d6c45");
+  libkeccak_pool_release(&pool, a);
+  d = libkeccak_pool_acquire(&pool, &spec);
+  Expect("pool reuse", d == a && pool.used == 2);
+  libkeccak_fast_digest(d, "", 0, 0, "", hashsum);
+  Expect("pool reset", hashsum, "c5d2460186f7233c927e7db2dcc703c0e500b653ca82273b7bfad8045d85a470");
+
+  libkeccak_pool_release(&pool, b);
+  libkeccak_pool_release(&pool, d);
+  a = libkeccak_pool_acquire(&pool, &spec);
+  b = libkeccak_pool_acquire(&pool, &spec);
+  c = libkeccak_pool_acquire(&pool, &spec);
+  Expect("pool reuse both", Pooled(&pool, a) && Pooled(&pool, b) && a != b && !Pooled(&pool, c) && pool.used == 2);
+  libkeccak_pool_release(&pool, a);
+  libkeccak_pool_release(&pool, b);
+  libkeccak_pool_release(&pool, c);
+  libkeccak_pool_destroy(&pool);
+}
+
+// A watchlist of every seventh of 100 derived addresses, matched against all of them
+static void TestWatchlist(){
+  char addresses[100 * 20], watched[20 * 20], hashsum[32], hex[LIBKECCAK_WATCHLIST_HEX];
+  size_t hits[100], n = 0, found;
+  libkeccak_watchlist_t watchlist;
+
+  for(int i = 0; i < 100; i++){
+    char byte = (char)i;
+    libkeccak_keccak256(&byte, 1, hashsum);
+    memcpy(addresses + i * 20, hashsum + 12, 20);
+  }
+  for(int i = 98; i >= 0; i -= 7, n++)
+    memcpy(watched + n * 20, addresses + i * 20, 20);
+  memcpy(watched + n++ * 20, addresses + 98 * 20, 20);
+  n = libkeccak_watchlist_sort(watched, n);
+  Expect("watchlist sort", n == 15);
+  if(libkeccak_watchlist_initialise(&watchlist, watched, n) < 0){
+    Expect("watchlist initialise", false);
+    return;
+  }
+
+  found = libkeccak_watchlist_match(&watchlist, addresses, 100, hits);
+  Expect("watchlist match", found == 15);
+  for(size_t i = 0; i < found; i++)
+    Expect("watchlist hit", hits[i] == i * 7);
+  for(int i = 0; i < 100; i++)
+    Expect("watchlist contains", libkeccak_watchlist_contains(&watchlist, addresses + i * 20) == (i % 7 == 0));
+  libkeccak_watchlist_hex(addresses, hex);
+  Expect("watchlist hex", !strcmp(hex, "0x828f817d6612f7b477d66591ff96a9e064bcc98a"));
+  libkeccak_watchlist_destroy(&watchlist);
+}
+
+// Make up binary public key number `i` and derive its address
+static void CacheKey(int i, char* key, char* address){
+  char byte = (char)i, hashsum[32];
+
+  libkeccak_keccak256(&byte, 1, key);
+  libkeccak_keccak256(key, 32, key + 32);
+  libkeccak_keccak256(key, LIBKECCAK_CACHE_KEY, hashsum);
+  memcpy(address, hashsum + 32 - LIBKECCAK_CACHE_VALUE, LIBKECCAK_CACHE_VALUE);
+}
+
+// Look up and derive addresses of keys `first` to `last`, from one thread of the smoke check
+static void CacheWork(libkeccak_cache_t* cache, int first, int last, int* wrong){
+  char key[LIBKECCAK_CACHE_KEY], want[LIBKECCAK_CACHE_VALUE], got[LIBKECCAK_CACHE_VALUE];
+
+  for(int i = first; i != last; i += first < last ? 1 : -1){
+    CacheKey(i % 200, key, want);
+    if(libkeccak_cache_lookup(cache, key, got) && memcmp(got, want, LIBKECCAK_CACHE_VALUE))
+      (*wrong)++;
+    libkeccak_cache_address(cache, key, got);
+    if(memcmp(got, want, LIBKECCAK_CACHE_VALUE))
+      (*wrong)++;
+  }
+}
+
+// One set of eight ways: hits, misses and CLOCK eviction; then two threads sharing a small cache, counted by the stats
+static void TestCache(){
+  char keys[9][LIBKECCAK_CACHE_KEY], addresses[9][LIBKECCAK_CACHE_VALUE], value[LIBKECCAK_CACHE_VALUE];
+  libkeccak_cache_t cache;
+  uint64_t hits, misses;
+  int wrong[2] = {0, 0};
+  bool ok = true;
+
+  for(int i = 0; i < 9; i++)
+    CacheKey(i, keys[i], addresses[i]);
+  if(libkeccak_cache_initialise(&cache, 8, 1) < 0){
+    Expect("cache initialise", false);
+    return;
+  }
+
+  Expect("cache miss", !libkeccak_cache_lookup(&cache, keys[0], value));
+  for(int i = 0; i < 8; i++){
+    libkeccak_cache_address(&cache, keys[i], value);
+    ok = ok && !memcmp(value, addresses[i], sizeof(value));
+  }
+  Expect("cache address", ok);
+  for(int i = 0; i < 7; i++)
+    ok = ok && libkeccak_cache_lookup(&cache, keys[i], value) && !memcmp(value, addresses[i], sizeof(value));
+  Expect("cache hit", ok);
+
+  // The set is full, and every entry but the last has been referenced since it was inserted
+  libkeccak_cache_address(&cache, keys[8], value);
+  Expect("cache evict", !libkeccak_cache_lookup(&cache, keys[7], value));
+  for(int i = 0; i < 9; i++)
+    ok = ok && (i == 7 || (libkeccak_cache_lookup(&cache, keys[i], value) && !memcmp(value, addresses[i], sizeof(value))));
+  Expect("cache keep referenced", ok);
+  libkeccak_cache_stats(&cache, &hits, &misses);
+  Expect("cache stats", hits == 15 && misses == 11);
+  libkeccak_cache_destroy(&cache);
+
+  if(libkeccak_cache_initialise(&cache, 64, 2) < 0){
+    Expect("cache initialise", false);
+    return;
+  }
+  std::thread other(CacheWork, &cache, 0, 3000, &wrong[0]);
+  CacheWork(&cache, 3000, 0, &wrong[1]);
+  other.join();
+  libkeccak_cache_stats(&cache, &hits, &misses);
+  Expect("cache threads", !wrong[0] && !wrong[1]);
+  Expect("cache threads stats", hits + misses == 2 * 2 * 3000 && misses >= 200);
+  libkeccak_cache_destroy(&cache);
+}
+
+// Keccak-256 of 300 bytes absorbed in two parts, split around the block size, against the one-shot sponge
+static void TestCompact(){
+  char msg[300], want[300], got[300];
+  libkeccak_compact_t state;
+
+  for(int i = 0; i < 300; i++)
+    msg[i] = (char)(i * 3);
+  libkeccak_sponge(msg, 300, LIBKECCAK_KECCAK256_RATE, 24, LIBKECCAK_KECCAK_PAD, want, 300);
+
+  for(int split : {0, 1, 135, 136, 137}){
+    libkeccak_compact_keccak256_initialise(&state);
+    libkeccak_compact_update(&state, msg, (size_t)split);
+    libkeccak_compact_digest(&state, msg + split, (size_t)(300 - split), got, 32);
+    Expect((std::string("compact split ") + std::to_string(split)).c_str(), !memcmp(got, want, 32));
+  }
+
+  libkeccak_compact_keccak256_initialise(&state);
+  libkeccak_compact_digest(&state, msg, 300, got, 100);
+  libkeccak_compact_squeeze(&state, got + 100, 200);
+  Expect("compact squeeze", !memcmp(got, want, 300));
+}
+
+// Byte ranges of the first output block that do not start or end on a lane, against slices of the whole block,
+// then the same ranges of seven strided messages on every kernel
+static void TestSqueezeRange(){
+  const libkeccak_kernel_t* kernels[] = {&libkeccak_scalar_kernel, &libkeccak_x2_kernel, &libkeccak_x4_kernel};
+  size_t ranges[][2] = {{0, 1}, {3, 5}, {4, 4}, {12, 20}, {7, 9}, {13, 0}, {1, 135}, {129, 7}, {0, 136}};
+  char msg[200], full[136], range[136], many[7 * 136], fulls[7 * 136];
+  libkeccak_spec_t spec;
+  libkeccak_state_t state;
+  bool ok = true;
+
+  for(int i = 0; i < 200; i++)
+    msg[i] = (char)i;
+  libkeccak_sponge(msg, 200, LIBKECCAK_KECCAK256_RATE, 24, LIBKECCAK_KECCAK_PAD, full, 136);
+  libkeccak_spec_sha3(&spec, 256);
+  libkeccak_state_initialise(&state, &spec);
+  libkeccak_fast_digest(&state, msg, 200, 0, "", NULL);
+
+  for(size_t* r : ranges){
+    memset(range, 0, sizeof(range));
+    ok = ok && !libkeccak_squeeze_range(&state, range, r[0], r[1]) && !memcmp(range, full + r[0], r[1]);
+    memset(range, 0, sizeof(range));
+    libkeccak_sponge_range(msg, 200, LIBKECCAK_KECCAK256_RATE, 24, LIBKECCAK_KECCAK_PAD, range, r[0], r[1]);
+    ok = ok && !memcmp(range, full + r[0], r[1]);
+    if(r[0] + r[1] <= 32){
+      libkeccak_keccak256_range(msg, 200, range, r[0], r[1]);
+      ok = ok && !memcmp(range, full + r[0], r[1]);
+    }
+  }
+  Expect("squeeze range", ok);
+  Expect("squeeze range past the block", libkeccak_squeeze_range(&state, range, 130, 7) < 0);
+  libkeccak_state_fast_destroy(&state);
+
+  libkeccak_sponge_many(msg, 20, 67, 7, LIBKECCAK_KECCAK256_RATE, 24, LIBKECCAK_KECCAK_PAD, fulls, 136);
+  for(const libkeccak_kernel_t* kernel : kernels){
+    libkeccak_set_kernel(kernel);
+    ok = true;
+    for(size_t* r : ranges){
+      libkeccak_sponge_range_many(msg, 20, 67, 7, LIBKECCAK_KECCAK256_RATE, 24, LIBKECCAK_KECCAK_PAD, many, r[0], r[1]);
+      for(int i = 0; i < 7; i++)
+        ok = ok && !memcmp(&many[i * r[1]], &fulls[i * 136 + r[0]], r[1]);
+    }
+    Expect((std::string("squeeze range many ") + kernel->name).c_str(), ok);
+  }
+  libkeccak_set_kernel(NULL);
+}
+
+// The bits of the ERC-20 Transfer topic, then the blooms of three receipts and their block, compared by hashsum
+static void TestLogsBloom(){
+  const char* signature = "Transfer(address,address,uint256)";
+  char transfer[32], addresses[3][32], topics[6][32], first[3 * 32], fourth[4 * 32], hashsum[32];
+  unsigned char bloom[LIBKECCAK_LOGS_BLOOM_SIZE] = {0}, blooms[3][LIBKECCAK_LOGS_BLOOM_SIZE], block[LIBKECCAK_LOGS_BLOOM_SIZE];
+  size_t receipts[] = {0, 2, 2, 4};
+  int set = 0;
+
+  libkeccak_keccak256(signature, strlen(signature), transfer);
+  Expect("logs bloom topic", transfer, "ddf252ad1be2c89b69c2b068fc378daa952ba7f163c4a11628f55a4df523b3ef");
+  libkeccak_logs_bloom_add(bloom, transfer, 32);
+  for(int i = 0; i < LIBKECCAK_LOGS_BLOOM_SIZE; i++)
+    set += bloom[i] != 0;
+  Expect("logs bloom bits", set == 3 && bloom[75] == 0x08 && bloom[123] == 0x10 && bloom[195] == 0x02);
+  Expect("logs bloom test", libkeccak_logs_bloom_test(bloom, transfer, 32) && !libkeccak_logs_bloom_test(bloom, signature, 8));
+
+  for(int i = 0; i < 3; i++){
+    char byte = (char)i;
+    libkeccak_keccak256(&byte, 1, addresses[i]);
+  }
+  for(int i = 0; i < 6; i++){
+    char byte = (char)(100 + i);
+    libkeccak_keccak256(&byte, 1, topics[i]);
+  }
+  memcpy(first, transfer, 32);
+  memcpy(first + 32, topics[0], 2 * 32);
+  memcpy(fourth, transfer, 32);
+  memcpy(fourth + 32, topics[3], 3 * 32);
+  libkeccak_log_t logs[] = {
+    {addresses[0] + 12, first, 3},
+    {addresses[1] + 12, topics[2], 1},
+    {addresses[2] + 12, NULL, 0},
+    {addresses[0] + 12, fourth, 4},
+  };
+
+  libkeccak_logs_bloom_block(logs, receipts, 3, blooms[0], block, 2);
+  libkeccak_keccak256((const char*)blooms[0], sizeof(blooms[0]), hashsum);
+  Expect("logs bloom receipt 0", hashsum, "38b7dce8f776f11c7ad4cc39bc7f68120344847fe81307928072a150b7830b93");
+  libkeccak_keccak256((const char*)blooms[1], sizeof(blooms[1]), hashsum);
+  Expect("logs bloom receipt 1", hashsum, "d397b3b043d87fcd6fad1291ff0bfd16401c274896d8c63a923727f077b8e0b5");
+  libkeccak_keccak256((const char*)blooms[2], sizeof(blooms[2]), hashsum);
+  Expect("logs bloom receipt 2", hashsum, "49c75d204a9665c8bc4b8958dd1ebcf3670482148ca03a26f153635632a4e1fd");
+  libkeccak_keccak256((const char*)block, sizeof(block), hashsum);
+  Expect("logs bloom block", hashsum, "579f9fc2a0ee429682ca66dcba32a17a59f0f10aa5a9d30cd7459a68675df395");
+}
+
+// Store a number as a big-endian EVM word
+static void Word(char* word, uint64_t value){
+  memset(word, 0, 32);
+  for(int i = 31; value; i--, value >>= 8)
+    word[i] = (char)value;
+}
+
+// Mapping slots for one and two levels of keys, and array element slots
+static void TestStorage(){
+  char keys[70 * 2 * 32], slot[32], slots[70 * 32], hashsum[32];
+  uint64_t indices[] = {0, 1, 1000, (uint64_t)1 << 40};
+
+  for(int i = 0; i < 70; i++)
+    Word(keys + i * 32, (uint64_t)i);
+  Word(slot, 3);
+  libkeccak_storage_mapping(keys, 1, 70, slot, slots, 2);
+  Expect("storage mapping 0", slots, "3617319a054d772f909f7c479a2cebe5066e836a939412e32403c99029b92eff");
+  Expect("storage mapping 69", slots + 69 * 32, "885ce2cbc289e24b266643f1b3bd713351837e3869b2fe1821204bfb89df8355");
+  libkeccak_keccak256(slots, 70 * 32, hashsum);
+  Expect("storage mapping", hashsum, "188cb596adaf7de84999329fcd9830dd2c27a878aabd36140d147c3571ae55e6");
+
+  for(int i = 0; i < 9; i++){
+    Word(keys + i * 64, (uint64_t)(1000 + i));
+    Word(keys + i * 64 + 32, (uint64_t)(i * i));
+  }
+  Word(slot, 1);
+  libkeccak_storage_mapping(keys, 2, 9, slot, slots, 1);
+  Expect("storage nested 8", slots + 8 * 32, "f2b2159843fd33c6574c4ffc0af52713518e37070ecaf14bb937461ca6d6e597");
+  libkeccak_keccak256(slots, 9 * 32, hashsum);
+  Expect("storage nested", hashsum, "5a214b9114a7f80a77f938ee86bbb620ec50eef258e50cb6dfd2c5e21f3df132");
+
+  Word(slot, 2);
+  libkeccak_storage_array(slot, indices, 4, 3, slots);
+  Expect("storage array 0", slots, "405787fa12a823e0f2b7631cc41b3ba8828b3321ca811111fa75cd3aa3bb5ace");
+  Expect("storage array 1", slots + 32, "405787fa12a823e0f2b7631cc41b3ba8828b3321ca811111fa75cd3aa3bb5ad1");
+  Expect("storage array 1000", slots + 64, "405787fa12a823e0f2b7631cc41b3ba8828b3321ca811111fa75cd3aa3bb6686");
+  Expect("storage array 2^40", slots + 96, "405787fa12a823e0f2b7631cc41b3ba8828b3321ca811111fa75d03aa3bb5ace");
+}
+
+// The NIST SP 800-185 KMAC samples, HMAC-Keccak-256, and batch verification of both on every kernel
+static void TestMac(){
+  const libkeccak_kernel_t* kernels[] = {&libkeccak_scalar_kernel, &libkeccak_x2_kernel, &libkeccak_x4_kernel};
+  const char* tag = "My Tagged Application";
+  char key[32], data[200], mac[64], kmacs[11 * 32], hmacs[11 * 32];
+  const char* msgs[11];
+  size_t msglens[11];
+  uint64_t valid;
+  libkeccak_kmac_t kmac;
+  libkeccak_hmac_t hmac;
+
+  for(int i = 0; i < 32; i++)
+    key[i] = (char)(0x40 + i);
+  for(int i = 0; i < 200; i++)
+    data[i] = (char)i;
+
+  libkeccak_kmac_initialise(&kmac, 128, key, 32, NULL, 0);
+  libkeccak_kmac(&kmac, data, 4, mac, 32, 0);
+  Expect("kmac128 sample 1", mac, "e5780b0d3ea6f7d3a429c5706aa43a00fadbd7d49628839e3187243f456ee14e");
+  libkeccak_kmac_initialise(&kmac, 128, key, 32, tag, strlen(tag));
+  libkeccak_kmac(&kmac, data, 4, mac, 32, 0);
+  Expect("kmac128 sample 2", mac, "3b1fba963cd8b0b59e8c1a6d71888b7143651af8ba0a7070c0979e2811324aa5");
+  libkeccak_kmac(&kmac, data, 200, mac, 32, 0);
+  Expect("kmac128 sample 3", mac, "1f5b4e6cca02209e0dcb5ca635b89a15e271ecc760071dfd805faa38f9729230");
+  libkeccak_kmac_initialise(&kmac, 256, key, 32, tag, strlen(tag));
+  libkeccak_kmac(&kmac, data, 4, mac, 64, 0);
+  Expect("kmac256 sample 4", mac, "20c570c31346f703c9ac36c61c03cb64c3970d0cfc787e9b79599d273a68d2f7"
+                                  "f69d4cc3de9d104a351689f27cf6f5951f0103f33f4f24871024d9c27773a8dd");
+  libkeccak_kmac(&kmac, data, 200, mac, 64, 0);
+  Expect("kmac256 sample 6", mac, "b58618f71f92e1d56c1b8c55ddd7cd188b97b4ca4d99831eb2699a837da2e4d9"
+                                  "70fbacfde50033aea585f1a2708510c32d07880801bd182898fe476876fc8965");
+  libkeccak_kmac(&kmac, data, 4, mac, 64, 1);
+  Expect("kmacxof256 sample 4", mac, "1755133f1534752aad0748f2c706fb5c784512cab835cd15676b16c0c6647fa9"
+                                     "6faa7af634a0bf8ff6df39374fa00fad9a39e322a7c92065a64eb1fb0801eb2b");
+  libkeccak_kmac_initialise(&kmac, 256, key, 32, NULL, 0);
+  libkeccak_kmac(&kmac, data, 200, mac, 64, 0);
+  Expect("kmac256 sample 5", mac, "75358cf39e41494e949707927cee0af20a3ff553904c86b08f21cc414bcfd691"
+                                  "589d27cf5e15369cbbff8b9a4c2eb17800855d0235ff635da82533ec6b759b69");
+
+  libkeccak_hmac_keccak256_initialise(&hmac, key, 32);
+  libkeccak_hmac_keccak256(&hmac, NULL, 0, mac);
+  Expect("hmac-keccak256", mac, "b0bffe7960303a088729992b70327b1aef6b94b0be79e7f39b3a9982f1a4a2f8");
+  libkeccak_hmac_keccak256_initialise(&hmac, data, 200);
+  libkeccak_hmac_keccak256(&hmac, data, 200, mac);
+  Expect("hmac-keccak256 long key", mac, "7bc3d2bfd6e34e11e0c9333f72e9f444268ab9bde5209efbba1202740566b455");
+
+  for(int i = 0; i < 11; i++){
+    msgs[i] = data;
+    msglens[i] = (size_t)(i * 17);
+    libkeccak_kmac(&kmac, msgs[i], msglens[i], kmacs + i * 32, 32, 0);
+    libkeccak_hmac_keccak256(&hmac, msgs[i], msglens[i], hmacs + i * 32);
+  }
+  kmacs[3 * 32] ^= 1;
+  hmacs[8 * 32 + 31] ^= 1;
+  for(const libkeccak_kernel_t* kernel : kernels){
+    libkeccak_set_kernel(kernel);
+    Expect("kmac verify", libkeccak_kmac_verify(&kmac, msgs, msglens, kmacs, 32, 11, &valid) == 10 && valid == 0x7F7);
+    Expect("hmac verify", libkeccak_hmac_keccak256_verify(&hmac, msgs, msglens, hmacs, 11, &valid) == 10 && valid == 0x6FF);
+  }
+  libkeccak_set_kernel(NULL);
+}
+
+// Duplexing calls, the first of which is Keccak-256, and 12-round duplexing at the SHAKE128 rate
+static void TestDuplex(){
+  char in[135], out[136], hashsum[32];
+  libkeccak_duplex_t duplex;
+
+  for(int i = 0; i < 135; i++)
+    in[i] = (char)i;
+  libkeccak_duplex_initialise(&duplex, LIBKECCAK_KECCAK256_RATE, 24, LIBKECCAK_KECCAK_PAD);
+  libkeccak_duplex(&duplex, "abc", 3, out, 32);
+  Expect("duplex first call", out, "4e03657aea45a94fc7d47ba826c8d667c0d1e6e33a64a036ec44f58fa12d6c45");
+  libkeccak_duplex(&duplex, NULL, 0, out, 136);
+  libkeccak_keccak256(out, 136, hashsum);
+  Expect("duplex full block", hashsum, "bf9ac1b2050e14370bc8ffc635d3d22cca25fc2890deb33c09272dcf9b490279");
+  libkeccak_duplex(&duplex, in, 135, out, 5);
+  Expect("duplex longest input", out, "aa3040ee5f");
+  Expect("duplex input too long", libkeccak_duplex(&duplex, in, 136, NULL, 0) < 0);
+
+  libkeccak_duplex_initialise(&duplex, 168, 12, LIBKECCAK_SHAKE_PAD);
+  libkeccak_duplex(&duplex, "key", 3, out, 16);
+  Expect("duplex 12 rounds", out, "6be55bdac184ac3f7fa20119ee916180");
+  libkeccak_duplex(&duplex, "nonce", 5, out, 16);
+  Expect("duplex 12 rounds again", out, "16cd7d92ac4b8614efe4a2300fd8b60a");
+}
+
+// Apply a permutation to the all-zero state and serialise it as the sponge reads it; lane (x, y) is stored at A[5x + y]
+template<typename T>
+static std::string ZeroPermuted(void (*permute)(T*, long), long nr){
+  T A[25] = {0};
+  std::string out;
+
+  permute(A, nr);
+  for(int i = 0; i < 25; i++)
+    for(size_t b = 0; b < sizeof(T); b++)
+      out += (char)(A[i % 5 * 5 + i / 5] >> (8 * b));
+  return out;
+}
+
+// Apply a packed permutation to N distinct states and compare each with the one-state permutation
+template<typename V, typename T, int N>
+static bool Packed(void (*one)(T*, long), void (*packed)(V*, long), long nr){
+  V S[25];
+  T A[N][25];
+
+  for(int i = 0; i < 25; i++)
+    for(int j = 0; j < N; j++)
+      S[i][j] = A[j][i] = (T)((uint32_t)(i * 37 + j * 11 + 1) * 0x9E3779B9u);
+  packed(S, nr);
+  for(int j = 0; j < N; j++)
+    one(A[j], nr);
+  for(int i = 0; i < 25; i++)
+    for(int j = 0; j < N; j++)
+      if(S[i][j] != A[j][i])
+        return false;
+  return true;
+}
+
+// Keccak-f[800], [400] and [200] on the zero state, the packed permutations, and the batch sponge over them
+static void TestNarrow(){
+  char msgs[35 * 150], out[35 * 100], hashsum[32];
+
+  Expect("keccak-f[800]", ZeroPermuted(libkeccak_p800, 22).data(),
+         "5dd431e5fbc604f499bfa0232f45f8f142d0ff5178f539e5a7800bf0643697af4cf35abf24247a22152717888458689f"
+         "54d05cb10efcf41b91fa66619a599e1a1f0a97a3879665ab688dabaf15104be7981a0034f3ef1941760e0a937080b28796e9ef11");
+  Expect("keccak-f[400]", ZeroPermuted(libkeccak_p400, 20).data(),
+         "f509ac40a90ff5149fe8a0ecd15b7078f0ef8fbf3703526075dcc90e76e74652a159815d956d146e3e63ee58ff714c718eb3");
+  Expect("keccak-f[200]", ZeroPermuted(libkeccak_p200, 18).data(), "3c2826841cb35c171eaae9b811134ceaa3852c69d2c5abafea");
+
+  for(long nr : {22L, 12L, 1L}){
+    Expect("keccak-p[800] x8", Packed<libkeccak_lane32_x8_t, uint32_t, 8>(libkeccak_p800, libkeccak_p800_x8, nr));
+    Expect("keccak-p[400] x16", Packed<libkeccak_lane16_x16_t, uint16_t, 16>(libkeccak_p400, libkeccak_p400_x16, nr - 2));
+    Expect("keccak-p[200] x32", Packed<libkeccak_lane8_x32_t, uint8_t, 32>(libkeccak_p200, libkeccak_p200_x32, nr - 4));
+  }
+
+  for(int i = 0; i < 35; i++)
+    for(int k = 0; k < 150; k++)
+      msgs[i * 150 + k] = (char)(i * 7 + k);
+  libkeccak_sponge_many_narrow(msgs, 150, 150, 11, 32, 64, 22, LIBKECCAK_KECCAK_PAD, out, 100);
+  Expect("narrow sponge 800", out, "2db9bbd87dd308781bfbd66322dbe2ee6888b5b603314b16a628f8cf0a999955539e64b32e7cbc8d"
+                                   "f09ebeefb57de3c228bb1997b57a8997ad72346f64449dc277d19fd4d6476b9ad1f2df49d32eef07"
+                                   "1057ca8682dfc0238996bb3dbf750803e004e496");
+  libkeccak_keccak256(out, 11 * 100, hashsum);
+  Expect("narrow sponge 800 x11", hashsum, "5a7628dc7d603bfa56e5a67a188fd476a74221770f8918765114e339d5991c0a");
+  libkeccak_sponge_many_narrow(msgs, 150, 70, 19, 16, 34, 20, LIBKECCAK_SHAKE_PAD, out, 50);
+  libkeccak_keccak256(out, 19 * 50, hashsum);
+  Expect("narrow sponge 400 x19", hashsum, "d3429db2f95a1f0a5cef71da8ae2f35f2db92037f224939c55c0bbcf3b458fe4");
+  libkeccak_sponge_many_narrow(msgs, 150, 40, 35, 8, 18, 18, LIBKECCAK_KECCAK_PAD, out, 30);
+  libkeccak_keccak256(out, 35 * 30, hashsum);
+  Expect("narrow sponge 200 x35", hashsum, "4eab1afc6e5d31b48e8aecc128c726b90ddabea1f6487f22497b906dd8f2e258");
+  Expect("narrow sponge width", libkeccak_sponge_many_narrow(msgs, 150, 40, 1, 64, 8, 24, LIBKECCAK_KECCAK_PAD, out, 8) < 0);
+}
+
+// Decompression and address derivation of the keys of private keys 1, 2, 3 and two others, and of three invalid keys
+static void TestSecp256k1(){
+  const char* keys[] = {
+    "0279be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798",
+    "02c6047f9441ed7d6d3045406e95c07cd85c778e4b8cef3ca7abac09b95c709ee5",
+    "02F9308A019258C31049344F85F89D5229B531C845836F99B08601F113BCE036F9",
+    "0264c9992d70d56cf60383b86dcba395ee0ccdb780b13d1b52803b010ae62574b6",
+    "03e8fee922ec71fe78ee0550b82ab4549387277d62bcf6e8b16fde0427d1689ec3",
+    "0479be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798",
+    "02fffffffffffffffffffffffffffffffffffffffffffffffffffffffefffffc2f",
+    "020000000000000000000000000000000000000000000000000000000000000005",
+  };
+  const char* addresses[] = {
+    "7e5f4552091a69125d5dfcb7b8c2659029395bdf",
+    "2b5ad5c4795c026514f8317c7a215e218dccd6cf",
+    "6813eb9362372eef6200f3b1dbc3f819671cba69",
+    "e7b8a14e8338963e64fb146cd22746b543d339e8",
+    "618a412f2446921d3d942c8bf073000b97728f0f",
+    "0000000000000000000000000000000000000000",
+    "0000000000000000000000000000000000000000",
+    "0000000000000000000000000000000000000000",
+  };
+  char compressed[8 * 33], uncompressed[64], derived[8 * 20], expected[8 * 20];
+  std::string hex;
+  uint64_t valid;
+
+  for(int i = 0; i < 8; i++){
+    libkeccak_secp256k1_unhex(keys[i], compressed + i * 33, 33);
+    libkeccak_secp256k1_unhex(addresses[i], expected + i * 20, 20);
+    hex += keys[i];
+    hex += '\n';
+  }
+  Expect("secp256k1 unhex", libkeccak_secp256k1_unhex("0x", uncompressed, 1) < 0);
+
+  Expect("secp256k1 decompress", libkeccak_secp256k1_decompress(compressed, uncompressed) == 0);
+  Expect("secp256k1 generator", uncompressed, "79be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798"
+                                              "483ada7726a3c4655da4fbfc0e1108a8fd17b448a68554199c47d08ffb10d4b8");
+  Expect("secp256k1 decompress odd", libkeccak_secp256k1_decompress(compressed + 4 * 33, uncompressed) == 0);
+  Expect("secp256k1 odd", uncompressed, "e8fee922ec71fe78ee0550b82ab4549387277d62bcf6e8b16fde0427d1689ec3"
+                                        "1ef2624f76b2e3895015f572fd60861afe53f22d88d3d70eddf7b78e9353e2ad");
+  Expect("secp256k1 bad prefix", libkeccak_secp256k1_decompress(compressed + 5 * 33, uncompressed) < 0);
+  Expect("secp256k1 x = p", libkeccak_secp256k1_decompress(compressed + 6 * 33, uncompressed) < 0);
+  Expect("secp256k1 off curve", libkeccak_secp256k1_decompress(compressed + 7 * 33, uncompressed) < 0);
+
+  Expect("secp256k1 addresses", libkeccak_secp256k1_addresses(compressed, 8, derived, &valid, 2) == 5 && valid == 0x1F);
+  Expect("secp256k1 address values", !memcmp(derived, expected, sizeof(expected)));
+  memset(derived, 1, sizeof(derived));
+  Expect("secp256k1 hex", libkeccak_secp256k1_addresses_hex(hex.data(), 67, 8, derived, &valid, 1) == 5 && valid == 0x1F);
+  Expect("secp256k1 hex values", !memcmp(derived, expected, sizeof(expected)));
+  expected[2 * 20 + 19] ^= 1;
+  Expect("secp256k1 verify", libkeccak_secp256k1_verify(compressed, 8, expected, &valid, 1) == 4 && valid == 0x1B);
+}
+
+// Checkpoint 1000 bytes into a 3000 byte message, resume in a new state and from a file, and reject a damaged checkpoint
+static void TestCheckpoint(){
+  const char* want = "c8426f8858565a7eb7038be747aabbaa314d255fc84cffbc3c3f84e60594c315";
+  std::string base = std::string("/tmp/keccak256-test.") + std::to_string(getpid());
+  std::string path = base + ".checkpoint", file = base + ".message";
+  char msg[3000], hashsum[32], byte;
+  libkeccak_spec_t spec;
+  libkeccak_state_t state;
+  uint64_t offset = 0;
+  int fd;
+
+  for(int i = 0; i < 3000; i++)
+    msg[i] = (char)(i * 13);
+  libkeccak_spec_sha3(&spec, 256);
+
+  libkeccak_state_initialise(&state, &spec);
+  libkeccak_fast_update(&state, msg, 1000);
+  Expect("checkpoint save", libkeccak_checkpoint_save(path.c_str(), &state, 1000) == 0);
+  libkeccak_state_fast_destroy(&state);
+  libkeccak_state_initialise(&state, &spec);
+  Expect("checkpoint load", libkeccak_checkpoint_load(path.c_str(), &state, &offset) == 0 && offset == 1000);
+  libkeccak_fast_digest(&state, msg + 1000, 2000, 0, "", hashsum);
+  Expect("checkpoint resume", hashsum, want);
+  libkeccak_state_fast_destroy(&state);
+
+  fd = open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  Expect("checkpoint message", fd >= 0 && write(fd, msg, 3000) == 3000 && lseek(fd, 0, SEEK_SET) == 0);
+  Expect("checkpoint hash fd", libkeccak_checkpoint_hash_fd(fd, &spec, "", path.c_str(), 0, hashsum) == 0);
+  Expect("checkpoint hash fd resume", hashsum, want);
+  Expect("checkpoint removed", access(path.c_str(), F_OK) < 0);
+  lseek(fd, 0, SEEK_SET);
+  Expect("checkpoint hash fd fresh", libkeccak_checkpoint_hash_fd(fd, &spec, "", path.c_str(), 0, hashsum) == 0);
+  Expect("checkpoint hash fd whole", hashsum, want);
+  close(fd);
+
+  libkeccak_state_initialise(&state, &spec);
+  libkeccak_fast_update(&state, msg, 1000);
+  libkeccak_checkpoint_save(path.c_str(), &state, 1000);
+  fd = open(path.c_str(), O_RDWR);
+  Expect("checkpoint read", fd >= 0 && pread(fd, &byte, 1, 100) == 1);
+  byte ^= 1;
+  Expect("checkpoint damage", pwrite(fd, &byte, 1, 100) == 1);
+  close(fd);
+  Expect("checkpoint damaged", libkeccak_checkpoint_load(path.c_str(), &state, &offset) < 0 && errno == EINVAL);
+  libkeccak_state_fast_destroy(&state);
+  unlink(path.c_str());
+  unlink(file.c_str());
+}
+
+// Bucket selection and quantile bounds of a histogram, the Prometheus text of a made-up snapshot, and live counters when compiled in
+static void TestMetrics(){
+  static libkeccak_metrics_t metrics, before, after;
+  libkeccak_metrics_histogram_t* h = &metrics.histograms[LIBKECCAK_LATENCY_KEY];
+  std::string text;
+  size_t len;
+  char small[10];
+
+  Expect("metrics bucket exact", libkeccak_metrics_bucket(0) == 0 && libkeccak_metrics_bucket(15) == 15);
+  Expect("metrics bucket 16", libkeccak_metrics_bucket(16) == 16 && libkeccak_metrics_bucket(17) == 16 &&
+                              libkeccak_metrics_bucket(18) == 17 && libkeccak_metrics_bucket(31) == 23);
+  Expect("metrics bucket 32", libkeccak_metrics_bucket(32) == 24 && libkeccak_metrics_bucket(1000) == 63);
+  Expect("metrics bucket last", libkeccak_metrics_bucket(UINT64_MAX) == LIBKECCAK_METRICS_BUCKETS - 1);
+
+  Expect("metrics quantile empty", libkeccak_metrics_quantile(h, 0.5) == 0);
+  for(uint64_t sample : {5, 100, 300, 1000, 1000000}){
+    h->buckets[libkeccak_metrics_bucket(sample)]++;
+    h->count++;
+    h->sum += sample;
+  }
+  Expect("metrics quantile 0", libkeccak_metrics_quantile(h, 0) == 5);
+  Expect("metrics quantile 0.25", libkeccak_metrics_quantile(h, 0.25) == 103);
+  Expect("metrics quantile 0.5", libkeccak_metrics_quantile(h, 0.5) == 319);
+  Expect("metrics quantile 0.75", libkeccak_metrics_quantile(h, 0.75) == 1023);
+  Expect("metrics quantile 1", libkeccak_metrics_quantile(h, 1) == 1048575);
+
+  metrics.counters[LIBKECCAK_CALLS] = 3;
+  len = libkeccak_metrics_prometheus(&metrics, NULL, 0);
+  text.assign(len + 1, '\0');
+  Expect("metrics prometheus length", libkeccak_metrics_prometheus(&metrics, &text[0], len + 1) == len && !text[len]);
+  text.resize(len);
+  Expect("metrics prometheus counter", text.find("# TYPE keccak_calls_total counter\nkeccak_calls_total 3\n") != std::string::npos);
+  Expect("metrics prometheus type", text.find("# TYPE keccak_latency_seconds histogram\n") != std::string::npos);
+  Expect("metrics prometheus bucket", text.find("keccak_latency_seconds_bucket{entry=\"key\",le=\"0.000000255\"} 2\n"
+                                                "keccak_latency_seconds_bucket{entry=\"key\",le=\"0.000000511\"} 3\n")
+                                      != std::string::npos);
+  Expect("metrics prometheus total", text.find("keccak_latency_seconds_bucket{entry=\"key\",le=\"+Inf\"} 5\n"
+                                               "keccak_latency_seconds_sum{entry=\"key\"} 0.001001405\n"
+                                               "keccak_latency_seconds_count{entry=\"key\"} 5\n") != std::string::npos);
+  Expect("metrics prometheus truncated", libkeccak_metrics_prometheus(&metrics, small, sizeof(small)) == len &&
+                                         strlen(small) == sizeof(small) - 1);
+
+#ifdef LIBKECCAK_METRICS
+  Expect("metrics snapshot", libkeccak_metrics_snapshot(&before) == 0);
+  delete[] PublicKeyToAddress("64c9992d70d56cf60383b86dcba395ee0ccdb780b13d1b52803b010ae62574b68ebc46f0b25acf3721da182a180b985500669ec8541244752ec1331ea61aacee");
+  Expect("metrics snapshot", libkeccak_metrics_snapshot(&after) == 0);
+  Expect("metrics calls", after.counters[LIBKECCAK_CALLS] > before.counters[LIBKECCAK_CALLS]);
+  Expect("metrics bytes", after.counters[LIBKECCAK_BYTES] - before.counters[LIBKECCAK_BYTES] == 64);
+  Expect("metrics latency", after.histograms[LIBKECCAK_LATENCY_KEY].count == before.histograms[LIBKECCAK_LATENCY_KEY].count + 1);
+#else
+  Expect("metrics not compiled in", libkeccak_metrics_snapshot(&after) < 0 && errno == ENOTSUP);
+#endif
+}
+
 char* RandomString(){
   char* temp = new char[129];
 
@@ -55,6 +1081,28 @@ int main(int argc, char *argv[]){
 
   delete[] keyring;
 
+  TestTurboShake();
+  TestKangarooTwelve();
+  TestSp800185();
+  TestMerkle();
+  TestMpt();
+  TestBatch();
+  TestAsyncHasher();
+  TestArena();
+  TestPool();
+  TestWatchlist();
+  TestCache();
+  TestCompact();
+  TestSqueezeRange();
+  TestLogsBloom();
+  TestStorage();
+  TestMac();
+  TestDuplex();
+  TestNarrow();
+  TestSecp256k1();
+  TestCheckpoint();
+  TestMetrics();
+
   // Private Key
   // abcdef1203405600789001112233aabbcc24680abcdef00001234567890abcde
   const char* publicKeySingle = "64c9992d70d56cf60383b86dcba395ee0ccdb780b13d1b52803b010ae62574b68ebc46f0b25acf3721da182a180b985500669ec8541244752ec1331ea61aacee";
@@ -65,5 +1113,5 @@ int main(int argc, char *argv[]){
   //                       0xe7B8a14E8338963E64fB146cd22746B543D339e8
 
   // std::cout << "===================== END TESTS =====================\n";
-  return 0;
+  return failures ? 1 : 0;
 }